@@ -164,7 +164,7 @@ extern int dimmerSet;
 extern int bright;
 extern bool dimmer;
 
-extern int prog_handler; // 0 - Flash, 1 - SPIFFS, 2 - Download
+extern int prog_handler; // 0 - Flash, 1 - SPIFFS, 2 - Download, 3 - Copy, 4 - Delete, 5 - Extract
 
 extern bool sdcardMounted;
 
@@ -204,6 +204,9 @@ extern bool update;
 // Used to choose SPIFFS or not
 extern bool askSpiffs;
 
+// Skip flash sectors that already hold the data being installed
+extern bool deltaFlash;
+
 // Don't let open OTA after use WebUI due t oRAM handling
 extern bool stopOta;
 
@@ -11,6 +11,8 @@
 #include <MD5Builder.h>
 #include <functional>
 #include "esp_partition.h"
+#include "GzipInflater.h"
+#include "FlashVerifier.h"
 
 #define UPDATE_ERROR_OK                 (0)
 #define UPDATE_ERROR_WRITE              (1)
@@ -25,6 +27,8 @@
 #define UPDATE_ERROR_NO_PARTITION       (10)
 #define UPDATE_ERROR_BAD_ARGUMENT       (11)
 #define UPDATE_ERROR_ABORT              (12)
+#define UPDATE_ERROR_DECOMPRESS         (13)
+#define UPDATE_ERROR_VERIFY             (14)
 
 #define UPDATE_SIZE_UNKNOWN 0xFFFFFFFF
 
@@ -37,9 +41,19 @@
 #define SPI_SECTORS_PER_BLOCK   16      // usually large erase block is 32k/64k
 #define SPI_FLASH_BLOCK_SIZE    (SPI_SECTORS_PER_BLOCK*SPI_FLASH_SEC_SIZE)
 
+#ifndef UPDATE_PIPELINE_DEPTH
+#define UPDATE_PIPELINE_DEPTH   4       // sector buffers in the ring used by the writer task
+#endif
+
+#ifndef UPDATE_CHECKPOINT_INTERVAL
+#define UPDATE_CHECKPOINT_INTERVAL  SPI_FLASH_BLOCK_SIZE    // bytes between two onCheckpoint() calls
+#endif
+
 class UpdateClass {
   public:
     typedef std::function<void(size_t, size_t)> THandlerFunction_Progress;
+    typedef std::function<void(size_t, size_t, size_t)> THandlerFunction_DeltaProgress;
+    typedef std::function<void(size_t, const String&, const uint8_t*)> THandlerFunction_Checkpoint;
 
     UpdateClass();
 
@@ -48,15 +62,58 @@ class UpdateClass {
     */
     UpdateClass& onProgress(THandlerFunction_Progress fn);
 
+    /*
+      Same, with the number of sectors delta flash left untouched so far
+      as the third argument
+    */
+    UpdateClass& onProgress(THandlerFunction_DeltaProgress fn);
+
+    /*
+      This callback will be called every UPDATE_CHECKPOINT_INTERVAL bytes once
+      they are really on flash, a few sectors later with the writer task, with
+      the MD5 of everything up to there and, for app images, the 16 stashed
+      header bytes (NULL otherwise).
+      Store them to continue later with resume()
+    */
+    UpdateClass& onCheckpoint(THandlerFunction_Checkpoint fn);
+
+    /*
+      Hands erase+program over to a writer task that owns a ring of
+      UPDATE_PIPELINE_DEPTH sector buffers, so the caller can read the
+      next chunk while the previous one is being flashed.
+      Takes effect on the next begin(), falls back to synchronous writes
+      if the task or the buffers can't be allocated
+    */
+    UpdateClass& setPipeline(bool enable){ _pipeline = enable; return *this; }
+
+    /*
+      Reads each target sector back before writing and leaves it alone when
+      it already holds the incoming data. Sectors are then erased one by one
+      instead of in 64k blocks, so it pays off when reinstalling the same or
+      a close version. Takes effect on the next begin()
+    */
+    UpdateClass& setDeltaFlash(bool enable){ _delta = enable; return *this; }
+
     /*
       Call this to check the space needed for the update
       Will return false if there is not enough space
     */
     bool begin(size_t size=UPDATE_SIZE_UNKNOWN, int command = U_FLASH, int ledPin = -1, uint8_t ledOn = LOW, const char *label = NULL);
 
+    /*
+      Call right after begin() to continue an interrupted update whose first
+      `progress` bytes (a sector multiple) are already on flash.
+      The prefix is read back and must hash to prefix_md5, head holds the
+      16 stashed header bytes given by onCheckpoint() for app images.
+      Returns false and leaves the update at 0 if the flash doesn't match
+    */
+    bool resume(size_t progress, const char *prefix_md5, const uint8_t *head = NULL);
+
     /*
       Writes a buffer to the flash and increments the address
       Returns the amount written
+      A stream starting with the gzip magic is inflated on the fly, the size given
+      to begin() is then the compressed one and the image ends with the gzip trailer
     */
     size_t write(uint8_t *data, size_t len);
 
@@ -66,12 +123,15 @@ class UpdateClass {
       Returns the bytes written
       Should be equal to the remaining bytes when called
       Usable for slow streams like Serial
+      gzip streams are read until their trailer, whatever the size given to begin()
     */
     size_t writeStream(Stream &data);
 
     /*
       If all bytes are written
-      this call will write the config to eboot
+      this call reads the partition back, fails with UPDATE_ERROR_VERIFY
+      when it doesn't hold what was written (see mismatches()),
+      then writes the config to eboot
       and return true
       If there is already an update running but is not finished and !evenIfRemaining
       or there is an error
@@ -114,15 +174,19 @@ class UpdateClass {
     bool hasError(){ return _error != UPDATE_ERROR_OK; }
     bool isRunning(){ return _size > 0; }
     bool isFinished(){ return _progress == _size; }
+    bool isCompressed(){ return _compressed; }
     size_t size(){ return _size; }
     size_t progress(){ return _progress; }
     size_t remaining(){ return _size - _progress; }
+    size_t skippedSectors(){ return _skipped; }
+    const String &mismatches(){ return _verifier.mismatches(); }   // sectors end() found wrong
 
     /*
       Template to write from objects that expose
       available() and read(uint8_t*, size_t) methods
       faster than the writeStream method
       writes only what is available
+      raw images only, gzip streams go through write(uint8_t*, size_t)
     */
     template<typename T>
     size_t write(T &data){
@@ -172,6 +236,15 @@ class UpdateClass {
     void _reset();
     void _abort(uint8_t err);
     bool _writeBuffer();
+    size_t _write(const uint8_t *data, size_t len);
+    bool _startGzip();
+    bool _endGzip();
+    size_t _writeGzipStream(Stream &data);
+    uint8_t _programSector(uint8_t *data, size_t len, uint32_t progress, uint8_t skip);
+    bool _startPipeline();
+    void _stopPipeline();
+    bool _drainPipeline();
+    static void _writerTask(void *arg);
     bool _verifyHeader(uint8_t data);
     bool _verifyEnd();
     bool _enablePartition(const esp_partition_t* partition);
@@ -183,7 +256,8 @@ class UpdateClass {
     uint8_t *_skipBuffer;
     size_t _bufferLen;
     size_t _size;
-    THandlerFunction_Progress _progress_callback;
+    THandlerFunction_DeltaProgress _progress_callback;
+    THandlerFunction_Checkpoint _checkpoint_callback;
     uint32_t _progress;
     uint32_t _paroffset;
     uint32_t _command;
@@ -194,6 +268,31 @@ class UpdateClass {
 
     int _ledPin;
     uint8_t _ledOn;
+
+    struct SectorJob {
+      uint8_t *data;
+      size_t len;
+      uint32_t progress;
+      uint8_t skip;
+    };
+    bool _pipeline;
+    uint8_t *_ring[UPDATE_PIPELINE_DEPTH];
+    QueueHandle_t _freeQueue;
+    QueueHandle_t _fullQueue;
+    TaskHandle_t _writer;
+    volatile uint8_t _asyncError;
+    volatile uint32_t _committed;   // end of the sectors already on flash, published by the writer task
+    uint32_t _checkpointAt;         // checkpoint waiting for _committed to reach it, 0 for none
+    MD5Builder _checkpointMd5;      // of the image up to _checkpointAt
+
+    bool _delta;
+    uint8_t *_readBack;
+    volatile size_t _skipped;
+
+    GzipInflater _gzip;
+    bool _compressed;
+
+    FlashVerifier _verifier;
 };
 
 #if !defined(NO_GLOBAL_INSTANCES) && !defined(NO_GLOBAL_UPDATE)
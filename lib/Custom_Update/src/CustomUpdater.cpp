@@ -37,6 +37,10 @@ static const char * _err2str(uint8_t _error){
         return ("Bad Argument");
     } else if(_error == UPDATE_ERROR_ABORT){
         return ("Aborted");
+    } else if(_error == UPDATE_ERROR_DECOMPRESS){
+        return ("Decompression Failed");
+    } else if(_error == UPDATE_ERROR_VERIFY){
+        return ("Flash Verify Failed");
     }
     return ("UNKNOWN");
 }
@@ -69,24 +73,60 @@ UpdateClass::UpdateClass()
 , _bufferLen(0)
 , _size(0)
 , _progress_callback(NULL)
+, _checkpoint_callback(NULL)
 , _progress(0)
 , _paroffset(0)
 , _command(U_FLASH)
 , _partition(NULL)
+, _pipeline(false)
+, _freeQueue(NULL)
+, _fullQueue(NULL)
+, _writer(NULL)
+, _asyncError(UPDATE_ERROR_OK)
+, _committed(0)
+, _checkpointAt(0)
+, _delta(false)
+, _readBack(NULL)
+, _skipped(0)
+, _compressed(false)
 {
+    memset(_ring, 0, sizeof(_ring));
 }
 
 UpdateClass& UpdateClass::onProgress(THandlerFunction_Progress fn) {
+    _progress_callback = NULL;
+    if(fn){
+        _progress_callback = [fn](size_t progress, size_t size, size_t){ fn(progress, size); };
+    }
+    return *this;
+}
+
+UpdateClass& UpdateClass::onProgress(THandlerFunction_DeltaProgress fn) {
     _progress_callback = fn;
     return *this;
 }
 
+UpdateClass& UpdateClass::onCheckpoint(THandlerFunction_Checkpoint fn) {
+    _checkpoint_callback = fn;
+    return *this;
+}
+
 void UpdateClass::_reset() {
-    if (_buffer)
+    if (_fullQueue)
+        _stopPipeline();    // _buffer belongs to the ring
+    else if (_buffer)
         delete[] _buffer;
     _buffer = 0;
+    if (_readBack)
+        free(_readBack);
+    _readBack = NULL;
+    _gzip.end();
+    _compressed = false;
+    _verifier.end();
     _bufferLen = 0;
     _progress = 0;
+    _committed = 0;
+    _checkpointAt = 0;
     _size = 0;
     _command = U_FLASH;
 
@@ -165,14 +205,85 @@ bool UpdateClass::begin(size_t size, int command, int ledPin, uint8_t ledOn, con
     }
 
     //initialize
-    _buffer = (uint8_t*)malloc(SPI_FLASH_SEC_SIZE);
+    if(!_pipeline || !_startPipeline()){
+        _buffer = (uint8_t*)malloc(SPI_FLASH_SEC_SIZE);
+    }
     if(!_buffer){
         log_e("malloc failed");
         return false;
     }
+    _skipped = 0;
+    if(_delta && !_partition->encrypted){
+        _readBack = (uint8_t*)malloc(SPI_FLASH_SEC_SIZE);
+        if(!_readBack){
+            log_w("no memory for delta flash, writing every sector");
+        }
+    }
     _size = size;
     _command = command;
     _md5.begin();
+    _verifier.begin(_partition);
+    return true;
+}
+
+bool UpdateClass::resume(size_t progress, const char *prefix_md5, const uint8_t *head){
+    if(!isRunning() || _progress || _bufferLen || !progress || progress % SPI_FLASH_SEC_SIZE || progress >= _size){
+        return false;
+    }
+    if(!prefix_md5 || (_command == U_FLASH && !head)){
+        return false;
+    }
+
+    // rebuild the running MD5 from flash, it must still be what was checkpointed
+    for(size_t pos = 0; pos < progress; pos += SPI_FLASH_SEC_SIZE){
+        if(!ESP.partitionRead(_partition, pos, (uint32_t*)_buffer, SPI_FLASH_SEC_SIZE)){
+            _md5 = MD5Builder();
+            _md5.begin();
+            _verifier.begin(_partition);
+            return false;
+        }
+        if(!pos && _command == U_FLASH){
+            memcpy(_buffer, head, ENCRYPTED_BLOCK_SIZE);    // never written until end()
+        }
+        _md5.add(_buffer, SPI_FLASH_SEC_SIZE);
+        _verifier.add(_buffer, SPI_FLASH_SEC_SIZE);
+    }
+    MD5Builder prefix = _md5;
+    prefix.calculate();
+    if(!prefix.toString().equalsIgnoreCase(prefix_md5)){
+        log_w("flash doesn't match the checkpoint, starting over");
+        _md5 = MD5Builder();
+        _md5.begin();
+        _verifier.begin(_partition);
+        return false;
+    }
+
+    if(_command == U_FLASH){
+        _skipBuffer = (uint8_t*)malloc(ENCRYPTED_BLOCK_SIZE);
+        if(!_skipBuffer){
+            log_e("malloc failed");
+            return false;
+        }
+        memcpy(_skipBuffer, head, ENCRYPTED_BLOCK_SIZE);
+    }
+
+    // _programSector only erases on block boundaries, clear up to the next one by hand
+    size_t offset = _partition->address + progress;
+    size_t toBoundary = (SPI_FLASH_BLOCK_SIZE - offset % SPI_FLASH_BLOCK_SIZE) % SPI_FLASH_BLOCK_SIZE;
+    if(toBoundary > _size - progress){
+        toBoundary = (_size - progress + SPI_FLASH_SEC_SIZE - 1) / SPI_FLASH_SEC_SIZE * SPI_FLASH_SEC_SIZE;
+    }
+    if(!_readBack && toBoundary && !ESP.partitionEraseRange(_partition, progress, toBoundary)){
+        _abort(UPDATE_ERROR_ERASE);
+        return false;
+    }
+
+    _progress = progress;
+    _committed = progress;
+    log_i("resuming at %u of %u", _progress, _size);
+    if(_progress_callback){
+        _progress_callback(_progress, _size, _skipped);
+    }
     return true;
 }
 
@@ -185,7 +296,114 @@ void UpdateClass::abort(){
     _abort(UPDATE_ERROR_ABORT);
 }
 
+bool UpdateClass::_startPipeline(){
+    _freeQueue = xQueueCreate(UPDATE_PIPELINE_DEPTH, sizeof(uint8_t*));
+    _fullQueue = xQueueCreate(UPDATE_PIPELINE_DEPTH, sizeof(SectorJob));
+    if(!_freeQueue || !_fullQueue){
+        _stopPipeline();
+        return false;
+    }
+    for(int i = 0; i < UPDATE_PIPELINE_DEPTH; i++){
+        _ring[i] = (uint8_t*)malloc(SPI_FLASH_SEC_SIZE);
+        if(!_ring[i]){
+            _stopPipeline();
+            return false;
+        }
+        if(i) xQueueSend(_freeQueue, &_ring[i], 0);    // _ring[0] is handed to the producer
+    }
+    _asyncError = UPDATE_ERROR_OK;
+    if(xTaskCreate(_writerTask, "UpdateWriter", 4096, this, uxTaskPriorityGet(NULL), &_writer) != pdPASS){
+        _writer = NULL;
+        _stopPipeline();
+        return false;
+    }
+    _buffer = _ring[0];
+    return true;
+}
+
+void UpdateClass::_stopPipeline(){
+    if(_writer){
+        _drainPipeline();
+        vTaskDelete(_writer);
+        _writer = NULL;
+    }
+    if(_fullQueue){
+        vQueueDelete(_fullQueue);
+        _fullQueue = NULL;
+    }
+    if(_freeQueue){
+        vQueueDelete(_freeQueue);
+        _freeQueue = NULL;
+    }
+    for(int i = 0; i < UPDATE_PIPELINE_DEPTH; i++){
+        if(_ring[i]) free(_ring[i]);
+        _ring[i] = NULL;
+    }
+    _asyncError = UPDATE_ERROR_OK;
+}
+
+// Waits until every queued sector was flashed, the producer always holds one buffer of the ring
+bool UpdateClass::_drainPipeline(){
+    uint8_t *held[UPDATE_PIPELINE_DEPTH - 1];
+    for(int i = 0; i < UPDATE_PIPELINE_DEPTH - 1; i++){
+        xQueueReceive(_freeQueue, &held[i], portMAX_DELAY);
+    }
+    for(int i = 0; i < UPDATE_PIPELINE_DEPTH - 1; i++){
+        xQueueSend(_freeQueue, &held[i], 0);
+    }
+    return _asyncError == UPDATE_ERROR_OK;
+}
+
+void UpdateClass::_writerTask(void *arg){
+    UpdateClass *self = (UpdateClass*)arg;
+    SectorJob job;
+    for(;;){
+        if(xQueueReceive(self->_fullQueue, &job, portMAX_DELAY) != pdTRUE){
+            continue;
+        }
+        // after a failure the remaining sectors are only recycled, the producer aborts on its next write
+        if(self->_asyncError == UPDATE_ERROR_OK){
+            self->_asyncError = self->_programSector(job.data, job.len, job.progress, job.skip);
+            if(self->_asyncError == UPDATE_ERROR_OK){
+                self->_committed = job.progress + job.len;
+            }
+        }
+        xQueueSend(self->_freeQueue, &job.data, portMAX_DELAY);
+    }
+}
+
+uint8_t UpdateClass::_programSector(uint8_t *data, size_t len, uint32_t progress, uint8_t skip){
+    // delta flash: keep sectors that already hold this data, the first one is always
+    // rewritten so the 16 stashed bytes keep a half-done install unbootable
+    if(_readBack && !skip){
+        if(ESP.partitionRead(_partition, progress, (uint32_t*)_readBack, len) && !memcmp(_readBack, data, len)){
+            _skipped++;
+            return UPDATE_ERROR_OK;
+        }
+    }
+
+    size_t offset = _partition->address + progress;
+    bool block_erase = !_readBack && (_size - progress >= SPI_FLASH_BLOCK_SIZE) && (offset % SPI_FLASH_BLOCK_SIZE == 0);             // if it's the block boundary, than erase the whole block from here
+    bool part_head_sectors = _partition->address % SPI_FLASH_BLOCK_SIZE && offset < (_partition->address / SPI_FLASH_BLOCK_SIZE + 1) * SPI_FLASH_BLOCK_SIZE;    // sector belong to unaligned partition heading block
+    bool part_tail_sectors = offset >= (_partition->address + _size) / SPI_FLASH_BLOCK_SIZE * SPI_FLASH_BLOCK_SIZE;     // sector belong to unaligned partition tailing block
+    if (_readBack || block_erase || part_head_sectors || part_tail_sectors){    // delta flash erases sector by sector so skipped neighbours survive
+        if(!ESP.partitionEraseRange(_partition, progress, block_erase ? SPI_FLASH_BLOCK_SIZE : SPI_FLASH_SEC_SIZE)){
+            return UPDATE_ERROR_ERASE;
+        }
+    }
+
+    // try to skip empty blocks on unecrypted partitions
+    if ((_partition->encrypted || _chkDataInBlock(data + skip/sizeof(uint32_t), len - skip)) && !ESP.partitionWrite(_partition, progress + skip, (uint32_t*)data + skip/sizeof(uint32_t), len - skip)) {
+        return UPDATE_ERROR_WRITE;
+    }
+    return UPDATE_ERROR_OK;
+}
+
 bool UpdateClass::_writeBuffer(){
+    if(_asyncError != UPDATE_ERROR_OK){
+        _abort(_asyncError);
+        return false;
+    }
     //first bytes of new firmware
     uint8_t skip = 0;
     if(!_progress && _command == U_FLASH){
@@ -207,34 +425,48 @@ bool UpdateClass::_writeBuffer(){
         memcpy(_skipBuffer, _buffer, skip);
     }
     if (!_progress && _progress_callback) {
-        _progress_callback(0, _size);
-    }
-    size_t offset = _partition->address + _progress;
-    bool block_erase = (_size - _progress >= SPI_FLASH_BLOCK_SIZE) && (offset % SPI_FLASH_BLOCK_SIZE == 0);             // if it's the block boundary, than erase the whole block from here
-    bool part_head_sectors = _partition->address % SPI_FLASH_BLOCK_SIZE && offset < (_partition->address / SPI_FLASH_BLOCK_SIZE + 1) * SPI_FLASH_BLOCK_SIZE;    // sector belong to unaligned partition heading block
-    bool part_tail_sectors = offset >= (_partition->address + _size) / SPI_FLASH_BLOCK_SIZE * SPI_FLASH_BLOCK_SIZE;     // sector belong to unaligned partition tailing block
-    if (block_erase || part_head_sectors || part_tail_sectors){
-        if(!ESP.partitionEraseRange(_partition, _progress, block_erase ? SPI_FLASH_BLOCK_SIZE : SPI_FLASH_SEC_SIZE)){
-            _abort(UPDATE_ERROR_ERASE);
+        _progress_callback(0, _size, _skipped);
+    }
+
+    if(_fullQueue){
+        // queue the sector for the writer task and pick up the next free buffer of the ring
+        SectorJob job = { _buffer, _bufferLen, _progress, skip };
+        _md5.add(_buffer, _bufferLen);
+        _verifier.add(_buffer, _bufferLen);
+        xQueueSend(_fullQueue, &job, portMAX_DELAY);
+        xQueueReceive(_freeQueue, &_buffer, portMAX_DELAY);
+    } else {
+        uint8_t err = _programSector(_buffer, _bufferLen, _progress, skip);
+        if(err != UPDATE_ERROR_OK){
+            _abort(err);
             return false;
         }
-    }
-
-    // try to skip empty blocks on unecrypted partitions
-    if ((_partition->encrypted || _chkDataInBlock(_buffer + skip/sizeof(uint32_t), _bufferLen - skip)) && !ESP.partitionWrite(_partition, _progress + skip, (uint32_t*)_buffer + skip/sizeof(uint32_t), _bufferLen - skip)) {
-        _abort(UPDATE_ERROR_WRITE);
-        return false;
-    }
 
-    //restore magic or md5 will fail
-    if(!_progress && _command == U_FLASH){
-        _buffer[0] = ESP_IMAGE_HEADER_MAGIC;
+        //restore magic or md5 will fail
+        if(!_progress && _command == U_FLASH){
+            _buffer[0] = ESP_IMAGE_HEADER_MAGIC;
+        }
+        _md5.add(_buffer, _bufferLen);
+        _verifier.add(_buffer, _bufferLen);
     }
-    _md5.add(_buffer, _bufferLen);
     _progress += _bufferLen;
     _bufferLen = 0;
+    if(!_fullQueue){
+        _committed = _progress;
+    }
     if (_progress_callback) {
-        _progress_callback(_progress, _size);
+        _progress_callback(_progress, _size, _skipped);
+    }
+    // a gzip stream can't be picked up halfway, the inflater state isn't on flash
+    if (_checkpoint_callback && !_compressed && _progress < _size && _progress % UPDATE_CHECKPOINT_INTERVAL == 0) {
+        _checkpointAt = _progress;
+        _checkpointMd5 = _md5;
+    }
+    // only reported once the writer task has put it on flash, the pipeline keeps running meanwhile
+    if (_checkpointAt && _committed >= _checkpointAt) {
+        _checkpointMd5.calculate();
+        _checkpoint_callback(_checkpointAt, _checkpointMd5.toString(), _command == U_FLASH ? _skipBuffer : NULL);
+        _checkpointAt = 0;
     }
     return true;
 }
@@ -258,6 +490,12 @@ bool UpdateClass::_verifyEnd() {
             _abort(UPDATE_ERROR_READ);
             return false;
         }
+        // the stashed header is on flash now, a bad read back makes it unbootable again
+        if(!_verifier.verify()) {
+            ESP.partitionEraseRange(_partition, 0, SPI_FLASH_SEC_SIZE);
+            _abort(UPDATE_ERROR_VERIFY);
+            return false;
+        }
 
 // Launcher doesn't have otadata partition anymore, so this information can't be saved at all
         //if(esp_ota_set_boot_partition(_partition)){
@@ -267,6 +505,10 @@ bool UpdateClass::_verifyEnd() {
         _reset();
         return true;
     } else if(_command == U_SPIFFS) {
+        if(!_verifier.verify()) {
+            _abort(UPDATE_ERROR_VERIFY);
+            return false;
+        }
         _reset();
         return true;
     }
@@ -293,10 +535,17 @@ bool UpdateClass::end(bool evenIfRemaining){
         return false;
     }
 
+    if(evenIfRemaining && _bufferLen > 0) {
+        _writeBuffer();
+    }
+
+    // everything queued to the writer task must be on flash before the image is enabled
+    if(_fullQueue && !_drainPipeline()) {
+        _abort(_asyncError);
+        return false;
+    }
+
     if(evenIfRemaining) {
-        if(_bufferLen > 0) {
-            _writeBuffer();
-        }
         _size = progress();
     }
 
@@ -311,11 +560,79 @@ bool UpdateClass::end(bool evenIfRemaining){
     return _verifyEnd();
 }
 
+bool UpdateClass::_startGzip(){
+    if(!_gzip.begin([this](const uint8_t *data, size_t len){ return _write(data, len) == len; })){
+        _abort(UPDATE_ERROR_DECOMPRESS);
+        return false;
+    }
+    // the inflated size is only known from the trailer, until then the image may fill the partition
+    log_i("gzip stream, inflating into %s", _partition->label);
+    _size = _partition->size;
+    _compressed = true;
+    return true;
+}
+
+bool UpdateClass::_endGzip(){
+    // the trailer matched, everything inflated so far is the image
+    _gzip.end();
+    if(!_progress && !_bufferLen){
+        _abort(UPDATE_ERROR_SIZE);
+        return false;
+    }
+    _size = _progress + _bufferLen;
+    log_i("inflated %u bytes", _size);
+    return !_bufferLen || _writeBuffer();
+}
+
 size_t UpdateClass::write(uint8_t *data, size_t len) {
     if(hasError() || !isRunning()){
         return 0;
     }
 
+    // the first bytes may come a few at a time, they are held in _buffer until the format is known
+    if(!_compressed && !_progress && _bufferLen < GZIP_MAGIC_LEN){
+        uint8_t magic[GZIP_MAGIC_LEN];
+        size_t held = _bufferLen;
+        size_t n = std::min(len, (size_t)GZIP_MAGIC_LEN - held);
+        memcpy(magic, _buffer, held);
+        memcpy(magic + held, data, n);
+        if(held + n < GZIP_MAGIC_LEN){
+            return _write(data, len);
+        }
+        if(GzipInflater::isGzip(magic, GZIP_MAGIC_LEN)){
+            _bufferLen = 0;     // the held bytes go to the inflater instead
+            if(!_startGzip()){
+                return 0;
+            }
+            if(held && !_gzip.write(magic, held)){
+                _abort(UPDATE_ERROR_DECOMPRESS);
+                return 0;
+            }
+        }
+    }
+    if(_compressed){
+        if(_gzip.finished()){
+            return len;     // padding after the trailer
+        }
+        if(!_gzip.write(data, len)){
+            if(!hasError()){
+                _abort(UPDATE_ERROR_DECOMPRESS);
+            }
+            return 0;
+        }
+        if(_gzip.finished() && !_endGzip()){
+            return 0;
+        }
+        return len;
+    }
+    return _write(data, len);
+}
+
+size_t UpdateClass::_write(const uint8_t *data, size_t len) {
+    if(hasError() || !isRunning()){
+        return 0;
+    }
+
     if(len > remaining()){
         _abort(UPDATE_ERROR_SPACE);
         return 0;
@@ -350,6 +667,10 @@ size_t UpdateClass::writeStream(Stream &data) {
     if(hasError() || !isRunning())
         return 0;
 
+    if(!_progress && !_bufferLen && data.peek() == GZIP_ID1) {
+        return _writeGzipStream(data);
+    }
+
     if(!_verifyHeader(data.peek())) {
         _reset();
         return 0;
@@ -401,6 +722,57 @@ size_t UpdateClass::writeStream(Stream &data) {
     return written;
 }
 
+/*
+  The compressed length isn't tied to the image size, read what the stream has
+  until the gzip trailer went through write()
+*/
+size_t UpdateClass::_writeGzipStream(Stream &data) {
+    size_t written = 0;
+    int timeout_failures = 0;
+    uint8_t *chunk = (uint8_t*)malloc(SPI_FLASH_SEC_SIZE);
+    if(!chunk) {
+        log_e("malloc failed");
+        _abort(UPDATE_ERROR_DECOMPRESS);
+        return 0;
+    }
+
+    if(_ledPin != -1) {
+        pinMode(_ledPin, OUTPUT);
+    }
+
+    while(!hasError() && !(_compressed && _gzip.finished())) {
+        size_t toRead = data.available();
+        if(!toRead) {
+            if (++timeout_failures >= 300) {
+                _abort(UPDATE_ERROR_STREAM);
+                break;
+            }
+            delay(100);
+            continue;
+        }
+        timeout_failures = 0;
+        if(toRead > SPI_FLASH_SEC_SIZE) {
+            toRead = SPI_FLASH_SEC_SIZE;
+        }
+        if(_ledPin != -1) {
+            digitalWrite(_ledPin, _ledOn); // Switch LED on
+        }
+        toRead = data.readBytes(chunk, toRead);
+        if(_ledPin != -1) {
+            digitalWrite(_ledPin, !_ledOn); // Switch LED off
+        }
+        if(write(chunk, toRead) != toRead)
+            break;
+        written += toRead;
+
+        #if CONFIG_FREERTOS_UNICORE
+        delay(1);  // Fix solo WDT
+        #endif
+    }
+    free(chunk);
+    return written;
+}
+
 void UpdateClass::printError(Print &out){
     out.println(_err2str(_error));
 }
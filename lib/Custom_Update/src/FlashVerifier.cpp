@@ -0,0 +1,124 @@
+#include "FlashVerifier.h"
+#include <esp_rom_crc.h>
+#include <mbedtls/sha256.h>
+
+bool FlashVerifier::begin(const esp_partition_t *partition){
+    end();
+    _partition = partition;
+    _crcs.clear();
+    if(partition){
+        _crcs.reserve(partition->size / FLASH_VERIFY_SECTOR);
+    }
+    _crc = 0;
+    _size = 0;
+    _ranges = 0;
+    _mismatches = "";
+    _sha = (mbedtls_sha256_context*)malloc(sizeof(mbedtls_sha256_context));
+    if(!_sha){
+        log_e("no memory to verify %s", partition ? partition->label : "");
+        return false;
+    }
+    mbedtls_sha256_init(_sha);
+    mbedtls_sha256_starts(_sha, 0);
+    return partition != NULL;
+}
+
+void FlashVerifier::end(){
+    if(_sha){
+        mbedtls_sha256_free(_sha);
+        free(_sha);
+    }
+    _sha = NULL;
+}
+
+void FlashVerifier::add(const uint8_t *data, size_t len){
+    if(!_sha){
+        return;
+    }
+    mbedtls_sha256_update(_sha, data, len);
+    while(len){
+        size_t n = FLASH_VERIFY_SECTOR - _size % FLASH_VERIFY_SECTOR;
+        if(n > len){
+            n = len;
+        }
+        _crc = esp_rom_crc32_le(_crc, data, n);
+        _size += n;
+        data += n;
+        len -= n;
+        if(_size % FLASH_VERIFY_SECTOR == 0){
+            _crcs.push_back(_crc);
+            _crc = 0;
+        }
+    }
+}
+
+void FlashVerifier::_addRange(size_t first, size_t last){
+    if(_ranges++ >= FLASH_VERIFY_MAX_RANGES){
+        if(_ranges == FLASH_VERIFY_MAX_RANGES + 1){
+            _mismatches += ", ...";
+        }
+        return;
+    }
+    char range[24];
+    size_t end = std::min(_size, (last + 1) * FLASH_VERIFY_SECTOR) - 1;
+    snprintf(range, sizeof(range), "0x%x-0x%x", (unsigned)(first * FLASH_VERIFY_SECTOR), (unsigned)end);
+    if(_mismatches.length()){
+        _mismatches += ", ";
+    }
+    _mismatches += range;
+}
+
+bool FlashVerifier::verify(){
+    if(!_sha){
+        return false;
+    }
+    mbedtls_sha256_finish(_sha, _sha256);
+    mbedtls_sha256_starts(_sha, 0);     // now hashes what reads back
+
+    uint8_t *sector = (uint8_t*)malloc(FLASH_VERIFY_SECTOR);
+    if(!sector){
+        log_e("no memory to verify %s", _partition->label);
+        end();
+        return false;
+    }
+    size_t bad = 0;
+    long first = -1;    // first sector of the mismatching run
+    size_t sectors = (_size + FLASH_VERIFY_SECTOR - 1) / FLASH_VERIFY_SECTOR;
+    for(size_t i = 0; i < sectors; i++){
+        size_t offset = i * FLASH_VERIFY_SECTOR;
+        size_t len = std::min(_size - offset, (size_t)FLASH_VERIFY_SECTOR);
+        uint32_t expected = i < _crcs.size() ? _crcs[i] : _crc;
+        bool ok = esp_partition_read(_partition, offset, sector, len) == ESP_OK;
+        if(ok){
+            mbedtls_sha256_update(_sha, sector, len);
+            ok = esp_rom_crc32_le(0, sector, len) == expected;
+        }
+        if(!ok){
+            bad++;
+            if(first < 0){
+                first = i;
+            }
+        }
+        if(first >= 0 && (ok || i == sectors - 1)){
+            _addRange(first, ok ? i - 1 : i);
+            first = -1;
+        }
+    }
+    free(sector);
+
+    // the CRCs point at the sectors, the hash covers what a CRC could miss
+    uint8_t readBack[32];
+    mbedtls_sha256_finish(_sha, readBack);
+    end();
+    if(!bad && memcmp(readBack, _sha256, sizeof(readBack))){
+        bad = sectors;
+        _addRange(0, sectors - 1);
+    }
+    if(bad){
+        log_e("%s: %u of %u sectors don't read back as written: %s", _partition->label, (unsigned)bad,
+              (unsigned)sectors, _mismatches.c_str());
+        return false;
+    }
+    log_i("%s: %u bytes verified", _partition->label, (unsigned)_size);
+    return true;
+}
@@ -0,0 +1,63 @@
+#ifndef FLASHVERIFIER_H
+#define FLASHVERIFIER_H
+
+#include <Arduino.h>
+#include <vector>
+#include "esp_partition.h"
+
+#define FLASH_VERIFY_SECTOR     4096
+#define FLASH_VERIFY_MAX_RANGES 8       // mismatching ranges spelled out by mismatches()
+
+struct mbedtls_sha256_context;
+
+/*
+  Read-back check shared by the flash writers.
+  Every byte meant for the partition goes through add(), in partition
+  order from offset 0, which keeps a CRC32 per sector and a SHA-256 of
+  the whole. verify() then reads the partition back, so a write that
+  reported success but didn't stick (brown-out, worn sector) is caught
+  before the image is enabled, along with the sectors it hit
+*/
+class FlashVerifier {
+  public:
+    ~FlashVerifier(){ end(); }
+
+    /*
+      Starts over for partition, at offset 0
+    */
+    bool begin(const esp_partition_t *partition);
+
+    /*
+      data as it must read back from flash, right after the previous bytes
+    */
+    void add(const uint8_t *data, size_t len);
+
+    /*
+      Reads back everything added, once it is all written
+      false when a sector differs or can't be read, see mismatches()
+    */
+    bool verify();
+
+    /*
+      Frees the hash, the results stay readable
+    */
+    void end();
+
+    size_t size() const { return _size; }
+    const uint8_t *sha256() const { return _sha256; }       // of the data added, after verify()
+    const String &mismatches() const { return _mismatches; } // "0x1000-0x2fff, ..." partition offsets
+
+  private:
+    void _addRange(size_t first, size_t last);
+
+    const esp_partition_t *_partition = NULL;
+    std::vector<uint32_t> _crcs;    // of each complete sector
+    uint32_t _crc = 0;              // of the sector being added
+    size_t _size = 0;
+    size_t _ranges = 0;
+    mbedtls_sha256_context *_sha = NULL;
+    uint8_t _sha256[32] = {0};
+    String _mismatches;
+};
+
+#endif
@@ -0,0 +1,181 @@
+#include "GzipInflater.h"
+#include "MemUtils.h"
+#include <esp_rom_crc.h>
+#include <rom/miniz.h>
+
+#define GZIP_FHCRC      0x02
+#define GZIP_FEXTRA     0x04
+#define GZIP_FNAME      0x08
+#define GZIP_FCOMMENT   0x10
+#define GZIP_RESERVED   0xE0
+
+bool GzipInflater::isGzip(const uint8_t *data, size_t len){
+    return len >= GZIP_MAGIC_LEN && data[0] == GZIP_ID1 && data[1] == GZIP_ID2 && data[2] == GZIP_DEFLATE;
+}
+
+bool GzipInflater::begin(THandlerFunction_Output output){
+    end();
+    _inflator = (tinfl_decompressor*)largeAlloc(sizeof(tinfl_decompressor));
+    _dict = (uint8_t*)largeAlloc(TINFL_LZ_DICT_SIZE);
+    if(!_inflator || !_dict){
+        end();
+        return _fail("not enough memory to inflate");
+    }
+    tinfl_init(_inflator);
+    _output = output;
+    _state = GZ_HEADER;
+    _flags = 0;
+    _hdrLen = 0;
+    _dictOfs = 0;
+    _crc = 0;
+    _size = 0;
+    return true;
+}
+
+void GzipInflater::end(){
+    if(_inflator) free(_inflator);
+    if(_dict) free(_dict);
+    _inflator = NULL;
+    _dict = NULL;
+}
+
+bool GzipInflater::_fail(const char *error){
+    log_e("gzip: %s", error);
+    _state = GZ_ERROR;
+    return false;
+}
+
+// Optional header fields come in this order, each flag is cleared once its field is read
+void GzipInflater::_nextField(){
+    _hdrLen = 0;
+    if(_flags & GZIP_FEXTRA){
+        _flags &= ~GZIP_FEXTRA;
+        _state = GZ_EXTRA_LEN;
+    } else if(_flags & GZIP_FNAME){
+        _flags &= ~GZIP_FNAME;
+        _state = GZ_NAME;
+    } else if(_flags & GZIP_FCOMMENT){
+        _flags &= ~GZIP_FCOMMENT;
+        _state = GZ_COMMENT;
+    } else if(_flags & GZIP_FHCRC){
+        _flags &= ~GZIP_FHCRC;
+        _state = GZ_HCRC;
+        _skip = 2;
+    } else {
+        _state = GZ_DEFLATE;
+    }
+}
+
+size_t GzipInflater::_collect(const uint8_t *data, size_t len, size_t need){
+    size_t n = need - _hdrLen < len ? need - _hdrLen : len;
+    memcpy(_hdr + _hdrLen, data, n);
+    _hdrLen += n;
+    return n;
+}
+
+bool GzipInflater::write(const uint8_t *data, size_t len){
+    while(len && _state != GZ_DONE){
+        size_t used = 0;
+        switch(_state){
+            case GZ_HEADER:
+                used = _collect(data, len, GZIP_HEADER_SIZE);
+                if(_hdrLen < GZIP_HEADER_SIZE){
+                    break;
+                }
+                if(!isGzip(_hdr, _hdrLen) || (_hdr[3] & GZIP_RESERVED)){
+                    return _fail("not a gzip stream");
+                }
+                _flags = _hdr[3];
+                _nextField();
+                break;
+            case GZ_EXTRA_LEN:
+                used = _collect(data, len, 2);
+                if(_hdrLen == 2){
+                    _skip = _hdr[0] | _hdr[1] << 8;
+                    _state = GZ_EXTRA;
+                    if(!_skip){
+                        _nextField();
+                    }
+                }
+                break;
+            case GZ_EXTRA:
+            case GZ_HCRC:
+                used = _skip < len ? _skip : len;
+                _skip -= used;
+                if(!_skip){
+                    _nextField();
+                }
+                break;
+            case GZ_NAME:
+            case GZ_COMMENT: {
+                const uint8_t *zero = (const uint8_t*)memchr(data, 0, len);
+                used = zero ? zero - data + 1 : len;
+                if(zero){
+                    _nextField();
+                }
+                break;
+            }
+            case GZ_DEFLATE:
+                used = _inflate(data, len);
+                break;
+            case GZ_TRAILER:
+                used = _collect(data, len, GZIP_TRAILER_SIZE);
+                if(_hdrLen < GZIP_TRAILER_SIZE){
+                    break;
+                }
+                if(le32(_hdr) != _crc){
+                    return _fail("CRC32 mismatch");
+                }
+                if(le32(_hdr + 4) != _size){
+                    return _fail("size mismatch");
+                }
+                _state = GZ_DONE;
+                break;
+            default:
+                return false;
+        }
+        if(_state == GZ_ERROR){
+            return false;
+        }
+        data += used;
+        len -= used;
+    }
+    return true;
+}
+
+size_t GzipInflater::_inflate(const uint8_t *data, size_t len){
+    size_t consumed = 0;
+    tinfl_status status;
+    for(;;){
+        size_t in = len - consumed;
+        size_t out = TINFL_LZ_DICT_SIZE - _dictOfs;
+        status = tinfl_decompress(_inflator, data + consumed, &in, _dict, _dict + _dictOfs, &out,
+                                  TINFL_FLAG_HAS_MORE_INPUT);
+        consumed += in;
+        if(out){
+            _crc = esp_rom_crc32_le(_crc, _dict + _dictOfs, out);
+            _size += out;
+            if(_output && !_output(_dict + _dictOfs, out)){
+                _fail("output refused");
+                return consumed;
+            }
+        }
+        _dictOfs = (_dictOfs + out) & (TINFL_LZ_DICT_SIZE - 1);
+        if(status < TINFL_STATUS_DONE){
+            _fail("corrupted deflate stream");
+            return consumed;
+        }
+        if(status == TINFL_STATUS_DONE){
+            break;
+        }
+        if(status == TINFL_STATUS_NEEDS_MORE_INPUT && consumed == len){
+            return consumed;
+        }
+    }
+    // bytes the inflater read ahead, past the end of the deflate stream, belong to the trailer
+    size_t ahead = (size_t)(_inflator->m_num_bits >> 3);
+    consumed -= ahead < consumed ? ahead : consumed;
+    _hdrLen = 0;
+    _state = GZ_TRAILER;
+    return consumed;
+}
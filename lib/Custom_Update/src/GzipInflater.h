@@ -0,0 +1,78 @@
+#ifndef GZIPINFLATER_H
+#define GZIPINFLATER_H
+
+#include <Arduino.h>
+#include <functional>
+
+#define GZIP_ID1            0x1F    // first bytes of every gzip member
+#define GZIP_ID2            0x8B
+#define GZIP_DEFLATE        8
+#define GZIP_MAGIC_LEN      3       // bytes isGzip() needs to tell
+
+#define GZIP_HEADER_SIZE    10
+#define GZIP_TRAILER_SIZE   8
+
+struct tinfl_decompressor_tag;
+
+/*
+  Streaming gunzip (RFC 1952) over the ROM inflater.
+  Compressed bytes are pushed a piece at a time and come out inflated
+  through the output callback, the 32k deflate window doubles as the
+  output buffer so memory doesn't grow with the image.
+  The CRC32 and size in the trailer are checked before finished() is true
+*/
+class GzipInflater {
+  public:
+    typedef std::function<bool(const uint8_t*, size_t)> THandlerFunction_Output;
+
+    ~GzipInflater(){ end(); }
+
+    /*
+      true when data starts with a gzip member header (magic and deflate method),
+      always false below GZIP_MAGIC_LEN bytes
+    */
+    static bool isGzip(const uint8_t *data, size_t len);
+
+    /*
+      Allocates the inflater and its window, PSRAM first when the board has it
+    */
+    bool begin(THandlerFunction_Output output);
+
+    /*
+      Inflates len bytes, false on a corrupt stream, a failed output() or a bad trailer
+      Bytes after the trailer are ignored
+    */
+    bool write(const uint8_t *data, size_t len);
+
+    /*
+      Frees the buffers, the state (finished, failed, size) stays readable
+    */
+    void end();
+
+    bool finished() const { return _state == GZ_DONE; }
+    bool failed() const { return _state == GZ_ERROR; }
+    uint32_t size() const { return _size; }     // bytes inflated so far
+
+  private:
+    enum State : uint8_t { GZ_HEADER, GZ_EXTRA_LEN, GZ_EXTRA, GZ_NAME, GZ_COMMENT, GZ_HCRC,
+                           GZ_DEFLATE, GZ_TRAILER, GZ_DONE, GZ_ERROR };
+
+    void _nextField();
+    size_t _collect(const uint8_t *data, size_t len, size_t need);
+    size_t _inflate(const uint8_t *data, size_t len);
+    bool _fail(const char *error);
+
+    State _state = GZ_ERROR;
+    uint8_t _flags = 0;
+    uint8_t _hdr[GZIP_HEADER_SIZE];
+    size_t _hdrLen = 0;
+    size_t _skip = 0;
+    uint32_t _crc = 0;
+    uint32_t _size = 0;
+    tinfl_decompressor_tag *_inflator = NULL;
+    uint8_t *_dict = NULL;
+    size_t _dictOfs = 0;
+    THandlerFunction_Output _output;
+};
+
+#endif
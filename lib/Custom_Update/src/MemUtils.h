@@ -0,0 +1,30 @@
+#ifndef MEMUTILS_H
+#define MEMUTILS_H
+
+#include <Arduino.h>
+
+/*
+  Buffers of a few KB and up: PSRAM when the board has it, so internal RAM
+  stays free for WiFi and TCP, internal RAM otherwise or once PSRAM is full.
+  Released with free()
+*/
+static inline void *largeAlloc(size_t size){
+#ifdef BOARD_HAS_PSRAM
+    void *p = ps_malloc(size);
+    if(p){
+        return p;
+    }
+#endif
+    return malloc(size);
+}
+
+// Little-endian fields of gzip, zip, sparse image and partition table headers
+static inline uint16_t le16(const uint8_t *p){
+    return p[0] | p[1] << 8;
+}
+
+static inline uint32_t le32(const uint8_t *p){
+    return le16(p) | (uint32_t)le16(p + 2) << 16;
+}
+
+#endif
@@ -25,6 +25,7 @@
 
 #include "M5-HTTPUpdate.h"
 #include <StreamString.h>
+#include <Preferences.h>
 
 #include <esp_partition.h>
 #include <esp_ota_ops.h>                // get running partition
@@ -32,9 +33,15 @@
 // To do extern "C" uint32_t _SPIFFS_start;
 // To do extern "C" uint32_t _SPIFFS_end;
 
+#define HTTP_UPDATE_NVS_NAMESPACE   "httpupdate"
+#define HTTP_UPDATE_MAX_RECONNECTS  8
+
 // Function to install from Offset
 HTTPUpdateResult HTTPUpdate::updateFromOffset(WiFiClient& client, const String& url, uint32_t offset, uint32_t size, const String& currentVersion, HTTPUpdateRequestCB requestCB)
 {
+    if(_resumable) {
+        return handleResumableUpdate(client, url, offset, size, false, requestCB);
+    }
     HTTPClient http;
     if(!http.begin(client, url))
     {
@@ -45,6 +52,9 @@ HTTPUpdateResult HTTPUpdate::updateFromOffset(WiFiClient& client, const String&
 }
 HTTPUpdateResult HTTPUpdate::updateSpiffsFromOffset(WiFiClient& client, const String& url, uint32_t offset, uint32_t size, const String& currentVersion, HTTPUpdateRequestCB requestCB)
 {
+    if(_resumable) {
+        return handleResumableUpdate(client, url, offset, size, true, requestCB);
+    }
     HTTPClient http;
     if(!http.begin(client, url))
     {
@@ -355,7 +365,8 @@ HTTPUpdateResult HTTPUpdate::handleUpdate(HTTPClient& http, const String& curren
 
                     // check for valid first magic byte
 //                    if(buf[0] != 0xE9) {
-                    if(tcp->peek() != 0xE9) {
+                    // .bin.gz images are inflated by Update, their first byte is the gzip magic
+                    if(tcp->peek() != 0xE9 && tcp->peek() != GZIP_ID1) {
                         log_e("Magic header does not start with 0xE9\n");
                         _lastError = HTTP_UE_BIN_VERIFY_HEADER_FAILED;
                         http.end();
@@ -483,6 +494,310 @@ bool HTTPUpdate::runUpdate(Stream& in, uint32_t size, String md5, int command)
     return true;
 }
 
+/**
+ * NVS checkpoint of an interrupted resumable update
+ */
+static bool loadCheckpoint(const String& url, uint32_t offset, uint32_t size, int command,
+                           size_t& done, String& md5, uint8_t* head, String& validator)
+{
+    Preferences prefs;
+    if(!prefs.begin(HTTP_UPDATE_NVS_NAMESPACE, true)) {
+        return false;
+    }
+    bool match = prefs.getString("url") == url && prefs.getUInt("off", UINT32_MAX) == offset
+                 && prefs.getUInt("size") == size && prefs.getInt("cmd", -1) == command;
+    if(match) {
+        done = prefs.getUInt("done");
+        md5 = prefs.getString("md5");
+        validator = prefs.getString("val");
+        // without a validator a replaced file couldn't be told from the one the prefix came from
+        match = done > 0 && md5.length() == 32 && validator.length();
+        if(match && command == U_FLASH) {
+            match = prefs.getBytes("head", head, ENCRYPTED_BLOCK_SIZE) == ENCRYPTED_BLOCK_SIZE;
+        }
+    }
+    prefs.end();
+    return match;
+}
+
+static void saveCheckpoint(const String& url, uint32_t offset, uint32_t size, int command,
+                           size_t done, const String& md5, const uint8_t* head, const String& validator)
+{
+    Preferences prefs;
+    if(!prefs.begin(HTTP_UPDATE_NVS_NAMESPACE, false)) {
+        return;
+    }
+    // NVS leaves unchanged values alone, only done/md5 really get written each block
+    prefs.putString("url", url);
+    prefs.putUInt("off", offset);
+    prefs.putUInt("size", size);
+    prefs.putInt("cmd", command);
+    prefs.putString("val", validator);
+    prefs.putUInt("done", done);
+    prefs.putString("md5", md5);
+    if(head) {
+        prefs.putBytes("head", head, ENCRYPTED_BLOCK_SIZE);
+    }
+    prefs.end();
+}
+
+static void clearCheckpoint()
+{
+    Preferences prefs;
+    if(prefs.begin(HTTP_UPDATE_NVS_NAMESPACE, false)) {
+        prefs.clear();
+        prefs.end();
+    }
+}
+
+bool HTTPUpdate::canResume(const String& url, uint32_t offset, uint32_t size, bool spiffs)
+{
+    size_t done;
+    String md5, validator;
+    uint8_t head[ENCRYPTED_BLOCK_SIZE];
+    return loadCheckpoint(url, offset, size, spiffs ? U_SPIFFS : U_FLASH, done, md5, head, validator);
+}
+
+void HTTPUpdate::trackCheckpoints(const String& url, uint32_t offset, uint32_t size, bool spiffs,
+                                  const String& validator)
+{
+    if(!url.length()) {
+        Update.onCheckpoint(NULL);
+        return;
+    }
+    int command = spiffs ? U_SPIFFS : U_FLASH;
+    Update.onCheckpoint([url, offset, size, command, validator](size_t done, const String& md5,
+                                                                const uint8_t* head) {
+        saveCheckpoint(url, offset, size, command, done, md5, head, validator);
+    });
+}
+
+void HTTPUpdate::forgetCheckpoint()
+{
+    clearCheckpoint();
+}
+
+HTTPUpdateResult HTTPUpdate::handleResumableUpdate(WiFiClient& client, const String& url, uint32_t offset, uint32_t size, bool spiffs, HTTPUpdateRequestCB requestCB)
+{
+    int command = spiffs ? U_SPIFFS : U_FLASH;
+    Update.onCheckpoint([&](size_t done, const String& md5, const uint8_t* head) {
+        saveCheckpoint(url, offset, size, command, done, md5, head, _validator);
+    });
+    HTTPUpdateResult ret = runResumableUpdate(client, url, offset, size, command, requestCB);
+    Update.onCheckpoint(NULL);
+
+    if(ret == HTTP_UPDATE_OK) {
+        if (_cbEnd) {
+            _cbEnd();
+        }
+        if(_rebootOnUpdate && !spiffs) {
+            ESP.restart();
+        }
+    }
+    return ret;
+}
+
+/**
+ * Range-requests [offset, offset + size) in as many connections as it takes,
+ * continuing from the NVS checkpoint when the flash prefix still matches it
+ */
+HTTPUpdateResult HTTPUpdate::runResumableUpdate(WiFiClient& client, const String& url, uint32_t offset, uint32_t size, int command, HTTPUpdateRequestCB requestCB)
+{
+    StreamString error;
+    size_t done = 0;
+    size_t total = size;
+    String md5;
+    uint8_t head[ENCRYPTED_BLOCK_SIZE];
+    bool resuming = loadCheckpoint(url, offset, size, command, done, md5, head, _validator);
+    if(!resuming) {
+        _validator = "";
+    }
+    int attempts = 0;
+
+    uint8_t* buf = (uint8_t*)malloc(SPI_FLASH_SEC_SIZE);
+    if(!buf) {
+        _lastError = HTTP_UE_TOO_LESS_SPACE;
+        return HTTP_UPDATE_FAILED;
+    }
+
+    while(attempts <= HTTP_UPDATE_MAX_RECONNECTS) {
+        HTTPClient http;
+        if(!http.begin(client, url)) {
+            break;
+        }
+        http.useHTTP10(true);
+        http.setTimeout(_httpClientTimeout);
+        http.setFollowRedirects(_followRedirects);
+        http.setUserAgent("ESP32-http-Update");
+        http.addHeader("Cache-Control", "no-cache");
+        http.addHeader("Range", "bytes=" + String(offset + done) + "-" + String(offset + size - 1));
+        if(done && _validator.length()) {
+            http.addHeader("If-Range", _validator);     // the rest of the same file or all of a new one
+        }
+        if (requestCB) {
+            requestCB(&http);
+        }
+        const char * headerkeys[] = { "x-MD5", "ETag", "Last-Modified" };
+        http.collectHeaders(headerkeys, 3);
+
+        int code = http.GET();
+        if(code <= 0) {
+            log_e("HTTP error: %s\n", http.errorToString(code).c_str());
+            _lastError = code;
+            http.end();
+            attempts++;
+            delay(500 * attempts);
+            continue;
+        }
+        String validator = http.header("ETag");
+        if(!validator.length()) {
+            validator = http.header("Last-Modified");
+        }
+        if(done && (code == HTTP_CODE_OK || (code == HTTP_CODE_PARTIAL_CONTENT && validator != _validator))) {
+            // the file was replaced since the prefix was flashed, its tail doesn't belong after it
+            log_w("%s changed on the server, starting over\n", url.c_str());
+            clearCheckpoint();
+            if(Update.isRunning()) {
+                Update.abort();
+            }
+            resuming = false;
+            done = 0;
+            total = size;
+            http.end();
+            attempts++;
+            continue;
+        }
+        if(!done) {
+            _validator = validator;
+        }
+        // a server ignoring Range only helps when we wanted the file from its first byte
+        if(code != HTTP_CODE_PARTIAL_CONTENT && !(code == HTTP_CODE_OK && offset + done == 0)) {
+            if(code == HTTP_CODE_NOT_FOUND) {
+                _lastError = HTTP_UE_SERVER_FILE_NOT_FOUND;
+            } else if(code == HTTP_CODE_FORBIDDEN) {
+                _lastError = HTTP_UE_SERVER_FORBIDDEN;
+            } else {
+                _lastError = HTTP_UE_SERVER_WRONG_HTTP_CODE;
+                log_e("HTTP Code is (%d)\n", code);
+            }
+            http.end();
+            break;
+        }
+
+        WiFiClient * tcp = http.getStreamPtr();
+        if(!Update.isRunning()) {
+            int len = http.getSize();
+            if(len <= 0) {
+                _lastError = HTTP_UE_SERVER_NOT_REPORT_SIZE;
+                http.end();
+                break;
+            }
+            if(done + len < total) {
+                total = done + len;     // file shorter than what was asked for
+            }
+            if(!done && command == U_FLASH && tcp->peek() != 0xE9 && tcp->peek() != GZIP_ID1) {
+                log_e("Magic header does not start with 0xE9\n");
+                _lastError = HTTP_UE_BIN_VERIFY_HEADER_FAILED;
+                http.end();
+                break;
+            }
+            if (_cbProgress) {
+                Update.onProgress(_cbProgress);
+            }
+            if(!Update.begin(total, command, _ledPin, _ledOn)) {
+                _lastError = Update.getError();
+                Update.printError(error);
+                error.trim(); // remove line ending
+                log_e("Update.begin failed! (%s)\n", error.c_str());
+                http.end();
+                break;
+            }
+            if(resuming && !Update.resume(done, md5.c_str(), command == U_FLASH ? head : NULL)) {
+                // flash no longer holds the checkpointed prefix, ask again from the start
+                log_w("checkpoint doesn't match the flash, starting over\n");
+                resuming = false;
+                done = 0;
+                total = size;
+                Update.abort();
+                http.end();
+                continue;
+            }
+            if (_cbStart) {
+                _cbStart();
+            }
+            if (_cbProgress) {
+                _cbProgress(done, total);
+            }
+            if(!done && http.header("x-MD5").length() && !Update.setMD5(http.header("x-MD5").c_str())) {
+                _lastError = HTTP_UE_SERVER_FAULTY_MD5;
+                http.end();
+                break;
+            }
+        }
+
+        size_t before = done;
+        uint32_t lastData = millis();
+        while(done < total) {
+            size_t avail = tcp->available();
+            if(avail) {
+                if(avail > SPI_FLASH_SEC_SIZE) {
+                    avail = SPI_FLASH_SEC_SIZE;
+                }
+                if(avail > total - done) {
+                    avail = total - done;
+                }
+                size_t got = tcp->read(buf, avail);
+                if(Update.write(buf, got) != got) {
+                    break;
+                }
+                done += got;
+                lastData = millis();
+            } else if(!tcp->connected() || millis() - lastData > (uint32_t)_httpClientTimeout) {
+                break;
+            } else {
+                delay(1);
+            }
+        }
+        http.end();
+
+        if(Update.hasError() || done >= total) {
+            break;
+        }
+        // only attempts that made no progress count against the limit
+        attempts = done > before ? 1 : attempts + 1;
+        _lastError = HTTPC_ERROR_CONNECTION_LOST;
+        log_w("connection lost at %u of %u, reconnecting\n", done, total);
+        delay(500 * attempts);
+    }
+    free(buf);
+
+    if(!Update.isRunning() || Update.hasError() || done < total) {
+        if(Update.hasError()) {
+            _lastError = Update.getError();
+            Update.printError(error);
+            error.trim(); // remove line ending
+            log_e("Update failed! (%s)\n", error.c_str());
+            clearCheckpoint();
+        }
+        Update.abort();     // the NVS checkpoint stays for the next call
+        return HTTP_UPDATE_FAILED;
+    }
+
+    if (_cbProgress) {
+        _cbProgress(total, total);
+    }
+    bool ok = Update.end();
+    clearCheckpoint();
+    if(!ok) {
+        _lastError = Update.getError();
+        Update.printError(error);
+        error.trim(); // remove line ending
+        log_e("Update.end failed! (%s)\n", error.c_str());
+        return HTTP_UPDATE_FAILED;
+    }
+    return HTTP_UPDATE_OK;
+}
+
 #if !defined(NO_GLOBAL_INSTANCES) && !defined(NO_GLOBAL_HTTPUPDATE)
 HTTPUpdate httpUpdate;
 #endif
@@ -85,6 +85,39 @@ public:
         _ledOn = ledOn;
     }
 
+    /**
+      * make updateFromOffset / updateSpiffsFromOffset survive dropped connections.
+      * The last flashed 64k block is checkpointed in NVS, a drop reconnects with a
+      * Range request from there, and a later call with the same url, offset and size
+      * (even after a reboot) re-verifies the written prefix and continues. The ETag
+      * (or Last-Modified) of the first response is kept too and sent as If-Range,
+      * a file replaced on the server starts the update over.
+      * @param resumable
+      */
+    void setResumable(bool resumable)
+    {
+        _resumable = resumable;
+    }
+
+    /**
+      * true if NVS holds a checkpoint for this url/offset/size that the next
+      * resumable update may continue from (the flash prefix is still verified then)
+      */
+    bool canResume(const String& url, uint32_t offset, uint32_t size, bool spiffs = false);
+
+    /**
+      * checkpoint an update the caller feeds to Update itself as if it was a
+      * resumable update of url/offset/size, validator being the ETag or Last-Modified
+      * the caller's response came with. An empty url stops tracking
+      */
+    void trackCheckpoints(const String& url, uint32_t offset = 0, uint32_t size = 0, bool spiffs = false,
+                          const String& validator = "");
+
+    /**
+      * drop the NVS checkpoint, once the tracked update is complete
+      */
+    void forgetCheckpoint();
+
     t_httpUpdate_return update(WiFiClient& client, const String& url, const String& currentVersion = "", HTTPUpdateRequestCB requestCB = NULL);
 
     t_httpUpdate_return update(WiFiClient& client, const String& host, uint16_t port, const String& uri = "/",
@@ -117,6 +150,8 @@ public:
 protected:
     t_httpUpdate_return handleUpdate(HTTPClient& http, const String& currentVersion, bool spiffs = false, HTTPUpdateRequestCB requestCB = NULL, uint32_t size = 0);
     bool runUpdate(Stream& in, uint32_t size, String md5, int command = U_FLASH);
+    t_httpUpdate_return handleResumableUpdate(WiFiClient& client, const String& url, uint32_t offset, uint32_t size, bool spiffs, HTTPUpdateRequestCB requestCB);
+    t_httpUpdate_return runResumableUpdate(WiFiClient& client, const String& url, uint32_t offset, uint32_t size, int command, HTTPUpdateRequestCB requestCB);
 
     // Set the error and potentially use a CB to notify the application
     void _setLastError(int err) {
@@ -130,6 +165,8 @@ protected:
 private:
     int _httpClientTimeout;
     followRedirects_t _followRedirects;
+    bool _resumable = false;
+    String _validator;      // of the file the running resumable update is flashing
 
     // Callbacks
     HTTPUpdateStartCB    _cbStart;
@@ -0,0 +1,465 @@
+#include "archive.h"
+#include "dirIndex.h"
+#include "display.h"
+#include "fileOps.h"
+#include "webInterface.h"
+#include <MemUtils.h>
+#include <esp_rom_crc.h>
+#include <globals.h>
+#include <rom/miniz.h>
+
+#define ZIP_LOCAL_SIG 0x04034b50
+#define ZIP_CENTRAL_SIG 0x02014b50
+#define ZIP_END_SIG 0x06054b50
+#define ZIP_DESCRIPTOR_SIG 0x08074b50
+#define ZIP_HEADER_SIZE 30
+#define TAR_BLOCK 512
+
+static uint64_t octal(const uint8_t *p, size_t len) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < len && p[i]; i++)
+        if (p[i] >= '0' && p[i] <= '7') value = value * 8 + (p[i] - '0');
+    return value;
+}
+
+static String field(const uint8_t *p, size_t len) {
+    String s;
+    for (size_t i = 0; i < len && p[i]; i++) s += (char)p[i];
+    return s;
+}
+
+bool ArchiveExtractor::formatOf(const String &name, Format &format) {
+    String lower = name;
+    lower.toLowerCase();
+    if (lower.endsWith(".zip")) format = ARCHIVE_ZIP;
+    else if (lower.endsWith(".tar")) format = ARCHIVE_TAR;
+    else return false;
+    return true;
+}
+
+bool ArchiveExtractor::_fail(const String &error) {
+    log_e("%s", error.c_str());
+    if (_state != ST_ERROR) _error = error;
+    _state = ST_ERROR;
+    if (_file) {
+        String path = _file.path();
+        _file.close();
+        SDM.remove(path); // partial or corrupted
+    }
+    return false;
+}
+
+bool ArchiveExtractor::begin(const String &folder, Format format) {
+    abort();
+    _format = format;
+    _folder = folder == "/" ? "" : folder;
+    _error = "";
+    _files = 0;
+    _longName = "";
+    _lastDir = "";
+    _buffer = (uint8_t *)largeAlloc(FILE_OPS_BUFFER);
+    if (!_buffer) return _fail("Not enough memory to extract");
+    _nextHeader();
+    return true;
+}
+
+void ArchiveExtractor::_nextHeader() {
+    _state = ST_HEADER;
+    _hdrLen = 0;
+    // a zip record is told by its signature, a tar header is one block
+    _hdrNeed = _format == ARCHIVE_ZIP ? 4 : TAR_BLOCK;
+}
+
+void ArchiveExtractor::_skip(uint64_t bytes, State then) {
+    _skipLeft = bytes;
+    _afterSkip = then;
+    if (!bytes) {
+        if (then == ST_HEADER) _nextHeader();
+        else _state = then;
+    } else _state = ST_SKIP;
+}
+
+size_t ArchiveExtractor::_collect(const uint8_t *data, size_t len) {
+    size_t n = std::min(len, _hdrNeed - _hdrLen);
+    memcpy(_hdr + _hdrLen, data, n);
+    _hdrLen += n;
+    return n;
+}
+
+/***************************************************************************************
+** Function name: ArchiveExtractor::write
+** Description:   Feeds the next bytes of the archive, whatever their size
+***************************************************************************************/
+bool ArchiveExtractor::write(const uint8_t *data, size_t len) {
+    while (len && _state != ST_DONE && _state != ST_ERROR) {
+        size_t used = 0;
+        switch (_state) {
+            case ST_HEADER:
+                used = _format == ARCHIVE_ZIP ? _zipHeader(data, len) : _tarHeader(data, len);
+                break;
+            case ST_NAME:
+            case ST_LONGNAME: {
+                used = std::min(len, (size_t)_remaining);
+                String &target = _state == ST_NAME ? _name : _longName;
+                target.concat((const char *)data, used);
+                _remaining -= used;
+                if (_remaining) break;
+                if (_state == ST_NAME) { // zip: extra field, then the data
+                    _skip(_skipLeft, ST_DATA);
+                    if (_state == ST_DATA && !_startEntry()) return false;
+                } else {
+                    _skip(_skipLeft, ST_HEADER); // tar: padding up to the next header
+                }
+                break;
+            }
+            case ST_SKIP:
+                used = std::min(len, (size_t)std::min(_skipLeft, (uint64_t)SIZE_MAX));
+                _skipLeft -= used;
+                if (_skipLeft) break;
+                if (_afterSkip == ST_HEADER) _nextHeader();
+                else {
+                    _state = _afterSkip;
+                    if (_state == ST_DATA && !_startEntry()) return false;
+                }
+                break;
+            case ST_DATA: used = _deflated ? _inflate(data, len) : _data(data, len); break;
+            case ST_DESCRIPTOR: used = _descriptor(data, len); break;
+            default: break;
+        }
+        data += used;
+        len -= used;
+    }
+    return _state != ST_ERROR;
+}
+
+/***************************************************************************************
+** Function name: ArchiveExtractor::_zipHeader
+** Description:   Local file header: signature, fixed fields, then name and extra field
+***************************************************************************************/
+size_t ArchiveExtractor::_zipHeader(const uint8_t *data, size_t len) {
+    size_t used = _collect(data, len);
+    if (_hdrLen < _hdrNeed) return used;
+    uint32_t sig = le32(_hdr);
+    if (_hdrLen == 4) {
+        if (sig == ZIP_CENTRAL_SIG || sig == ZIP_END_SIG) { // the directory at the end, all entries are out
+            _state = ST_DONE;
+            return used;
+        }
+        if (sig != ZIP_LOCAL_SIG) return _fail("Not a zip file, or corrupted"), used;
+        _hdrNeed = ZIP_HEADER_SIZE;
+        return used;
+    }
+    uint16_t flags = le16(_hdr + 6);
+    uint16_t method = le16(_hdr + 8);
+    _expectedCrc = le32(_hdr + 14);
+    uint32_t compressed = le32(_hdr + 18);
+    if (flags & 1) return _fail("Encrypted zip entries are not supported"), used;
+    if (method != 0 && method != 8) return _fail("Unsupported zip compression " + String(method)), used;
+    if (compressed == 0xFFFFFFFF) return _fail("Zip64 entries are not supported"), used;
+    _deflated = method == 8;
+    _hasDescriptor = flags & 8;
+    // streamed entries may leave the sizes for the descriptor after the data
+    _sizeKnown = !_hasDescriptor || compressed != 0;
+    _entrySize = compressed;
+    _remaining = le16(_hdr + 26);
+    _skipLeft = le16(_hdr + 28);
+    _name = "";
+    _state = ST_NAME;
+    if (!_remaining) return _fail("Zip entry without a name"), used;
+    return used;
+}
+
+/***************************************************************************************
+** Function name: ArchiveExtractor::_tarHeader
+** Description:   ustar/GNU header block, long names and pax paths come in a record before
+***************************************************************************************/
+size_t ArchiveExtractor::_tarHeader(const uint8_t *data, size_t len) {
+    size_t used = _collect(data, len);
+    if (_hdrLen < _hdrNeed) return used;
+
+    uint32_t sum = 0;
+    bool zero = true;
+    for (int i = 0; i < TAR_BLOCK; i++) {
+        sum += (i >= 148 && i < 156) ? ' ' : _hdr[i];
+        zero &= _hdr[i] == 0;
+    }
+    if (zero) { // end of archive marker
+        _state = ST_DONE;
+        return used;
+    }
+    if (sum != octal(_hdr + 148, 8)) return _fail("Not a tar file, or corrupted"), used;
+
+    uint64_t size = octal(_hdr + 124, 12);
+    uint64_t padding = (TAR_BLOCK - size % TAR_BLOCK) % TAR_BLOCK;
+    char type = _hdr[156];
+    if (type == 'L' || type == 'x') { // name of the next entry
+        if (size > 1024) {
+            _skip(size + padding, ST_HEADER);
+            return used;
+        }
+        _longName = type == 'x' ? "\x01" : ""; // pax records are parsed once read
+        _remaining = size;
+        _skipLeft = padding;
+        _state = ST_LONGNAME;
+        return used;
+    }
+    if (type == 'g') {
+        _skip(size + padding, ST_HEADER);
+        return used;
+    }
+
+    String name = _longName;
+    _longName = "";
+    if (name.startsWith("\x01")) { // pax: "<len> path=<name>\n" records
+        int at = name.indexOf(" path=");
+        name = at < 0 ? "" : name.substring(at + 6, name.indexOf('\n', at));
+    }
+    if (name.isEmpty()) {
+        name = field(_hdr, 100);
+        String prefix = field(_hdr + 345, 155);
+        if (memcmp(_hdr + 257, "ustar", 5) == 0 && prefix.length()) name = prefix + "/" + name;
+    }
+    _name = name;
+    if (type == '5' || name.endsWith("/")) {
+        _name += "/";
+        _remaining = 0;
+    } else if (type != '0' && type != '\0' && type != '7') { // links, devices...
+        _skip(size + padding, ST_HEADER);
+        return used;
+    } else {
+        _remaining = size;
+    }
+    _sizeKnown = true;
+    _hasDescriptor = false;
+    _deflated = false;
+    _skipLeft = padding;
+    _state = ST_DATA;
+    _startEntry();
+    return used;
+}
+
+/***************************************************************************************
+** Function name: ArchiveExtractor::_startEntry
+** Description:   Creates the folder or opens the file of the entry, inside the destination
+***************************************************************************************/
+bool ArchiveExtractor::_startEntry() {
+    if (_format == ARCHIVE_ZIP) _remaining = _entrySize;
+    String name = _name;
+    name.replace("\\", "/");
+    while (name.startsWith("/") || name.startsWith("./")) name.remove(0, name.startsWith("/") ? 1 : 2);
+    if (name == ".." || name.startsWith("../") || name.indexOf("/../") >= 0 || name.endsWith("/.."))
+        return _fail("Unsafe path in archive: " + _name);
+
+    _isFile = !name.isEmpty() && !name.endsWith("/");
+    if (!_sizeKnown && !_deflated) { // stored data can't be told apart from the descriptor
+        if (_isFile) return _fail("Unsupported streamed zip entry " + _name);
+        _sizeKnown = true;
+    }
+    String path = _folder + "/" + name;
+    String dir = _isFile ? path.substring(0, path.lastIndexOf('/')) : path;
+    if (dir.endsWith("/")) dir.remove(dir.length() - 1);
+    if (dir.length() && dir != _lastDir) {
+        createDirRecursive(dir);
+        _lastDir = dir;
+    }
+    _crc = 0;
+    if (_isFile) {
+        _file = SDM.open(path, FILE_WRITE);
+        if (!_file) return _fail("Fail creating " + path);
+    }
+    if (_deflated) {
+        if (!_inflator) {
+            _inflator = (tinfl_decompressor_tag *)largeAlloc(sizeof(tinfl_decompressor));
+            _dict = (uint8_t *)largeAlloc(TINFL_LZ_DICT_SIZE);
+            if (!_inflator || !_dict) return _fail("Not enough memory to inflate");
+        }
+        tinfl_init(_inflator);
+        _dictOfs = 0;
+    } else if (_sizeKnown && !_remaining) {
+        _endData(); // folders and empty files
+    }
+    return _state != ST_ERROR;
+}
+
+bool ArchiveExtractor::_output(const uint8_t *data, size_t len) {
+    if (_format == ARCHIVE_ZIP) _crc = esp_rom_crc32_le(_crc, data, len);
+    if (!_file) return true;
+    while (len) {
+        size_t n = std::min(len, (size_t)FILE_OPS_BUFFER - _buffered);
+        memcpy(_buffer + _buffered, data, n);
+        _buffered += n;
+        data += n;
+        len -= n;
+        if (_buffered == FILE_OPS_BUFFER && !_flush()) return false;
+    }
+    return true;
+}
+
+bool ArchiveExtractor::_flush() {
+    if (_buffered && _file.write(_buffer, _buffered) != _buffered) return _fail("Fail writing, SD card full?");
+    _buffered = 0;
+    return true;
+}
+
+size_t ArchiveExtractor::_data(const uint8_t *data, size_t len) {
+    size_t n = std::min(len, (size_t)std::min(_remaining, (uint64_t)SIZE_MAX));
+    if (!_output(data, n)) return n;
+    _remaining -= n;
+    if (!_remaining) _endData();
+    return n;
+}
+
+/***************************************************************************************
+** Function name: ArchiveExtractor::_inflate
+** Description:   Raw deflate through the ROM inflater, its 32 KB window is the output buffer
+***************************************************************************************/
+size_t ArchiveExtractor::_inflate(const uint8_t *data, size_t len) {
+    size_t avail = _sizeKnown ? std::min(len, (size_t)std::min(_remaining, (uint64_t)SIZE_MAX)) : len;
+    bool more = !_sizeKnown || avail < _remaining;
+    size_t consumed = 0;
+    tinfl_status status;
+    for (;;) {
+        size_t in = avail - consumed;
+        size_t out = TINFL_LZ_DICT_SIZE - _dictOfs;
+        status = tinfl_decompress(
+            _inflator,
+            data + consumed,
+            &in,
+            _dict,
+            _dict + _dictOfs,
+            &out,
+            more ? TINFL_FLAG_HAS_MORE_INPUT : 0
+        );
+        consumed += in;
+        if (out && !_output(_dict + _dictOfs, out)) return consumed;
+        _dictOfs = (_dictOfs + out) & (TINFL_LZ_DICT_SIZE - 1);
+        if (status < TINFL_STATUS_DONE) return _fail("Corrupted zip entry " + _name), consumed;
+        if (status == TINFL_STATUS_DONE) break;
+        if (status == TINFL_STATUS_NEEDS_MORE_INPUT && consumed == avail) {
+            if (_sizeKnown) _remaining -= consumed;
+            return consumed;
+        }
+    }
+    if (_sizeKnown) {
+        _remaining -= consumed;
+        uint64_t rest = _remaining;
+        _endData();
+        if (rest && _state != ST_ERROR) _fail("Corrupted zip entry " + _name);
+    } else {
+        // bytes the inflater read ahead, past the end of the stream, belong to the descriptor
+        size_t ahead = std::min((size_t)(_inflator->m_num_bits >> 3), consumed);
+        consumed -= ahead;
+        _endData();
+    }
+    return consumed;
+}
+
+// Entry data is over: descriptor, tar padding, or the next header
+void ArchiveExtractor::_endData() {
+    if (_hasDescriptor) {
+        _state = ST_DESCRIPTOR;
+        _hdrLen = 0;
+        _hdrNeed = 4;
+        return;
+    }
+    if (!_finishEntry()) return;
+    if (_format == ARCHIVE_TAR) _skip(_skipLeft, ST_HEADER);
+    else _nextHeader();
+}
+
+size_t ArchiveExtractor::_descriptor(const uint8_t *data, size_t len) {
+    size_t used = _collect(data, len);
+    if (_hdrLen < _hdrNeed) return used;
+    if (_hdrNeed == 4) { // the signature is optional
+        _hdrNeed = le32(_hdr) == ZIP_DESCRIPTOR_SIG ? 16 : 12;
+        return used;
+    }
+    _expectedCrc = le32(_hdr + _hdrNeed - 12);
+    if (_finishEntry()) _nextHeader();
+    return used;
+}
+
+bool ArchiveExtractor::_finishEntry() {
+    String path;
+    if (_file) {
+        if (!_flush()) return false;
+        path = _file.path();
+        _file.close();
+    }
+    if (_format == ARCHIVE_ZIP && _crc != _expectedCrc) {
+        if (path.length()) SDM.remove(path);
+        return _fail("CRC error in " + _name);
+    }
+    if (_isFile) _files++;
+    return true;
+}
+
+bool ArchiveExtractor::end() {
+    if (_state == ST_ERROR) return false;
+    // tar writers may stop right after the last entry, without the zero blocks
+    bool complete = _state == ST_DONE || (_format == ARCHIVE_TAR && _state == ST_HEADER && _hdrLen == 0);
+    if (!complete) _fail("Archive ended before its last entry");
+    bool ok = _state != ST_ERROR;
+    abort();
+    return ok;
+}
+
+void ArchiveExtractor::abort() {
+    if (_state != ST_DONE && _state != ST_ERROR && _file) _fail("Extraction aborted");
+    if (_file) _file.close();
+    free(_buffer);
+    free(_inflator);
+    free(_dict);
+    _buffer = nullptr;
+    _inflator = nullptr;
+    _dict = nullptr;
+    _buffered = 0;
+    if (_state != ST_ERROR) _state = ST_DONE;
+}
+
+/***************************************************************************************
+** Function name: extractArchive
+** Description:   extract a .zip or .tar of the SD card into folder
+***************************************************************************************/
+bool extractArchive(const String &archive, const String &folder, String *error) {
+    ArchiveExtractor::Format format;
+    ArchiveExtractor extractor;
+    File file;
+    uint8_t *buffer = nullptr;
+    bool ok = false;
+    uint32_t total = 0, done = 0, scale = 1;
+
+    if (!ArchiveExtractor::formatOf(archive, format)) {
+        if (error) *error = "Not a .zip or .tar file";
+        return false;
+    }
+    file = SDM.open(archive, FILE_READ);
+    buffer = (uint8_t *)largeAlloc(FILE_OPS_BUFFER);
+    if (!file || !buffer || !extractor.begin(folder, format)) goto Exit;
+
+    total = file.size();
+    scale = total > INT32_MAX ? 1024 : 1;
+    beginFileOp();
+    prog_handler = 5;
+    progressHandler(0, 500);
+    invalidateDirIndex();
+    ok = true;
+    for (size_t n; ok && (n = file.read(buffer, FILE_OPS_BUFFER)) > 0;) {
+        ok = extractor.write(buffer, n);
+        done += n;
+        progressHandler(done / scale, total / scale);
+        if (fileOpCancelled()) {
+            extractor.abort();
+            if (error) *error = "Cancelled";
+            ok = false;
+        }
+    }
+    ok = ok && extractor.end();
+    invalidateDirIndex();
+Exit:
+    if (!ok && error && error->isEmpty())
+        *error = extractor.error().isEmpty() ? "Fail opening " + archive : extractor.error();
+    extractor.abort();
+    free(buffer);
+    return ok;
+}
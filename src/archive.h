@@ -0,0 +1,86 @@
+#ifndef __ARCHIVE_H
+#define __ARCHIVE_H
+
+#include <Arduino.h>
+#include <FS.h>
+
+struct tinfl_decompressor_tag;
+
+// Extracts a .zip (stored or deflated entries) or .tar pushed a piece at a time, in archive
+// order, into a folder of the SD card. Only the current header, one write buffer and, for
+// deflated entries, the 32 KB inflate window are held, whatever the archive size.
+class ArchiveExtractor {
+public:
+    enum Format : uint8_t { ARCHIVE_ZIP, ARCHIVE_TAR };
+    // Format from the file name, false when it isn't an archive
+    static bool formatOf(const String &name, Format &format);
+
+    bool begin(const String &folder, Format format);
+    bool write(const uint8_t *data, size_t len);
+    // true when the archive ended properly and every entry was extracted
+    bool end();
+    void abort();
+
+    const String &error() const { return _error; }
+    uint32_t files() const { return _files; }
+
+private:
+    enum State : uint8_t {
+        ST_HEADER,
+        ST_NAME,
+        ST_SKIP,
+        ST_DATA,
+        ST_LONGNAME,
+        ST_DESCRIPTOR,
+        ST_DONE,
+        ST_ERROR
+    };
+
+    size_t _collect(const uint8_t *data, size_t len);
+    size_t _zipHeader(const uint8_t *data, size_t len);
+    size_t _tarHeader(const uint8_t *data, size_t len);
+    size_t _data(const uint8_t *data, size_t len);
+    size_t _inflate(const uint8_t *data, size_t len);
+    size_t _descriptor(const uint8_t *data, size_t len);
+    bool _startEntry();
+    bool _output(const uint8_t *data, size_t len);
+    bool _flush();
+    void _endData();
+    bool _finishEntry();
+    void _nextHeader();
+    void _skip(uint64_t bytes, State then);
+    bool _fail(const String &error);
+
+    Format _format = ARCHIVE_ZIP;
+    State _state = ST_DONE;
+    State _afterSkip = ST_HEADER;
+    String _folder;
+    String _name;
+    String _longName; // tar: GNU long name or pax path of the next entry
+    String _lastDir;
+    uint8_t _hdr[512];
+    size_t _hdrLen = 0;
+    size_t _hdrNeed = 0;
+    uint64_t _entrySize = 0; // zip: compressed size from the local header, 0 when streamed
+    uint64_t _remaining = 0; // entry bytes left in the archive
+    uint64_t _skipLeft = 0;
+    bool _sizeKnown = true;
+    bool _hasDescriptor = false;
+    bool _deflated = false;
+    bool _isFile = false;
+    uint32_t _crc = 0;
+    uint32_t _expectedCrc = 0;
+    uint32_t _files = 0;
+    File _file;
+    uint8_t *_buffer = nullptr;
+    size_t _buffered = 0;
+    tinfl_decompressor_tag *_inflator = nullptr;
+    uint8_t *_dict = nullptr;
+    size_t _dictOfs = 0;
+    String _error;
+};
+
+// Extracts an archive of the SD card into folder, with progressHandler() and cancelFileOp()
+bool extractArchive(const String &archive, const String &folder, String *error = nullptr);
+
+#endif
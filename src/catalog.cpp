@@ -0,0 +1,266 @@
+#include "catalog.h"
+#include "sd_functions.h"
+#include <globals.h>
+
+#define CATALOG_MAGIC "LCAT"
+#define CATALOG_VERSION 1
+#define CATALOG_HEADER_SIZE 12
+
+/***************************************************************************************
+** Binary helpers
+** Description:   Fixed width little endian fields and length prefixed strings
+***************************************************************************************/
+static void putU16(File &file, uint16_t value) { file.write((uint8_t *)&value, sizeof(value)); }
+
+static void putU32(File &file, uint32_t value) { file.write((uint8_t *)&value, sizeof(value)); }
+
+static void putStr(File &file, const char *value) {
+    uint16_t len = value ? strlen(value) : 0;
+    putU16(file, len);
+    if (len) file.write((const uint8_t *)value, len);
+}
+
+static uint16_t getU16(File &file) {
+    uint16_t value = 0;
+    file.read((uint8_t *)&value, sizeof(value));
+    return value;
+}
+
+static uint32_t getU32(File &file) {
+    uint32_t value = 0;
+    file.read((uint8_t *)&value, sizeof(value));
+    return value;
+}
+
+static String getStr(File &file) {
+    uint16_t len = getU16(file);
+    String value;
+    if (!value.reserve(len)) return value;
+    while (len) {
+        uint8_t chunk[64];
+        int got = file.read(chunk, std::min((size_t)len, sizeof(chunk)));
+        if (got <= 0) break;
+        value.concat((const char *)chunk, got);
+        len -= got;
+    }
+    return value;
+}
+
+/***************************************************************************************
+** Function name: openCatalog
+** Description:   Opens the cache and checks its header, leaves the file after it
+***************************************************************************************/
+static File openCatalog(uint16_t &count, uint32_t &indexOffset) {
+    if (!setupSdCard()) return File();
+    File file = SDM.open(CATALOG_FILE, FILE_READ);
+    if (!file) return file;
+    char magic[4];
+    if (file.read((uint8_t *)magic, 4) != 4 || memcmp(magic, CATALOG_MAGIC, 4) ||
+        getU16(file) != CATALOG_VERSION) {
+        file.close();
+        return File();
+    }
+    count = getU16(file);
+    indexOffset = getU32(file);
+    if (indexOffset + count * sizeof(uint32_t) != file.size()) { // interrupted write
+        file.close();
+        return File();
+    }
+    return file;
+}
+
+/***************************************************************************************
+** Function name: readCatalogValidators
+** Description:   ETag and Last-Modified of the cached catalog, for a conditional GET
+***************************************************************************************/
+bool readCatalogValidators(String &etag, String &lastModified) {
+    uint16_t count;
+    uint32_t indexOffset;
+    File file = openCatalog(count, indexOffset);
+    if (!file) return false;
+    etag = getStr(file);
+    lastModified = getStr(file);
+    file.close();
+    return count > 0;
+}
+
+/***************************************************************************************
+** Function name: readRecord
+** Description:   Decodes the firmware record at offset into item
+***************************************************************************************/
+static bool readRecord(File &file, uint32_t offset, JsonObject item) {
+    if (!file.seek(offset)) return false;
+    item["name"] = getStr(file);
+    item["author"] = getStr(file);
+    JsonArray versions = item["versions"].to<JsonArray>();
+    uint16_t versionCount = getU16(file);
+    for (uint16_t v = 0; v < versionCount; v++) {
+        JsonObject version = versions.add<JsonObject>();
+        version["version"] = getStr(file);
+        version["published_at"] = getStr(file);
+        version["file"] = getStr(file);
+        uint8_t flags = file.read();
+        version["s"] = (bool)(flags & 1);
+        version["nb"] = (bool)(flags & 2);
+        version["f"] = (bool)(flags & 4);
+        version["f2"] = (bool)(flags & 8);
+        for (const char *key : {"as", "so", "ss", "fo", "fs", "fo2", "fs2"}) version[key] = getU32(file);
+    }
+    return true;
+}
+
+/***************************************************************************************
+** Catalog index
+** Description:   Random access to the catalog for the firmware browser. Records are
+**                decoded from catalog.bin one at a time into a small LRU around the
+**                cursor; without an SD card the in-memory doc is used instead.
+**                An optional name filter maps browser positions to catalog entries
+***************************************************************************************/
+struct CatalogSlot {
+    int index = -1;
+    uint32_t used = 0;
+    JsonDocument entry;
+};
+
+static File catalogFile;
+static std::vector<uint32_t> catalogOffsets;
+static std::vector<uint16_t> catalogMatches;
+static bool catalogFiltered = false;
+static CatalogSlot catalogSlots[CATALOG_LRU];
+static uint32_t catalogTick = 0;
+
+static int catalogTotal() { return catalogFile ? catalogOffsets.size() : doc.size(); }
+
+static int catalogIndex(int position) { return catalogFiltered ? catalogMatches[position] : position; }
+
+bool openCatalogIndex() {
+    closeCatalogIndex();
+    uint16_t count;
+    uint32_t indexOffset;
+    catalogFile = openCatalog(count, indexOffset);
+    if (catalogFile) {
+        catalogOffsets.resize(count);
+        if (!catalogFile.seek(indexOffset) ||
+            catalogFile.read((uint8_t *)catalogOffsets.data(), count * sizeof(uint32_t)) !=
+                count * sizeof(uint32_t)) {
+            closeCatalogIndex();
+        } else {
+            doc.clear(); // everything is read from the card from now on
+        }
+    }
+    return catalogSize() > 0;
+}
+
+void closeCatalogIndex() {
+    if (catalogFile) catalogFile.close();
+    catalogOffsets.clear();
+    catalogOffsets.shrink_to_fit();
+    catalogMatches.clear();
+    catalogMatches.shrink_to_fit();
+    catalogFiltered = false;
+    for (CatalogSlot &slot : catalogSlots) {
+        slot.index = -1;
+        slot.used = 0;
+        slot.entry.clear();
+    }
+}
+
+int catalogSize() { return catalogFiltered ? catalogMatches.size() : catalogTotal(); }
+
+JsonObject catalogEntry(int position) {
+    if (position < 0 || position >= catalogSize()) return JsonObject();
+    int index = catalogIndex(position);
+    if (!catalogFile) return doc[index].as<JsonObject>();
+
+    CatalogSlot *slot = &catalogSlots[0];
+    for (CatalogSlot &s : catalogSlots) {
+        if (s.index == index) {
+            s.used = ++catalogTick;
+            return s.entry.as<JsonObject>();
+        }
+        if (s.used < slot->used) slot = &s;
+    }
+    slot->entry.clear();
+    slot->index = -1;
+    if (!readRecord(catalogFile, catalogOffsets[index], slot->entry.to<JsonObject>())) return JsonObject();
+    slot->index = index;
+    slot->used = ++catalogTick;
+    return slot->entry.as<JsonObject>();
+}
+
+int filterCatalog(const String &text) {
+    catalogMatches.clear();
+    catalogFiltered = text.length() > 0;
+    if (!catalogFiltered) return catalogSize();
+
+    String needle = text;
+    needle.toLowerCase();
+    for (int i = 0; i < catalogTotal(); i++) {
+        String name;
+        if (catalogFile) {
+            catalogFile.seek(catalogOffsets[i]); // name is the first field of a record
+            name = getStr(catalogFile);
+        } else {
+            name = doc[i]["name"].as<String>();
+        }
+        name.toLowerCase();
+        if (name.indexOf(needle) >= 0) catalogMatches.push_back(i);
+    }
+    return catalogSize();
+}
+
+/***************************************************************************************
+** Function name: saveCatalogCache
+** Description:   Writes the filtered catalog and its validators to the SD card
+***************************************************************************************/
+bool saveCatalogCache(JsonDocument &catalog, const String &etag, const String &lastModified) {
+    JsonArray items = catalog.as<JsonArray>();
+    if (items.size() == 0 || items.size() > UINT16_MAX || !setupSdCard()) return false;
+
+    String tmpPath = String(CATALOG_FILE) + ".tmp";
+    File file = SDM.open(tmpPath, FILE_WRITE);
+    if (!file) return false;
+
+    std::vector<uint32_t> offsets;
+    offsets.reserve(items.size());
+    file.write((const uint8_t *)CATALOG_MAGIC, 4);
+    putU16(file, CATALOG_VERSION);
+    putU16(file, items.size());
+    putU32(file, 0); // index offset, patched below
+    putStr(file, etag.c_str());
+    putStr(file, lastModified.c_str());
+
+    for (JsonObject item : items) {
+        offsets.push_back(file.position());
+        putStr(file, item["name"].as<const char *>());
+        putStr(file, item["author"].as<const char *>());
+        JsonArray versions = item["versions"];
+        putU16(file, versions.size());
+        for (JsonObject version : versions) {
+            putStr(file, version["version"].as<const char *>());
+            putStr(file, version["published_at"].as<const char *>());
+            putStr(file, version["file"].as<const char *>());
+            file.write(
+                (uint8_t)(version["s"].as<bool>() | version["nb"].as<bool>() << 1 |
+                          version["f"].as<bool>() << 2 | version["f2"].as<bool>() << 3)
+            );
+            for (const char *key : {"as", "so", "ss", "fo", "fs", "fo2", "fs2"})
+                putU32(file, version[key].as<uint32_t>());
+        }
+    }
+
+    uint32_t indexOffset = file.position();
+    for (uint32_t offset : offsets) putU32(file, offset);
+    bool ok = file.seek(CATALOG_HEADER_SIZE - sizeof(uint32_t));
+    putU32(file, indexOffset);
+    file.close();
+
+    // swap it in only when complete, a half written cache is never read
+    if (ok) {
+        SDM.remove(CATALOG_FILE);
+        ok = SDM.rename(tmpPath, CATALOG_FILE);
+    }
+    if (!ok) SDM.remove(tmpPath);
+    log_i("Catalog> %d entries cached: %s", offsets.size(), ok ? "ok" : "failed");
+    return ok;
+}
@@ -0,0 +1,47 @@
+#ifndef __CATALOG_H
+#define __CATALOG_H
+
+#include <ArduinoJson.h>
+#include <FS.h>
+
+#ifndef CATALOG_FILE
+#define CATALOG_FILE "/catalog.bin"
+#endif
+
+#ifndef CATALOG_LRU
+#define CATALOG_LRU 4 // decoded firmware entries kept around the browser cursor
+#endif
+
+/*
+catalog.bin structure, little endian, also written by support_files/catalog_bin.py
+
+   "LCAT"  u16 version  u16 count  u32 indexOffset
+   str etag  str lastModified
+   record[count]
+   u32 recordOffset[count]                 <- indexOffset
+
+   record:  str name  str author  u16 versions  version[versions]
+   version: str version  str published_at  str file
+            u8 flags (s | nb << 1 | f << 2 | f2 << 3)
+            u32 as  u32 so  u32 ss  u32 fo  u32 fs  u32 fo2  u32 fs2
+   str:     u16 length, then the bytes without terminator
+*/
+
+bool readCatalogValidators(String &etag, String &lastModified);
+
+bool saveCatalogCache(JsonDocument &catalog, const String &etag, const String &lastModified);
+
+// Browses catalog.bin when it can be opened, the global doc otherwise
+bool openCatalogIndex();
+
+void closeCatalogIndex();
+
+int catalogSize();
+
+// Valid until CATALOG_LRU other entries have been fetched
+JsonObject catalogEntry(int position);
+
+// Case insensitive name filter, an empty text shows everything again. Returns catalogSize()
+int filterCatalog(const String &text);
+
+#endif
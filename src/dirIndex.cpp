@@ -0,0 +1,209 @@
+#include "dirIndex.h"
+#include "sd_functions.h"
+#include <algorithm>
+#include <globals.h>
+
+/***************************************************************************************
+** Function name: sortKey
+** Description:   4 characters from name upper-cased and packed, compares like the names
+***************************************************************************************/
+static uint32_t sortKey(const char *&name) {
+    uint32_t key = 0;
+    for (int i = 0; i < 4; i++) {
+        key <<= 8;
+        if (*name) key |= (uint8_t)toupper((uint8_t)*name++);
+    }
+    return key;
+}
+
+static int compareUpper(const char *a, const char *b) {
+    while (*a && toupper((uint8_t)*a) == toupper((uint8_t)*b)) {
+        a++;
+        b++;
+    }
+    return toupper((uint8_t)*a) - toupper((uint8_t)*b);
+}
+
+bool DirIndex::sameKey(const Entry &a, const Entry &b) {
+    return a.folder == b.folder && a.key == b.key && a.key2 == b.key2;
+}
+
+/***************************************************************************************
+** Function name: DirIndex::load
+** Description:   Lists folder in a single pass and sorts it, without keeping the names
+***************************************************************************************/
+bool DirIndex::load(const String &folder, bool onlyBins) {
+    clear();
+    _folder = folder;
+    _onlyBins = onlyBins;
+
+    File root = SDM.open(folder);
+    if (!root || !root.isDirectory()) return false;
+
+    // getNextFileName only reads the directory entry, openNextFile would open every file
+    bool isDir = false;
+    uint32_t pos = 0;
+    for (String fileName = root.getNextFileName(&isDir); fileName.length() > 0 && pos <= UINT16_MAX;
+         fileName = root.getNextFileName(&isDir), pos++) {
+        const char *name = fileName.c_str() + fileName.lastIndexOf('/') + 1;
+        if (!isDir && onlyBins) {
+            const char *ext = strrchr(name, '.');
+            if (ext && !strcasecmp(ext, ".gz") && ext - name >= 4) ext -= 4; // .bin.gz
+            if (!ext || (strcasecmp(ext, ".bin") && strcasecmp(ext, ".bin.gz"))) continue;
+        }
+        Entry entry;
+        entry.key = sortKey(name);
+        entry.key2 = sortKey(name);
+        entry.pos = pos;
+        entry.folder = isDir;
+        entry.tied = false;
+        _entries.push_back(entry);
+    }
+    root.close();
+
+    std::sort(_entries.begin(), _entries.end(), [](const Entry &a, const Entry &b) {
+        if (a.folder != b.folder) return a.folder;
+        if (a.key != b.key) return a.key < b.key;
+        if (a.key2 != b.key2) return a.key2 < b.key2;
+        return a.pos < b.pos;
+    });
+    sortTies();
+    _entries.shrink_to_fit();
+    return true;
+}
+
+/***************************************************************************************
+** Function name: DirIndex::sortTies
+** Description:   Orders entries sharing their first 8 chars, reading only those names
+***************************************************************************************/
+void DirIndex::sortTies() {
+    std::vector<uint16_t> positions;
+    for (size_t i = 1; i < _entries.size(); i++) {
+        // a key ending in 0 holds the whole name, so equal keys are equal names
+        if (!sameKey(_entries[i - 1], _entries[i]) || (_entries[i].key2 & 0xFF) == 0) continue;
+        if (!_entries[i - 1].tied) positions.push_back(_entries[i - 1].pos);
+        positions.push_back(_entries[i].pos);
+        _entries[i - 1].tied = true;
+        _entries[i].tied = true;
+    }
+    if (positions.empty()) return;
+
+    std::sort(positions.begin(), positions.end());
+    std::vector<String> names(positions.size());
+    if (!readNames(positions, names.data())) return; // leave ties in directory order
+
+    auto nameOf = [&](const Entry &e) {
+        return names[std::lower_bound(positions.begin(), positions.end(), e.pos) - positions.begin()].c_str();
+    };
+    for (size_t i = 0; i < _entries.size();) {
+        size_t end = i + 1;
+        while (end < _entries.size() && _entries[end].tied && sameKey(_entries[i], _entries[end])) end++;
+        if (end - i > 1) {
+            std::sort(_entries.begin() + i, _entries.begin() + end, [&](const Entry &a, const Entry &b) {
+                return compareUpper(nameOf(a), nameOf(b)) < 0;
+            });
+        }
+        i = end;
+    }
+}
+
+/***************************************************************************************
+** Function name: DirIndex::readNames
+** Description:   Reads the names at the ascending directory positions in one pass
+***************************************************************************************/
+bool DirIndex::readNames(const std::vector<uint16_t> &positions, String *names) {
+    File root = SDM.open(_folder);
+    if (!root || !root.isDirectory()) return false;
+
+    size_t k = 0;
+    uint32_t pos = positions[0];
+    root.seekDir(pos);
+    while (k < positions.size()) {
+        String fileName = root.getNextFileName();
+        if (fileName.length() == 0) break;
+        if (pos++ == positions[k]) names[k++] = fileName.substring(fileName.lastIndexOf('/') + 1);
+    }
+    root.close();
+    return k == positions.size();
+}
+
+/***************************************************************************************
+** Function name: DirIndex::loadWindow
+** Description:   Decodes the DIR_WINDOW names around entry i
+***************************************************************************************/
+void DirIndex::loadWindow(size_t i) {
+    size_t start = i > DIR_WINDOW / 2 ? i - DIR_WINDOW / 2 : 0;
+    if (start + DIR_WINDOW > _entries.size())
+        start = _entries.size() > DIR_WINDOW ? _entries.size() - DIR_WINDOW : 0;
+    size_t count = std::min((size_t)DIR_WINDOW, _entries.size() - start);
+    _windowSize = 0;
+
+    // the window is in sorted order, the card is read in directory order
+    uint16_t slot[DIR_WINDOW];
+    for (size_t k = 0; k < count; k++) slot[k] = k;
+    std::sort(slot, slot + count, [&](uint16_t a, uint16_t b) {
+        return _entries[start + a].pos < _entries[start + b].pos;
+    });
+    std::vector<uint16_t> positions(count);
+    for (size_t k = 0; k < count; k++) positions[k] = _entries[start + slot[k]].pos;
+
+    String names[DIR_WINDOW];
+    if (count == 0 || !readNames(positions, names)) return;
+    for (size_t k = 0; k < count; k++) _window[slot[k]] = std::move(names[k]);
+    _windowStart = start;
+    _windowSize = count;
+}
+
+void DirIndex::clear() {
+    _folder = "";
+    _entries.clear();
+    _entries.shrink_to_fit();
+    for (int i = 0; i < DIR_WINDOW; i++) _window[i] = "";
+    _windowStart = 0;
+    _windowSize = 0;
+}
+
+String DirIndex::name(size_t i) {
+    if (i < _windowStart || i >= _windowStart + _windowSize) loadWindow(i);
+    if (i < _windowStart || i >= _windowStart + _windowSize) return "";
+    return _window[i - _windowStart];
+}
+
+String DirIndex::path(size_t i) {
+    String path = _folder;
+    if (!path.endsWith("/")) path += "/";
+    return path + name(i);
+}
+
+/***************************************************************************************
+** Directory index cache
+** Description:   The last DIR_INDEX_SLOTS folders listed, least recently used goes first
+***************************************************************************************/
+static DirIndex dirSlots[DIR_INDEX_SLOTS];
+static uint32_t dirUsed[DIR_INDEX_SLOTS] = {0};
+static uint32_t dirTick = 0;
+
+DirIndex *indexFolder(const String &folder, bool onlyBins) {
+    int slot = 0;
+    for (int i = 0; i < DIR_INDEX_SLOTS; i++) {
+        if (dirUsed[i] && dirSlots[i].folder() == folder && dirSlots[i].binsOnly() == onlyBins) {
+            dirUsed[i] = ++dirTick;
+            return &dirSlots[i];
+        }
+        if (dirUsed[i] < dirUsed[slot]) slot = i;
+    }
+    dirUsed[slot] = 0;
+    if (!dirSlots[slot].load(folder, onlyBins)) {
+        dirSlots[slot].clear();
+        return nullptr;
+    }
+    dirUsed[slot] = ++dirTick;
+    return &dirSlots[slot];
+}
+
+void invalidateDirIndex() {
+    for (int i = 0; i < DIR_INDEX_SLOTS; i++) {
+        dirSlots[i].clear();
+        dirUsed[i] = 0;
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef __DIR_INDEX_H
+#define __DIR_INDEX_H
+
+#include <Arduino.h>
+#include <vector>
+
+#ifndef DIR_INDEX_SLOTS
+#ifdef BOARD_HAS_PSRAM
+#define DIR_INDEX_SLOTS 8 // folders kept indexed, so going back to one is instant
+#else
+#define DIR_INDEX_SLOTS 2
+#endif
+#endif
+
+#ifndef DIR_WINDOW
+#define DIR_WINDOW 32 // names kept decoded around the cursor, more than a screen on any board
+#endif
+
+// One directory listing, folders first, then files, each group sorted case insensitively.
+// Only sort keys and directory positions are indexed (12 bytes per entry), names are read
+// back from the card DIR_WINDOW at a time, so big folders cost no more than a screen of Strings
+class DirIndex {
+public:
+    bool load(const String &folder, bool onlyBins);
+    void clear();
+
+    size_t size() const { return _entries.size(); }
+    const String &folder() const { return _folder; }
+    bool binsOnly() const { return _onlyBins; }
+    bool isFolder(size_t i) const { return _entries[i].folder; }
+    String name(size_t i);
+    String path(size_t i);
+
+private:
+    struct Entry {
+        uint32_t key;  // first 8 upper-cased chars, settles most comparisons
+        uint32_t key2;
+        uint16_t pos;  // position in the directory, for seekDir
+        bool folder;
+        bool tied;     // same key as a neighbour, needs the full name to sort
+    };
+    static bool sameKey(const Entry &a, const Entry &b);
+    void sortTies();
+    bool readNames(const std::vector<uint16_t> &positions, String *names);
+    void loadWindow(size_t i);
+
+    String _folder;
+    bool _onlyBins = false;
+    std::vector<Entry> _entries;
+    String _window[DIR_WINDOW];
+    size_t _windowStart = 0;
+    size_t _windowSize = 0;
+};
+
+// Cached listing of folder, read from the card only when not indexed yet
+DirIndex *indexFolder(const String &folder, bool onlyBins);
+
+// Forget every cached listing, call after anything changes the card contents
+void invalidateDirIndex();
+
+#endif
@@ -1,4 +1,6 @@
 #include "display.h"
+#include "catalog.h"
+#include "dirIndex.h"
 #include "mykeyboard.h"
 #include "onlineLauncher.h"
 #include "sd_functions.h"
@@ -255,11 +257,11 @@ void initDisplayLoop() {
 ** Function name: displayCurrentItem
 ** Description:   Display Item on Screen before instalation
 ***************************************************************************************/
-void displayCurrentItem(JsonDocument doc, int currentIndex) {
+void displayCurrentItem(int currentIndex) {
 #ifdef E_PAPER_DISPLAY
     tft->stopCallback();
 #endif
-    JsonObject item = doc[currentIndex];
+    JsonObject item = catalogEntry(currentIndex);
 
     const char *name = item["name"];
     const char *author = item["author"];
@@ -293,12 +295,12 @@ void displayCurrentItem(JsonDocument doc, int currentIndex) {
     tft->setTextColor(FGCOLOR);
     tft->drawCentreString(texto, tftWidth / 2, tftHeight - (10 + FM * 9), 1);
 
-    texto = String(currentIndex + 1) + " of " + String(doc.size());
+    texto = String(currentIndex + 1) + " of " + String(catalogSize());
     tft->drawCentreString(texto, tftWidth / 2, tftHeight - (2 + FM * 9), 1);
     tft->drawRoundRect(tftWidth / 2 - (6 * 11), tftHeight - (10 + FM * 10), 12 * 11, 19, 3, FGCOLOR);
 #else
 
-    String texto = String(currentIndex + 1) + " of " + String(doc.size());
+    String texto = String(currentIndex + 1) + " of " + String(catalogSize());
     setTftDisplay(int(tftWidth / 2 - 3 * texto.length()), tftHeight - (10 + FM * 6), FGCOLOR, FP, BGCOLOR);
     tft->println(texto);
 #endif
@@ -306,7 +308,7 @@ void displayCurrentItem(JsonDocument doc, int currentIndex) {
 #if defined(HAS_TOUCH)
     TouchFooter();
 #endif
-    int docsize = doc.size();
+    int docsize = catalogSize();
     if (docsize == 0) docsize = 1; // avoid division by zero
     int bar = int(tftWidth / (docsize));
     if (bar < 5) bar = 5;
@@ -421,9 +423,12 @@ void displayRedStripe(String text, uint16_t fgcolor, uint16_t bgcolor) {
 /***************************************************************************************
 ** Function name: progressHandler
 ** Description:   Função para manipular o progresso da atualização
-** Dependencia: prog_handler =>>    0 - Flash, 1 - SPIFFS
+** Dependencia: prog_handler =>>    0 - Flash, 1 - SPIFFS, 2 - Download, 3 - Copy, 4 - Delete, 5 - Extract
 ***************************************************************************************/
-void progressHandler(int progress, size_t total) {
+void (*progressListener)(int progress, size_t total) = nullptr;
+
+void progressHandler(int progress, size_t total, size_t skipped) {
+    if (progressListener) progressListener(progress, total);
 #ifdef GxEPD2_DISPLAY
     static unsigned long lastUpdate = 0;
     tft->setFullWindow();
@@ -449,6 +454,9 @@ void progressHandler(int progress, size_t total) {
             case 0: txt = "Installing FW"; break;
             case 1: txt = "Installing SPIFFS"; break;
             case 2: txt = "Downloading"; break;
+            case 3: txt = "Copying"; break;
+            case 4: txt = "Deleting"; break;
+            case 5: txt = "Extracting"; break;
         }
         displayRedStripe(txt);
     }
@@ -456,6 +464,18 @@ void progressHandler(int progress, size_t total) {
     if (prog_handler == 1) tft->fillRect(20, tftHeight - 26, barWidth, 13, ALCOLOR);
     else tft->fillRect(20, tftHeight - 45, barWidth, 13, FGCOLOR);
 
+    // Delta flash: tell how many sectors were left untouched
+    static size_t lastSkipped = 0;
+    if (progress == 0) lastSkipped = 0;
+    if (skipped != lastSkipped) {
+        lastSkipped = skipped;
+        tft->setTextSize(FP);
+        tft->setTextColor(FGCOLOR, BGCOLOR);
+        tft->drawCentreString(
+            String(lastSkipped) + " sectors unchanged", tftWidth / 2, tftHeight / 2 + 16, 1
+        );
+    }
+
 #ifdef GxEPD2_DISPLAY
     if (millis() - lastUpdate > 3000) {
         tft->display();
@@ -754,7 +774,7 @@ void drawBatteryStatus(uint8_t bat) {
 #else
 #define MAX_ITEMS (int)((tftHeight - 20) / (LH * FM))
 #endif
-Opt_Coord listFiles(int index, String fileList[][3], std::vector<MenuOptions> &opt) {
+Opt_Coord listFiles(int index, DirIndex *dir, std::vector<MenuOptions> &opt) {
 
 #ifdef E_PAPER_DISPLAY
     tft->stopCallback();
@@ -764,8 +784,8 @@ Opt_Coord listFiles(int index, String fileList[][3], std::vector<MenuOptions> &o
     tft->setCursor(10, 10);
     tft->setTextSize(FM);
     int i = 0;
-    int arraySize = 0;
-    while (fileList[arraySize][2] != "" && arraySize < MAXFILES) arraySize++;
+    int dirSize = dir ? dir->size() : 0;
+    int arraySize = dirSize + 1; // entries and "> Back"
 
     int num_pages = 0;
     static int show_page = 0;
@@ -834,51 +854,52 @@ Opt_Coord listFiles(int index, String fileList[][3], std::vector<MenuOptions> &o
     }
 #endif
 
+    i = start; // only the page on screen is decoded, from the index window
     while (i < arraySize) {
-        if (i >= start && fileList[i][2] != "") {
-            uint16_t c_y = tft->getCursorY();
-            int first_offset = 0;
-            tft->setCursor(10, c_y);
+        bool back = i >= dirSize;
+        bool folder = !back && dir->isFolder(i);
+        uint16_t c_y = tft->getCursorY();
+        int first_offset = 0;
+        tft->setCursor(10, c_y);
 
 #ifdef HAS_TOUCH
-            if (start == i) {
-                first_offset = 10 + 5 * LW * FM; // [ESC]
-                tft->setTextColor(ALCOLOR, BGCOLOR);
-                tft->print("[ESC]");
-            }
+        if (start == i) {
+            first_offset = 10 + 5 * LW * FM; // [ESC]
+            tft->setTextColor(ALCOLOR, BGCOLOR);
+            tft->print("[ESC]");
+        }
 #endif
-            MenuOptions optItem =
-                MenuOptions(String(i), "", nullptr, true, false, 0 + first_offset, c_y, tftWidth, FM * LH);
-            if (fileList[i][2] == "folder") tft->setTextColor(FGCOLOR - 0x1111, BGCOLOR);
-            else if (fileList[i][2] == "operator") tft->setTextColor(ALCOLOR, BGCOLOR);
-            else { tft->setTextColor(FGCOLOR, BGCOLOR); }
-
-            if (index == i) {
-                optItem.selected = true;
-                txt = ">";
+        MenuOptions optItem =
+            MenuOptions(String(i), "", nullptr, true, false, 0 + first_offset, c_y, tftWidth, FM * LH);
+        if (folder) tft->setTextColor(FGCOLOR - 0x1111, BGCOLOR);
+        else if (back) tft->setTextColor(ALCOLOR, BGCOLOR);
+        else { tft->setTextColor(FGCOLOR, BGCOLOR); }
+
+        if (index == i) {
+            optItem.selected = true;
+            txt = ">";
 #ifdef HAS_TOUCH
-                coord.x = 10 + FM * LW + (start == i ? 4 * FM * LW : 0);
-                coord.size = nchars - (start == i ? 4 : 0);
+            coord.x = 10 + FM * LW + (start == i ? 4 * FM * LW : 0);
+            coord.size = nchars - (start == i ? 4 : 0);
 #else
-                coord.x = 10 + FM * LW;
-                coord.size = nchars;
+            coord.x = 10 + FM * LW;
+            coord.size = nchars;
 #endif
-                coord.y = c_y;
+            coord.y = c_y;
 
-                coord.fgcolor = fileList[i][2] == "folder" ? FGCOLOR - 0x1111 : FGCOLOR;
-                coord.bgcolor = BGCOLOR;
-            } else txt = " ";
-            txt += fileList[i][0] + "                       ";
+            coord.fgcolor = folder ? FGCOLOR - 0x1111 : FGCOLOR;
+            coord.bgcolor = BGCOLOR;
+        } else txt = " ";
+        txt += (back ? String("> Back") : dir->name(i)) + "                       ";
 #ifdef HAS_TOUCH
-            tft->println(txt.substring(0, nchars - (start == i ? 6 : 0)));
+        tft->println(txt.substring(0, nchars - (start == i ? 6 : 0)));
 #else
-            tft->println(txt.substring(0, nchars));
+        tft->println(txt.substring(0, nchars));
 #endif
-            opt.push_back(optItem);
-            j++;
-        }
+        opt.push_back(optItem);
+        j++;
         i++;
-        if (i == (start + Max_items) || fileList[i][2] == "") break;
+        if (i == (start + Max_items)) break;
     }
 #ifdef HAS_TOUCH
     if (num_pages != show_page + 1) {
@@ -921,7 +942,7 @@ void loopOptions(const std::vector<std::pair<String, std::function<void()>>> &op
             list = {};
             coord = drawOptions(index, options, list, ALCOLOR, BGCOLOR);
             max_idx = 0;
-            min_idx = MAXFILES;
+            min_idx = options.size();
             int tmp = 0;
             for (auto item : list) {
                 if (item.name != "") {
@@ -1032,7 +1053,7 @@ void loopOptions(const std::vector<std::pair<String, std::function<void()>>> &op
 **  Where you choose which version to install/download **
 **********************************************************************/
 void loopVersions() {
-    JsonObject item = doc[currentIndex];
+    JsonObject item = catalogEntry(currentIndex);
 
     int versionIndex = 0;
     const char *name = item["name"];
@@ -1040,38 +1061,46 @@ void loopVersions() {
     JsonArray versions = item["versions"];
     bool redraw = true;
 
+    // Selected version, only looked up again when versionIndex changes
+    const char *version = nullptr;
+    const char *published_at = nullptr;
+    const char *file = nullptr;
+    bool spiffs = false;
+    bool fat = false;
+    bool nb = false;
+    uint32_t app_size = 0;
+    uint32_t spiffs_size = 0;
+    uint32_t spiffs_offset = 0;
+    uint32_t FAT_size[2] = {
+        0,
+        0,
+    };
+    uint32_t FAT_offset[2] = {
+        0,
+        0,
+    };
+
     LongPressTmp = millis();
     while (1) {
         if (returnToMenu) break; // Stops the loop to get back to Main menu
 
-        JsonObject Version = versions[versionIndex];
-        const char *version = Version["version"];
-        const char *published_at = Version["published_at"];
-        const char *file = Version["file"];
-        bool spiffs = Version["s"].as<bool>();
-        bool fat = Version["f"].as<bool>();
-        bool fat2 = Version["f2"].as<bool>();
-        bool nb = Version["nb"].as<bool>();
-        uint32_t app_size = Version["as"].as<uint32_t>();
-        uint32_t spiffs_size = Version["ss"].as<uint32_t>();
-        uint32_t spiffs_offset = Version["so"].as<uint32_t>();
-        uint32_t FAT_size[2] = {
-            0,
-            0,
-        };
-        uint32_t FAT_offset[2] = {
-            0,
-            0,
-        };
-        if (fat) {
-            FAT_size[0] = Version["fs"].as<uint32_t>();
-            FAT_offset[0] = Version["fo"].as<uint32_t>();
-        }
-        if (fat2) {
-            FAT_size[1] = Version["fs2"].as<uint32_t>();
-            FAT_offset[1] = Version["fo2"].as<uint32_t>();
-        }
         if (redraw) {
+            JsonObject Version = versions[versionIndex];
+            version = Version["version"];
+            published_at = Version["published_at"];
+            file = Version["file"];
+            spiffs = Version["s"].as<bool>();
+            fat = Version["f"].as<bool>();
+            bool fat2 = Version["f2"].as<bool>();
+            nb = Version["nb"].as<bool>();
+            app_size = Version["as"].as<uint32_t>();
+            spiffs_size = Version["ss"].as<uint32_t>();
+            spiffs_offset = Version["so"].as<uint32_t>();
+            FAT_size[0] = fat ? Version["fs"].as<uint32_t>() : 0;
+            FAT_offset[0] = fat ? Version["fo"].as<uint32_t>() : 0;
+            FAT_size[1] = fat2 ? Version["fs2"].as<uint32_t>() : 0;
+            FAT_offset[1] = fat2 ? Version["fo2"].as<uint32_t>() : 0;
+
             displayCurrentVersion(
                 String(name), String(author), String(version), String(published_at), versionIndex, versions
             );
@@ -1180,7 +1209,22 @@ Sucesso:
 
 // quando sair, redesenhar a tela
 SAIR:
-    if (!returnToMenu) displayCurrentItem(doc, currentIndex);
+    if (!returnToMenu) displayCurrentItem(currentIndex);
+}
+
+/*********************************************************************
+**  Function: searchFirmware
+**  Filters the firmware list by name, an empty text shows all again
+**********************************************************************/
+void searchFirmware() {
+    String text = keyboard("", 32, "Search firmware:");
+    if (filterCatalog(text) == 0) {
+        displayRedStripe("Nothing found");
+        delay(1500);
+        filterCatalog("");
+    }
+    currentIndex = 0;
+    displayCurrentItem(currentIndex);
 }
 
 /*********************************************************************
@@ -1190,15 +1234,15 @@ SAIR:
 void loopFirmware() {
     LongPressTmp = millis();
     currentIndex = 0;
-    displayCurrentItem(doc, currentIndex);
+    displayCurrentItem(currentIndex);
 
     while (1) {
         if (WiFi.status() == WL_CONNECTED) {
             /* UP Btn go to previous item */
             if (check(PrevPress)) {
-                if (currentIndex == 0) currentIndex = doc.size() - 1;
+                if (currentIndex == 0) currentIndex = catalogSize() - 1;
                 else if (currentIndex > 0) currentIndex--;
-                displayCurrentItem(doc, currentIndex);
+                displayCurrentItem(currentIndex);
 #ifdef E_PAPER_DISPLAY
                 tft->display(false);
                 delay(200);
@@ -1207,8 +1251,8 @@ void loopFirmware() {
             /* DW Btn to next item */
             if (check(NextPress)) {
                 currentIndex++;
-                if ((currentIndex + 1) > doc.size()) currentIndex = 0;
-                displayCurrentItem(doc, currentIndex);
+                if ((currentIndex + 1) > catalogSize()) currentIndex = 0;
+                displayCurrentItem(currentIndex);
 #ifdef E_PAPER_DISPLAY
                 tft->display(false);
                 delay(200);
@@ -1217,12 +1261,19 @@ void loopFirmware() {
 
 // Checks for long press to get back to Main Menu, only for StickCs.. Cardputer uses Esc btn
 #if defined(T_EMBED) || defined(HAS_TOUCH) || defined(HAS_KEYBOARD)
-            /* Select to install */
+            /* Select for the versions or the search, Cardputer, T-Deck and T-Embed have no Up button */
             if (check(SelPress)) {
-                loopVersions();
+                options = {
+                    {"View version", [=]() { loopVersions(); }  },
+                    {"Search",       [=]() { searchFirmware(); }},
+                };
+                loopOptions(options);
+                displayCurrentItem(currentIndex);
                 delay(200);
                 returnToMenu = false;
             }
+            /* UP Btn, on the boards having one, searches straight away */
+            if (check(UpPress)) searchFirmware();
 #else
             if (LongPress || SelPress) {
                 if (!LongPress) {
@@ -1234,8 +1285,9 @@ void loopFirmware() {
                 if (check(SelPress)) {
                     bool exit = false;
                     options = {
-                        {"View version", [=]() { loopVersions(); }},
-                        {"Main Menu",    [&]() { exit = true; }   }
+                        {"View version", [=]() { loopVersions(); }  },
+                        {"Search",       [=]() { searchFirmware(); }},
+                        {"Main Menu",    [&]() { exit = true; }     }
                     };
                     loopOptions(options);
                     returnToMenu = false;
@@ -1243,12 +1295,12 @@ void loopFirmware() {
                         returnToMenu = true;
                         goto END;
                     }
-                    displayCurrentItem(doc, currentIndex);
+                    displayCurrentItem(currentIndex);
                     delay(200);
                 } else {
                     check(SelPress);
                     loopVersions(); // goes to the Version information
-                    displayCurrentItem(doc, currentIndex);
+                    displayCurrentItem(currentIndex);
                     delay(200);
                     returnToMenu = false;
                 }
@@ -1271,6 +1323,7 @@ void loopFirmware() {
 END:
     WiFi.disconnect(true, true);
     WiFi.mode(WIFI_OFF);
+    closeCatalogIndex();
     doc.clear();
 }
 
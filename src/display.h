@@ -22,6 +22,7 @@ extern Ard_eSPI *tft;
 
 void loopOptions(const std::vector<std::pair<String, std::function<void()>>> &options, bool bright = false);
 void loopVersions();
+void searchFirmware();
 void loopFirmware();
 void initDisplay(bool doAll = false); // Início da função e mostra bootscreen
 void initDisplayLoop();
@@ -36,7 +37,7 @@ void setTftDisplay(
     uint16_t bg = tft->getTextbgcolor()
 );
 
-void displayCurrentItem(JsonDocument doc, int currentIndex);
+void displayCurrentItem(int currentIndex);
 void displayCurrentVersion(
     String name, String author, String version, String published_at, int versionIndex, JsonArray versions
 );
@@ -45,7 +46,10 @@ void displayRedStripe(
     String text, uint16_t fgcolor = getComplementaryColor(BGCOLOR), uint16_t bgcolor = ALCOLOR
 );
 
-void progressHandler(int progress, size_t total);
+// skipped: sectors the UpdateClass delta flash left untouched, told through its progress callback
+void progressHandler(int progress, size_t total, size_t skipped = 0);
+// Told about every progressHandler() step as well, e.g. to mirror it to the WebUI
+extern void (*progressListener)(int progress, size_t total);
 
 struct Opt_Coord {
     uint16_t x = 0;
@@ -70,7 +74,8 @@ void drawBatteryStatus(uint8_t bat);
 void drawMainMenu(std::vector<MenuOptions> &opt, int index);
 // void drawMainMenu(int index = 0);
 
-Opt_Coord listFiles(int index, String fileList[][3], std::vector<MenuOptions> &opt);
+class DirIndex;
+Opt_Coord listFiles(int index, DirIndex *dir, std::vector<MenuOptions> &opt);
 
 void TouchFooter(uint16_t color = FGCOLOR);
 
@@ -0,0 +1,181 @@
+#include "fileOps.h"
+#include "dirIndex.h"
+#include "display.h"
+#include <MemUtils.h>
+#include <globals.h>
+#include <vector>
+
+static volatile bool cancelled = false;
+
+struct FileOp {
+    uint8_t *buffer;
+    uint64_t done;
+    uint64_t total;
+    uint32_t scale; // progressHandler() takes an int
+};
+
+static String baseName(const String &path) { return path.substring(path.lastIndexOf('/') + 1); }
+
+static String childPath(const String &folder, const String &name) {
+    return (folder == "/" ? "" : folder) + "/" + name;
+}
+
+void beginFileOp() { cancelled = false; }
+
+bool fileOpCancelled() {
+    if (check(EscPress)) cancelled = true;
+    return cancelled;
+}
+
+struct OpEntry {
+    String path;
+    bool folder;
+};
+
+// Folder entries, read before recursing so no directory stays open meanwhile
+static std::vector<OpEntry> listChildren(const String &folder) {
+    std::vector<OpEntry> children;
+    File root = SDM.open(folder);
+    if (!root) return children;
+    bool isDir = false;
+    for (String name = root.getNextFileName(&isDir); name.length() > 0; name = root.getNextFileName(&isDir))
+        children.push_back({name, isDir});
+    root.close();
+    return children;
+}
+
+// Number of entries under a folder, plus the bytes in its files when bytes is given
+static void measure(const OpEntry &entry, uint64_t *bytes, uint32_t &entries) {
+    entries++;
+    if (!entry.folder) {
+        if (bytes) {
+            File file = SDM.open(entry.path);
+            if (file) *bytes += file.size();
+        }
+        return;
+    }
+    for (const OpEntry &child : listChildren(entry.path)) measure(child, bytes, entries);
+}
+
+static bool findEntry(const String &path, OpEntry &entry) {
+    File file = SDM.open(path);
+    if (!file) return false;
+    entry = {path, file.isDirectory()};
+    return true;
+}
+
+static void report(FileOp &op) { progressHandler(op.done / op.scale, op.total / op.scale); }
+
+static void start(FileOp &op, int handler, uint64_t total) {
+    beginFileOp();
+    op.done = 0;
+    op.total = total ? total : 1;
+    op.scale = op.total > INT32_MAX ? 1024 : 1;
+    prog_handler = handler;
+    progressHandler(0, 500);
+}
+
+static bool copyInto(FileOp &op, const OpEntry &source, const String &target) {
+    if (source.folder) {
+        if (!SDM.exists(target) && !SDM.mkdir(target)) return false;
+        bool ok = true;
+        for (const OpEntry &child : listChildren(source.path)) {
+            ok &= copyInto(op, child, target + "/" + baseName(child.path));
+            if (cancelled) return false;
+        }
+        return ok;
+    }
+
+    File src = SDM.open(source.path, FILE_READ);
+    if (!src) return false;
+    File dst = SDM.open(target, FILE_WRITE);
+    if (!dst) return false;
+    bool ok = true;
+    size_t bytesRead;
+    while ((bytesRead = src.read(op.buffer, FILE_OPS_BUFFER)) > 0) {
+        if (dst.write(op.buffer, bytesRead) != bytesRead || fileOpCancelled()) {
+            ok = false;
+            break;
+        }
+        op.done += bytesRead;
+        report(op);
+    }
+    src.close();
+    dst.close();
+    if (!ok) SDM.remove(target);
+    return ok;
+}
+
+static bool deleteEntry(FileOp &op, const OpEntry &entry) {
+    bool ok = true;
+    if (entry.folder) {
+        for (const OpEntry &child : listChildren(entry.path)) {
+            ok &= deleteEntry(op, child);
+            if (cancelled) return false;
+        }
+        ok &= SDM.rmdir(entry.path);
+    } else {
+        ok &= SDM.remove(entry.path);
+    }
+    op.done++;
+    report(op);
+    if (fileOpCancelled()) return false;
+    return ok;
+}
+
+/***************************************************************************************
+** Function name: copyPath
+** Description:   copy a file or a whole folder into folder
+***************************************************************************************/
+bool copyPath(const String &source, const String &folder) {
+    String target = childPath(folder, baseName(source));
+    OpEntry entry;
+    // into itself or over itself
+    if (target == source || target.startsWith(source + "/") || !findEntry(source, entry)) return false;
+
+    FileOp op;
+    op.buffer = (uint8_t *)largeAlloc(FILE_OPS_BUFFER);
+    if (!op.buffer) return false;
+    uint64_t bytes = 0;
+    uint32_t entries = 0;
+    measure(entry, &bytes, entries);
+    start(op, 3, bytes);
+    invalidateDirIndex();
+    bool ok = copyInto(op, entry, target);
+    free(op.buffer);
+    invalidateDirIndex();
+    return ok;
+}
+
+/***************************************************************************************
+** Function name: movePath
+** Description:   move a file or a whole folder into folder
+***************************************************************************************/
+bool movePath(const String &source, const String &folder) {
+    String target = childPath(folder, baseName(source));
+    if (target == source || target.startsWith(source + "/")) return false;
+    invalidateDirIndex();
+    if (SDM.rename(source, target)) return true;
+    if (SDM.exists(target)) return false; // rename doesn't replace
+    return copyPath(source, folder) && deletePath(source);
+}
+
+/***************************************************************************************
+** Function name: deletePath
+** Description:   delete a file or a folder with everything in it
+***************************************************************************************/
+bool deletePath(const String &path) {
+    OpEntry entry;
+    if (!findEntry(path, entry)) return false;
+    FileOp op;
+    uint32_t entries = 0;
+    measure(entry, nullptr, entries);
+    op.buffer = nullptr;
+    start(op, 4, entries);
+    invalidateDirIndex();
+    bool ok = deleteEntry(op, entry);
+    invalidateDirIndex();
+    return ok;
+}
+
+void cancelFileOp() { cancelled = true; }
@@ -0,0 +1,29 @@
+#ifndef __FILE_OPS_H
+#define __FILE_OPS_H
+
+#include <Arduino.h>
+
+#ifndef FILE_OPS_BUFFER
+#ifdef BOARD_HAS_PSRAM
+#define FILE_OPS_BUFFER (32 * 1024) // bytes read and written at once while copying
+#else
+#define FILE_OPS_BUFFER (8 * 1024)
+#endif
+#endif
+
+// Recursive SD card operations on files and folders. Progress goes through progressHandler(),
+// pressing Esc on the device or cancelFileOp() stops them between two buffers or entries,
+// leaving what was done so far (a partially copied file is removed).
+
+// Copies a file or folder into folder, keeping its name
+bool copyPath(const String &source, const String &folder);
+// Renames when possible, copies then deletes otherwise
+bool movePath(const String &source, const String &folder);
+bool deletePath(const String &path);
+void cancelFileOp();
+
+// For operations living elsewhere: forget an earlier cancel, then poll for a new one
+void beginFileOp();
+bool fileOpCancelled();
+
+#endif
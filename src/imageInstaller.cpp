@@ -0,0 +1,234 @@
+#include "imageInstaller.h"
+#include "display.h"
+#include <MemUtils.h>
+#include <algorithm>
+#include <esp_flash.h>
+#include <globals.h>
+
+#define IMAGE_HEAD_SIZE (IMAGE_TABLE_OFFSET + IMAGE_TABLE_SIZE)
+
+bool ImageInstaller::_fail(const String &error) {
+    log_e("%s", error.c_str());
+    abort();
+    _error = error;
+    return false;
+}
+
+/***************************************************************************************
+** Function name: ImageInstaller::begin
+** Description:   Holds the first IMAGE_HEAD_SIZE bytes, the partition table tells what they are
+***************************************************************************************/
+bool ImageInstaller::begin(uint32_t imageSize, bool withSpiffs) {
+    abort();
+    _error = "";
+    _size = imageSize;
+    _withSpiffs = withSpiffs;
+    _pos = 0;
+    _headLen = 0;
+    _compressed = false;
+    _head = (uint8_t *)largeAlloc(IMAGE_HEAD_SIZE);
+    if (!_head) return _fail("Not enough memory to start the install");
+    _active = true;
+    return true;
+}
+
+/***************************************************************************************
+** Function name: ImageInstaller::_plan
+** Description:   Same layout updateFromSD() reads from the card, as ordered segments
+***************************************************************************************/
+bool ImageInstaller::_plan() {
+    uint8_t table[IMAGE_TABLE_SIZE];
+    memset(table, 0xFF, sizeof(table));
+    if (_headLen > IMAGE_TABLE_OFFSET)
+        memcpy(table, _head + IMAGE_TABLE_OFFSET, std::min(_headLen - IMAGE_TABLE_OFFSET, (uint32_t)sizeof(table)));
+    ImageLayout layout;
+    parseImageLayout(table, _size, layout);
+
+    _segments.clear();
+    if (!layout.merged) {
+        _segments.push_back({0, _size, TARGET_APP});
+    } else {
+        if (layout.app_size) _segments.push_back({0x10000, layout.app_size, TARGET_APP});
+        if (layout.spiffs && _withSpiffs && layout.spiffs_size)
+            _segments.push_back({layout.spiffs_offset, layout.spiffs_size, TARGET_SPIFFS});
+        if (layout.fat_size_sys) _segments.push_back({layout.fat_offset_sys, layout.fat_size_sys, TARGET_FAT_SYS});
+        if (layout.fat_size_vfs) _segments.push_back({layout.fat_offset_vfs, layout.fat_size_vfs, TARGET_FAT_VFS});
+        std::sort(_segments.begin(), _segments.end(), [](const Segment &a, const Segment &b) {
+            return a.offset < b.offset;
+        });
+    }
+    for (size_t i = 1; i < _segments.size(); i++)
+        if (_segments[i].offset < _segments[i - 1].offset + _segments[i - 1].size)
+            return _fail("Overlapping partitions in the image");
+    if (_segments.empty()) return _fail("Nothing to install in the image");
+    _current = 0;
+    return true;
+}
+
+bool ImageInstaller::write(const uint8_t *data, size_t len) {
+    if (!_active) return false;
+    // the first bytes may come a few at a time, they are held in _head until the format is known
+    if (!_pos && _head && !_compressed && _headLen < GZIP_MAGIC_LEN) {
+        uint8_t magic[GZIP_MAGIC_LEN];
+        size_t held = _headLen;
+        size_t n = std::min(len, (size_t)GZIP_MAGIC_LEN - held);
+        memcpy(magic, _head, held);
+        memcpy(magic + held, data, n);
+        if (held + n < GZIP_MAGIC_LEN) return _push(data, len);
+        if (GzipInflater::isGzip(magic, GZIP_MAGIC_LEN)) {
+            if (!_gzip.begin([this](const uint8_t *data, size_t len) { return _push(data, len); }))
+                return _fail("Not enough memory to inflate the image");
+            _compressed = true;
+            _headLen = 0; // the held bytes go through the inflater instead
+            if (held && !_gzip.write(magic, held))
+                return _error.isEmpty() ? _fail("Corrupted .gz image") : false;
+        }
+    }
+    if (_compressed) {
+        if (_gzip.write(data, len)) return true;
+        return _error.isEmpty() ? _fail("Corrupted .gz image") : false;
+    }
+    return _push(data, len);
+}
+
+bool ImageInstaller::_push(const uint8_t *data, size_t len) {
+    if (!_active) return false;
+    if (_head) {
+        size_t n = std::min(len, (size_t)(IMAGE_HEAD_SIZE - _headLen));
+        memcpy(_head + _headLen, data, n);
+        _headLen += n;
+        data += n;
+        len -= n;
+        if (_headLen < IMAGE_HEAD_SIZE && _headLen < _size) return true;
+
+        // the partition table is in, replay the held bytes through the segments
+        if (!_plan()) return false;
+        uint8_t *head = _head;
+        _head = nullptr;
+        bool ok = _route(head, _headLen);
+        free(head);
+        if (!ok) return false;
+    }
+    return _route(data, len);
+}
+
+/***************************************************************************************
+** Function name: ImageInstaller::_route
+** Description:   Sends each byte range to the segment it belongs to, skipping gaps
+***************************************************************************************/
+bool ImageInstaller::_route(const uint8_t *data, size_t len) {
+    while (len) {
+        if (_current >= _segments.size()) { // trailing bytes nobody needs
+            _pos += len;
+            return true;
+        }
+        const Segment &seg = _segments[_current];
+        size_t n;
+        if (_pos < seg.offset) {
+            n = std::min(len, (size_t)(seg.offset - _pos));
+        } else {
+            if (!_segmentOpen && !_openSegment(seg)) return false;
+            n = std::min(len, (size_t)(seg.offset + seg.size - _pos));
+            if (!_writeSegment(seg, data, n)) return false;
+        }
+        _pos += n;
+        data += n;
+        len -= n;
+        if (_segmentOpen && _pos == seg.offset + seg.size) {
+            if (!_closeSegment(seg)) return false;
+            _current++;
+        }
+    }
+    return true;
+}
+
+bool ImageInstaller::_openSegment(const Segment &seg) {
+    tft->fillRoundRect(6, 6, tftWidth - 12, tftHeight - 12, 5, BGCOLOR);
+    _segmentWritten = 0;
+    if (seg.target == TARGET_APP || seg.target == TARGET_SPIFFS) {
+        prog_handler = seg.target == TARGET_APP ? 0 : 1;
+        progressHandler(0, 500);
+        Update.setPipeline(true); // the network keeps coming while the previous sector is flashed
+        Update.setDeltaFlash(deltaFlash);
+        if (!Update.begin(seg.size, seg.target == TARGET_APP ? U_FLASH : U_SPIFFS))
+            return _fail("E:" + String(Update.getError()) + "-Wrong Partition Scheme");
+        Update.onProgress(progressHandler);
+    } else {
+        const char *label = seg.target == TARGET_FAT_SYS ? "sys" : "vfs";
+        _fat = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_FAT, label);
+        if (!_fat || _fat->size < seg.size) return _fail("No FAT " + String(label) + " partition to install");
+        esp_flash_set_chip_write_protect(NULL, false);
+        _fatErased = 0;
+        _fatVerifier.begin(_fat);
+        prog_handler = 1;
+        displayRedStripe("Updating FAT");
+        progressHandler(0, 500);
+    }
+    _segmentOpen = true;
+    return true;
+}
+
+bool ImageInstaller::_writeSegment(const Segment &seg, const uint8_t *data, size_t len) {
+    if (seg.target == TARGET_APP || seg.target == TARGET_SPIFFS) {
+        if (Update.write((uint8_t *)data, len) != len)
+            return _fail("FAIL 170: " + String(Update.getError()));
+    } else {
+        // erase just ahead of the data, a whole FAT erase would stall the network for seconds
+        while (_fatErased < _segmentWritten + len) {
+            if (esp_flash_erase_region(NULL, _fat->address + _fatErased, SPI_FLASH_SEC_SIZE) != ESP_OK)
+                return _fail("FAT erase failed");
+            _fatErased += SPI_FLASH_SEC_SIZE;
+            progressHandler(_segmentWritten, seg.size);
+        }
+        if (esp_flash_write(NULL, data, _fat->address + _segmentWritten, len) != ESP_OK)
+            return _fail("FAT write failed");
+        _fatVerifier.add(data, len);
+    }
+    _segmentWritten += len;
+    return true;
+}
+
+bool ImageInstaller::_closeSegment(const Segment &seg) {
+    _segmentOpen = false;
+    if (seg.target == TARGET_APP || seg.target == TARGET_SPIFFS) {
+        if (Update.end()) return true;
+        if (Update.getError() == UPDATE_ERROR_VERIFY) return _fail("Verify failed " + Update.mismatches());
+        return _fail("Fail 181: " + String(Update.getError()));
+    } else {
+        progressHandler(seg.size, seg.size);
+        _fat = nullptr;
+        if (!_fatVerifier.verify()) return _fail("Verify failed " + _fatVerifier.mismatches());
+    }
+    return true;
+}
+
+bool ImageInstaller::end() {
+    if (!_active) return false;
+    if (_compressed && !_gzip.finished()) return _fail("Image ended before the install was complete");
+    if (_head) { // image smaller than the partition table offset, a plain app
+
+        if (!_plan()) return false;
+        uint8_t *head = _head;
+        _head = nullptr;
+        bool ok = _route(head, _headLen);
+        free(head);
+        if (!ok) return false;
+    }
+    if (_current < _segments.size()) return _fail("Image ended before the install was complete");
+    _active = false;
+    return true;
+}
+
+void ImageInstaller::abort() {
+    if (_segmentOpen && _current < _segments.size()) {
+        Target target = _segments[_current].target;
+        if (target == TARGET_APP || target == TARGET_SPIFFS) Update.abort();
+    }
+    _segmentOpen = false;
+    _fat = nullptr;
+    if (_head) free(_head);
+    _head = nullptr;
+    _gzip.end();
+    _segments.clear();
+    _active = false;
+}
@@ -0,0 +1,58 @@
+#ifndef __IMAGE_INSTALLER_H
+#define __IMAGE_INSTALLER_H
+
+#include "sd_functions.h"
+#include <Arduino.h>
+#include <GzipInflater.h>
+#include <esp_partition.h>
+#include <vector>
+
+// Installs a .bin pushed in order, a chunk at a time, as it arrives from the network.
+// Merged images are split on the fly by their partition table, app, SPIFFS and FAT bytes
+// going straight to their partitions, anything else in the image is skipped.
+// A .bin.gz is inflated on the fly, imageSize is then the size of the inflated image.
+class ImageInstaller {
+public:
+    bool begin(uint32_t imageSize, bool withSpiffs);
+    bool write(const uint8_t *data, size_t len);
+    // true once every segment of the image was written
+    bool end();
+    void abort();
+
+    bool active() const { return _active; }
+    const String &error() const { return _error; }
+
+private:
+    enum Target : uint8_t { TARGET_APP, TARGET_SPIFFS, TARGET_FAT_SYS, TARGET_FAT_VFS };
+    struct Segment {
+        uint32_t offset;
+        uint32_t size;
+        Target target;
+    };
+    bool _plan();
+    bool _push(const uint8_t *data, size_t len);
+    bool _route(const uint8_t *data, size_t len);
+    bool _openSegment(const Segment &seg);
+    bool _writeSegment(const Segment &seg, const uint8_t *data, size_t len);
+    bool _closeSegment(const Segment &seg);
+    bool _fail(const String &error);
+
+    bool _active = false;
+    bool _withSpiffs = false;
+    uint32_t _size = 0;
+    uint32_t _pos = 0;          // image offset of the next byte
+    uint8_t *_head = nullptr;   // image start, kept until the partition table arrived
+    uint32_t _headLen = 0;
+    std::vector<Segment> _segments;
+    size_t _current = 0;
+    bool _segmentOpen = false;
+    uint32_t _segmentWritten = 0;
+    const esp_partition_t *_fat = nullptr;
+    uint32_t _fatErased = 0;
+    FlashVerifier _fatVerifier;
+    GzipInflater _gzip;
+    bool _compressed = false;
+    String _error;
+};
+
+#endif
@@ -88,6 +88,7 @@ bool onlyBins;
 bool returnToMenu;
 bool update;
 bool askSpiffs;
+bool deltaFlash;
 #ifdef DISABLE_OTA
 bool stopOta = true;
 #else
@@ -195,10 +196,10 @@ void get_partition_sizes() {
     //     if(MAX_APP==0) {
     //       // Makes the arrangements
 
-    //       //partitionSetter(def_part, sizeof(def_part));
-    //       if(__size==0x400000) { partitionSetter(def_part, sizeof(def_part)); }
-    //       if(__size==0x800000) { partitionSetter(def_part8, sizeof(def_part8));}
-    //       if(__size==0x1000000) { partitionSetter(def_part16, sizeof(def_part16)); }
+    //       //partitionSetter(def_part);
+    //       if(__size==0x400000) { partitionSetter(def_part); }
+    //       if(__size==0x800000) { partitionSetter(def_part8);}
+    //       if(__size==0x1000000) { partitionSetter(def_part16); }
     //       while(1) {
     //         Serial.println("Turn Off and On again to apply partition changes.");
     //         delay(2500);
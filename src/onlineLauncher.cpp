@@ -1,6 +1,9 @@
 #include "onlineLauncher.h"
+#include "catalog.h"
 #include "display.h"
+#include "imageInstaller.h"
 #include "mykeyboard.h"
+#include "partitioner.h"
 #include "powerSave.h"
 #include "sd_functions.h"
 #include "settings.h"
@@ -139,8 +142,8 @@ void ota_function() {
                 if (GetJsonFromM5()) loopFirmware();
             }
         } else {
-            // If it is already connected, download the JSON again... it loses the information once you step
-            // out of loopFirmware(), dkw
+            // If it is already connected, fetch the catalog again, it is freed once you step out of
+            // loopFirmware(). A cached copy on the SD card makes this a quick 304
             closeSdCard();
             if (GetJsonFromM5()) loopFirmware();
         }
@@ -173,12 +176,34 @@ String replaceChars(String input) {
     }
     return input;
 }
+/***************************************************************************************
+** Function name: catalogFilter
+** Description:   Fields of the firmware catalog the browser and installer use, everything
+**                else (descriptions, images, downloads count...) is dropped while parsing
+***************************************************************************************/
+static JsonDocument catalogFilter() {
+    JsonDocument filter;
+    JsonObject item = filter[0].to<JsonObject>();
+    item["name"] = true;
+    item["author"] = true;
+    JsonObject version = item["versions"][0].to<JsonObject>();
+    for (const char *key :
+         {"version", "published_at", "file", "s", "so", "ss", "nb", "as", "f", "fo", "fs", "f2", "fo2", "fs2"}) {
+        version[key] = true;
+    }
+    return filter;
+}
+
 /***************************************************************************************
 ** Function name: GetJsonFromM5
-** Description:   Gets JSON from github server
+** Description:   Gets JSON from github server, or from the SD card cache when the
+**                server answers it didn't change (or can't be reached)
 ***************************************************************************************/
 bool GetJsonFromM5() {
     const char *serverUrl = JSON_SOURCE_PATH;
+    String etag, lastModified;
+    closeCatalogIndex();
+    bool cached = readCatalogValidators(etag, lastModified);
 
     if (WiFi.status() == WL_CONNECTED) {
         HTTPClient http;
@@ -190,19 +215,37 @@ bool GetJsonFromM5() {
         tft->drawCentreString("repository", tftWidth / 2, tftHeight / 3 + FM * 9, 1);
 
         tft->setCursor(18, tftHeight / 3 + FM * 9 * 2);
+        const char *headerKeys[] = {"ETag", "Last-Modified"};
         while (httpResponseCode < 0) {
             http.begin(serverUrl);
             http.useHTTP10(true);
+            http.collectHeaders(headerKeys, 2);
+            if (cached && etag.length()) http.addHeader("If-None-Match", etag);
+            if (cached && lastModified.length()) http.addHeader("If-Modified-Since", lastModified);
             httpResponseCode = http.GET();
-            if (httpResponseCode > 0) {
-                DeserializationError error;
-                deserializeJson(doc, http.getStream());
+            if (httpResponseCode == HTTP_CODE_NOT_MODIFIED) {
+                http.end();
+                if (openCatalogIndex()) return true;
+                cached = false; // unreadable cache, ask for the whole catalog
+                httpResponseCode = -1;
+            } else if (httpResponseCode == HTTP_CODE_OK) {
+                // Parsed straight from the socket, keeping only what catalogFilter() asks for
+                DeserializationError error = deserializeJson(
+                    doc, http.getStream(), DeserializationOption::Filter(catalogFilter())
+                );
+                etag = http.header("ETag");
+                lastModified = http.header("Last-Modified");
+                http.end();
+                if (error) log_i("Catalog> %s, %d entries kept", error.c_str(), doc.size());
+                else saveCatalogCache(doc, etag, lastModified);
                 delay(100);
-                return true;
-                break;
+                return openCatalogIndex(); // browses from the card if it was saved, frees doc
             } else {
-                tftprint(".", 10);
                 http.end();
+                // Offline or server trouble, an older catalog beats waiting
+                if (cached && openCatalogIndex()) return true;
+                if (httpResponseCode > 0) return false;
+                tftprint(".", 10);
                 delay(1000);
             }
         }
@@ -211,13 +254,70 @@ bool GetJsonFromM5() {
     return false;
 }
 
+/***************************************************************************************
+** Download journal
+** Description:   A small JSON file kept next to a partial download (<file>.bin.dl)
+**                with the URL, expected size, validators and bytes already on the
+**                SD card, so an interrupted download can continue with a Range request.
+**                The data goes to <file>.bin.part, renamed to <file>.bin once complete
+***************************************************************************************/
+#define DOWNLOAD_JOURNAL_EXT ".dl"
+#define DOWNLOAD_PART_EXT ".part"
+#define DOWNLOAD_MAX_RETRIES 8
+#define DOWNLOAD_SYNC_EVERY (64 * 1024) // flush file and journal every 64KB
+#define DOWNLOAD_STALL_MS 10000         // no data for this long means the link is gone
+
+struct DownloadJournal {
+    String url;
+    size_t size = 0;
+    String etag;
+    String lastModified;
+    size_t committed = 0;
+};
+
+static bool readDownloadJournal(const String &path, DownloadJournal &journal) {
+    File file = SDM.open(path, FILE_READ);
+    if (!file) return false;
+    JsonDocument doc;
+    DeserializationError error = deserializeJson(doc, file);
+    file.close();
+    if (error) return false;
+    journal.url = doc["url"].as<String>();
+    journal.size = doc["size"].as<size_t>();
+    journal.etag = doc["etag"].as<String>();
+    journal.lastModified = doc["lastmod"].as<String>();
+    journal.committed = doc["done"].as<size_t>();
+    return true;
+}
+
+// First byte of a "bytes first-last/total" Content-Range, -1 when there is none
+static long contentRangeStart(const String &range) {
+    if (!range.startsWith("bytes ") || !isdigit((uint8_t)range.charAt(6))) return -1;
+    return range.substring(6, range.indexOf('-')).toInt();
+}
+
+static void writeDownloadJournal(const String &path, const DownloadJournal &journal) {
+    File file = SDM.open(path, FILE_WRITE);
+    if (!file) return;
+    JsonDocument doc;
+    doc["url"] = journal.url;
+    doc["size"] = journal.size;
+    doc["etag"] = journal.etag;
+    doc["lastmod"] = journal.lastModified;
+    doc["done"] = journal.committed;
+    serializeJson(doc, file);
+    file.close();
+}
+
 /***************************************************************************************
 ** Function name: downloadFirmware
-** Description:   Downloads the firmware and save into the SDCard
+** Description:   Downloads the firmware and save into the SDCard, resuming a previous
+**                partial download of the same file when the server supports Range
 ***************************************************************************************/
 void downloadFirmware(String file_str, String fileName, String folder) {
     String fileAddr = SERVER_PATH + file_str;
     int tries = 0;
+    bool complete = false;
     fileName = replaceChars(fileName);
     prog_handler = 2;
     if (!setupSdCard()) {
@@ -225,89 +325,398 @@ void downloadFirmware(String file_str, String fileName, String folder) {
         delay(2500);
         return;
     }
+    if (!SDM.exists("/downloads")) SDM.mkdir("/downloads");
+
+    String binPath = folder + fileName + ".bin";
+    String partPath = binPath + DOWNLOAD_PART_EXT; // never installable until renamed
+    String journalPath = binPath + DOWNLOAD_JOURNAL_EXT;
+
+    // Continue from the last committed byte if the journal belongs to this same URL, the size has to be
+    // known too, bytes left past the end of a shorter download couldn't be told from the firmware
+    DownloadJournal journal;
+    size_t offset = 0;
+    if (readDownloadJournal(journalPath, journal) && journal.url == fileAddr && journal.size > 0 &&
+        SDM.exists(partPath)) {
+        File part = SDM.open(partPath, FILE_READ);
+        offset = std::min(journal.committed, (size_t)part.size());
+        part.close();
+        log_i("Download> Resuming %s at %d", partPath.c_str(), offset);
+    } else {
+        journal = DownloadJournal();
+        journal.url = fileAddr;
+    }
 
     tft->fillRect(7, 40, tftWidth - 14, 88, BGCOLOR); // Erase the information below the firmware name
     displayRedStripe("Connecting FW");
     WiFiClientSecure *client = new WiFiClientSecure;
+    if (!client) {
+        displayRedStripe("Couldn't Connect");
+        wakeUpScreen();
+        return;
+    }
     client->setInsecure();
-retry:
-    if (client) {
+
+    const char *headerKeys[] = {"ETag", "Last-Modified", "Content-Range"};
+    while (!complete && tries <= DOWNLOAD_MAX_RETRIES) {
         HTTPClient http;
-        int httpResponseCode = -1;
+        http.begin(*client, fileAddr);
+        http.setFollowRedirects(HTTPC_FORCE_FOLLOW_REDIRECTS); // Github links need it
+        http.useHTTP10(true);
+        http.collectHeaders(headerKeys, 3);
+        if (offset > 0) {
+            http.addHeader("Range", "bytes=" + String(offset) + "-");
+            // If the file changed on the server, If-Range makes it send the whole new file (200)
+            if (journal.etag.length()) http.addHeader("If-Range", journal.etag);
+            else if (journal.lastModified.length()) http.addHeader("If-Range", journal.lastModified);
+        }
+        int httpResponseCode = http.GET();
 
-        while (httpResponseCode < 0) {
-            http.begin(*client, fileAddr);
-            http.setFollowRedirects(HTTPC_FORCE_FOLLOW_REDIRECTS); // Github links need it
-            http.useHTTP10(true);
-            httpResponseCode = http.GET();
-            if (httpResponseCode > 0) {
-                setupSdCard();
-                if (!SDM.exists("/downloads")) SDM.mkdir("/downloads");
-
-                File file = SDM.open(folder + fileName + ".bin", FILE_WRITE);
-                size_t size = http.getSize();
-                displayRedStripe("Downloading FW");
-                if (file) {
-
-                    int downloaded = 0;
-                    WiFiClient *stream = http.getStreamPtr();
-                    int len = size;
-
-                    prog_handler = 2; // Download handler
-
-                    // Ler dados enquanto disponível
-                    progressHandler(downloaded, size);
-                    while (http.connected() && (len > 0 || len == -1)) {
-                        // Ler dados em partes
-                        int size_av = stream->available();
-                        if (size_av) {
-                            int c = stream->readBytes(buff, std::min(size_av, bufSize));
-                            file.write(buff, c);
-
-                            if (len > 0) { len -= c; }
-
-                            downloaded += c;
-                            progressHandler(downloaded, size); // Chama a função de progresso
-                            progressHandler(downloaded, size); // Chama a função de progresso
-                        }
-                    }
-                    file.close();
-                } else {
-                    log_i("Download> Couldn't create file %s", String(folder + fileName + ".bin"));
-                    displayRedStripe("Fail creating file.");
-                }
-                // Checks if the file was preatically not downloaded and try one more time (size <= bufSize)
-                file = SDM.open(folder + fileName + ".bin");
-                if (file.size() <= bufSize & tries < 1) {
-                    tries++;
-                    http.end();
-                    goto retry;
-                }
-                // Checks if the file was completely downloaded
-                log_i("File size in get() = %d\nFile size in SD    = %d", size, file.size());
-                if (file.size() != size) {
-                    SDM.remove(file.path());
-                    displayRedStripe("Download FAILED");
-                    while (!check(SelPress)) yield();
-                } else {
-                    log_i("File successfully downloaded.");
-                    displayRedStripe(" Downloaded ");
-                    while (!check(SelPress)) yield();
+        if (httpResponseCode == HTTP_CODE_RANGE_NOT_SATISFIABLE) {
+            http.end();
+            if (journal.size > 0 && offset == journal.size) complete = true; // was already all there
+            else offset = 0;                                                  // journal is stale
+            continue;
+        }
+        if (httpResponseCode != HTTP_CODE_OK && httpResponseCode != HTTP_CODE_PARTIAL_CONTENT) {
+            log_i("Download> HTTP %d, retrying", httpResponseCode);
+            http.end();
+            tries++;
+            delay(500 * tries);
+            continue;
+        }
+
+        bool resumed = httpResponseCode == HTTP_CODE_PARTIAL_CONTENT && offset > 0;
+        if (resumed && contentRangeStart(http.header("Content-Range")) != (long)offset) {
+            // not the bytes that follow what is on the card, start over instead of splicing them in
+            log_i("Download> Content-Range %s for offset %d", http.header("Content-Range").c_str(), offset);
+            http.end();
+            offset = 0;
+            continue;
+        }
+        int remaining = http.getSize();
+        if (!resumed) {
+            offset = 0;
+            journal.size = remaining > 0 ? remaining : 0;
+            journal.etag = http.header("ETag");
+            journal.lastModified = http.header("Last-Modified");
+        }
+
+        // The file can be longer than the journal says, the bytes written after the last sync are
+        // written again from offset over whatever is there
+        File file = SDM.open(partPath, resumed ? "r+" : FILE_WRITE);
+        if (file && resumed && !file.seek(offset)) file.close();
+        if (!file) {
+            log_i("Download> Couldn't create file %s", partPath.c_str());
+            displayRedStripe("Fail creating file.");
+            http.end();
+            break;
+        }
+        journal.committed = offset;
+        writeDownloadJournal(journalPath, journal);
+        displayRedStripe(resumed ? "Resuming FW" : "Downloading FW");
+
+        WiFiClient *stream = http.getStreamPtr();
+        size_t started = offset;
+        size_t lastSync = offset;
+        uint32_t lastData = millis();
+        bool closed = false;
+        prog_handler = 2; // Download handler
+        progressHandler(offset, journal.size);
+        while (remaining != 0) {
+            int size_av = stream->available();
+            if (size_av) {
+                int c = stream->readBytes(buff, std::min(size_av, bufSize));
+                if (c <= 0 || file.write(buff, c) != (size_t)c) break;
+                if (remaining > 0) remaining -= c;
+                offset += c;
+                lastData = millis();
+                progressHandler(offset, journal.size);
+                if (offset - lastSync >= DOWNLOAD_SYNC_EVERY) {
+                    file.flush();
+                    journal.committed = offset;
+                    writeDownloadJournal(journalPath, journal);
+                    lastSync = offset;
                 }
-                file.close();
+            } else if (!http.connected() || millis() - lastData > DOWNLOAD_STALL_MS) {
+                closed = !http.connected();
                 break;
             } else {
-                http.end();
-                delay(500);
+                yield();
             }
         }
+        file.close();
         http.end();
+
+        journal.committed = offset;
+        if (journal.size > 0) complete = offset == journal.size;
+        else complete = offset > 0 && closed; // no Content-Length: ends when server closes
+        if (!complete) {
+            writeDownloadJournal(journalPath, journal);
+            if (offset > started) tries = 0; // only count attempts that made no progress
+            tries++;
+            log_i("Download> Stopped at %d of %d, retry %d", offset, journal.size, tries);
+            displayRedStripe("Reconnecting");
+            delay(500 * tries);
+        }
+    }
+    delete client;
+
+    if (complete) {
+        SDM.remove(binPath); // an earlier download of the same firmware
+        complete = SDM.rename(partPath, binPath);
+    }
+    if (complete) {
+        SDM.remove(journalPath);
+        log_i("File successfully downloaded.");
+        displayRedStripe(" Downloaded ");
     } else {
-        displayRedStripe("Couldn't Connect");
+        // Keep the partial file and its journal, selecting the same firmware again resumes it. Under
+        // its .part name it can't be mistaken for a firmware by the SD browser
+        displayRedStripe("Download paused");
     }
+    while (!check(SelPress)) yield();
     wakeUpScreen();
 }
 
+/***************************************************************************************
+** Class name:    SegmentStream
+** Description:   One Range request over the merged image that the partition writers
+**                read from in offset order. Each writer sees only its own segment,
+**                gaps are read through (or skipped with a new request when large) and
+**                a dropped connection is reopened at the current position, with the
+**                first response's ETag or Last-Modified as If-Range
+***************************************************************************************/
+#define SEGMENT_MAX_GAP (256 * 1024) // reading through is cheaper than a new TLS handshake
+#define SEGMENT_MAX_RETRIES 5
+#define SEGMENT_STALL_MS 10000
+
+class SegmentStream : public Stream {
+public:
+    SegmentStream(WiFiClientSecure *client, const String &url, uint32_t last)
+        : _client(client), _url(url), _last(last) {}
+    ~SegmentStream() { _http.end(); }
+
+    // Positions the stream at offset and limits reads to the next size bytes
+    bool window(uint32_t offset, uint32_t size) {
+        if (offset < _pos || !_open) return open(offset) && setLimit(size);
+        if (offset - _pos > SEGMENT_MAX_GAP) return open(offset) && setLimit(size);
+        _limit = offset - _pos;
+        while (_limit > 0) {
+            if (readBytes(buff, std::min((uint32_t)bufSize, _limit)) == 0) return false;
+        }
+        return setLimit(size);
+    }
+
+    int available() override {
+        return _open && _limit ? std::min((uint32_t)std::max(_client->available(), 0), _limit) : 0;
+    }
+    int peek() override { return _limit && waitData() ? _client->peek() : -1; }
+    int read() override {
+        uint8_t c;
+        return readBytes(&c, 1) ? c : -1;
+    }
+    size_t readBytes(char *buffer, size_t length) override { return readBytes((uint8_t *)buffer, length); }
+    size_t readBytes(uint8_t *buffer, size_t length) override {
+        size_t got = 0;
+        if (length > _limit) length = _limit;
+        while (got < length) {
+            if (!waitData()) break;
+            int c = _client->read(buffer + got, length - got);
+            if (c <= 0) continue;
+            got += c;
+            _pos += c;
+            _limit -= c;
+        }
+        return got;
+    }
+    size_t write(uint8_t) override { return 0; }
+
+    // ETag or Last-Modified of the image, what a resumed install checks it against
+    const String &validator() const { return _validator; }
+
+private:
+    WiFiClientSecure *_client;
+    String _url;
+    String _validator;
+    HTTPClient _http;
+    uint32_t _last;
+    uint32_t _pos = 0;
+    uint32_t _limit = 0;
+    bool _open = false;
+
+    bool setLimit(uint32_t size) {
+        _limit = size;
+        return true;
+    }
+
+    bool open(uint32_t from) {
+        const char *headerKeys[] = {"ETag", "Last-Modified"};
+        bool first = !_validator.length();
+        for (int tries = 0; tries < SEGMENT_MAX_RETRIES; tries++) {
+            _http.end();
+            _http.begin(*_client, _url);
+            _http.setFollowRedirects(HTTPC_FORCE_FOLLOW_REDIRECTS); // Github links need it
+            _http.useHTTP10(true);
+            _http.collectHeaders(headerKeys, 2);
+            _http.addHeader("Range", "bytes=" + String(from) + "-" + String(_last));
+            if (!first) _http.addHeader("If-Range", _validator);
+            int code = _http.GET();
+            String validator = _http.header("ETag");
+            if (!validator.length()) validator = _http.header("Last-Modified");
+            if (!first && (code == HTTP_CODE_OK || validator != _validator)) {
+                // the image was replaced on the server, its bytes don't go after the ones flashed
+                log_i("Segments> %s changed on the server", _url.c_str());
+                break;
+            }
+            // a server ignoring Range is only usable when reading from the first byte
+            if (code == HTTP_CODE_PARTIAL_CONTENT || (code == HTTP_CODE_OK && from == 0)) {
+                if (first) _validator = validator;
+                _pos = from;
+                _open = true;
+                return true;
+            }
+            log_i("Segments> HTTP %d at %d, retrying", code, from);
+            delay(500 * (tries + 1));
+        }
+        _open = false;
+        return false;
+    }
+
+    // Waits for bytes on the socket, reconnecting at the current position if it dropped
+    bool waitData() {
+        uint32_t lastData = millis();
+        while (_open) {
+            if (_client->available() > 0) return true;
+            if (!_client->connected() || millis() - lastData > SEGMENT_STALL_MS) {
+                log_i("Segments> Connection lost at %d, reopening", _pos);
+                if (!open(_pos)) return false;
+                lastData = millis();
+            } else {
+                delay(1);
+            }
+        }
+        return false;
+    }
+};
+
+struct FirmwareSegment {
+    uint32_t offset;
+    uint32_t size;
+    int command; // U_FLASH, U_SPIFFS, U_FAT_sys or U_FAT_vfs
+};
+
+/***************************************************************************************
+** Function name: eraseSpiffsTail
+** Description:   Erases the SPIFFS partition past the first size bytes, what the image
+**                doesn't cover. Same end state as the format the old install did
+***************************************************************************************/
+static bool eraseSpiffsTail(uint32_t size) {
+    const esp_partition_t *part =
+        esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_SPIFFS, NULL);
+    if (!part) return false;
+    uint32_t from = (size + SPI_FLASH_SEC_SIZE - 1) / SPI_FLASH_SEC_SIZE * SPI_FLASH_SEC_SIZE;
+    if (from >= part->size) return true;
+    return esp_partition_erase_range(part, from, part->size - from) == ESP_OK;
+}
+
+/***************************************************************************************
+** Function name: installSegments
+** Description:   Streams every partition of a merged image through a single connection
+***************************************************************************************/
+bool installSegments(WiFiClientSecure *client, String fileAddr, std::vector<FirmwareSegment> segments) {
+    std::sort(segments.begin(), segments.end(), [](const FirmwareSegment &a, const FirmwareSegment &b) {
+        return a.offset < b.offset;
+    });
+    SegmentStream stream(client, fileAddr, segments.back().offset + segments.back().size - 1);
+    bool appDone = false;
+
+    for (const FirmwareSegment &seg : segments) {
+        if (!stream.window(seg.offset, seg.size)) {
+            displayRedStripe("Connection Lost");
+            delay(2500);
+            return appDone;
+        }
+        switch (seg.command) {
+            case U_FLASH:
+                prog_handler = 0;
+                // checkpoints let a later attempt continue the app with a resumable update
+                httpUpdate.trackCheckpoints(fileAddr, seg.offset, seg.size, false, stream.validator());
+                appDone = performUpdate(stream, seg.size, U_FLASH);
+                httpUpdate.trackCheckpoints("");
+                if (!appDone) return false;
+                httpUpdate.forgetCheckpoint();
+                break;
+            case U_SPIFFS:
+                // Update only erases what it writes, the rest of the partition would keep blocks of
+                // the old filesystem that SPIFFS scans on mount
+                displayRedStripe("Erasing SPIFFS");
+                if (!eraseSpiffsTail(seg.size)) {
+                    displayRedStripe("SPIFFS Failed");
+                    delay(2500);
+                    break;
+                }
+                displayRedStripe("Installing SPIFFS");
+                if (!performUpdate(stream, seg.size, U_SPIFFS)) {
+                    displayRedStripe("SPIFFS Failed");
+                    delay(2500);
+                }
+                break;
+            default:
+                prog_handler = 1;
+                if (!performFATUpdate(stream, seg.size, seg.command == U_FAT_sys ? "sys" : "vfs")) {
+                    displayRedStripe("FAT Failed");
+                    delay(2500);
+                }
+                break;
+        }
+    }
+    return appDone;
+}
+
+/***************************************************************************************
+** Function name: installGzipImage
+** Description:   A .bin.gz can't be read by ranges, the whole file comes through one GET
+**                and ImageInstaller inflates it and splits it into the partitions
+***************************************************************************************/
+bool installGzipImage(WiFiClientSecure *client, String fileAddr, uint32_t imageSize, bool spiffs) {
+    HTTPClient http;
+    http.begin(*client, fileAddr);
+    http.setFollowRedirects(HTTPC_FORCE_FOLLOW_REDIRECTS); // Github links need it
+    http.useHTTP10(true);
+    int code = http.GET();
+    if (code != HTTP_CODE_OK) {
+        log_i("Gzip> HTTP %d", code);
+        http.end();
+        return false;
+    }
+
+    ImageInstaller installer;
+    WiFiClient *stream = http.getStreamPtr();
+    int left = http.getSize(); // -1 when the server doesn't say
+    uint8_t buf[1024];
+    uint32_t lastData = millis();
+    installer.begin(imageSize, spiffs);
+    while (installer.active() && left != 0) {
+        size_t avail = stream->available();
+        if (avail) {
+            int n = stream->read(buf, std::min(avail, sizeof(buf)));
+            if (n <= 0) continue;
+            installer.write(buf, n);
+            if (left > 0) left -= n;
+            lastData = millis();
+        } else if (!stream->connected() || millis() - lastData > SEGMENT_STALL_MS) {
+            break;
+        } else {
+            delay(1);
+        }
+    }
+    http.end();
+    if (installer.active() && installer.end()) return true;
+    displayRedStripe(installer.error().isEmpty() ? "Connection Lost" : installer.error());
+    delay(2500);
+    return false;
+}
+
 /***************************************************************************************
 ** Function name: installFirmware
 ** Description:   installs Firmware using OTA
@@ -327,6 +736,12 @@ void installFirmware(
         loopOptions(options);
     }
 
+    // sizes from the catalog, before they are capped to the current partitions
+    offerFitPartitions(
+        {app_size, spiffs ? spiffs_size : 0, fat && fat_size[1] ? fat_size[0] : 0,
+         fat ? (fat_size[1] ? fat_size[1] : fat_size[0]) : 0}
+    );
+
     if (spiffs && spiffs_size > MAX_SPIFFS) spiffs_size = MAX_SPIFFS;
     if (app_size > MAX_APP) app_size = MAX_APP;
     if (app_size > MAX_APP) app_size = MAX_APP;
@@ -346,14 +761,49 @@ void installFirmware(
     client->setInsecure();
     httpUpdate.rebootOnUpdate(false);
     httpUpdate.setFollowRedirects(HTTPC_FORCE_FOLLOW_REDIRECTS); // Github links need it
+    httpUpdate.setResumable(true); // reconnect from the last flashed block instead of starting over
     /* Install App */
     prog_handler = 0;
     tft->fillRoundRect(6, 6, tftWidth - 12, tftHeight - 12, 5, BGCOLOR);
     progressHandler(0, 500);
-    httpUpdate.onProgress(progressHandler);
+    Update.onProgress(progressHandler); // straight to Update, it tells the skipped sectors
     httpUpdate.setLedPin(LED, LED_ON);
+    Update.setPipeline(true); // keep the TCP stream flowing while the previous sector is being flashed
+    Update.setDeltaFlash(deltaFlash);
 
     if (nb) app_offset = 0;
+    if (file.endsWith(".gz")) {
+        // the catalog sizes tell how far the inflated image goes
+        uint32_t imageSize = app_offset + app_size;
+        if (spiffs) imageSize = std::max(imageSize, spiffs_offset + spiffs_size);
+        for (int i = 0; fat && i < 2; i++) imageSize = std::max(imageSize, fat_offset[i] + fat_size[i]);
+        if (!installGzipImage(client, fileAddr, imageSize, spiffs)) {
+            displayRedStripe("Instalation Failed");
+            goto SAIR;
+        }
+        goto Sucesso;
+    }
+    if (!httpUpdate.canResume(fileAddr, app_offset, app_size)) {
+        // Fresh install: every segment through one connection and one TLS handshake
+        std::vector<FirmwareSegment> segments = {
+            {app_offset, app_size, U_FLASH}
+        };
+        if (spiffs) segments.push_back({spiffs_offset, spiffs_size, U_SPIFFS});
+#if !defined(PART_04MB)
+        // with two FAT images the first one goes to "sys", a single one to "vfs"
+        for (int i = 0; fat && i < 2; i++) {
+            if (fat_size[i] > 0)
+                segments.push_back({fat_offset[i], fat_size[i], fat_size[1] > 0 && i == 0 ? U_FAT_sys : U_FAT_vfs});
+        }
+#endif
+        if (!installSegments(client, fileAddr, segments)) {
+            displayRedStripe("Instalation Failed");
+            goto SAIR;
+        }
+        goto Sucesso;
+    }
+
+    // An interrupted install left a checkpoint behind, continue it segment by segment
     if (!httpUpdate.updateFromOffset(*client, fileAddr, app_offset, app_size)) {
         displayRedStripe("Instalation Failed");
         goto SAIR;
@@ -369,8 +819,10 @@ void installFirmware(
         setTftDisplay(5, 60, WHITE, FM, ALCOLOR);
 
         tft->println(" Preparing SPIFFS");
-        // Format Spiffs partition
-        if (!SPIFFS.begin(true)) {
+        // Format Spiffs partition, unless an interrupted install is going to continue on it
+        if (httpUpdate.canResume(fileAddr, spiffs_offset, spiffs_size, true)) {
+            displayRedStripe("Resuming SPIFFS");
+        } else if (!SPIFFS.begin(true)) {
             displayRedStripe("Fail to start SPIFFS");
             delay(2500);
         } else {
@@ -382,7 +834,7 @@ void installFirmware(
 
         // Install Spiffs
         progressHandler(0, 500);
-        httpUpdate.onProgress(progressHandler);
+        Update.onProgress(progressHandler); // straight to Update, it tells the skipped sectors
 
         if (!httpUpdate.updateSpiffsFromOffset(*client, fileAddr, spiffs_offset, spiffs_size)) {
             displayRedStripe("SPIFFS Failed");
@@ -0,0 +1,155 @@
+#include "partitionIo.h"
+#include "display.h"
+#include "sparseImage.h"
+#include <MemUtils.h>
+#include <globals.h>
+#include <mbedtls/sha256.h>
+
+namespace {
+struct Block {
+    uint8_t *data;
+    size_t offset;
+    size_t len;
+};
+
+struct Pipe {
+    QueueHandle_t freeBlocks;
+    QueueHandle_t fullBlocks;
+    const PartitionWriteFn *write;
+    TaskHandle_t caller;
+    volatile bool failed;
+};
+} // namespace
+
+static void writerTask(void *arg) {
+    Pipe *pipe = (Pipe *)arg;
+    Block block;
+    for (;;) {
+        if (xQueueReceive(pipe->fullBlocks, &block, portMAX_DELAY) != pdTRUE) continue;
+        if (!block.data) break; // end of the transfer, every block before it is written
+        if (!pipe->failed && !(*pipe->write)(block.data, block.offset, block.len)) pipe->failed = true;
+        xQueueSend(pipe->freeBlocks, &block, portMAX_DELAY);
+    }
+    // the pipe lives on the caller's stack, it can't be touched once the caller is told
+    xTaskNotifyGive(pipe->caller);
+    vTaskDelete(NULL);
+}
+
+/***************************************************************************************
+** Function name: transferPartition
+** Description:   double buffered copy, one block is read and hashed while the other is written
+***************************************************************************************/
+bool transferPartition(size_t total, PartitionReadFn read, PartitionWriteFn write, uint8_t *sha256) {
+    uint8_t *buffers[2] = {
+        (uint8_t *)largeAlloc(PARTITION_IO_BUFFER), (uint8_t *)largeAlloc(PARTITION_IO_BUFFER)
+    };
+    if (!buffers[0]) std::swap(buffers[0], buffers[1]);
+    if (!buffers[0]) return false;
+
+    // without a second buffer, or a task to write it, the blocks are written in turn
+    Pipe pipe = {NULL, NULL, &write, xTaskGetCurrentTaskHandle(), false};
+    TaskHandle_t writer = NULL;
+    if (buffers[1]) {
+        pipe.freeBlocks = xQueueCreate(2, sizeof(Block));
+        pipe.fullBlocks = xQueueCreate(2, sizeof(Block));
+        if (pipe.freeBlocks && pipe.fullBlocks &&
+            xTaskCreate(writerTask, "PartitionIo", 4096, &pipe, uxTaskPriorityGet(NULL), &writer) == pdPASS) {
+            for (uint8_t *data : buffers) {
+                Block block = {data, 0, 0};
+                xQueueSend(pipe.freeBlocks, &block, 0);
+            }
+        } else writer = NULL;
+    }
+
+    mbedtls_sha256_context ctx;
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_starts(&ctx, 0);
+    bool ok = true;
+    uint32_t lastUi = millis();
+    for (size_t offset = 0; ok && offset < total;) {
+        Block block = {buffers[0], 0, 0};
+        if (writer) xQueueReceive(pipe.freeBlocks, &block, portMAX_DELAY);
+        block.offset = offset;
+        block.len = std::min(total - offset, (size_t)PARTITION_IO_BUFFER);
+        for (size_t got = 0, n; ok && got < block.len; got += n) {
+            n = read(block.data + got, offset + got, block.len - got);
+            ok = n > 0 && !pipe.failed;
+        }
+        if (!ok) {
+            if (writer) xQueueSend(pipe.freeBlocks, &block, 0);
+            break;
+        }
+        if (sha256) mbedtls_sha256_update(&ctx, block.data, block.len);
+        if (writer) xQueueSend(pipe.fullBlocks, &block, portMAX_DELAY);
+        else ok = write(block.data, block.offset, block.len);
+        offset += block.len;
+        if (offset == total || millis() - lastUi >= PARTITION_IO_UI_MS) {
+            progressHandler(offset, total);
+            lastUi = millis();
+        }
+    }
+
+    if (writer) { // the writer ends itself once it reaches this empty block
+        Block block = {nullptr, 0, 0};
+        xQueueSend(pipe.fullBlocks, &block, portMAX_DELAY);
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+    if (pipe.freeBlocks) vQueueDelete(pipe.freeBlocks);
+    if (pipe.fullBlocks) vQueueDelete(pipe.fullBlocks);
+    free(buffers[0]);
+    free(buffers[1]);
+    if (sha256) mbedtls_sha256_finish(&ctx, sha256);
+    mbedtls_sha256_free(&ctx);
+    return ok && !pipe.failed;
+}
+
+String sha256Hex(const uint8_t *sha256) {
+    char hex[65];
+    for (int i = 0; i < 32; i++) sprintf(hex + 2 * i, "%02x", sha256[i]);
+    return String(hex);
+}
+
+bool writeManifest(const String &path, const uint8_t *sha256) {
+    File file = SDM.open(path + ".sha256", FILE_WRITE);
+    if (!file) return false;
+    String line = sha256Hex(sha256) + "  " + path.substring(path.lastIndexOf('/') + 1) + "\n";
+    bool ok = file.print(line) == line.length();
+    file.close();
+    return ok;
+}
+
+/***************************************************************************************
+** Function name: backupPartition
+** Description:   dump partition to the SD card as a sparse image, with its manifest
+***************************************************************************************/
+bool backupPartition(const esp_partition_t *partition, const String &path, String *error) {
+    File file = SDM.open(path, FILE_WRITE);
+    if (!file) {
+        if (error) *error = "Fail creating " + path;
+        return false;
+    }
+    esp_err_t readError = ESP_OK;
+    uint8_t sha256[32];
+    SparseEncoder encoder;
+    bool ok = encoder.begin(file, partition->label, partition->size) &&
+              transferPartition(
+                  partition->size,
+                  [&](uint8_t *data, size_t offset, size_t len) -> size_t {
+                      readError = esp_partition_read(partition, offset, data, len);
+                      return readError == ESP_OK ? len : 0;
+                  },
+                  [&](const uint8_t *data, size_t offset, size_t len) { return encoder.write(data, len); },
+                  sha256
+              ) &&
+              encoder.end(sha256);
+    file.close();
+    if (ok && !writeManifest(path, sha256)) ok = false;
+    if (!ok) {
+        log_e("Backup of %s failed, read error %d", partition->label, readError);
+        if (error)
+            *error = readError != ESP_OK ? "Fail reading " + String(partition->label) : "Fail writing to SD";
+        SDM.remove(path);
+        SDM.remove(path + ".sha256");
+    }
+    return ok;
+}
@@ -0,0 +1,38 @@
+#ifndef __PARTITION_IO_H
+#define __PARTITION_IO_H
+
+#include <Arduino.h>
+#include <esp_partition.h>
+#include <functional>
+
+#ifndef PARTITION_IO_BUFFER
+#ifdef BOARD_HAS_PSRAM
+#define PARTITION_IO_BUFFER (64 * 1024) // bytes per flash read or SD write, two of them
+#else
+#define PARTITION_IO_BUFFER (16 * 1024)
+#endif
+#endif
+
+#ifndef PARTITION_IO_UI_MS
+#define PARTITION_IO_UI_MS 100 // minimum time between two progressHandler() calls
+#endif
+
+// Fills data with up to len bytes found at offset of the source, returns how many, 0 on error
+typedef std::function<size_t(uint8_t *data, size_t offset, size_t len)> PartitionReadFn;
+// Writes the len bytes of data at offset of the destination
+typedef std::function<bool(const uint8_t *data, size_t offset, size_t len)> PartitionWriteFn;
+
+// Moves total bytes from read() to write() by PARTITION_IO_BUFFER blocks. write() of a block
+// runs on a helper task while read() fills the next one, so a transfer takes about as long as
+// its slower side. sha256, when given, receives the SHA-256 of the data.
+bool transferPartition(size_t total, PartitionReadFn read, PartitionWriteFn write, uint8_t *sha256 = nullptr);
+
+// Saves a partition to path on the SD card as a sparse image (see sparseImage.h), and the
+// SHA-256 of its content to path + ".sha256"
+bool backupPartition(const esp_partition_t *partition, const String &path, String *error = nullptr);
+
+// "<hash>  <file name>" manifest next to path, the format of sha256sum
+bool writeManifest(const String &path, const uint8_t *sha256);
+String sha256Hex(const uint8_t *sha256);
+
+#endif
@@ -0,0 +1,202 @@
+#include "partitionTable.h"
+#include <MD5Builder.h>
+#include <MemUtils.h>
+
+#define PART_MAGIC 0x50AA     // AA 50, first bytes of every entry
+#define PART_MD5_MAGIC 0xEBEB // EB EB, row holding the MD5 of the entries before it
+#define PART_MAX_ENTRIES (PART_TABLE_MAX_SIZE / PART_ENTRY_SIZE - 1)
+
+static uint32_t alignUp(uint32_t value, uint32_t align) { return (value + align - 1) & ~(align - 1); }
+
+static uint32_t alignFor(uint8_t type) { return type == PART_APP ? PART_APP_ALIGN : PART_DATA_ALIGN; }
+
+static void putLe32(uint8_t *p, uint32_t value) {
+    for (int i = 0; i < 4; i++) p[i] = value >> (8 * i);
+}
+
+static void md5Row(const uint8_t *entries, size_t len, uint8_t *row) {
+    MD5Builder md5;
+    md5.begin();
+    md5.add(entries, len);
+    md5.calculate();
+    row[0] = row[1] = 0xEB;
+    memset(row + 2, 0xFF, 14);
+    md5.getBytes(row + 16);
+}
+
+bool PartitionTable::add(const char *label, uint8_t type, uint8_t subtype, uint32_t size, uint32_t offset) {
+    if (_entries.size() >= PART_MAX_ENTRIES || strlen(label) > 16) return false;
+    if (!offset) {
+        uint32_t end = _entries.empty() ? PART_TABLE_OFFSET + PART_DATA_ALIGN
+                                        : _entries.back().offset + _entries.back().size;
+        offset = alignUp(end, alignFor(type));
+    }
+    Entry entry = {};
+    strncpy(entry.label, label, 16);
+    entry.type = type;
+    entry.subtype = subtype;
+    entry.offset = offset;
+    entry.size = size;
+    _entries.push_back(entry);
+    return true;
+}
+
+bool PartitionTable::add(const PartitionSpec *specs, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        const PartitionSpec &spec = specs[i];
+        if (!add(spec.label, spec.type, spec.subtype, spec.size, spec.offset)) return false;
+    }
+    return true;
+}
+
+/***************************************************************************************
+** Function name: parse
+** Description:   reads the entries of a binary table, as stored at PART_TABLE_OFFSET
+***************************************************************************************/
+bool PartitionTable::parse(const uint8_t *data, size_t len) {
+    _entries.clear();
+    for (size_t pos = 0; pos + PART_ENTRY_SIZE <= len; pos += PART_ENTRY_SIZE) {
+        const uint8_t *row = data + pos;
+        uint16_t magic = row[0] | row[1] << 8;
+        if (magic == PART_MD5_MAGIC) {
+            uint8_t md5[PART_ENTRY_SIZE];
+            md5Row(data, pos, md5);
+            return memcmp(md5 + 16, row + 16, 16) == 0;
+        }
+        if (magic != PART_MAGIC) break;
+        if (_entries.size() >= PART_MAX_ENTRIES) return false;
+        Entry entry = {};
+        memcpy(entry.label, row + 12, 16);
+        entry.type = row[2];
+        entry.subtype = row[3];
+        entry.offset = le32(row + 4);
+        entry.size = le32(row + 8);
+        entry.flags = le32(row + 28);
+        _entries.push_back(entry);
+    }
+    return !_entries.empty();
+}
+
+/***************************************************************************************
+** Function name: validate
+** Description:   checks the table the way the bootloader and esp_partition would use it
+***************************************************************************************/
+bool PartitionTable::validate(uint32_t flashSize, String *error) const {
+    String problem;
+    if (_entries.empty()) problem = "Empty partition table";
+    uint32_t end = PART_TABLE_OFFSET + PART_DATA_ALIGN; // the table owns its sector
+    for (const Entry &entry : _entries) {
+        if (problem.length()) break;
+        String name = entry.label;
+        uint32_t align = alignFor(entry.type);
+        if (!entry.label[0]) problem = "Partition without label";
+        else if (entry.offset % align || entry.size % PART_DATA_ALIGN)
+            problem = name + " is not aligned to 0x" + String(align, HEX);
+        else if (!entry.size) problem = name + " is empty";
+        else if (entry.offset < end) problem = name + " overlaps the previous partition";
+        else if (entry.offset > flashSize || entry.size > flashSize - entry.offset)
+            problem = name + " ends past the " + String(flashSize >> 20) + "MB flash";
+        for (const Entry &other : _entries) {
+            if (&other == &entry) break;
+            if (!strcmp(other.label, entry.label)) problem = "Two partitions named " + name;
+        }
+        end = entry.offset + entry.size;
+    }
+    if (!problem.length() && !find(PART_APP, PART_TEST) && !find(PART_APP, PART_FACTORY))
+        problem = "No partition to boot the Launcher";
+    if (problem.length()) {
+        log_e("Partition table: %s", problem.c_str());
+        if (error) *error = problem;
+        return false;
+    }
+    return true;
+}
+
+/***************************************************************************************
+** Function name: build
+** Description:   binary table, same layout as gen_esp32part.py writes, MD5 row included
+***************************************************************************************/
+size_t PartitionTable::build(uint8_t *out, size_t len) const {
+    size_t total = (_entries.size() + 1) * PART_ENTRY_SIZE;
+    if (len < total) return 0;
+    uint8_t *row = out;
+    for (const Entry &entry : _entries) {
+        row[0] = PART_MAGIC & 0xFF;
+        row[1] = PART_MAGIC >> 8;
+        row[2] = entry.type;
+        row[3] = entry.subtype;
+        putLe32(row + 4, entry.offset);
+        putLe32(row + 8, entry.size);
+        memset(row + 12, 0, 16);
+        memcpy(row + 12, entry.label, strlen(entry.label));
+        putLe32(row + 28, entry.flags);
+        row += PART_ENTRY_SIZE;
+    }
+    md5Row(out, row - out, row);
+    return total;
+}
+
+const PartitionTable::Entry *PartitionTable::find(uint8_t type, uint8_t subtype, const char *label) const {
+    for (const Entry &entry : _entries) {
+        if (entry.type == type && entry.subtype == subtype && (!label || !strcmp(entry.label, label)))
+            return &entry;
+    }
+    return nullptr;
+}
+
+FirmwareSizes PartitionTable::firmwareSizes() const {
+    FirmwareSizes sizes = {0, 0, 0, 0};
+    for (const Entry &entry : _entries) {
+        if (entry.type == PART_APP && entry.offset == PART_APP_ALIGN) sizes.app = entry.size;
+        else if (entry.type != PART_DATA) continue;
+        else if (entry.subtype == PART_SPIFFS && !sizes.spiffs) sizes.spiffs = entry.size;
+        else if (entry.subtype == PART_FAT && !strcmp(entry.label, "sys")) sizes.fat_sys = entry.size;
+        else if (entry.subtype == PART_FAT && !strcmp(entry.label, "vfs")) sizes.fat_vfs = entry.size;
+    }
+    return sizes;
+}
+
+/***************************************************************************************
+** Function name: fitPartitions
+** Description:   nvs and the Launcher stay where they are, coredump ends the flash with
+**                spiffs, vfs and sys right before it, app1 takes what is left between
+***************************************************************************************/
+bool fitPartitions(
+    const PartitionTable &current, const FirmwareSizes &want, uint32_t flashSize, PartitionTable &out,
+    String *error
+) {
+    out.clear();
+    const PartitionTable::Entry *launcher = current.find(PART_APP, PART_TEST);
+    if (!launcher) {
+        if (error) *error = "Launcher partition not found";
+        return false;
+    }
+    uint32_t launcherEnd = launcher->offset + launcher->size;
+    for (const PartitionTable::Entry &entry : current.entries()) {
+        if (entry.offset + entry.size > launcherEnd) continue;
+        out.add(entry.label, entry.type, entry.subtype, entry.size, entry.offset);
+    }
+
+    // laid out backwards from the end of the flash
+    uint32_t coredump = flashSize - PART_COREDUMP_SIZE;
+    uint32_t spiffs = coredump - alignUp(want.spiffs, PART_DATA_ALIGN);
+    uint32_t vfs = spiffs - alignUp(want.fat_vfs, PART_DATA_ALIGN);
+    uint32_t sys = vfs - alignUp(want.fat_sys, PART_DATA_ALIGN);
+    uint32_t app1 = alignUp(launcherEnd, PART_APP_ALIGN);
+    uint32_t app1End = sys & ~(PART_APP_ALIGN - 1);
+    if (sys > flashSize || app1End < app1 + alignUp(want.app, PART_DATA_ALIGN)) {
+        if (error) *error = "Firmware doesn't fit in " + String(flashSize >> 20) + "MB";
+        return false;
+    }
+    // what app1 can't use for being unaligned goes to the first data partition after it
+    if (want.fat_sys) sys = app1End;
+    else if (want.fat_vfs) vfs = app1End;
+    else if (want.spiffs) spiffs = app1End;
+
+    out.add("app1", PART_APP, PART_OTA_0, app1End - app1, app1);
+    if (want.fat_sys) out.add("sys", PART_DATA, PART_FAT, vfs - sys, sys);
+    if (want.fat_vfs) out.add("vfs", PART_DATA, PART_FAT, spiffs - vfs, vfs);
+    if (want.spiffs) out.add("spiffs", PART_DATA, PART_SPIFFS, coredump - spiffs, spiffs);
+    out.add("coredump", PART_DATA, PART_COREDUMP, PART_COREDUMP_SIZE, coredump);
+    return out.validate(flashSize, error);
+}
@@ -0,0 +1,87 @@
+#ifndef __PARTITION_TABLE_H
+#define __PARTITION_TABLE_H
+
+#include <Arduino.h>
+#include <vector>
+
+#define PART_TABLE_OFFSET 0x8000   // where the bootloader reads the table
+#define PART_TABLE_MAX_SIZE 0xC00  // entries and MD5 row, the rest of the sector stays erased
+#define PART_ENTRY_SIZE 32
+#define PART_APP_ALIGN 0x10000
+#define PART_DATA_ALIGN 0x1000
+
+#ifndef PART_COREDUMP_SIZE
+#define PART_COREDUMP_SIZE 0x10000 // kept at the end of the flash by fitted schemes
+#endif
+
+// Partition types and subtypes, as in the .csv files of support_files
+#define PART_APP 0x00
+#define PART_DATA 0x01
+#define PART_FACTORY 0x00
+#define PART_OTA_0 0x10
+#define PART_TEST 0x20
+#define PART_OTADATA 0x00
+#define PART_PHY 0x01
+#define PART_NVS 0x02
+#define PART_COREDUMP 0x03
+#define PART_FAT 0x81
+#define PART_SPIFFS 0x82
+
+// One line of a partitions .csv, offset 0 places it right after the previous one
+struct PartitionSpec {
+    const char *label;
+    uint8_t type;
+    uint8_t subtype;
+    uint32_t offset;
+    uint32_t size;
+};
+
+// Partition sizes a firmware comes with, 0 for the ones it doesn't have
+struct FirmwareSizes {
+    uint32_t app;
+    uint32_t spiffs;
+    uint32_t fat_sys;
+    uint32_t fat_vfs;
+};
+
+// Builds the binary partition table the bootloader reads at PART_TABLE_OFFSET, MD5 row included,
+// from specs instead of hand written byte arrays
+class PartitionTable {
+public:
+    struct Entry {
+        char label[17];
+        uint8_t type;
+        uint8_t subtype;
+        uint32_t offset;
+        uint32_t size;
+        uint32_t flags;
+    };
+
+    void clear() { _entries.clear(); }
+    bool add(const char *label, uint8_t type, uint8_t subtype, uint32_t size, uint32_t offset = 0);
+    bool add(const PartitionSpec *specs, size_t count);
+    // Reads a binary table up to its MD5 row, which must match, or its first empty entry
+    bool parse(const uint8_t *data, size_t len);
+
+    // Alignment, overlaps, labels and every partition within flashSize
+    bool validate(uint32_t flashSize, String *error = nullptr) const;
+    // Entries then the MD5 row, returns the bytes used, 0 when len is too small
+    size_t build(uint8_t *out, size_t len) const;
+
+    const std::vector<Entry> &entries() const { return _entries; }
+    const Entry *find(uint8_t type, uint8_t subtype, const char *label = nullptr) const;
+    // What a merged image laid out by this table holds, the app being the one at 0x10000
+    FirmwareSizes firmwareSizes() const;
+
+private:
+    std::vector<Entry> _entries;
+};
+
+// Scheme sized to a firmware: the entries up to the Launcher partition are kept from current,
+// SPIFFS and FAT get the firmware's sizes at the end of the flash and app1 all the space left
+bool fitPartitions(
+    const PartitionTable &current, const FirmwareSizes &want, uint32_t flashSize, PartitionTable &out,
+    String *error = nullptr
+);
+
+#endif
@@ -2,147 +2,163 @@
 #include "display.h"
 #include "esp_heap_caps.h"
 #include "mykeyboard.h"
+#include "partitionIo.h"
+#include "sparseImage.h"
 #include "sd_functions.h"
 #include <globals.h>
 
 // Define o tamanho da partição
 #define PARTITION_SIZE 4096
 
-// Using "buff[4096]" to store and write the partitions
+// Schemes offered by partitioner(), built into a binary table by PartitionTable
 #if defined(PART_08MB)
 // default partition scheme(App, FAT and SPIFFS)
-const uint8_t def_part[224] PROGMEM = {
-    0xAA, 0x50, 0x01, 0x02, 0x00, 0x90, 0x00, 0x00, 0x00, 0x60, 0x00, 0x00, 0x6E, 0x76, 0x73, 0x00,
-    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-    0xAA, 0x50, 0x00, 0x20, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x16, 0x00, 0x61, 0x70, 0x70, 0x30,
-    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-    0xAA, 0x50, 0x00, 0x10, 0x00, 0x00, 0x17, 0x00, 0x00, 0x00, 0x4F, 0x00, 0x61, 0x70, 0x70, 0x31,
-    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-    0xAA, 0x50, 0x01, 0x81, 0x00, 0x00, 0x67, 0x00, 0x00, 0x00, 0x08, 0x00, 0x76, 0x66, 0x73, 0x00,
-    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-    0xAA, 0x50, 0x01, 0x82, 0x00, 0x00, 0x6F, 0x00, 0x00, 0x00, 0x10, 0x00, 0x73, 0x70, 0x69, 0x66,
-    0x66, 0x73, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-    0xAA, 0x50, 0x01, 0x03, 0x00, 0x00, 0x7F, 0x00, 0x00, 0x00, 0x01, 0x00, 0x63, 0x6F, 0x72, 0x65,
-    0x64, 0x75, 0x6D, 0x70, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-    0xEB, 0xEB, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-    0xBF, 0xE1, 0xC0, 0x6C, 0x4F, 0xCC, 0x25, 0x52, 0x53, 0xAB, 0xDA, 0xEA, 0x74, 0x87, 0x7F, 0x13
+const PartitionSpec def_part[] = {
+    {"nvs",      PART_DATA, PART_NVS,      0x9000,   0x6000  },
+    {"app0",     PART_APP,  PART_TEST,     0x10000,  0x160000},
+    {"app1",     PART_APP,  PART_OTA_0,    0x170000, 0x4F0000},
+    {"vfs",      PART_DATA, PART_FAT,      0x670000, 0x80000 },
+    {"spiffs",   PART_DATA, PART_SPIFFS,   0x6F0000, 0x100000},
+    {"coredump", PART_DATA, PART_COREDUMP, 0x7F0000, 0x10000 },
 };
 // 6Mb app partition
-const uint8_t doom[160] PROGMEM = {
-    0xAA, 0x50, 0x01, 0x02, 0x00, 0x90, 0x00, 0x00, 0x00, 0x60, 0x00, 0x00, 0x6E, 0x76, 0x73, 0x00,
-    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-    0xAA, 0x50, 0x00, 0x20, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x16, 0x00, 0x61, 0x70, 0x70, 0x30,
-    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-    0xAA, 0x50, 0x00, 0x10, 0x00, 0x00, 0x17, 0x00, 0x00, 0x00, 0x68, 0x00, 0x61, 0x70, 0x70, 0x31,
-    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-    0xAA, 0x50, 0x01, 0x03, 0x00, 0x00, 0x7F, 0x00, 0x00, 0x00, 0x01, 0x00, 0x63, 0x6F, 0x72, 0x65,
-    0x64, 0x75, 0x6D, 0x70, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-    0xEB, 0xEB, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-    0x2D, 0x3C, 0x30, 0x3F, 0x42, 0x7D, 0x51, 0xEE, 0xE9, 0x2B, 0x8D, 0x78, 0xCB, 0x29, 0x7D, 0xDC
+const PartitionSpec doom[] = {
+    {"nvs",      PART_DATA, PART_NVS,      0x9000,   0x6000  },
+    {"app0",     PART_APP,  PART_TEST,     0x10000,  0x160000},
+    {"app1",     PART_APP,  PART_OTA_0,    0x170000, 0x680000},
+    {"coredump", PART_DATA, PART_COREDUMP, 0x7F0000, 0x10000 },
 };
-
-const uint8_t uiflow2[192] PROGMEM = {
-    // uiflow partition scheme, APP, sys(FAT) and vfs(FAT)
-    0xAA, 0x50, 0x01, 0x02, 0x00, 0x90, 0x00, 0x00, 0x00, 0x60, 0x00, 0x00, 0x6E, 0x76, 0x73, 0x00,
-    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-    0xAA, 0x50, 0x00, 0x20, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x16, 0x00, 0x61, 0x70, 0x70, 0x30,
-    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-    0xAA, 0x50, 0x00, 0x10, 0x00, 0x00, 0x17, 0x00, 0x00, 0x00, 0x4E, 0x00, 0x61, 0x70, 0x70, 0x31,
-    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-    0xAA, 0x50, 0x01, 0x81, 0x00, 0x00, 0x65, 0x00, 0x00, 0x00, 0x10, 0x00, 0x73, 0x79, 0x73, 0x00,
-    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-    0xAA, 0x50, 0x01, 0x81, 0x00, 0x00, 0x75, 0x00, 0x00, 0x00, 0x0B, 0x00, 0x76, 0x66, 0x73, 0x00,
-    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-    0xEB, 0xEB, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-    0xF0, 0x4F, 0xA2, 0x1D, 0x91, 0x76, 0x30, 0x87, 0x76, 0x59, 0xCC, 0x84, 0xED, 0x69, 0x02, 0xE3
+// uiflow partition scheme, APP, sys(FAT) and vfs(FAT)
+const PartitionSpec uiflow2[] = {
+    {"nvs",  PART_DATA, PART_NVS,   0x9000,   0x6000  },
+    {"app0", PART_APP,  PART_TEST,  0x10000,  0x160000},
+    {"app1", PART_APP,  PART_OTA_0, 0x170000, 0x4E0000},
+    {"sys",  PART_DATA, PART_FAT,   0x650000, 0x100000},
+    {"vfs",  PART_DATA, PART_FAT,   0x750000, 0xB0000 },
 };
 
 #elif defined(PART_16MB)
-
-const uint8_t def_part[288] PROGMEM = {
-    0xAA, 0x50, 0x01, 0x02, 0x00, 0x90, 0x00, 0x00, 0x00, 0x60, 0x00, 0x00, 0x6E, 0x76, 0x73, 0x00,
-    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-    0xAA, 0x50, 0x00, 0x20, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x1F, 0x00, 0x61, 0x70, 0x70, 0x30,
-    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-    0xAA, 0x50, 0x00, 0x10, 0x00, 0x00, 0x20, 0x00, 0x00, 0x00, 0x80, 0x00, 0x61, 0x70, 0x70, 0x31,
-    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-    0xAA, 0x50, 0x01, 0x81, 0x00, 0x00, 0xA0, 0x00, 0x00, 0x00, 0x10, 0x00, 0x73, 0x79, 0x73, 0x00,
-    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-    0xAA, 0x50, 0x01, 0x81, 0x00, 0x00, 0xB0, 0x00, 0x00, 0x00, 0x20, 0x00, 0x76, 0x66, 0x73, 0x00,
-    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-    0xAA, 0x50, 0x01, 0x82, 0x00, 0x00, 0xD0, 0x00, 0x00, 0x00, 0x2F, 0x00, 0x73, 0x70, 0x69, 0x66,
-    0x66, 0x73, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-    0xAA, 0x50, 0x01, 0x03, 0x00, 0x00, 0xFF, 0x00, 0x00, 0x00, 0x01, 0x00, 0x63, 0x6F, 0x72, 0x65,
-    0x64, 0x75, 0x6D, 0x70, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-    0xEB, 0xEB, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-    0x2C, 0x4E, 0x70, 0x13, 0x8D, 0xF3, 0xB0, 0xF7, 0xBF, 0x69, 0x7C, 0xF1, 0x13, 0xDB, 0x36, 0xC1
+const PartitionSpec def_part[] = {
+    {"nvs",      PART_DATA, PART_NVS,      0x9000,   0x6000  },
+    {"app0",     PART_APP,  PART_TEST,     0x10000,  0x1F0000},
+    {"app1",     PART_APP,  PART_OTA_0,    0x200000, 0x800000},
+    {"sys",      PART_DATA, PART_FAT,      0xA00000, 0x100000},
+    {"vfs",      PART_DATA, PART_FAT,      0xB00000, 0x200000},
+    {"spiffs",   PART_DATA, PART_SPIFFS,   0xD00000, 0x2F0000},
+    {"coredump", PART_DATA, PART_COREDUMP, 0xFF0000, 0x10000 },
 };
 
-const uint8_t uiFlow1[352] PROGMEM = {
-    0xAA, 0x50, 0x01, 0x02, 0x00, 0x90, 0x00, 0x00, 0x00, 0x60, 0x00, 0x00, 0x6E, 0x76, 0x73, 0x00, 0x00,
-    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xAA, 0x50,
-    0x01, 0x01, 0x00, 0xF0, 0x00, 0x00, 0x00, 0x10, 0x00, 0x00, 0x70, 0x68, 0x79, 0x5F, 0x69, 0x6E, 0x69,
-    0x74, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xAA, 0x50, 0x00, 0x20,
-    0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x1D, 0x00, 0x61, 0x70, 0x70, 0x30, 0x00, 0x00, 0x00, 0x00, 0x00,
-    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xAA, 0x50, 0x00, 0x10, 0x00, 0x00,
-    0x1E, 0x00, 0x00, 0x00, 0x4E, 0x00, 0x61, 0x70, 0x70, 0x31, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xAA, 0x50, 0x01, 0x81, 0x00, 0x00, 0x6C, 0x00,
-    0x00, 0x00, 0x53, 0x00, 0x76, 0x66, 0x73, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xAA, 0x50, 0x40, 0x40, 0x00, 0xE0, 0xBF, 0x00, 0x00, 0x10,
-    0x00, 0x00, 0x63, 0x6F, 0x6E, 0x66, 0x69, 0x67, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-    0x00, 0x00, 0x00, 0x00, 0x00, 0xAA, 0x50, 0x50, 0x50, 0x00, 0xF0, 0xBF, 0x00, 0x00, 0x10, 0x00, 0x00,
-    0x77, 0x69, 0x66, 0x69, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-    0x00, 0x00, 0x00, 0xAA, 0x50, 0x01, 0x81, 0x00, 0x00, 0xC0, 0x00, 0x00, 0x00, 0x10, 0x00, 0x73, 0x79,
-    0x73, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-    0x00, 0xAA, 0x50, 0x01, 0x82, 0x00, 0x00, 0xD0, 0x00, 0x00, 0x00, 0x2F, 0x00, 0x73, 0x70, 0x69, 0x66,
-    0x66, 0x73, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xAA,
-    0x50, 0x01, 0x03, 0x00, 0x00, 0xFF, 0x00, 0x00, 0x00, 0x01, 0x00, 0x63, 0x6F, 0x72, 0x65, 0x64, 0x75,
-    0x6D, 0x70, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xEB, 0xEB, 0xFF,
-    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x38, 0x4C, 0x68, 0xD6,
-    0x6A, 0x40, 0x6E, 0x11, 0xB8, 0x86, 0xC8, 0xA7, 0xBE, 0xD5, 0x72, 0xF9
+const PartitionSpec uiFlow1[] = {
+    {"nvs",      PART_DATA, PART_NVS,      0x9000,   0x6000  },
+    {"phy_init", PART_DATA, PART_PHY,      0xF000,   0x1000  },
+    {"app0",     PART_APP,  PART_TEST,     0x10000,  0x1D0000},
+    {"app1",     PART_APP,  PART_OTA_0,    0x1E0000, 0x4E0000},
+    {"vfs",      PART_DATA, PART_FAT,      0x6C0000, 0x530000},
+    {"config",   0x40,      0x40,          0xBFE000, 0x1000  },
+    {"wifi",     0x50,      0x50,          0xBFF000, 0x1000  },
+    {"sys",      PART_DATA, PART_FAT,      0xC00000, 0x100000},
+    {"spiffs",   PART_DATA, PART_SPIFFS,   0xD00000, 0x2F0000},
+    {"coredump", PART_DATA, PART_COREDUMP, 0xFF0000, 0x10000 },
 };
 #endif
 
-// Função para apagar e escrever na região de memória flash
-bool partitionSetter(const uint8_t *scheme, size_t scheme_size) {
+/***************************************************************************************
+** Function name: partitionSetter
+** Description:   validates table against the flash chip and writes it over the current one
+***************************************************************************************/
+bool partitionSetter(const PartitionTable &table, String *error) {
+    if (!table.validate(ESP.getFlashChipSize(), error)) return false;
     uint8_t *buffer = (uint8_t *)heap_caps_malloc(PARTITION_SIZE, MALLOC_CAP_INTERNAL);
     if (buffer == NULL) {
         ESP_LOGE("FLASH", "Failed to allocate buffer in DRAM");
+        if (error) *error = "Not enough memory";
         return false;
     }
 
     // Preencher o buffer com 0xFF
     memset(buffer, 0xFF, PARTITION_SIZE);
 
-    // Copiar o esquema de partição para o buffer
-    memcpy(buffer, scheme, scheme_size);
+    // Montar a tabela, com a linha do MD5, no buffer
+    table.build(buffer, PART_TABLE_MAX_SIZE);
 
     esp_err_t err;
 
     // Apagar a região de memória flash
-    err = esp_flash_erase_region(NULL, 0x8000, PARTITION_SIZE);
+    err = esp_flash_erase_region(NULL, PART_TABLE_OFFSET, PARTITION_SIZE);
     if (err != ESP_OK) {
         ESP_LOGE("FLASH", "Failed to erase flash region (0x%x)", err);
+        if (error) *error = "Partitioning Error";
         heap_caps_free(buffer);
         return false;
     }
 
     // Escrever o buffer na memória flash
-    err = esp_flash_write(NULL, buffer, 0x8000, PARTITION_SIZE);
+    err = esp_flash_write(NULL, buffer, PART_TABLE_OFFSET, PARTITION_SIZE);
     if (err != ESP_OK) {
         ESP_LOGE("FLASH", "Failed to write to flash (0x%x)", err);
+        if (error) *error = "Partitioning Error";
         heap_caps_free(buffer);
         return false;
     }
 
+    // Ler de volta, a linha do MD5 tem que bater com as entradas
+    PartitionTable written;
+    bool ok = esp_flash_read(NULL, buffer, PART_TABLE_OFFSET, PART_TABLE_MAX_SIZE) == ESP_OK &&
+              written.parse(buffer, PART_TABLE_MAX_SIZE) &&
+              written.entries().size() == table.entries().size();
     heap_caps_free(buffer);
-    return true;
+    if (!ok) {
+        ESP_LOGE("FLASH", "Partition table doesn't read back as written");
+        if (error) *error = "Verify failed";
+    }
+    return ok;
+}
+
+/***************************************************************************************
+** Function name: offerFitPartitions
+** Description:   when a firmware is bigger than the partitions it goes to, offers to
+**                resize them for it instead of truncating, restarts once resized
+***************************************************************************************/
+void offerFitPartitions(const FirmwareSizes &want) {
+    if (want.app <= MAX_APP && want.spiffs <= MAX_SPIFFS && want.fat_sys <= MAX_FAT_sys &&
+        want.fat_vfs <= MAX_FAT_vfs)
+        return;
+
+    PartitionTable current, fitted;
+    String error;
+    uint8_t *raw = (uint8_t *)malloc(PART_TABLE_MAX_SIZE);
+    bool ok = raw && esp_flash_read(NULL, raw, PART_TABLE_OFFSET, PART_TABLE_MAX_SIZE) == ESP_OK &&
+              current.parse(raw, PART_TABLE_MAX_SIZE) &&
+              fitPartitions(current, want, ESP.getFlashChipSize(), fitted, &error);
+    free(raw);
+    if (!ok) {
+        log_i("Partitions can't be resized: %s", error.c_str());
+        return;
+    }
+
+    bool resize = false;
+    options = {
+        {"Truncate",    [&]() { resize = false; }},
+        {"Repartition", [&]() { resize = true; } },
+    };
+    loopOptions(options);
+    if (!resize) return;
+    if (!partitionSetter(fitted, &error)) {
+        displayRedStripe(error);
+        delay(2500);
+        return;
+    }
+    displayRedStripe("Restart, install again");
+    while (!check(SelPress)) yield();
+    while (check(SelPress)) yield();
+    FREE_TFT
+    ESP.restart();
 }
 
 void partitioner() {
     int partition = 100;
-    const uint8_t *data = nullptr;
-    size_t data_size = 0;
+    PartitionTable table;
+    String error;
 
     // Opções de partição
     options = {
@@ -161,34 +177,24 @@ void partitioner() {
     if (partition == 100) goto Exit;
     switch (partition) {
 #if !defined(PART_04MB)
-        case 0:
-            data = def_part;
-            data_size = sizeof(def_part);
-            break;
+        case 0: table.add(def_part, sizeof(def_part) / sizeof(def_part[0])); break;
 #endif
 #if defined(PART_08MB)
-        case 1:
-            data = doom;
-            data_size = sizeof(doom);
-            break;
-        case 2:
-            data = uiflow2;
-            data_size = sizeof(uiflow2);
-            break;
+        case 1: table.add(doom, sizeof(doom) / sizeof(doom[0])); break;
+        case 2: table.add(uiflow2, sizeof(uiflow2) / sizeof(uiflow2[0])); break;
 #elif defined(PART_16MB)
         case 1:
-            data = uiFlow1;
+            table.add(uiFlow1, sizeof(uiFlow1) / sizeof(uiFlow1[0]));
             displayRedStripe("Experimental");
             delay(2500);
-            data_size = sizeof(uiFlow1);
             break;
 #endif
         default: goto Exit;
     }
 
-    if (!partitionSetter(data, data_size)) {
-        Serial.println("Error when running partitionSetter function");
-        displayRedStripe("Partitioning Error");
+    if (!partitionSetter(table, &error)) {
+        Serial.println("Error when running partitionSetter function: " + error);
+        displayRedStripe(error);
         while (!check(SelPress)) yield();
     }
 
@@ -241,113 +247,110 @@ void partList() {
     }
 }
 
-void dumpPartition(const char *partitionLabel, const char *outputPath) {
+bool dumpPartition(const char *partitionLabel, const char *outputPath, String *error) {
     tft->fillScreen(BGCOLOR);
     const esp_partition_t *partition =
         esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, partitionLabel);
     if (partition == NULL) {
         Serial.printf("Partição %s não encontrada\n", partitionLabel);
-        return;
+        if (error) *error = "No " + String(partitionLabel) + " partition";
+        return false;
     }
 
     setupSdCard();
     if (!SDM.exists("/bkp")) SDM.mkdir("/bkp");
 
-    File outputFile = SDM.open(outputPath, FILE_WRITE);
-    if (!outputFile) {
-        Serial.printf("Falha ao abrir o arquivo %s no cartão SD\n", outputPath);
-        return;
-    }
-
     Serial.printf("Iniciando dump da partição %s para o arquivo %s\n", partitionLabel, outputPath);
 
-    const size_t bufferSize = 1024; // Ajuste conforme necessário
-    uint8_t buffer[1024];
-    size_t bytesToRead = 0;
-    esp_err_t result;
+    String reason;
     progressHandler(0, 500);
     displayRedStripe("Backing up");
-    for (size_t offset = 0; offset < partition->size; offset += bufferSize) {
-        bytesToRead = (offset + bufferSize > partition->size) ? (partition->size - offset) : bufferSize;
-        result = esp_partition_read(partition, offset, buffer, bytesToRead);
-        if (result != ESP_OK) {
-            Serial.printf(
-                "Erro ao ler a partição %s no offset %d (código de erro: %d)\n",
-                partitionLabel,
-                offset,
-                result
-            );
-            outputFile.close();
-            return;
-        }
-        outputFile.write(buffer, bytesToRead);
-        progressHandler(int(offset + bufferSize), partition->size);
+    if (!backupPartition(partition, outputPath, &reason)) {
+        displayRedStripe(reason);
+        delay(2500);
+        if (error) *error = reason;
+        return false;
     }
-    outputFile.close();
     displayRedStripe("    Complete!    ");
     delay(2500);
 
     Serial.printf("Dump da partição %s para o arquivo %s concluído\n", partitionLabel, outputPath);
+    return true;
 }
 
 void restorePartition(const char *partitionLabel) {
     String filepath = loopSD(true);
     tft->fillScreen(BGCOLOR);
+    bool ok = false;
     if (filepath == "") return;
     else {
         File source = SDM.open(filepath, "r");
-        if (strcmp(partitionLabel, "spiffs") == 0) {
+        if (source && isSparseImage(source)) { // backups made by dumpPartition
+            const esp_partition_t *partition =
+                esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, partitionLabel);
+            String error = "No " + String(partitionLabel) + " partition";
+            if (strcmp(partitionLabel, "spiffs") == 0) prog_handler = 1;
+            progressHandler(0, 500);
+            displayRedStripe("Restoring");
+            ok = partition && restoreSparseImage(source, partition, &error);
+            if (!ok) {
+                displayRedStripe(error);
+                delay(2500);
+            }
+        } else if (strcmp(partitionLabel, "spiffs") == 0) {
             prog_handler = 1;
-            Update.begin(source.size(), U_SPIFFS);
-            uint8_t buffer[1024];
-            int bytesRead = 0;
-            int written = 0;
             size_t total = source.size();
             progressHandler(0, 500);
-            while (source.available()) {
-                bytesRead = source.read(buffer, sizeof(buffer));
-                Update.write(buffer, bytesRead);
-                written += bytesRead;
-                progressHandler(written, total);
-            }
+            ok = Update.begin(total, U_SPIFFS) &&
+                 transferPartition(
+                     total,
+                     [&](uint8_t *data, size_t offset, size_t len) { return source.read(data, len); },
+                     [](const uint8_t *data, size_t offset, size_t len) {
+                         return Update.write((uint8_t *)data, len) == len;
+                     }
+                 ) &&
+                 Update.end(true);
+            if (!ok) Update.abort();
+        } else if (strcmp(partitionLabel, "vfs") == 0) {
+            ok = performFATUpdate(source, source.size(), "vfs");
+        } else if (strcmp(partitionLabel, "sys") == 0) {
+            ok = performFATUpdate(source, source.size(), "sys");
         }
-
-        if (strcmp(partitionLabel, "vfs") == 0) { performFATUpdate(source, source.size(), "vfs"); }
-        if (strcmp(partitionLabel, "sys") == 0) { performFATUpdate(source, source.size(), "sys"); }
+        source.close();
     }
     delay(100);
-    displayRedStripe("    Restored!    ");
+    displayRedStripe(ok ? "    Restored!    " : "  Restore failed  ");
     delay(2500);
 }
 
 #define TAG "Partitioneer"
-#define BUFFER_SIZE 1024
 
-// Função para copiar partições com buffer de 1024 bytes
+// Função para copiar partições, em blocos de PARTITION_IO_BUFFER
 esp_err_t copy_partition(const esp_partition_t *src, const esp_partition_t *dst) {
-    uint8_t buffer[BUFFER_SIZE];
-    esp_err_t err;
+    esp_err_t readErr = ESP_OK, writeErr = ESP_OK;
+    FlashVerifier verifier;
+    verifier.begin(dst);
     progressHandler(0, 500);
     displayRedStripe("Launcher Update");
-    for (size_t offset = 0; offset < dst->size; offset += BUFFER_SIZE) {
-        size_t read_size = BUFFER_SIZE;
-        if (offset + BUFFER_SIZE > dst->size) { read_size = dst->size - offset; }
-
-        err = esp_partition_read(src, offset, buffer, read_size);
-        if (err != ESP_OK) {
-            ESP_LOGE(TAG, "Failed to read source partition at offset %u", offset);
-            return err;
-        }
-
-        err = esp_partition_write(dst, offset, buffer, read_size);
-        if (err != ESP_OK) {
-            ESP_LOGE(TAG, "Failed to write to destination partition at offset %u", offset);
-            return err;
+    transferPartition(
+        dst->size,
+        [&](uint8_t *data, size_t offset, size_t len) -> size_t {
+            readErr = esp_partition_read(src, offset, data, len);
+            if (readErr != ESP_OK) ESP_LOGE(TAG, "Failed to read source partition at offset %u", offset);
+            return readErr == ESP_OK ? len : 0;
+        },
+        [&](const uint8_t *data, size_t offset, size_t len) {
+            writeErr = esp_partition_write(dst, offset, data, len);
+            if (writeErr != ESP_OK)
+                ESP_LOGE(TAG, "Failed to write to destination partition at offset %u", offset);
+            verifier.add(data, len);
+            return writeErr == ESP_OK;
         }
-        progressHandler(offset + BUFFER_SIZE, dst->size);
-    }
-
-    return ESP_OK;
+    );
+    if (readErr != ESP_OK) return readErr;
+    if (writeErr != ESP_OK) return writeErr;
+    // the running Launcher is broken right after, the copy must be good
+    return verifier.verify() ? ESP_OK : ESP_ERR_INVALID_CRC;
 }
 
 // Função principal
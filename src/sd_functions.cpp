@@ -1,5 +1,12 @@
 #include "sd_functions.h"
+#include "archive.h"
+#include "dirIndex.h"
 #include "display.h"
+#include "fileOps.h"
+#include "imageInstaller.h"
+#include "partitionIo.h"
+#include "partitioner.h"
+#include "sparseImage.h"
 #include "esp_log.h"
 #include "mykeyboard.h"
 #include <esp_flash.h>
@@ -8,8 +15,7 @@
 #include <globals.h>
 SPIClass sdcardSPI;
 String fileToCopy;
-// Protected global variables
-String fileList[MAXFILES][3];
+static bool moveOnPaste = false; // fileToCopy was cut, not copied
 
 #ifndef PART_04MB
 /***************************************************************************************
@@ -96,6 +102,7 @@ bool setupSdCard() {
 ** Description:   Turn Off SDCard, set sdcardMounted state to false
 ***************************************************************************************/
 void closeSdCard() {
+    invalidateDirIndex(); // the card may be swapped
     SDM.end();
     sdcardMounted = false;
 }
@@ -118,28 +125,7 @@ bool ToggleSDCard() {
 ** Function name: deleteFromSd
 ** Description:   delete file or folder
 ***************************************************************************************/
-bool deleteFromSd(String path) {
-    File dir = SDM.open(path);
-    if (!dir.isDirectory()) { return SDM.remove(path.c_str()); }
-
-    dir.rewindDirectory();
-    bool success = true;
-
-    File file = dir.openNextFile();
-    while (file) {
-        if (file.isDirectory()) {
-            success &= deleteFromSd(file.path());
-        } else {
-            success &= SDM.remove(file.path());
-        }
-        file = dir.openNextFile();
-    }
-
-    dir.close();
-    // Apaga a própria pasta depois de apagar seu conteúdo
-    success &= SDM.rmdir(path.c_str());
-    return success;
-}
+bool deleteFromSd(String path) { return deletePath(path); }
 
 /***************************************************************************************
 ** Function name: renameFile
@@ -153,6 +139,7 @@ bool renameFile(String path, String filename) {
     }
 
     // Rename the file of folder
+    invalidateDirIndex();
     if (SDM.rename(path, path.substring(0, path.lastIndexOf('/')) + "/" + newName)) {
         // Serial.println("Renamed from " + filename + " to " + newName);
         return true;
@@ -164,23 +151,17 @@ bool renameFile(String path, String filename) {
 
 /***************************************************************************************
 ** Function name: copyFile
-** Description:   copy file address to memory
+** Description:   copy (or cut) file or folder address to memory
 ***************************************************************************************/
-bool copyFile(String path) {
+bool copyFile(String path, bool move) {
     if (!setupSdCard()) {
         // Serial.println("Fail to start SDCard");
         return false;
     }
-    File file = SDM.open(path, FILE_READ);
-    if (!file.isDirectory()) {
-        fileToCopy = path;
-        file.close();
-        return true;
-    } else {
-        displayRedStripe("Cannot copy Folder");
-        file.close();
-        return false;
-    }
+    if (!SDM.exists(path)) return false;
+    fileToCopy = path;
+    moveOnPaste = move;
+    return true;
 }
 
 /***************************************************************************************
@@ -188,48 +169,22 @@ bool copyFile(String path) {
 ** Description:   paste file to new folder
 ***************************************************************************************/
 bool pasteFile(String path) {
-    // Tamanho do buffer para leitura/escrita
-    const size_t bufferSize = 2048 * 2; // Ajuste conforme necessário para otimizar a performance
-    uint8_t buffer[bufferSize];
-
-    // Abrir o arquivo original
-    File sourceFile = SDM.open(fileToCopy, FILE_READ);
-    if (!sourceFile) {
-        // Serial.println("Falha ao abrir o arquivo original para leitura");
-        return false;
-    }
-
-    // Criar o arquivo de destino
-    File destFile = SDM.open(path + "/" + fileToCopy.substring(fileToCopy.lastIndexOf('/') + 1), FILE_WRITE);
-    if (!destFile) {
-        // Serial.println("Falha ao criar o arquivo de destino");
-        sourceFile.close();
-        return false;
-    }
-
-    // Ler dados do arquivo original e escrever no arquivo de destino
-    size_t bytesRead;
-    int tot = sourceFile.size();
-    int prog = 0;
-    // tft->drawRect(5,tftHeight-12, (tftWidth-10), 9, FGCOLOR);
-    while ((bytesRead = sourceFile.read(buffer, bufferSize)) > 0) {
-        if (destFile.write(buffer, bytesRead) != bytesRead) {
-            // Serial.println("Falha ao escrever no arquivo de destino");
-            sourceFile.close();
-            destFile.close();
-            return false;
-        } else {
-            prog += bytesRead;
-            float rad = 360 * prog / tot;
-            tft->drawArc(tftWidth / 2, tftHeight / 2, tftHeight / 4, tftHeight / 5, 0, int(rad), ALCOLOR);
-            // tft->fillRect(7,tftHeight-10, (tftWidth-14)*prog/tot, 5, FGCOLOR);
-        }
-    }
+    if (!moveOnPaste) return copyPath(fileToCopy, path);
+    bool ok = movePath(fileToCopy, path);
+    if (ok) fileToCopy = "";
+    return ok;
+}
 
-    // Fechar ambos os arquivos
-    sourceFile.close();
-    destFile.close();
-    return true;
+/***************************************************************************************
+** Function name: extractFile
+** Description:   extract a .zip or .tar into folder
+***************************************************************************************/
+bool extractFile(String path, String folder) {
+    String error;
+    if (extractArchive(path, folder, &error)) return true;
+    displayRedStripe(error);
+    delay(2500);
+    return false;
 }
 
 /***************************************************************************************
@@ -242,6 +197,7 @@ bool createFolder(String path) {
         // Serial.println("Fail to start SDCard");
         return false;
     }
+    invalidateDirIndex();
     if (!SDM.mkdir(path + foldername)) {
         displayRedStripe("Couldn't create folder");
         return false;
@@ -250,130 +206,24 @@ bool createFolder(String path) {
 }
 
 /***************************************************************************************
-** Function name: sortList
-** Description:   sort files for name
-***************************************************************************************/
-void sortList(String fileList[][3], int fileListCount) {
-    bool swapped;
-    String temp[3];
-    String name1, name2;
-
-    do {
-        swapped = false;
-        for (int i = 0; i < fileListCount - 1; i++) {
-            name1 = fileList[i][0];
-            name1.toUpperCase();
-            name2 = fileList[i + 1][0];
-            name2.toUpperCase();
-
-            // Verificar se ambos são pastas ou arquivos
-            bool isFolder1 = fileList[i][2] == "folder";
-            bool isFolder2 = fileList[i + 1][2] == "folder";
-
-            // Primeiro, ordenar pastas
-            if (isFolder1 && !isFolder2) {
-                continue; // Se o primeiro for uma pasta e o segundo não, não troque
-            } else if (!isFolder1 && isFolder2) {
-                // Se o primeiro for um arquivo e o segundo uma pasta, troque
-                for (int j = 0; j < 3; j++) {
-                    temp[j] = fileList[i][j];
-                    fileList[i][j] = fileList[i + 1][j];
-                    fileList[i + 1][j] = temp[j];
-                }
-                swapped = true;
-            } else {
-                // Ambos são pastas ou arquivos, então ordenar alfabeticamente
-                if (name1.compareTo(name2) > 0) {
-                    for (int j = 0; j < 2; j++) {
-                        temp[j] = fileList[i][j];
-                        fileList[i][j] = fileList[i + 1][j];
-                        fileList[i + 1][j] = temp[j];
-                    }
-                    swapped = true;
-                }
-            }
-        }
-    } while (swapped);
-}
-
-/***************************************************************************************
-** Function name: sortList
-** Description:   sort files for name
+** Function name: readFs
+** Description:   index folder, sorted, names are paged in by the index as they are shown
 ***************************************************************************************/
-void readFs(String folder, String result[][3]) {
-    int allFilesCount = 0;
-    while (allFilesCount < MAXFILES) {
-        result[allFilesCount][0] = "";
-        result[allFilesCount][1] = "";
-        result[allFilesCount][2] = "";
-        allFilesCount++;
-    }
-    allFilesCount = 0;
-
+DirIndex *readFs(const String &folder) {
     if (!setupSdCard()) {
         // Serial.println("Falha ao iniciar o cartão SD");
         displayRedStripe("SD not found or not formatted in FAT32");
         delay(2500);
-        return; // Retornar imediatamente em caso de falha
+        return nullptr; // Retornar imediatamente em caso de falha
     }
 
-    File root = SDM.open(folder);
-    if (!root || !root.isDirectory()) {
+    DirIndex *dir = indexFolder(folder, onlyBins);
+    if (!dir) {
         displayRedStripe("Fail open root");
         delay(2500);
-        return; // Retornar imediatamente se não for possível abrir o diretório
-    }
-
-    File file2;
-    file2 = root.openNextFile();
-    while (file2 && allFilesCount < (MAXFILES - 1)) {
-        String fileName = file2.name();
-        if (!file2.isDirectory()) {
-            String ext = fileName.substring(fileName.lastIndexOf(".") + 1);
-            ext.toUpperCase();
-            if (onlyBins) {
-                if (ext.equals("BIN")) {
-                    result[allFilesCount][0] = fileName.substring(fileName.lastIndexOf("/") + 1);
-                    result[allFilesCount][1] = file2.path();
-                    result[allFilesCount][2] = "file";
-                    allFilesCount++;
-                }
-            } else {
-                result[allFilesCount][0] = fileName.substring(fileName.lastIndexOf("/") + 1);
-                result[allFilesCount][1] = file2.path();
-                result[allFilesCount][2] = "file";
-                allFilesCount++;
-            }
-        }
-
-        file2 = root.openNextFile();
+        return nullptr; // Retornar imediatamente se não for possível abrir o diretório
     }
-    file2.close();
-    root.close();
-
-    root = SDM.open(folder);
-    File file = root.openNextFile();
-    while (file && allFilesCount < (MAXFILES - 1)) {
-        String fileName = file.name();
-        if (file.isDirectory()) {
-            result[allFilesCount][0] = fileName.substring(fileName.lastIndexOf("/") + 1);
-            result[allFilesCount][1] = file.path();
-            result[allFilesCount][2] = "folder";
-            allFilesCount++;
-        }
-        file = root.openNextFile();
-    }
-    file.close();
-    root.close();
-
-    // Ordenar os arquivos e pastas
-    sortList(result, allFilesCount);
-    // allFilesCount++;
-    result[allFilesCount][0] = "> Back";
-    folder = folder.substring(0, folder.lastIndexOf('/'));
-    if (folder == "") folder = "/";
-    result[allFilesCount][1] = folder;
-    result[allFilesCount][2] = "operator";
+    return dir;
 }
 /*********************************************************************
 **  Function: loopSD
@@ -390,18 +240,15 @@ String loopSD(bool filePicker) {
     bool reload = false;
     bool redraw = true;
     int index = 0;
-    int maxFiles = 0;
     String Folder = "/";
     String PreFolder = "/";
+    String fileName = "";
     tft->fillScreen(BGCOLOR);
     tft->drawRoundRect(5, 5, tftWidth - 10, tftHeight - 10, 5, FGCOLOR);
 
-    readFs(Folder, fileList);
-    coord = listFiles(0, fileList, list);
-
-    for (int i = 0; i < MAXFILES; i++)
-        if (fileList[i][2] != "") maxFiles++;
-        else break;
+    invalidateDirIndex(); // downloads or the web UI may have changed the card since last time
+    DirIndex *dir = readFs(Folder);
+    int maxFiles = (dir ? dir->size() : 0) + 1; // entries and "> Back"
     LongPressTmp = millis();
     while (1) {
         if (returnToMenu) break; // stop this loop and retur to the previous loop
@@ -409,21 +256,19 @@ String loopSD(bool filePicker) {
         if (redraw) {
             if (strcmp(PreFolder.c_str(), Folder.c_str()) != 0 || reload) {
                 index = 0;
-                readFs(Folder, fileList);
+                dir = readFs(Folder);
                 PreFolder = Folder;
-                maxFiles = 0;
-                for (int i = 0; i < MAXFILES; i++)
-                    if (fileList[i][2] != "") maxFiles++;
-                    else break;
+                maxFiles = (dir ? dir->size() : 0) + 1;
                 reload = false;
                 tft->fillRoundRect(6, 6, tftWidth - 12, tftHeight - 12, 5, BGCOLOR);
                 tft->fillRoundRect(6, 6, tftWidth - 12, tftHeight - 12, 5, BGCOLOR);
             }
-            coord = listFiles(index, fileList, list);
+            coord = listFiles(index, dir, list);
+            fileName = index < maxFiles - 1 ? dir->name(index) : String("> Back");
 
             // Serial.println("\nContent of list object:");
             max_idx = 0;
-            min_idx = MAXFILES;
+            min_idx = maxFiles;
             int tmp = 0;
             for (auto item : list) {
                 if (item.name != "") {
@@ -438,7 +283,7 @@ String loopSD(bool filePicker) {
             redraw = false;
         }
 
-        displayScrollingText(fileList[index][0], coord);
+        displayScrollingText(fileName, coord);
 
 #ifdef HAS_TOUCH
         if (touchPoint.pressed) {
@@ -496,21 +341,24 @@ String loopSD(bool filePicker) {
             if (true) {
 #endif
                 // Definição da matriz "Options"
-                if (fileList[index][2] == "folder") {
+                if (index < maxFiles - 1 && dir->isFolder(index)) {
+                    String filePath = dir->path(index);
                     options = {
 #ifdef E_PAPER_DISPLAY
-                        {"Open Folder", [&]() { Folder = fileList[index][1]; }                       },
+                        {"Open Folder", [&]() { Folder = filePath; }                  },
 #endif
-                        {"New Folder",  [=]() { createFolder(Folder); }                              },
-                        {"Rename",      [=]() { renameFile(fileList[index][1], fileList[index][0]); }},
-                        {"Delete",      [=]() { deleteFromSd(fileList[index][1]); }                  },
-                        {"Main Menu",   [=]() { returnToMenu = true; }                               },
+                        {"New Folder",  [=]() { createFolder(Folder); }               },
+                        {"Rename",      [=]() { renameFile(filePath, fileName); }     },
+                        {"Copy",        [=]() { copyFile(filePath); }                 },
+                        {"Cut",         [=]() { copyFile(filePath, true); }           },
+                        {"Delete",      [=]() { deleteFromSd(filePath); }             },
+                        {"Main Menu",   [=]() { returnToMenu = true; }                },
                     };
                     loopOptions(options);
                     tft->drawRoundRect(5, 5, tftWidth - 10, tftHeight - 10, 5, FGCOLOR);
                     reload = true;
                     redraw = true;
-                } else if (fileList[index][2] == "file") {
+                } else if (index < maxFiles - 1) {
                     goto Files;
                 } else {
                     bool bkf = false;
@@ -529,23 +377,28 @@ String loopSD(bool filePicker) {
                 }
             } else {
             Files:
-                if (fileList[index][2] == "folder") {
-                    Folder = fileList[index][1];
+                if (index < maxFiles - 1 && dir->isFolder(index)) {
+                    Folder = dir->path(index);
                     redraw = true;
-                } else if (fileList[index][2] == "file") {
+                } else if (index < maxFiles - 1) {
+                    String filePath = dir->path(index);
                     options = {
-                        {"Install",    [=]() { updateFromSD(fileList[index][1]); }                  },
-                        {"New Folder", [=]() { createFolder(Folder); }                              },
-                        {"Rename",     [=]() { renameFile(fileList[index][1], fileList[index][0]); }},
-                        {"Copy",       [=]() { copyFile(fileList[index][1]); }                      },
+                        {"Install",    [=]() { updateFromSD(filePath); }         },
+                        {"New Folder", [=]() { createFolder(Folder); }           },
+                        {"Rename",     [=]() { renameFile(filePath, fileName); } },
+                        {"Copy",       [=]() { copyFile(filePath); }             },
+                        {"Cut",        [=]() { copyFile(filePath, true); }       },
                     };
                     if (fileToCopy != "") options.push_back({"Paste", [=]() { pasteFile(Folder); }});
-                    options.push_back({"Delete", [=]() { deleteFromSd(fileList[index][1]); }});
+                    ArchiveExtractor::Format format;
+                    if (ArchiveExtractor::formatOf(filePath, format))
+                        options.push_back({"Extract", [=]() { extractFile(filePath, Folder); }});
+                    options.push_back({"Delete", [=]() { deleteFromSd(filePath); }});
                     options.push_back({"Main Menu", [=]() { returnToMenu = true; }});
 
                     if (!filePicker) loopOptions(options);
                     else {
-                        result = fileList[index][1];
+                        result = filePath;
                         break;
                     }
                     reload = true;
@@ -553,8 +406,8 @@ String loopSD(bool filePicker) {
                 } else {
                 BACK_FOLDER:
                     if (Folder == "/") break;
-                    while (fileList[index][2] != "operator") index++; // to reach pre_folder
-                    Folder = fileList[index][1];
+                    Folder = Folder.substring(0, Folder.lastIndexOf('/')); // to reach pre_folder
+                    if (Folder == "") Folder = "/";
                     index = 0;
                     redraw = true;
                 }
@@ -569,13 +422,7 @@ String loopSD(bool filePicker) {
 
         if (check(EscPress)) goto BACK_FOLDER;
     }
-    // clear fileList memory
-    for (int i = 0; i < MAXFILES; i++) {
-        fileList[i][0] = "";
-        fileList[i][1] = "";
-        fileList[i][2] = "";
-    }
-    closeSdCard();
+    closeSdCard(); // drops the directory index too
     setupSdCard();
     tft->fillScreen(BGCOLOR);
     return result;
@@ -584,7 +431,7 @@ String loopSD(bool filePicker) {
 ** Function name: performUpdate
 ** Description:   this function performs the update
 ***************************************************************************************/
-void performUpdate(Stream &updateSource, size_t updateSize, int command) {
+bool performUpdate(Stream &updateSource, size_t updateSize, int command) {
     // command = U_FAT_vfs = 300
     // command = U_FAT_sys = 400
     // command = U_SPIFFS = 100
@@ -593,6 +440,8 @@ void performUpdate(Stream &updateSource, size_t updateSize, int command) {
     tft->fillRoundRect(6, 6, tftWidth - 12, tftHeight - 12, 5, BGCOLOR);
     progressHandler(0, 500);
 
+    Update.setPipeline(true); // keep reading the SD while the previous sector is being flashed
+    Update.setDeltaFlash(deltaFlash);
     if (Update.begin(updateSize, command)) {
         int written = 0;
         uint8_t buf[1024];
@@ -604,12 +453,17 @@ void performUpdate(Stream &updateSource, size_t updateSize, int command) {
         log_i("updateSize = %d", updateSize);
         while (written < updateSize) { // updateSource.available() > 0 &&
             bytesRead = updateSource.readBytes(buf, sizeof(buf));
+            if (bytesRead == 0) break; // source ended early, end() reports it
             written += Update.write(buf, bytesRead);
-            progressHandler(written, updateSize);
+            progressHandler(written, updateSize, Update.skippedSectors());
         }
         if (Update.end()) {
             if (Update.isFinished()) log_i("Update successfully completed.");
             else log_i("Update not finished? Something went wrong!");
+            return true;
+        } else if (Update.getError() == UPDATE_ERROR_VERIFY) {
+            displayRedStripe("Verify failed " + Update.mismatches());
+            delay(2500);
         } else {
             log_i("Error Occurred. Error #: %s", String(Update.getError()));
         }
@@ -618,6 +472,141 @@ void performUpdate(Stream &updateSource, size_t updateSize, int command) {
         displayRedStripe("E:" + String(error) + "-Wrong Partition Scheme");
         delay(2500);
     }
+    return false;
+}
+
+/***************************************************************************************
+** Function name: parseImageLayout
+** Description:   reads the partition table of a merged image, table holds the
+**                IMAGE_TABLE_SIZE bytes found at IMAGE_TABLE_OFFSET
+***************************************************************************************/
+void parseImageLayout(const uint8_t *table, uint32_t imageSize, ImageLayout &layout) {
+    memset(&layout, 0, sizeof(layout));
+    layout.merged = table[0] == 0xAA && table[1] == 0x50 && table[2] == 0x01;
+    if (!layout.merged) {
+        layout.app_size = imageSize;
+        return;
+    }
+    for (int i = 0; i < IMAGE_TABLE_SIZE; i += 0x20) {
+        const uint8_t *entry = table + i;
+
+        if ((entry[0x03] == 0x00 || entry[0x03] == 0x10 || entry[0x03] == 0x20) && entry[0x06] == 0x01) {
+            layout.app_size = (entry[0x0A] << 16) | (entry[0x0B] << 8) | 0x00;
+            if (imageSize < (layout.app_size + 0x10000)) layout.app_size = imageSize - 0x10000;
+            else if (layout.app_size > MAX_APP) layout.app_size = MAX_APP;
+        }
+
+        if (entry[3] == 0x82) {
+            layout.spiffs_offset = (entry[0x06] << 16) | (entry[0x07] << 8) | entry[0x08];
+            layout.spiffs_size = (entry[0x0A] << 16) | (entry[0x0B] << 8) | 0x00;
+            if (imageSize < layout.spiffs_offset) layout.spiffs = false;
+            else if (layout.spiffs_size > MAX_SPIFFS) {
+                layout.spiffs_size = MAX_SPIFFS;
+                layout.spiffs = true;
+            }
+            if (layout.spiffs && imageSize < (layout.spiffs_offset + layout.spiffs_size))
+                layout.spiffs_size = imageSize - layout.spiffs_offset;
+        }
+
+        if (entry[3] == 0x81 && entry[0x0C] == 0x73) {
+            layout.fat_offset_sys = (entry[0x06] << 16) | (entry[0x07] << 8) | entry[0x08];
+            layout.fat_size_sys = (entry[0x0A] << 16) | (entry[0x0B] << 8) | 0x00;
+            if (imageSize < layout.fat_offset_sys) layout.fat = false;
+            else layout.fat = true;
+            if (layout.fat && layout.fat_size_sys > MAX_FAT_sys) layout.fat_size_sys = MAX_FAT_sys;
+            if (layout.fat && imageSize < (layout.fat_offset_sys + layout.fat_size_sys))
+                layout.fat_size_sys = imageSize - layout.fat_offset_sys;
+        }
+
+        if (entry[3] == 0x81 && entry[0x0C] == 0x76) {
+            layout.fat_offset_vfs = (entry[0x06] << 16) | (entry[0x07] << 8) | entry[0x08];
+            layout.fat_size_vfs = (entry[0x0A] << 16) | (entry[0x0B] << 8) | 0x00;
+            if (imageSize < layout.fat_offset_vfs) layout.fat = false;
+            else layout.fat = true;
+            if (layout.fat && layout.fat_size_vfs > MAX_FAT_vfs) layout.fat_size_vfs = MAX_FAT_vfs;
+            if (layout.fat && imageSize < (layout.fat_offset_vfs + layout.fat_size_vfs))
+                layout.fat_size_vfs = imageSize - layout.fat_offset_vfs;
+        }
+    }
+
+    log_i("Appsize: %d", layout.app_size);
+    log_i("Spiffsize: %d", layout.spiffs_size);
+    log_i("FATsize[0]: %d - max: %d at offset: %d", layout.fat_size_sys, MAX_FAT_sys, layout.fat_offset_sys);
+    log_i("FATsize[1]: %d - max: %d at offset: %d", layout.fat_size_vfs, MAX_FAT_vfs, layout.fat_offset_vfs);
+    log_i("FAT: %d", layout.fat);
+    log_i("------------------------");
+
+    if (!layout.fat) {
+        layout.fat_size_sys = 0;
+        layout.fat_size_vfs = 0;
+        layout.fat_offset_sys = 0;
+        layout.fat_offset_vfs = 0;
+    }
+}
+
+/***************************************************************************************
+** Function name: offerImagePartitions
+** Description:   offers partitions sized to a merged image, the sizes its table asks for
+**                before parseImageLayout caps them, the app only as far as the image goes
+***************************************************************************************/
+static void offerImagePartitions(const uint8_t *table, uint32_t imageSize, const ImageLayout &layout) {
+    PartitionTable image;
+    if (!layout.merged || imageSize < 0x10000 || !image.parse(table, IMAGE_TABLE_SIZE)) return;
+    FirmwareSizes want = image.firmwareSizes();
+    want.app = std::min(want.app, imageSize - 0x10000);
+    if (!layout.spiffs) want.spiffs = 0;
+    if (!layout.fat) want.fat_sys = want.fat_vfs = 0;
+    offerFitPartitions(want);
+}
+
+/***************************************************************************************
+** Function name: updateFromGzip
+** Description:   installs a .bin.gz with ImageInstaller, inflating it twice: once up to
+**                the partition table to ask about SPIFFS, then the whole image
+***************************************************************************************/
+static bool updateFromGzip(File &file) {
+    uint8_t chunk[1024];
+    uint8_t table[IMAGE_TABLE_SIZE];
+    ImageLayout layout;
+    uint32_t imageSize = 0;
+
+    // gzip ends with the inflated size
+    if (file.size() < GZIP_HEADER_SIZE + GZIP_TRAILER_SIZE || !file.seek(file.size() - 4)) return false;
+    for (int i = 0; i < 4; i++) imageSize |= (uint32_t)file.read() << (8 * i);
+
+    uint32_t pos = 0;
+    GzipInflater head;
+    memset(table, 0xFF, sizeof(table));
+    bool ok = file.seek(0) && head.begin([&](const uint8_t *data, size_t len) {
+        for (size_t i = 0; i < len; i++, pos++)
+            if (pos >= IMAGE_TABLE_OFFSET && pos < IMAGE_TABLE_OFFSET + IMAGE_TABLE_SIZE)
+                table[pos - IMAGE_TABLE_OFFSET] = data[i];
+        return true;
+    });
+    while (ok && !head.finished() && pos < IMAGE_TABLE_OFFSET + IMAGE_TABLE_SIZE) {
+        int n = file.read(chunk, sizeof(chunk));
+        ok = n > 0 && head.write(chunk, n);
+    }
+    head.end();
+    if (!ok) return false;
+    parseImageLayout(table, imageSize, layout);
+    if (layout.spiffs && askSpiffs) {
+        options = {
+            {"SPIFFS No",  [&]() { layout.spiffs = false; }},
+            {"SPIFFS Yes", [&]() { layout.spiffs = true; } },
+        };
+        loopOptions(options);
+    }
+    offerImagePartitions(table, imageSize, layout);
+
+    ImageInstaller installer;
+    if (!file.seek(0) || !installer.begin(imageSize, layout.spiffs)) return false;
+    for (int n; installer.active() && (n = file.read(chunk, sizeof(chunk))) > 0;) installer.write(chunk, n);
+    if (installer.active() && installer.end()) return true;
+    log_i("gzip install failed: %s", installer.error().c_str());
+    displayRedStripe(installer.error());
+    delay(2500);
+    return false;
 }
 
 /***************************************************************************************
@@ -625,130 +614,76 @@ void performUpdate(Stream &updateSource, size_t updateSize, int command) {
 ** Description:   this function analyse the .bin and calls performUpdate
 ***************************************************************************************/
 void updateFromSD(String path) {
-    uint8_t firstThreeBytes[16];
-    uint32_t spiffs_offset = 0;
-    uint32_t spiffs_size = 0;
-    uint32_t app_size = 0;
-    bool spiffs = false;
-    uint32_t fat_offset_sys = 0;
-    uint32_t fat_size_sys = 0;
-    uint32_t fat_offset_vfs = 0;
-    uint32_t fat_size_vfs = 0;
-    bool fat = false;
+    uint8_t table[IMAGE_TABLE_SIZE];
+    ImageLayout layout;
 
     File file = SDM.open(path);
 
     if (!file) goto Exit;
-    if (!file.seek(0x8000)) goto Exit;
-    file.read(firstThreeBytes, 16);
+    if (file.peek() == GZIP_ID1) {
+        if (updateFromGzip(file)) {
+            file.close();
+            displayRedStripe("Complete");
+            delay(1000);
+            FREE_TFT
+            ESP.restart();
+        }
+        goto Exit;
+    }
+    if (!file.seek(IMAGE_TABLE_OFFSET)) goto Exit;
+    memset(table, 0xFF, sizeof(table));
+    file.read(table, sizeof(table));
+    parseImageLayout(table, file.size(), layout);
 
-    if (firstThreeBytes[0] != 0xAA || firstThreeBytes[1] != 0x50 || firstThreeBytes[2] != 0x01) {
+    if (!layout.merged) {
         if (!file.seek(0x0)) goto Exit;
-        performUpdate(file, file.size(), U_FLASH);
+        if (!performUpdate(file, file.size(), U_FLASH)) goto Exit; // not restarted into a bad image
         file.close();
         tft->fillScreen(BGCOLOR);
         FREE_TFT
         ESP.restart();
     } else {
-        if (!file.seek(0x8000)) goto Exit;
-        for (int i = 0; i < 0x0A0; i += 0x20) {
-            if (!file.seek(0x8000 + i)) goto Exit;
-            file.read(firstThreeBytes, 16);
-
-            if ((firstThreeBytes[0x03] == 0x00 || firstThreeBytes[0x03] == 0x10 ||
-                 firstThreeBytes[0x03] == 0x20) &&
-                firstThreeBytes[0x06] == 0x01) {
-                app_size = (firstThreeBytes[0x0A] << 16) | (firstThreeBytes[0x0B] << 8) | 0x00;
-                if (file.size() < (app_size + 0x10000)) app_size = file.size() - 0x10000;
-                else if (app_size > MAX_APP) app_size = MAX_APP;
-            }
-
-            if (firstThreeBytes[3] == 0x82) {
-                spiffs_offset =
-                    (firstThreeBytes[0x06] << 16) | (firstThreeBytes[0x07] << 8) | firstThreeBytes[0x08];
-                spiffs_size = (firstThreeBytes[0x0A] << 16) | (firstThreeBytes[0x0B] << 8) | 0x00;
-                if (file.size() < spiffs_offset) spiffs = false;
-                else if (spiffs_size > MAX_SPIFFS) {
-                    spiffs_size = MAX_SPIFFS;
-                    spiffs = true;
-                }
-                if (spiffs && file.size() < (spiffs_offset + spiffs_size))
-                    spiffs_size = file.size() - spiffs_offset;
-            }
-
-            if (firstThreeBytes[3] == 0x81 && firstThreeBytes[0x0C] == 0x73) {
-                fat_offset_sys =
-                    (firstThreeBytes[0x06] << 16) | (firstThreeBytes[0x07] << 8) | firstThreeBytes[0x08];
-                fat_size_sys = (firstThreeBytes[0x0A] << 16) | (firstThreeBytes[0x0B] << 8) | 0x00;
-                if (file.size() < fat_offset_sys) fat = false;
-                else fat = true;
-                if (fat && fat_size_sys > MAX_FAT_sys) fat_size_sys = MAX_FAT_sys;
-                if (fat && file.size() < (fat_offset_sys + fat_size_sys))
-                    fat_size_sys = file.size() - fat_offset_sys;
-            }
-
-            if (firstThreeBytes[3] == 0x81 && firstThreeBytes[0x0C] == 0x76) {
-                fat_offset_vfs =
-                    (firstThreeBytes[0x06] << 16) | (firstThreeBytes[0x07] << 8) | firstThreeBytes[0x08];
-                fat_size_vfs = (firstThreeBytes[0x0A] << 16) | (firstThreeBytes[0x0B] << 8) | 0x00;
-                if (file.size() < fat_offset_vfs) fat = false;
-                else fat = true;
-                if (fat && fat_size_vfs > MAX_FAT_vfs) fat_size_vfs = MAX_FAT_vfs;
-                if (fat && file.size() < (fat_offset_vfs + fat_size_vfs))
-                    fat_size_vfs = file.size() - fat_offset_vfs;
-            }
-        }
-
-        log_i("Appsize: %d", app_size);
-        log_i("Spiffsize: %d", spiffs_size);
-        log_i("FATsize[0]: %d - max: %d at offset: %d", fat_size_sys, MAX_FAT_sys, fat_offset_sys);
-        log_i("FATsize[1]: %d - max: %d at offset: %d", fat_size_vfs, MAX_FAT_vfs, fat_offset_vfs);
-        log_i("FAT: %d", fat);
-        log_i("------------------------");
-
-        if (!fat) {
-            fat_size_sys = 0;
-            fat_size_vfs = 0;
-            fat_offset_sys = 0;
-            fat_offset_vfs = 0;
-        }
-
         prog_handler = 0; // Install flash update
-        if (spiffs && askSpiffs) {
+        if (layout.spiffs && askSpiffs) {
             options = {
-                {"SPIFFS No",  [&]() { spiffs = false; }},
-                {"SPIFFS Yes", [&]() { spiffs = true; } },
+                {"SPIFFS No",  [&]() { layout.spiffs = false; }},
+                {"SPIFFS Yes", [&]() { layout.spiffs = true; } },
             };
 
             loopOptions(options);
             tft->fillRoundRect(6, 6, tftWidth - 12, tftHeight - 12, 5, BGCOLOR);
         }
+        offerImagePartitions(table, file.size(), layout);
 
-        log_i("Appsize: %d", app_size);
-        log_i("Spiffsize: %d", spiffs_size);
-        log_i("FATsize[0]: %d - max: %d at offset: %d", fat_size_sys, MAX_FAT_sys, fat_offset_sys);
-        log_i("FATsize[1]: %d - max: %d at offset: %d", fat_size_vfs, MAX_FAT_vfs, fat_offset_vfs);
+        log_i("Appsize: %d", layout.app_size);
+        log_i("Spiffsize: %d", layout.spiffs_size);
+        log_i(
+            "FATsize[0]: %d - max: %d at offset: %d", layout.fat_size_sys, MAX_FAT_sys, layout.fat_offset_sys
+        );
+        log_i(
+            "FATsize[1]: %d - max: %d at offset: %d", layout.fat_size_vfs, MAX_FAT_vfs, layout.fat_offset_vfs
+        );
 
         if (!file.seek(0x10000)) goto Exit;
-        performUpdate(file, app_size, U_FLASH);
+        if (!performUpdate(file, layout.app_size, U_FLASH)) goto Exit;
 
         prog_handler = 1; // Install SPIFFS update
-        if (spiffs) {
-            if (!file.seek(spiffs_offset)) goto Exit;
-            performUpdate(file, spiffs_size, U_SPIFFS);
+        if (layout.spiffs) {
+            if (!file.seek(layout.spiffs_offset)) goto Exit;
+            performUpdate(file, layout.spiffs_size, U_SPIFFS);
         }
 
-        if (fat) {
+        if (layout.fat) {
             displayRedStripe("Formating FAT");
-            if (fat_size_sys > 0) {
-                if (!file.seek(fat_offset_sys)) goto Exit;
-                if (!performFATUpdate(file, fat_size_sys, "sys")) log_i("FAIL updating FAT sys");
+            if (layout.fat_size_sys > 0) {
+                if (!file.seek(layout.fat_offset_sys)) goto Exit;
+                if (!performFATUpdate(file, layout.fat_size_sys, "sys")) log_i("FAIL updating FAT sys");
                 else displayRedStripe("sys FAT complete");
             }
             displayRedStripe("Formating FAT");
-            if (fat_size_vfs > 0) {
-                if (!file.seek(fat_offset_vfs)) goto Exit;
-                if (!performFATUpdate(file, fat_size_vfs, "vfs")) log_i("FAIL updating FAT vfs");
+            if (layout.fat_size_vfs > 0) {
+                if (!file.seek(layout.fat_offset_vfs)) goto Exit;
+                if (!performFATUpdate(file, layout.fat_size_vfs, "vfs")) log_i("FAIL updating FAT vfs");
                 else displayRedStripe("vfs FAT complete");
             }
         }
@@ -766,16 +701,10 @@ Exit:
 ** Function name: performFATUpdate
 ** Description:   this function performs the update
 ***************************************************************************************/
-uint8_t buffer2[1024];
-
 bool performFATUpdate(Stream &updateSource, size_t updateSize, const char *label) {
-    // Preencher o buffer com 0xFF
-    memset(buffer2, 0x00, sizeof(buffer2));
     const esp_partition_t *partition;
     esp_err_t error;
     size_t paroffset = 0;
-    int written = 0;
-    int bytesRead = 0;
     error = esp_flash_set_chip_write_protect(NULL, false);
 
     if (error != ESP_OK) {
@@ -803,20 +732,34 @@ bool performFATUpdate(Stream &updateSource, size_t updateSize, const char *label
     displayRedStripe("Updating FAT");
     log_i("Updating updating: %s", label);
 
-    while (written < updateSize) { // updateSource.available() &&
-        bytesRead = updateSource.readBytes(buffer2, sizeof(buffer2));
-        error = esp_flash_write(NULL, buffer2, paroffset, bytesRead);
-        if (error != ESP_OK) {
-            log_i("[FLASH] Failed to write to flash (0x%x)", error);
-            return false;
+    // the source is read while the previous block is written, a read of 0 bytes ends it
+    FlashVerifier verifier;
+    verifier.begin(partition); // without memory to hash, verify() fails the update
+    bool written = transferPartition(
+        updateSize,
+        [&](uint8_t *data, size_t offset, size_t len) { return updateSource.readBytes(data, len); },
+        [&](const uint8_t *data, size_t offset, size_t len) {
+            verifier.add(data, len);
+            // the region was just erased, sectors of 0xFF are left as they are
+            for (size_t done = 0, n; done < len; done += n) {
+                n = std::min(len - done, (size_t)SPARSE_SECTOR);
+                if (isErased(data + done, n)) continue;
+                esp_err_t err = esp_flash_write(NULL, data + done, paroffset + offset + done, n);
+                if (err != ESP_OK) {
+                    log_i("[FLASH] Failed to write to flash (0x%x)", err);
+                    return false;
+                }
+            }
+            return true;
         }
-        if (bytesRead == 0) break; // Evitar loop infinito se não houver bytes para ler
-        paroffset += bytesRead;
-        written += bytesRead;
-        progressHandler(written, updateSize);
+    );
+    if (written && !verifier.verify()) {
+        displayRedStripe("Verify failed " + verifier.mismatches());
+        delay(2500);
+        written = false;
     }
 
-    if (written == updateSize) {
+    if (written) {
         log_i("Success updating %s", label);
     } else {
         log_i("FAIL updating %s", label);
@@ -22,19 +22,39 @@ bool deleteFromSd(String path);
 
 bool renameFile(String path, String filename);
 
-bool copyFile(String path);
+bool copyFile(String path, bool move = false);
 
 bool pasteFile(String path);
 
-bool createFolder(String path);
+bool extractFile(String path, String folder);
 
-void readFs(String folder, String result[][3]);
+bool createFolder(String path);
 
-void sortList(String fileList[][3], int fileListCount);
+class DirIndex;
+DirIndex *readFs(const String &folder);
 
 String loopSD(bool filePicker = false);
 
-void performUpdate(Stream &updateSource, size_t updateSize, int command);
+bool performUpdate(Stream &updateSource, size_t updateSize, int command);
+
+#define IMAGE_TABLE_OFFSET 0x8000 // partition table of a merged image
+#define IMAGE_TABLE_SIZE 0xA0     // the entries the Launcher looks at
+
+// Where app, SPIFFS and FAT images are in a merged .bin, sizes capped to this device
+struct ImageLayout {
+    bool merged; // partition table found, app at 0x10000, else the whole file is the app
+    uint32_t app_size;
+    bool spiffs;
+    uint32_t spiffs_offset;
+    uint32_t spiffs_size;
+    bool fat;
+    uint32_t fat_offset_sys;
+    uint32_t fat_size_sys;
+    uint32_t fat_offset_vfs;
+    uint32_t fat_size_vfs;
+};
+
+void parseImageLayout(const uint8_t *table, uint32_t imageSize, ImageLayout &layout);
 
 void updateFromSD(String path);
 
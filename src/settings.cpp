@@ -78,6 +78,16 @@ void settings_menu() {
                                gsetAskSpiffs(true, true);
                                saveConfigs();
                            }});
+    if (deltaFlash)
+        options.push_back({"Rewrite All", [=]() {
+                               deltaFlash = false;
+                               saveConfigs();
+                           }});
+    else
+        options.push_back({"Skip Unchanged", [=]() {
+                               deltaFlash = true;
+                               saveConfigs();
+                           }});
 #ifndef E_PAPER_DISPLAY
     options.push_back({"Orientation", [=]() {
                            gsetRotation(true);
@@ -542,6 +552,12 @@ void getConfigs() {
                 count++;
                 log_i("Fail");
             }
+            if (setting["delta"].is<bool>()) {
+                deltaFlash = setting["delta"].as<bool>();
+            } else {
+                count++;
+                log_i("Fail");
+            }
             if (setting["dwn_path"].is<String>()) {
                 dwn_path = setting["dwn_path"].as<String>();
             } else {
@@ -622,6 +638,7 @@ Retry:
         setting["wui_usr"] = wui_usr;
         setting["wui_pwd"] = wui_pwd;
         setting["dwn_path"] = dwn_path;
+        setting["delta"] = deltaFlash;
         if (!setting["wifi"].is<JsonArray>()) {
             JsonArray WifiList = setting["wifi"].to<JsonArray>();
             if (WifiList.size() < 1) {
@@ -19,6 +19,7 @@ config.conf JSON structure
       "wui_usr":"admin",
       "wui_pwd":"launcher",
       "dwn_path": "/downloads/",
+      "delta":0,
       "FGCOLOR":2016,
       "BGCOLOR":0,
       "ALCOLOR":63488,
@@ -0,0 +1,343 @@
+#include "sparseImage.h"
+#include "partitionIo.h"
+#include <MemUtils.h>
+#include <globals.h>
+#include <mbedtls/sha256.h>
+#include <new>
+#include <rom/miniz.h>
+
+static void put16(uint8_t *p, uint16_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+}
+static void put32(uint8_t *p, uint32_t v) {
+    put16(p, v);
+    put16(p + 2, v >> 16);
+}
+
+// erased NOR flash reads back as all ones
+bool isErased(const uint8_t *data, size_t len) {
+    const uint32_t *words = (const uint32_t *)data;
+    for (size_t i = 0; i < len / sizeof(uint32_t); i++)
+        if (words[i] != 0xFFFFFFFF) return false;
+    for (size_t i = len & ~(sizeof(uint32_t) - 1); i < len; i++)
+        if (data[i] != 0xFF) return false;
+    return true;
+}
+
+static bool blank(const uint8_t *data) { return isErased(data, SPARSE_SECTOR); }
+
+bool isSparseImage(File &file) {
+    uint8_t magic[4];
+    size_t position = file.position();
+    bool sparse = file.read(magic, sizeof(magic)) == sizeof(magic) && !memcmp(magic, SPARSE_MAGIC, 4);
+    file.seek(position);
+    return sparse;
+}
+
+bool SparseEncoder::_put(const uint8_t *data, size_t len) {
+    if (_ok && _file->write(data, len) != len) _ok = false;
+    return _ok;
+}
+
+bool SparseEncoder::_record(char type, uint32_t sectors, uint32_t length) {
+    uint8_t record[SPARSE_RECORD_SIZE];
+    record[0] = type;
+    put32(record + 1, sectors);
+    put32(record + 5, length);
+    return _put(record, sizeof(record));
+}
+
+bool SparseEncoder::_flushHoles() {
+    if (!_holes) return _ok;
+    uint32_t holes = _holes;
+    _holes = 0;
+    return _record('H', holes, 0);
+}
+
+bool SparseEncoder::begin(File &file, const char *label, size_t size) {
+    _file = &file;
+    _holes = 0;
+    _ok = size % SPARSE_SECTOR == 0;
+    uint8_t header[SPARSE_HEADER_SIZE] = {0};
+    memcpy(header, SPARSE_MAGIC, 4);
+    put16(header + 4, SPARSE_VERSION);
+    put16(header + 6, SPARSE_SECTOR);
+    put32(header + 8, size);
+    strncpy((char *)header + 12, label, 16);
+    return _put(header, sizeof(header));
+}
+
+/***************************************************************************************
+** Function name: SparseEncoder::write
+** Description:   Stores runs of sectors holding data, counts the erased ones in between
+***************************************************************************************/
+bool SparseEncoder::write(const uint8_t *data, size_t len) {
+    if (len % SPARSE_SECTOR) _ok = false;
+    while (_ok && len) {
+        size_t run = 0;
+        while (run < len && !blank(data + run)) run += SPARSE_SECTOR;
+        if (run) {
+            _flushHoles();
+            _record('D', run / SPARSE_SECTOR, run);
+            _put(data, run);
+        }
+        for (; run < len && blank(data + run); run += SPARSE_SECTOR) _holes++;
+        data += run;
+        len -= run;
+    }
+    return _ok;
+}
+
+bool SparseEncoder::end(const uint8_t *sha256) {
+    _flushHoles();
+    _record('E', 0, 32);
+    return _put(sha256, 32);
+}
+
+bool SparseDecoder::_fail(const String &error) {
+    log_e("%s", error.c_str());
+    if (_state != ST_ERROR) _error = error;
+    _state = ST_ERROR;
+    return false;
+}
+
+bool SparseDecoder::begin(const esp_partition_t *partition) {
+    abort();
+    _partition = partition;
+    _error = "";
+    _sector = 0;
+    _skipped = 0;
+    _buffered = 0;
+    _state = ST_HEADER;
+    _hdrLen = 0;
+    _hdrNeed = SPARSE_HEADER_SIZE;
+    _buffer = (uint8_t *)largeAlloc(SPARSE_SECTOR);
+    _readBack = (uint8_t *)largeAlloc(SPARSE_SECTOR);
+    mbedtls_sha256_context *sha = new (std::nothrow) mbedtls_sha256_context;
+    _sha = sha;
+    if (!_buffer || !_readBack || !sha || !_verifier.begin(partition))
+        return _fail("Not enough memory to restore");
+    mbedtls_sha256_init(sha);
+    mbedtls_sha256_starts(sha, 0);
+    return true;
+}
+
+size_t SparseDecoder::_collect(const uint8_t *data, size_t len) {
+    size_t n = std::min(len, _hdrNeed - _hdrLen);
+    memcpy(_hdr + _hdrLen, data, n);
+    _hdrLen += n;
+    return n;
+}
+
+/***************************************************************************************
+** Function name: SparseDecoder::write
+** Description:   Feeds the next bytes of the image, whatever their size
+***************************************************************************************/
+bool SparseDecoder::write(const uint8_t *data, size_t len) {
+    while (len && _state != ST_DONE && _state != ST_ERROR) {
+        size_t used = 0;
+        switch (_state) {
+            case ST_HEADER:
+                used = _collect(data, len);
+                if (_hdrLen < _hdrNeed) break;
+                _imageSize = le32(_hdr + 8);
+                if (memcmp(_hdr, SPARSE_MAGIC, 4) || le16(_hdr + 4) != SPARSE_VERSION ||
+                    le16(_hdr + 6) != SPARSE_SECTOR)
+                    return _fail("Not a sparse image");
+                if (_imageSize % SPARSE_SECTOR || _imageSize > _partition->size)
+                    return _fail("Image doesn't fit " + String(_partition->label));
+                _nextRecord();
+                break;
+            case ST_RECORD:
+                used = _collect(data, len);
+                if (_hdrLen < _hdrNeed) break;
+                {
+                    char type = _hdr[0];
+                    uint32_t sectors = le32(_hdr + 1);
+                    uint32_t length = le32(_hdr + 5);
+                    if (type != 'E' && ((uint64_t)_sector + sectors) * SPARSE_SECTOR > _imageSize)
+                        return _fail("Corrupted sparse image");
+                    _sectors = sectors;
+                    _remaining = length;
+                    if (type == 'H' && !length) {
+                        for (; _sectors; _sectors--)
+                            if (!_program(nullptr)) return false;
+                        _nextRecord();
+                    } else if (type == 'D' && length == sectors * SPARSE_SECTOR) {
+                        _state = ST_DATA;
+                        if (!length) _nextRecord();
+                    } else if (type == 'Z' && sectors && length) {
+                        if (!_inflator) {
+                            _inflator = (tinfl_decompressor_tag *)largeAlloc(sizeof(tinfl_decompressor));
+                            _dict = (uint8_t *)largeAlloc(TINFL_LZ_DICT_SIZE);
+                            if (!_inflator || !_dict) return _fail("Not enough memory to inflate");
+                        }
+                        tinfl_init(_inflator);
+                        _dictOfs = 0;
+                        _state = ST_INFLATE;
+                    } else if (type == 'E' && length == 32) {
+                        if ((uint64_t)_sector * SPARSE_SECTOR != _imageSize)
+                            return _fail("Sparse image ended early");
+                        _state = ST_HASH;
+                        _hdrLen = 0;
+                        _hdrNeed = 32;
+                    } else {
+                        return _fail("Corrupted sparse image");
+                    }
+                }
+                break;
+            case ST_DATA:
+                used = std::min(len, (size_t)_remaining);
+                if (!_sectorData(data, used)) return false;
+                _remaining -= used;
+                if (!_remaining) _nextRecord();
+                break;
+            case ST_INFLATE: used = _inflate(data, len); break;
+            case ST_HASH: {
+                used = _collect(data, len);
+                if (_hdrLen < _hdrNeed) break;
+                uint8_t sha256[32];
+                mbedtls_sha256_finish((mbedtls_sha256_context *)_sha, sha256);
+                if (memcmp(sha256, _hdr, 32)) return _fail("Image hash mismatch");
+                _state = ST_DONE;
+                break;
+            }
+            default: break;
+        }
+        data += used;
+        len -= used;
+    }
+    return _state != ST_ERROR;
+}
+
+void SparseDecoder::_nextRecord() {
+    _state = ST_RECORD;
+    _hdrLen = 0;
+    _hdrNeed = SPARSE_RECORD_SIZE;
+}
+
+// Gathers the data of a record into whole sectors
+bool SparseDecoder::_sectorData(const uint8_t *data, size_t len) {
+    while (len) {
+        if (!_sectors) return _fail("Corrupted sparse image");
+        size_t n = std::min(len, SPARSE_SECTOR - _buffered);
+        memcpy(_buffer + _buffered, data, n);
+        _buffered += n;
+        data += n;
+        len -= n;
+        if (_buffered < SPARSE_SECTOR) continue;
+        _buffered = 0;
+        _sectors--;
+        if (!_program(_buffer)) return false;
+    }
+    return true;
+}
+
+/***************************************************************************************
+** Function name: SparseDecoder::_inflate
+** Description:   Raw deflate record through the ROM inflater, its window is the output buffer
+***************************************************************************************/
+size_t SparseDecoder::_inflate(const uint8_t *data, size_t len) {
+    size_t avail = std::min(len, (size_t)_remaining);
+    bool more = avail < _remaining;
+    size_t consumed = 0;
+    tinfl_status status;
+    for (;;) {
+        size_t in = avail - consumed;
+        size_t out = TINFL_LZ_DICT_SIZE - _dictOfs;
+        status = tinfl_decompress(
+            _inflator,
+            data + consumed,
+            &in,
+            _dict,
+            _dict + _dictOfs,
+            &out,
+            more ? TINFL_FLAG_HAS_MORE_INPUT : 0
+        );
+        consumed += in;
+        if (out && !_sectorData(_dict + _dictOfs, out)) return consumed;
+        _dictOfs = (_dictOfs + out) & (TINFL_LZ_DICT_SIZE - 1);
+        if (status < TINFL_STATUS_DONE) return _fail("Corrupted sparse image"), consumed;
+        if (status == TINFL_STATUS_DONE) break;
+        if (status == TINFL_STATUS_NEEDS_MORE_INPUT && consumed == avail) {
+            _remaining -= consumed;
+            return consumed;
+        }
+    }
+    _remaining -= consumed;
+    if (_remaining || _sectors || _buffered) return _fail("Corrupted sparse image"), consumed;
+    _nextRecord();
+    return consumed;
+}
+
+/***************************************************************************************
+** Function name: SparseDecoder::_program
+** Description:   Brings the next sector to data, nullptr for an erased one, touching the
+**                flash only when it differs
+***************************************************************************************/
+bool SparseDecoder::_program(const uint8_t *data) {
+    if (!data) { // between records, the buffer is free
+        memset(_buffer, 0xFF, SPARSE_SECTOR);
+        data = _buffer;
+    }
+    mbedtls_sha256_update((mbedtls_sha256_context *)_sha, data, SPARSE_SECTOR);
+    _verifier.add(data, SPARSE_SECTOR);
+    size_t offset = _sector * SPARSE_SECTOR;
+    if (esp_partition_read(_partition, offset, _readBack, SPARSE_SECTOR) != ESP_OK)
+        return _fail("Fail reading " + String(_partition->label));
+    if (!memcmp(_readBack, data, SPARSE_SECTOR)) {
+        _skipped++;
+    } else {
+        if (!blank(_readBack) && esp_partition_erase_range(_partition, offset, SPARSE_SECTOR) != ESP_OK)
+            return _fail("Fail erasing " + String(_partition->label));
+        if (!blank(data) && esp_partition_write(_partition, offset, data, SPARSE_SECTOR) != ESP_OK)
+            return _fail("Fail writing " + String(_partition->label));
+    }
+    _sector++;
+    return true;
+}
+
+bool SparseDecoder::end() {
+    if (_state != ST_DONE && _state != ST_ERROR) _fail("Sparse image ended early");
+    if (_state == ST_DONE && !_verifier.verify()) _fail("Verify failed " + _verifier.mismatches());
+    bool ok = _state == ST_DONE;
+    abort();
+    return ok;
+}
+
+void SparseDecoder::abort() {
+    free(_buffer);
+    free(_readBack);
+    free(_inflator);
+    free(_dict);
+    _buffer = nullptr;
+    _readBack = nullptr;
+    _inflator = nullptr;
+    _dict = nullptr;
+    _verifier.end();
+    if (_sha) {
+        mbedtls_sha256_free((mbedtls_sha256_context *)_sha);
+        delete (mbedtls_sha256_context *)_sha;
+        _sha = nullptr;
+    }
+    if (_state != ST_ERROR) _state = ST_DONE;
+}
+
+/***************************************************************************************
+** Function name: restoreSparseImage
+** Description:   the image is read from the SD card while the previous block is programmed
+***************************************************************************************/
+bool restoreSparseImage(File &source, const esp_partition_t *partition, String *error) {
+    SparseDecoder decoder;
+    bool ok = decoder.begin(partition) &&
+              transferPartition(
+                  source.size(),
+                  [&](uint8_t *data, size_t offset, size_t len) { return source.read(data, len); },
+                  [&](const uint8_t *data, size_t offset, size_t len) { return decoder.write(data, len); }
+              );
+    ok = ok ? decoder.end() : (decoder.abort(), false);
+    if (!ok && error) *error = decoder.error().isEmpty() ? "Fail reading the image" : decoder.error();
+    log_i("%s restored, %u sectors were already up to date", partition->label, decoder.skippedSectors());
+    return ok;
+}
@@ -0,0 +1,100 @@
+#ifndef __SPARSE_IMAGE_H
+#define __SPARSE_IMAGE_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include <FlashVerifier.h>
+#include <esp_partition.h>
+
+struct tinfl_decompressor_tag;
+
+/*
+Partition backups in /bkp use a sparse image instead of raw bytes: erased (0xFF) sectors,
+most of a young SPIFFS or FAT partition, are only counted. support_files/sparse_image.py
+packs and unpacks the same format on a computer.
+
+   header  "LSPI", u16 version, u16 sector size, u32 image size, char label[16], u32 0
+   records u8 type, u32 sectors, u32 payload length, payload, little endian:
+           'H'  sectors erased, no payload
+           'D'  sectors stored as is
+           'Z'  sectors as one raw deflate stream (written by the computer tool only)
+           'E'  end, the payload is the SHA-256 of the whole image, erased sectors included
+*/
+#define SPARSE_MAGIC "LSPI"
+#define SPARSE_VERSION 1
+#define SPARSE_SECTOR 4096
+#define SPARSE_HEADER_SIZE 32
+#define SPARSE_RECORD_SIZE 9
+
+// True when the file starts with a sparse image header, the read position is kept
+bool isSparseImage(File &file);
+// data only holds 0xFF, what an erased sector reads, data must be 4 bytes aligned
+bool isErased(const uint8_t *data, size_t len);
+
+// Writes the sparse image of whole sectors pushed in partition order
+class SparseEncoder {
+public:
+    bool begin(File &file, const char *label, size_t size);
+    bool write(const uint8_t *data, size_t len);
+    // Ends the image with the SHA-256 of the partition
+    bool end(const uint8_t *sha256);
+
+private:
+    bool _put(const uint8_t *data, size_t len);
+    bool _record(char type, uint32_t sectors, uint32_t length);
+    bool _flushHoles();
+
+    File *_file = nullptr;
+    uint32_t _holes = 0;
+    bool _ok = false;
+};
+
+// Programs a partition from a sparse image pushed a piece at a time. A sector is only erased
+// when it isn't blank and only written when it holds data, sectors already holding the
+// right bytes are left alone. end() reads the partition back before reporting success.
+class SparseDecoder {
+public:
+    bool begin(const esp_partition_t *partition);
+    bool write(const uint8_t *data, size_t len);
+    // true once the end record was met, the image hash matched and the flash reads it back
+    bool end();
+    void abort();
+
+    const String &error() const { return _error; }
+    uint32_t skippedSectors() const { return _skipped; }
+
+private:
+    enum State : uint8_t { ST_HEADER, ST_RECORD, ST_DATA, ST_INFLATE, ST_HASH, ST_DONE, ST_ERROR };
+
+    size_t _collect(const uint8_t *data, size_t len);
+    void _nextRecord();
+    bool _sectorData(const uint8_t *data, size_t len);
+    size_t _inflate(const uint8_t *data, size_t len);
+    bool _program(const uint8_t *data);
+    bool _fail(const String &error);
+
+    const esp_partition_t *_partition = nullptr;
+    State _state = ST_DONE;
+    uint8_t _hdr[SPARSE_HEADER_SIZE];
+    size_t _hdrLen = 0;
+    size_t _hdrNeed = 0;
+    uint32_t _imageSize = 0;
+    uint32_t _sector = 0;    // next sector to program
+    uint32_t _sectors = 0;   // sectors left in the record
+    uint32_t _remaining = 0; // payload bytes left in the record
+    uint32_t _skipped = 0;
+    uint8_t *_buffer = nullptr; // the sector being gathered
+    size_t _buffered = 0;
+    uint8_t *_readBack = nullptr;
+    tinfl_decompressor_tag *_inflator = nullptr;
+    uint8_t *_dict = nullptr;
+    size_t _dictOfs = 0;
+    void *_sha = nullptr;
+    FlashVerifier _verifier;
+    String _error;
+};
+
+// Restores a sparse image file into partition, with progressHandler()
+bool restoreSparseImage(File &source, const esp_partition_t *partition, String *error = nullptr);
+
+#endif
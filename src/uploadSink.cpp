@@ -0,0 +1,149 @@
+#include "uploadSink.h"
+#include <Arduino.h>
+#include <MemUtils.h>
+#include <new>
+
+static UploadSink sinks[UPLOAD_SINKS];
+static QueueHandle_t freeBlocks = NULL;
+static QueueHandle_t fullBlocks = NULL;
+static SemaphoreHandle_t cardLock = NULL;
+static TaskHandle_t writer = NULL;
+
+/***************************************************************************************
+** Function name: UploadSink::_start
+** Description:   Allocates the buffers, in PSRAM when present, and starts the writer task
+***************************************************************************************/
+bool UploadSink::_start() {
+    if (writer) return true;
+    freeBlocks = xQueueCreate(UPLOAD_SINK_BUFFERS, sizeof(Block *));
+    fullBlocks = xQueueCreate(UPLOAD_SINK_BUFFERS, sizeof(Block *));
+    cardLock = xSemaphoreCreateMutex();
+    if (!freeBlocks || !fullBlocks || !cardLock) {
+        release();
+        return false;
+    }
+    int blocks = 0;
+    for (int i = 0; i < UPLOAD_SINK_BUFFERS; i++) {
+        Block *block = new (std::nothrow) Block();
+        uint8_t *data = (uint8_t *)largeAlloc(UPLOAD_SINK_BUFFER);
+        if (!block || !data) {
+            delete block;
+            free(data);
+            break;
+        }
+        block->data = data;
+        xQueueSend(freeBlocks, &block, 0);
+        blocks++;
+    }
+    // the writer runs below the async TCP task, which only waits on it when every buffer is full
+    if (!blocks || xTaskCreate(_writerTask, "UploadSink", 4096, NULL, 2, &writer) != pdPASS) {
+        writer = NULL;
+        release();
+        return false;
+    }
+    return true;
+}
+
+void UploadSink::release() {
+    for (int i = 0; i < UPLOAD_SINKS; i++)
+        if (sinks[i]._used) sinks[i].close();
+    if (writer) {
+        vTaskDelete(writer);
+        writer = NULL;
+    }
+    Block *block;
+    while (freeBlocks && xQueueReceive(freeBlocks, &block, 0) == pdTRUE) {
+        free(block->data);
+        delete block;
+    }
+    if (freeBlocks) vQueueDelete(freeBlocks);
+    if (fullBlocks) vQueueDelete(fullBlocks);
+    if (cardLock) vSemaphoreDelete(cardLock);
+    freeBlocks = NULL;
+    fullBlocks = NULL;
+    cardLock = NULL;
+}
+
+void UploadSink::_writerTask(void *arg) {
+    Block *block;
+    for (;;) {
+        if (xQueueReceive(fullBlocks, &block, portMAX_DELAY) != pdTRUE) continue;
+        UploadSink *sink = block->sink;
+        if (!sink->_failed && !writeAt(*sink->_file, block->offset, block->data, block->len))
+            sink->_failed = true;
+        sink->_pending--;
+        xQueueSend(freeBlocks, &block, portMAX_DELAY);
+    }
+}
+
+/***************************************************************************************
+** Function name: UploadSink::writeAt
+** Description:   Seeks and writes under the card lock, several sinks may share a file
+***************************************************************************************/
+bool UploadSink::writeAt(File &file, uint32_t offset, const uint8_t *data, size_t len) {
+    if (cardLock) xSemaphoreTake(cardLock, portMAX_DELAY);
+    bool ok = (file.position() == offset || file.seek(offset)) && file.write(data, len) == len;
+    if (cardLock) xSemaphoreGive(cardLock);
+    return ok;
+}
+
+UploadSink *UploadSink::open(File &file, uint32_t offset) {
+    if (!_start()) return nullptr;
+    for (int i = 0; i < UPLOAD_SINKS; i++) {
+        if (sinks[i]._used) continue;
+        sinks[i]._used = true;
+        sinks[i]._file = &file;
+        sinks[i]._offset = offset;
+        sinks[i]._block = nullptr;
+        sinks[i]._pending = 0;
+        sinks[i]._failed = false;
+        return &sinks[i];
+    }
+    return nullptr;
+}
+
+void UploadSink::_queue() {
+    _pending++;
+    xQueueSend(fullBlocks, &_block, portMAX_DELAY); // never blocks, it holds every buffer
+    _block = nullptr;
+}
+
+/***************************************************************************************
+** Function name: UploadSink::write
+** Description:   Copies data into the current buffer, queues it once it reaches the boundary
+***************************************************************************************/
+bool UploadSink::write(const uint8_t *data, size_t len) {
+    while (len && !_failed) {
+        if (!_block) {
+            if (xQueueReceive(freeBlocks, &_block, pdMS_TO_TICKS(UPLOAD_SINK_WAIT)) != pdTRUE) {
+                // every buffer is busy, the card is the bottleneck anyway
+                _block = nullptr;
+                if (!writeAt(*_file, _offset, data, len)) _failed = true;
+                _offset += len;
+                break;
+            }
+            _block->sink = this;
+            _block->offset = _offset;
+            _block->len = 0;
+            _block->cap = UPLOAD_SINK_BUFFER - _offset % UPLOAD_SINK_BUFFER;
+        }
+        size_t n = std::min(len, (size_t)(_block->cap - _block->len));
+        memcpy(_block->data + _block->len, data, n);
+        _block->len += n;
+        _offset += n;
+        data += n;
+        len -= n;
+        if (_block->len == _block->cap) _queue();
+    }
+    return !_failed;
+}
+
+bool UploadSink::close() {
+    if (!_used) return false;
+    if (_block && _block->len) _queue();
+    else if (_block) xQueueSend(freeBlocks, &_block, 0);
+    _block = nullptr;
+    while (_pending > 0) vTaskDelay(1);
+    _used = false;
+    return !_failed;
+}
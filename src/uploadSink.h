@@ -0,0 +1,62 @@
+#ifndef __UPLOAD_SINK_H
+#define __UPLOAD_SINK_H
+
+#include <FS.h>
+#include <atomic>
+
+#ifndef UPLOAD_SINK_BUFFER
+#ifdef BOARD_HAS_PSRAM
+#define UPLOAD_SINK_BUFFER (32 * 1024) // bytes gathered before one SD write, a multiple of the sector
+#define UPLOAD_SINK_BUFFERS 8
+#else
+#define UPLOAD_SINK_BUFFER (16 * 1024)
+#define UPLOAD_SINK_BUFFERS 3
+#endif
+#endif
+
+#ifndef UPLOAD_SINKS
+#define UPLOAD_SINKS 8 // uploads writing at the same time
+#endif
+
+#ifndef UPLOAD_SINK_WAIT
+#define UPLOAD_SINK_WAIT 50 // ms to wait for a free buffer before writing synchronously
+#endif
+
+// Gathers the small fragments the async TCP task receives into UPLOAD_SINK_BUFFER blocks,
+// aligned on the card, and writes them from a separate task, so the TCP task doesn't wait on
+// the SD card. When every buffer is in use, data is written synchronously instead.
+class UploadSink {
+public:
+    // Sink writing file from offset on, nullptr if all UPLOAD_SINKS are busy
+    static UploadSink *open(File &file, uint32_t offset = 0);
+    // Writes data at offset through the same lock the writer task uses
+    static bool writeAt(File &file, uint32_t offset, const uint8_t *data, size_t len);
+
+    bool write(const uint8_t *data, size_t len);
+    // Queues what is left and waits until all of it is on the card, the sink is free afterwards
+    bool close();
+
+    // Frees the buffers and stops the writer task, once no upload is running anymore
+    static void release();
+
+private:
+    struct Block {
+        uint8_t *data;
+        UploadSink *sink;
+        uint32_t offset; // where data goes in the file
+        uint32_t len;
+        uint32_t cap;    // up to the next UPLOAD_SINK_BUFFER boundary of the file
+    };
+    static bool _start();
+    static void _writerTask(void *arg);
+    void _queue();
+
+    File *_file = nullptr;
+    uint32_t _offset = 0;
+    Block *_block = nullptr;
+    std::atomic<int> _pending{0};
+    volatile bool _failed = false;
+    bool _used = false;
+};
+
+#endif
@@ -0,0 +1,159 @@
+#include "webDownload.h"
+#include "webInterface.h"
+#include <MemUtils.h>
+#include <esp_partition.h>
+#include <globals.h>
+
+// One download being sent, owned by the response filler
+struct Download {
+    File file;
+    const esp_partition_t *partition = nullptr;
+    uint32_t pos = 0; // next byte to send
+    uint32_t end = 0; // one past the last byte to send
+    uint8_t *buffer = nullptr;
+    uint32_t bufferStart = 0;
+    uint32_t bufferLen = 0;
+    bool failed = false; // a read failed, the rest of Content-Length will never come
+    ~Download() { free(buffer); }
+};
+
+/***************************************************************************************
+** Function name: parseRange
+** Description:   Applies a "bytes=a-b", "bytes=a-" or "bytes=-n" header to size,
+**                false when the range can't be satisfied
+***************************************************************************************/
+static bool parseRange(const String &header, uint32_t size, uint32_t &first, uint32_t &last) {
+    first = 0;
+    last = size ? size - 1 : 0;
+    if (!header.startsWith("bytes=") || header.indexOf(',') >= 0) return true; // whole content
+    String spec = header.substring(6);
+    int dash = spec.indexOf('-');
+    if (dash < 0) return true;
+    String from = spec.substring(0, dash);
+    String to = spec.substring(dash + 1);
+    from.trim();
+    to.trim();
+    if (from.length() == 0) { // suffix, the last n bytes
+        uint32_t n = strtoul(to.c_str(), nullptr, 10);
+        if (n == 0 || size == 0) return false;
+        first = n >= size ? 0 : size - n;
+        return true;
+    }
+    first = strtoul(from.c_str(), nullptr, 10);
+    if (to.length()) last = std::min(last, (uint32_t)strtoul(to.c_str(), nullptr, 10));
+    return first < size && first <= last;
+}
+
+/***************************************************************************************
+** Function name: fillDownload
+** Description:   Partitions are read straight into the response buffer, files through
+**                DOWNLOAD_BUFFER reads that start on buffer aligned offsets of the file
+***************************************************************************************/
+static size_t fillDownload(Download &dl, uint8_t *out, size_t maxLen) {
+    size_t len = std::min((size_t)(dl.end - dl.pos), maxLen);
+    if (!len || dl.failed) return 0;
+    if (dl.partition) {
+        if (esp_partition_read(dl.partition, dl.pos, out, len) != ESP_OK) {
+            dl.failed = true;
+            return 0;
+        }
+        dl.pos += len;
+        return len;
+    }
+    size_t sent = 0;
+    while (sent < len) {
+        if (dl.pos < dl.bufferStart || dl.pos >= dl.bufferStart + dl.bufferLen) {
+            dl.bufferStart = dl.pos;
+            uint32_t want = std::min(DOWNLOAD_BUFFER - dl.pos % DOWNLOAD_BUFFER, dl.end - dl.pos);
+            dl.bufferLen = dl.file.seek(dl.pos) ? dl.file.read(dl.buffer, want) : 0;
+            if (!dl.bufferLen) {
+                dl.failed = true;
+                break;
+            }
+        }
+        size_t n = std::min(len - sent, (size_t)(dl.bufferStart + dl.bufferLen - dl.pos));
+        memcpy(out + sent, dl.buffer + (dl.pos - dl.bufferStart), n);
+        dl.pos += n;
+        sent += n;
+    }
+    return sent;
+}
+
+/***************************************************************************************
+** Function name: sendDownload
+** Description:   Picks the range, or 416, and streams it
+***************************************************************************************/
+static void sendDownload(
+    AsyncWebServerRequest *request, std::shared_ptr<Download> dl, uint32_t size, const String &name,
+    const String &etag
+) {
+    uint32_t first, last;
+    bool ranged = request->hasHeader("Range");
+    // If-Range only keeps the range when the content is still the one the client has
+    if (ranged && request->hasHeader("If-Range") && (etag == "" || request->header("If-Range") != etag))
+        ranged = false;
+    if (ranged && !parseRange(request->header("Range"), size, first, last)) {
+        AsyncWebServerResponse *response = request->beginResponse(416, "text/plain", "Range Not Satisfiable");
+        response->addHeader("Content-Range", "bytes */" + String(size));
+        return request->send(response);
+    }
+    if (!ranged) {
+        first = 0;
+        last = size ? size - 1 : 0;
+    }
+    if (etag != "" && request->hasHeader("If-None-Match") && request->header("If-None-Match") == etag)
+        return request->send(304);
+
+    dl->pos = first;
+    dl->end = size ? last + 1 : 0;
+    AsyncWebServerResponse *response = request->beginResponse(
+        "application/octet-stream",
+        dl->end - dl->pos,
+        [dl, request](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+            size_t len = fillDownload(*dl, buffer, maxLen);
+            // short of Content-Length, closing is the only way left to tell the client
+            if (dl->failed) request->client()->close();
+            return len;
+        }
+    );
+    if (ranged) {
+        response->setCode(206);
+        response->addHeader(
+            "Content-Range", "bytes " + String(first) + "-" + String(last) + "/" + String(size)
+        );
+    }
+    response->addHeader("Accept-Ranges", "bytes");
+    if (etag != "") response->addHeader("ETag", etag);
+    response->addHeader("Content-Disposition", "attachment; filename=\"" + name + "\"");
+    request->send(response);
+}
+
+void sendFileDownload(AsyncWebServerRequest *request, const String &path) {
+    std::shared_ptr<Download> dl = std::make_shared<Download>();
+    dl->file = SDM.open(path, FILE_READ);
+    if (!dl->file || dl->file.isDirectory()) return request->send(404, "text/plain", "File not found");
+    dl->buffer = (uint8_t *)largeAlloc(DOWNLOAD_BUFFER);
+    if (!dl->buffer) return request->send(503, "text/plain", "Out of memory, try again");
+
+    uint32_t size = dl->file.size();
+    char etag[24];
+    snprintf(etag, sizeof(etag), "\"%x-%x\"", (unsigned)size, (unsigned)dl->file.getLastWrite());
+    sendDownload(request, dl, size, path.substring(path.lastIndexOf('/') + 1), etag);
+}
+
+void sendPartitionDownload(AsyncWebServerRequest *request, const String &label) {
+    std::shared_ptr<Download> dl = std::make_shared<Download>();
+    dl->partition =
+        esp_partition_find_first(ESP_PARTITION_TYPE_ANY, ESP_PARTITION_SUBTYPE_ANY, label.c_str());
+    if (!dl->partition) return request->send(404, "text/plain", "Partition not found");
+    // live contents have no validator, an If-Range always gets the whole partition
+    sendDownload(request, dl, dl->partition->size, label + ".bin", "");
+}
+
+void configureDownloadApi(AsyncWebServer *server) {
+    server->on("/partition", HTTP_GET, [](AsyncWebServerRequest *request) {
+        if (!checkUserWebAuth(request)) return request->requestAuthentication();
+        if (!request->hasParam("label")) return request->send(400, "text/plain", "label param required");
+        sendPartitionDownload(request, request->getParam("label")->value());
+    });
+}
@@ -0,0 +1,26 @@
+#ifndef __WEB_DOWNLOAD_H
+#define __WEB_DOWNLOAD_H
+
+#include <ESPAsyncWebServer.h>
+
+#ifndef DOWNLOAD_BUFFER
+#ifdef BOARD_HAS_PSRAM
+#define DOWNLOAD_BUFFER (32 * 1024) // SD bytes read at once per download, on buffer aligned offsets
+#else
+#define DOWNLOAD_BUFFER (8 * 1024)
+#endif
+#endif
+
+/*
+Downloads honoring Range (a single "bytes=" range) and If-Range, answering 206 with
+Content-Range when a range is served and Accept-Ranges on every response
+
+   GET /file?action=download&name=/dir/file.bin   SD file, ETag from size and modification time
+   GET /partition?label=spiffs                    live flash contents of a partition, read as
+                                                  it is sent, no dump to the SD card first
+*/
+void sendFileDownload(AsyncWebServerRequest *request, const String &path);
+void sendPartitionDownload(AsyncWebServerRequest *request, const String &label);
+void configureDownloadApi(AsyncWebServer *server);
+
+#endif
@@ -1,11 +1,19 @@
 
 #include "webInterface.h"
+#include "dirIndex.h"
 #include "display.h"
 #include "esp_task_wdt.h"
+#include "imageInstaller.h"
 #include "mykeyboard.h"
 #include "onlineLauncher.h"
 #include "sd_functions.h"
 #include "settings.h"
+#include "uploadSink.h"
+#include "webDownload.h"
+#include "webJobs.h"
+#include "webSession.h"
+#include "webUpload.h"
+#include <atomic>
 #include <globals.h>
 
 struct Config {
@@ -18,7 +26,6 @@ struct Config {
 // command = U_SPIFFS = 100
 // command = U_FLASH = 0
 int command = 0;
-bool updateFromSd_var = false;
 
 // WiFi as a Client
 const int default_webserverporthttp = 80;
@@ -88,58 +95,174 @@ String humanReadableSize(uint64_t bytes) {
     else return String(bytes / 1024.0 / 1024.0 / 1024.0) + " GB";
 }
 
-// list all of the files, if ishtml=true, return html rather than simple text
-String listFiles(String folder) {
-    // log_i("Listfiles Start");
-    String returnText = "pa:" + folder + ":0\n";
-    Serial.println("Listing files stored on SD");
+// One /listfiles page, read off the card by listingTask and streamed by the chunked response filler
+struct Listing {
+    struct Item {
+        String name;
+        uint64_t size;
+        bool folder;
+    };
+    String folder;
+    bool sorted;
+    uint32_t limit;
+    uint32_t first;                 // offset of the page
+    std::shared_ptr<DirIndex> dir;  // sorted: this listing's own index, shared with its next pages only
+    std::vector<Item> items;        // the page
+    bool exhausted;                 // no entries after the page
+    std::atomic<bool> ready{false}; // fields above filled, the filler may start
+    size_t item;                    // next item to serialize
+    uint8_t stage;                  // 0 header, 1 entries, 2 footer, 3 done
+    String pending;                 // serialized, not sent yet
+    size_t sent;                    // bytes of pending already sent
+};
 
-    File root = SDM.open(folder);
-    File foundfile = root.openNextFile();
-    if (folder == "//") folder = "/";
-    uploadFolder = folder;
-    String PreFolder = folder;
-    PreFolder = PreFolder.substring(0, PreFolder.lastIndexOf("/"));
-    if (PreFolder == "") PreFolder = "/";
-
-    if (folder == "/") folder = "";
-    while (foundfile) {
-        if (esp_get_free_heap_size() > (String("Fo:" + String(foundfile.name()) + ":0\n").length()) + 1024) {
-            if (foundfile.isDirectory()) returnText += "Fo:" + String(foundfile.name()) + ":0\n";
-        } else break;
-        foundfile = root.openNextFile();
-        esp_task_wdt_reset();
+// Index of the last sorted listing, the next pages of the same folder page through it. Only the
+// handlers touch these two, the index itself belongs to the listing tasks
+static std::shared_ptr<DirIndex> webIndex;
+static String webIndexFolder;
+static SemaphoreHandle_t listingLock = NULL; // one page read at a time, pages may share their index
+
+// Reads the entries of the page, names, folders and sizes, so the filler never touches the card
+static void readListingPage(Listing &ls) {
+    if (ls.sorted) {
+        DirIndex &dir = *ls.dir;
+        if (dir.folder() != ls.folder) dir.load(ls.folder, false); // a new listing, the card may have changed
+        for (uint32_t pos = ls.first; pos < dir.size() && ls.items.size() < ls.limit; pos++) {
+            Listing::Item item = {dir.name(pos), 0, dir.isFolder(pos)};
+            if (!item.folder) {
+                File file = SDM.open(dir.path(pos));
+                if (file) item.size = file.size();
+            }
+            ls.items.push_back(item);
+        }
+        ls.exhausted = ls.first + ls.items.size() >= dir.size();
+        return;
     }
-    root.close();
-    foundfile.close();
-
-    if (folder == "") folder = "/";
-    root = SDM.open(folder);
-    foundfile = root.openNextFile();
-    while (foundfile) {
-        if (esp_get_free_heap_size() > (String("Fo:" + String(foundfile.name()) + ":0\n").length()) + 1024) {
-            if (!(foundfile.isDirectory()))
-                returnText +=
-                    "Fi:" + String(foundfile.name()) + ":" + humanReadableSize(foundfile.size()) + "\n";
-        } else break;
-        foundfile = root.openNextFile();
-        esp_task_wdt_reset();
+    File root = SDM.open(ls.folder);
+    if (!root || !root.isDirectory()) return;
+    if (ls.first) root.seekDir(ls.first);
+    while (ls.items.size() < ls.limit) {
+        File file = root.openNextFile();
+        if (!file) {
+            ls.exhausted = true;
+            break;
+        }
+        ls.items.push_back({String(file.name()), file.isDirectory() ? 0 : file.size(), file.isDirectory()});
+    }
+}
+
+static void listingTask(void *arg) {
+    std::shared_ptr<Listing> *ls = (std::shared_ptr<Listing> *)arg;
+    xSemaphoreTake(listingLock, portMAX_DELAY);
+    readListingPage(**ls);
+    xSemaphoreGive(listingLock);
+    (*ls)->ready = true;
+    delete ls; // the response may be gone already, the listing goes with the last reference
+    vTaskDelete(NULL);
+}
+
+// Serializes the next piece of the listing into pending
+static void nextListingPiece(Listing &ls) {
+    ls.pending = "";
+    ls.sent = 0;
+    if (ls.stage == 0) {
+        JsonDocument doc;
+        doc["folder"] = ls.folder;
+        doc["offset"] = ls.first;
+        serializeJson(doc, ls.pending);
+        ls.pending.remove(ls.pending.length() - 1); // keep the object open for the entries
+        ls.pending += ",\"entries\":[";
+        ls.stage = 1;
+        return;
+    }
+    if (ls.stage == 1) {
+        if (ls.item < ls.items.size()) {
+            const Listing::Item &item = ls.items[ls.item];
+            JsonDocument doc;
+            doc["n"] = item.name;
+            if (item.folder) doc["d"] = 1;
+            else doc["s"] = item.size;
+            serializeJson(doc, ls.pending);
+            if (ls.item > 0) ls.pending = "," + ls.pending;
+            ls.item++;
+            return;
+        }
+        ls.stage = 2;
+    }
+    if (ls.stage == 2) {
+        // next is the offset of the following page, -1 once the folder is done
+        int32_t next = ls.exhausted ? -1 : (int32_t)(ls.first + ls.items.size());
+        ls.pending = "],\"next\":" + String(next) + "}";
+        ls.stage = 3;
     }
+}
+
+// Streams one page of folder as JSON, sorted pages come from the directory index. The card is read
+// by a task of its own, the async TCP task only waits for it through RESPONSE_TRY_AGAIN
+AsyncWebServerResponse *
+listFiles(AsyncWebServerRequest *request, String folder, uint32_t offset, uint32_t limit, bool sorted) {
+    if (folder == "" || folder == "//") folder = "/";
+    uploadFolder = folder;
+
+    File root = SDM.open(folder);
+    bool found = root && root.isDirectory();
     root.close();
-    foundfile.close();
+    if (!found) return request->beginResponse(404, "text/plain", "Folder not found");
+
+    std::shared_ptr<Listing> ls = std::make_shared<Listing>();
+    ls->folder = folder;
+    ls->sorted = sorted;
+    ls->first = offset;
+    ls->limit = limit;
+    ls->exhausted = false;
+    ls->item = 0;
+    ls->stage = 0;
+    ls->sent = 0;
+    if (sorted) {
+        // the first page indexes the folder again, the following ones reuse that index
+        if (offset == 0 || !webIndex || webIndexFolder != folder) {
+            webIndex = std::make_shared<DirIndex>();
+            webIndexFolder = folder;
+        }
+        ls->dir = webIndex;
+    }
 
-    // log_i("ListFiles End");
-    return returnText;
+    if (!listingLock) listingLock = xSemaphoreCreateMutex();
+    std::shared_ptr<Listing> *held = new std::shared_ptr<Listing>(ls);
+    // below the async TCP task, like the web jobs
+    if (!listingLock || xTaskCreate(listingTask, "Listing", LISTING_STACK, held, 1, NULL) != pdPASS) {
+        delete held; // no task, read it right here
+        readListingPage(*ls);
+        ls->ready = true;
+    }
+
+    return request->beginChunkedResponse(
+        "application/json",
+        [ls](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+            if (!ls->ready) return RESPONSE_TRY_AGAIN;
+            size_t len = 0;
+            while (len < maxLen) {
+                if (ls->sent >= ls->pending.length()) {
+                    if (ls->stage == 3) break;
+                    nextListingPiece(*ls);
+                    continue;
+                }
+                size_t n = std::min(maxLen - len, ls->pending.length() - ls->sent);
+                memcpy(buffer + len, ls->pending.c_str() + ls->sent, n);
+                ls->sent += n;
+                len += n;
+            }
+            return len;
+        }
+    );
 }
 
 // used by server.on functions to discern whether a user has the correct httpapitoken OR is authenticated by
 // username and password
 bool checkUserWebAuth(AsyncWebServerRequest *request) {
-    bool isAuthenticated = false;
-    if (request->authenticate(config.httpuser.c_str(), config.httppassword.c_str())) {
-        isAuthenticated = true;
-    }
-    return isAuthenticated;
+    // browsers logged in through /login carry a session cookie, HTTP Basic is kept for scripts
+    if (checkWebSession(request)) return true;
+    return checkWebBasic(request, config.httpuser, config.httppassword);
 }
 
 // Função auxiliar para criar diretórios recursivamente
@@ -167,7 +290,39 @@ void createDirRecursive(String path) {
     }
 }
 
+// Waits for the sink of a form upload to reach the card, before its file is closed
+static void closeRequestSink(AsyncWebServerRequest *request) {
+    UploadSink **sink = (UploadSink **)request->_tempObject;
+    if (!sink || !*sink) return;
+    (*sink)->close();
+    *sink = nullptr;
+}
+
 bool runOnce = false;
+static ImageInstaller installer; // one /install at a time
+
+/***************************************************************************************
+** Function name: sendWebFile
+** Description:   Sends an embedded gzip asset, or 304 when the browser already has it.
+**                ?v=<web_files_version> URLs are fixed for this build and cached for a year
+***************************************************************************************/
+static void sendWebFile(
+    AsyncWebServerRequest *request, const char *type, const uint8_t *data, size_t size, const char *etag
+) {
+    bool versioned = request->hasParam("v") && request->getParam("v")->value() == web_files_version;
+    const char *cache = versioned ? "private, max-age=31536000, immutable" : "no-cache";
+    AsyncWebServerResponse *response;
+    if (request->hasHeader("If-None-Match") && request->header("If-None-Match").indexOf(etag) >= 0) {
+        response = request->beginResponse(304);
+    } else {
+        response = request->beginResponse_P(200, type, data, size);
+        response->addHeader("Content-Encoding", "gzip");
+    }
+    response->addHeader("ETag", etag);
+    response->addHeader("Cache-Control", cache);
+    request->send(response);
+}
+
 // handles uploads to the filserver
 void handleUpload(
     AsyncWebServerRequest *request, String filename, size_t index, uint8_t *data, size_t len, bool final
@@ -186,6 +341,7 @@ void handleUpload(
                 // Cria diretórios necessários
                 String dirPath = fullPath.substring(0, fullPath.lastIndexOf("/"));
                 if (dirPath.length() > 0) { createDirRecursive(dirPath); }
+                closeRequestSink(request); // previous file of the same form
             // Upload de arquivo único
             TRY_AGAIN:
                 request->_tempFile = SDM.open(uploadFolder + "/" + filename, "w");
@@ -194,9 +350,18 @@ void handleUpload(
                     vTaskDelay(5 / portTICK_PERIOD_MS);
                     goto TRY_AGAIN;
                 }
+                // fragments are gathered into aligned blocks and written by the sink task
+                if (!request->_tempObject) {
+                    request->_tempObject = calloc(1, sizeof(UploadSink *));
+                    request->onDisconnect([request]() { closeRequestSink(request); });
+                }
+                if (request->_tempObject)
+                    *(UploadSink **)request->_tempObject = UploadSink::open(request->_tempFile);
             } else {
                 runOnce = false;
                 // open the file on first call and store the file handle in the request object
+                Update.setPipeline(true); // don't hold the async TCP task while a sector is flashed
+                Update.setDeltaFlash(deltaFlash);
                 if (Update.begin(file_size, command)) {
                     if (command == 0) prog_handler = 0;
                     else prog_handler = 1;
@@ -213,7 +378,9 @@ void handleUpload(
         if (len) {
             // stream the incoming chunk to the opened file
             if (!update) {
-                request->_tempFile.write(data, len);
+                UploadSink *sink = request->_tempObject ? *(UploadSink **)request->_tempObject : nullptr;
+                if (sink) sink->write(data, len);
+                else request->_tempFile.write(data, len);
             } else {
                 if (!Update.write(data, len)) displayRedStripe("FAIL 170");
             }
@@ -222,6 +389,7 @@ void handleUpload(
         if (final) {
             if (!update) {
                 // close the file handle as the upload is now done
+                closeRequestSink(request);
                 request->_tempFile.close();
                 request->redirect("/");
             } else {
@@ -250,10 +418,33 @@ void configureWebServer() {
     // if url isn't found
     server->onNotFound([](AsyncWebServerRequest *request) { request->redirect("/"); });
 
+#if WEB_SESSION_RATE > 0
+    server->addMiddleware([](AsyncWebServerRequest *request, ArMiddlewareNext next) {
+        if (webSessionLimited(request)) return request->send(429, "text/plain", "Too many requests");
+        next();
+    });
+#endif
+
+    server->on("/login", HTTP_GET, [](AsyncWebServerRequest *request) {
+        sendWebFile(request, "text/html", login_html, login_html_size, login_html_etag);
+    });
+    server->on("/login", HTTP_POST, [](AsyncWebServerRequest *request) {
+        if (!checkWebLogin(request, config.httpuser, config.httppassword))
+            return request->redirect("/login?failed=1");
+        AsyncWebServerResponse *response = request->beginResponse(302);
+        response->addHeader("Location", "/");
+        response->addHeader(
+            "Set-Cookie", WEB_SESSION_COOKIE "=" + openWebSession() + "; Path=/; HttpOnly; SameSite=Strict"
+        );
+        request->send(response);
+    });
+
     // visiting this page will cause you to be logged out
     server->on("/logout", HTTP_GET, [](AsyncWebServerRequest *request) {
-        request->requestAuthentication();
-        request->send(401);
+        closeWebSession(request);
+        AsyncWebServerResponse *response = request->beginResponse(200, "text/plain", "Logged out");
+        response->addHeader("Set-Cookie", WEB_SESSION_COOKIE "=; Path=/; Max-Age=0");
+        request->send(response);
     });
 
     // presents a "you are now logged out webpage
@@ -262,18 +453,17 @@ void configureWebServer() {
         Serial.println(logmessage);
 #ifdef PART_04MB
         AsyncWebServerResponse *response = request->beginResponse_P(200, "text/html", "", 0);
+        request->send(response);
 #else
-    AsyncWebServerResponse *response = request->beginResponse_P(200, "text/html", logout_html, logout_html_size);
-    response->addHeader("Content-Encoding", "gzip");
+        sendWebFile(request, "text/html", logout_html, logout_html_size, logout_html_etag);
 #endif
-        request->send(response);
     });
 
     server->on("/UPDATE", HTTP_POST, [](AsyncWebServerRequest *request) {
         if (request->hasParam("fileName", true)) {
-            fileToCopy = request->getParam("fileName", true)->value().c_str();
-            request->send(200, "text/plain", "Starting Update");
-            updateFromSd_var = true;
+            if (queueWebJob(JOB_INSTALL, request->getParam("fileName", true)->value()))
+                request->send(200, "text/plain", "Starting Update");
+            else request->send(503, "text/plain", "Fail starting Update");
         }
     });
 
@@ -320,15 +510,44 @@ void configureWebServer() {
             }
         }
     });
+    // whole .bin or .bin.gz as the raw body, merged images are split into app/SPIFFS/FAT while they arrive
+    server->on(
+        "/install",
+        HTTP_POST,
+        [](AsyncWebServerRequest *request) {
+            if (!checkUserWebAuth(request)) return request->requestAuthentication();
+            if (installer.active() || !installer.error().isEmpty()) {
+                String error = installer.active() ? "Incomplete image" : installer.error();
+                installer.abort();
+                displayRedStripe(error);
+                return request->send(500, "text/plain", error);
+            }
+            request->send(200, "text/plain", "OK");
+            displayRedStripe("Restart your device");
+        },
+        NULL,
+        [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+            if (!checkUserWebAuth(request)) return;
+            if (!index) {
+                bool spiffs = request->hasParam("spiffs") && request->getParam("spiffs")->value() == "1";
+                // a .bin.gz body comes with the size of the inflated image
+                size_t size = request->hasParam("size") ? request->getParam("size")->value().toInt() : 0;
+                installer.begin(size ? size : total, spiffs);
+                request->onDisconnect([]() { installer.abort(); });
+            }
+            if (!installer.active() || !installer.write(data, len)) return;
+            if (index + len == total) installer.end();
+        }
+    );
     // run handleUpload function when any file is uploaded
     server->onFileUpload(handleUpload);
+    configureUploadApi(server);
+    configureDownloadApi(server);
+    configureJobsApi(server);
 
     server->on("/scripts.js", HTTP_GET, [](AsyncWebServerRequest *request) {
         if (checkUserWebAuth(request)) {
-            AsyncWebServerResponse *response =
-                request->beginResponse_P(200, "application/javascript", scripts_js, scripts_js_size);
-            response->addHeader("Content-Encoding", "gzip");
-            request->send(response);
+            sendWebFile(request, "application/javascript", scripts_js, scripts_js_size, scripts_js_etag);
         } else {
             return request->requestAuthentication();
         }
@@ -336,25 +555,19 @@ void configureWebServer() {
     server->on("/style.css", HTTP_GET, [](AsyncWebServerRequest *request) {
         if (checkUserWebAuth(request)) {
 #ifdef PART_04MB
-            AsyncWebServerResponse *response =
-                request->beginResponse_P(200, "text/css", style_4mb_css, style_4mb_css_size);
+            sendWebFile(request, "text/css", style_4mb_css, style_4mb_css_size, style_4mb_css_etag);
 #else
-      AsyncWebServerResponse *response = request->beginResponse_P(200, "text/css", style_css, style_css_size);
+            sendWebFile(request, "text/css", style_css, style_css_size, style_css_etag);
 #endif
-            response->addHeader("Content-Encoding", "gzip");
-            request->send(response);
         } else {
             return request->requestAuthentication();
         }
     });
     server->on("/", HTTP_GET, [](AsyncWebServerRequest *request) {
         if (checkUserWebAuth(request)) {
-            AsyncWebServerResponse *response =
-                request->beginResponse_P(200, "text/html", index_html, index_html_size);
-            response->addHeader("Content-Encoding", "gzip");
-            request->send(response);
+            sendWebFile(request, "text/html", index_html, index_html_size, index_html_etag);
         } else {
-            return request->requestAuthentication();
+            return request->redirect("/login");
         }
     });
     server->on("/systeminfo", HTTP_GET, [](AsyncWebServerRequest *request) {
@@ -387,13 +600,17 @@ void configureWebServer() {
     server->on("/listfiles", HTTP_GET, [](AsyncWebServerRequest *request) {
         if (checkUserWebAuth(request)) {
             update = false;
-            String folder = "";
-            if (request->hasParam("folder")) {
-                folder = request->getParam("folder")->value().c_str();
-            } else {
-                String folder = "/";
-            }
-            request->send(200, "text/plain", listFiles(folder));
+            String folder = "/";
+            uint32_t offset = 0;
+            uint32_t limit = LISTING_PAGE;
+            if (request->hasParam("folder")) folder = request->getParam("folder")->value();
+            if (request->hasParam("offset"))
+                offset = strtoul(request->getParam("offset")->value().c_str(), nullptr, 10);
+            if (request->hasParam("limit"))
+                limit = strtoul(request->getParam("limit")->value().c_str(), nullptr, 10);
+            if (limit == 0 || limit > LISTING_MAX_PAGE) limit = LISTING_MAX_PAGE;
+            bool sorted = request->hasParam("sort") && request->getParam("sort")->value() == "name";
+            request->send(listFiles(request, folder, offset, limit, sorted));
 
         } else {
             return request->requestAuthentication();
@@ -419,10 +636,11 @@ void configureWebServer() {
                     }
                 } else {
                     if (strcmp(fileAction, "download") == 0) {
-                        request->send(SDM, fileName, "application/octet-stream");
+                        sendFileDownload(request, fileName);
                     } else if (strcmp(fileAction, "delete") == 0) {
-                        if (deleteFromSd(fileName)) {
-                            request->send(200, "text/plain", "Deleted : " + String(fileName));
+                        // folders can hold thousands of files, deleting runs as a job
+                        if (queueWebJob(JOB_DELETE, fileName)) {
+                            request->send(200, "text/plain", "Deleting : " + String(fileName));
                         } else {
                             request->send(200, "text/plain", "FAIL delating: " + String(fileName));
                         }
@@ -500,6 +718,7 @@ void configureWebServer() {
                 saveConfigs();
                 config.httpuser = usr;
                 config.httppassword = pwdd;
+                closeWebSessions();
 
                 request->send(
                     200, "text/plain", "User: " + String(ssid) + " configured with password: " + String(pwd)
@@ -587,26 +806,23 @@ void startWebUi(String ssid, int encryptation, bool mode_ap) {
     tft->startCallback();
 #endif
 
-    while (!check(SelPress)) {
+    // installs, copies and dumps run in the jobs task, the buttons are theirs while one runs
+    while (webJobsBusy() || !check(SelPress)) {
         if (shouldReboot) {
             FREE_TFT
             ESP.restart();
         }
-        // Perform installation from SD Card
-        if (updateFromSd_var) {
-            // log_i("Starting Update from SD");
-            updateFromSD(fileToCopy);
-            updateFromSd_var = false;
-            fileToCopy = "";
-            displayRedStripe("Restart your Device");
-        }
+        vTaskDelay(10 / portTICK_PERIOD_MS);
     }
 
     // log_i("Closing Server and turning off WiFi");
+    stopWebJobs();
     server->reset();
     server->end();
     delay(100);
     delete server;
+    UploadSink::release();
+    webIndex.reset();
     WiFi.softAPdisconnect(true);
     WiFi.disconnect(true, true);
     WiFi.mode(WIFI_OFF);
@@ -654,21 +870,17 @@ void startWebUi(String ssid, int encryptation, bool mode_ap) {
             FREE_TFT
             ESP.restart();
         }
-        // Perform installation from SD Card
-        if (updateFromSd_var) {
-            // log_i("Starting Update from SD");
-            updateFromSD(fileToCopy);
-            updateFromSd_var = false;
-            fileToCopy = "";
-            Serial.println("\n\n--------------------\nRestart your Device");
-        }
+        vTaskDelay(10 / portTICK_PERIOD_MS);
     }
 
     log_i("Closing Server and turning off WiFi, something went wrong?");
+    stopWebJobs();
     server->reset();
     server->end();
     delay(100);
     delete server;
+    UploadSink::release();
+    webIndex.reset();
     WiFi.softAPdisconnect(true);
     WiFi.disconnect(true, true);
     WiFi.mode(WIFI_OFF);
@@ -11,9 +11,22 @@
 #include <WiFi.h>
 #include <webFiles.h>
 
+#ifndef LISTING_PAGE
+#define LISTING_PAGE 100 // /listfiles entries per page when no limit is asked
+#endif
+#ifndef LISTING_MAX_PAGE
+#define LISTING_MAX_PAGE 500
+#endif
+#ifndef LISTING_STACK
+#define LISTING_STACK 6144 // task reading a /listfiles page off the card
+#endif
+
 // function defaults
 String humanReadableSize(uint64_t bytes);
-String listFiles(String folder);
+AsyncWebServerResponse *
+listFiles(AsyncWebServerRequest *request, String folder, uint32_t offset, uint32_t limit, bool sorted);
+bool checkUserWebAuth(AsyncWebServerRequest *request);
+void createDirRecursive(String path);
 String processor(const String &var);
 String readLineFromFile(File myFile);
 
@@ -0,0 +1,292 @@
+#include "webJobs.h"
+#include "archive.h"
+#include "dirIndex.h"
+#include "display.h"
+#include "fileOps.h"
+#include "partitioner.h"
+#include "sd_functions.h"
+#include "webInterface.h"
+#include <ArduinoJson.h>
+#include <atomic>
+#include <globals.h>
+
+struct WebJob {
+    uint16_t id; // 0: free slot
+    WebJobKind kind;
+    WebJobState state;
+    uint32_t progress;
+    uint32_t total;
+    String source;
+    String target;
+    String message;
+};
+
+static WebJob jobs[WEB_JOBS];
+static uint16_t lastId = 0;
+static SemaphoreHandle_t jobsLock = NULL;
+static QueueHandle_t pending = NULL;
+static TaskHandle_t worker = NULL;
+static std::atomic<int> outstanding{0};
+static AsyncEventSource *events = nullptr;
+
+static uint16_t runningJob = 0;
+static uint32_t lastEvent = 0;
+static int lastPercent = -1;
+
+static const char *const kindNames[] = {"install", "copy", "dump", "move", "delete", "extract"};
+static const char *const stateNames[] = {"queued", "running", "done", "failed"};
+
+static WebJob *findJob(uint16_t id) {
+    for (auto &job : jobs)
+        if (job.id == id) return &job;
+    return nullptr;
+}
+
+static void jobToJson(const WebJob &job, JsonObject obj) {
+    obj["id"] = job.id;
+    obj["kind"] = kindNames[job.kind];
+    obj["source"] = job.source;
+    obj["target"] = job.target;
+    obj["state"] = stateNames[job.state];
+    obj["progress"] = job.progress;
+    obj["total"] = job.total;
+    if (!job.message.isEmpty()) obj["message"] = job.message;
+}
+
+static String jobsJson() {
+    JsonDocument doc;
+    JsonArray list = doc.to<JsonArray>();
+    xSemaphoreTake(jobsLock, portMAX_DELAY);
+    for (auto &job : jobs)
+        if (job.id) jobToJson(job, list.add<JsonObject>());
+    xSemaphoreGive(jobsLock);
+    String out;
+    serializeJson(doc, out);
+    return out;
+}
+
+/***************************************************************************************
+** Function name: publishJob
+** Description:   Pushes the job to every /events client
+***************************************************************************************/
+static void publishJob(uint16_t id) {
+    JsonDocument doc;
+    xSemaphoreTake(jobsLock, portMAX_DELAY);
+    WebJob *job = findJob(id);
+    if (job) jobToJson(*job, doc.to<JsonObject>());
+    xSemaphoreGive(jobsLock);
+    if (!job || !events || !events->count()) return;
+    String out;
+    serializeJson(doc, out);
+    events->send(out.c_str(), "job", millis());
+}
+
+static void setJobState(uint16_t id, WebJobState state, const String &message = "") {
+    xSemaphoreTake(jobsLock, portMAX_DELAY);
+    WebJob *job = findJob(id);
+    if (job) {
+        job->state = state;
+        job->message = message;
+    }
+    xSemaphoreGive(jobsLock);
+    publishJob(id);
+}
+
+/***************************************************************************************
+** Function name: jobProgress
+** Description:   progressListener of the worker, throttled to WEB_JOBS_EVENT_MS per event
+***************************************************************************************/
+static void jobProgress(int progress, size_t total) {
+    // progressHandler() is also used by installs the web server runs itself
+    if (xTaskGetCurrentTaskHandle() != worker || !runningJob || !total) return;
+    int percent = (uint64_t)progress * 100 / total;
+    xSemaphoreTake(jobsLock, portMAX_DELAY);
+    WebJob *job = findJob(runningJob);
+    if (job) {
+        job->progress = progress;
+        job->total = total;
+    }
+    xSemaphoreGive(jobsLock);
+    if (percent == lastPercent || millis() - lastEvent < WEB_JOBS_EVENT_MS) return;
+    lastPercent = percent;
+    lastEvent = millis();
+    publishJob(runningJob);
+}
+
+static void runJob(uint16_t id) {
+    xSemaphoreTake(jobsLock, portMAX_DELAY);
+    WebJob *job = findJob(id);
+    if (job && job->state != JOB_QUEUED) job = nullptr; // cancelled while queued
+    WebJobKind kind = job ? job->kind : JOB_INSTALL;
+    String source = job ? job->source : "";
+    String target = job ? job->target : "";
+    xSemaphoreGive(jobsLock);
+    if (!job) return;
+
+    runningJob = id;
+    lastPercent = -1;
+    lastEvent = 0;
+    setJobState(id, JOB_RUNNING);
+    bool ok = true;
+    String message;
+    switch (kind) {
+        case JOB_INSTALL:
+            updateFromSD(source); // restarts the device once installed
+            ok = false;
+            message = "Update Error.";
+            break;
+        case JOB_COPY:
+            ok = copyPath(source, target);
+            if (!ok) message = "Fail copying " + source;
+            break;
+        case JOB_MOVE:
+            ok = movePath(source, target);
+            if (!ok) message = "Fail moving " + source;
+            break;
+        case JOB_DELETE:
+            ok = deletePath(source);
+            if (!ok) message = "Fail deleting " + source;
+            break;
+        case JOB_EXTRACT:
+            ok = extractArchive(source, target, &message);
+            break;
+        case JOB_DUMP:
+            ok = dumpPartition(source.c_str(), target.c_str(), &message);
+            invalidateDirIndex();
+            break;
+    }
+    runningJob = 0;
+    setJobState(id, ok ? JOB_DONE : JOB_FAILED, message);
+}
+
+static void jobTask(void *arg) {
+    uint16_t id;
+    for (;;) {
+        if (xQueueReceive(pending, &id, portMAX_DELAY) != pdTRUE) continue;
+        runJob(id);
+        outstanding--;
+    }
+}
+
+static bool startJobs() {
+    if (worker) return true;
+    if (!jobsLock) jobsLock = xSemaphoreCreateMutex();
+    if (!pending) pending = xQueueCreate(WEB_JOBS, sizeof(uint16_t));
+    if (!jobsLock || !pending) return false;
+    // below the async TCP task, the web server stays responsive while a job runs
+    if (xTaskCreate(jobTask, "WebJobs", WEB_JOBS_STACK, NULL, 1, &worker) != pdPASS) {
+        worker = NULL;
+        return false;
+    }
+    progressListener = jobProgress;
+    return true;
+}
+
+/***************************************************************************************
+** Function name: queueWebJob
+** Description:   Adds a job to the table and the worker queue, 0 when the table is full
+***************************************************************************************/
+uint16_t queueWebJob(WebJobKind kind, const String &source, const String &target) {
+    if (!startJobs()) return 0;
+    xSemaphoreTake(jobsLock, portMAX_DELAY);
+    WebJob *slot = nullptr;
+    for (auto &job : jobs) { // a free slot, or the oldest finished job
+        if (job.id == 0) {
+            slot = &job;
+            break;
+        }
+        if (job.state >= JOB_DONE && (!slot || job.id < slot->id)) slot = &job;
+    }
+    uint16_t id = 0;
+    if (slot) {
+        if (++lastId == 0) lastId = 1;
+        id = lastId;
+        *slot = {id, kind, JOB_QUEUED, 0, 0, source, target, ""};
+    }
+    xSemaphoreGive(jobsLock);
+    if (!id) return 0;
+    outstanding++;
+    if (xQueueSend(pending, &id, 0) != pdTRUE) {
+        outstanding--;
+        setJobState(id, JOB_FAILED, "Queue full");
+        return 0;
+    }
+    publishJob(id);
+    return id;
+}
+
+bool webJobsBusy() { return outstanding > 0; }
+
+bool cancelWebJob(uint16_t id) {
+    if (!jobsLock) return false;
+    xSemaphoreTake(jobsLock, portMAX_DELAY);
+    WebJob *job = findJob(id);
+    bool queued = job && job->state == JOB_QUEUED;
+    bool stoppable = job && job->state == JOB_RUNNING &&
+                     (job->kind == JOB_COPY || job->kind == JOB_MOVE || job->kind == JOB_DELETE ||
+                      job->kind == JOB_EXTRACT);
+    xSemaphoreGive(jobsLock);
+    if (queued) setJobState(id, JOB_FAILED, "Cancelled");
+    else if (stoppable) cancelFileOp();
+    return queued || stoppable;
+}
+
+void stopWebJobs() {
+    progressListener = nullptr;
+    events = nullptr; // owned and freed by the server
+    if (worker) vTaskDelete(worker);
+    worker = NULL;
+    if (pending) vQueueDelete(pending);
+    pending = NULL;
+}
+
+static bool dumpable(const String &label) {
+    return esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label.c_str());
+}
+
+void configureJobsApi(AsyncWebServer *server) {
+    events = new AsyncEventSource("/events");
+    events->setFilter([](AsyncWebServerRequest *request) { return checkUserWebAuth(request); });
+    events->onConnect([](AsyncEventSourceClient *client) {
+        if (jobsLock) client->send(jobsJson().c_str(), "jobs", millis());
+    });
+    server->addHandler(events);
+
+    server->on("/jobs", HTTP_GET, [](AsyncWebServerRequest *request) {
+        if (!checkUserWebAuth(request)) return request->requestAuthentication();
+        request->send(200, "application/json", jobsLock ? jobsJson() : String("[]"));
+    });
+
+    server->on("/jobs", HTTP_POST, [](AsyncWebServerRequest *request) {
+        if (!checkUserWebAuth(request)) return request->requestAuthentication();
+        String action = request->hasParam("action", true) ? request->getParam("action", true)->value() : "";
+        String path = request->hasParam("path", true) ? request->getParam("path", true)->value() : "";
+        String dest = request->hasParam("dest", true) ? request->getParam("dest", true)->value() : "";
+        String label = request->hasParam("label", true) ? request->getParam("label", true)->value() : "";
+        uint16_t id = 0;
+        ArchiveExtractor::Format format;
+        if (action == "cancel") {
+            id = request->hasParam("id", true) ? request->getParam("id", true)->value().toInt() : 0;
+            if (cancelWebJob(id)) return request->send(200, "text/plain", "Cancelling");
+            return request->send(409, "text/plain", "ERROR: job can't be cancelled");
+        } else if (action == "install" && SDM.exists(path)) {
+            id = queueWebJob(JOB_INSTALL, path);
+        } else if ((action == "copy" || action == "move") && SDM.exists(path) &&
+                   SDM.exists(dest.isEmpty() ? "/" : dest)) {
+            id = queueWebJob(action == "copy" ? JOB_COPY : JOB_MOVE, path, dest.isEmpty() ? "/" : dest);
+        } else if (action == "delete" && SDM.exists(path)) {
+            id = queueWebJob(JOB_DELETE, path);
+        } else if (action == "extract" && SDM.exists(path) && ArchiveExtractor::formatOf(path, format)) {
+            int slash = path.lastIndexOf('/');
+            if (dest.isEmpty()) dest = slash > 0 ? path.substring(0, slash) : "/";
+            if (!SDM.exists(dest)) return request->send(400, "text/plain", "ERROR: invalid job");
+            id = queueWebJob(JOB_EXTRACT, path, dest);
+        } else if (action == "dump" && !label.isEmpty() && dumpable(label)) {
+            id = queueWebJob(JOB_DUMP, label, path.isEmpty() ? "/bkp/" + label + ".bin" : path);
+        } else {
+            return request->send(400, "text/plain", "ERROR: invalid job");
+        }
+        if (!id) return request->send(503, "text/plain", "ERROR: job table is full");
+        request->send(200, "application/json", "{\"id\":" + String(id) + "}");
+    });
+}
@@ -0,0 +1,48 @@
+#ifndef __WEB_JOBS_H
+#define __WEB_JOBS_H
+
+#include <ESPAsyncWebServer.h>
+
+#ifndef WEB_JOBS
+#define WEB_JOBS 8 // jobs kept in the table, finished ones are reused oldest first
+#endif
+
+#ifndef WEB_JOBS_STACK
+#define WEB_JOBS_STACK 12288
+#endif
+
+#ifndef WEB_JOBS_EVENT_MS
+#define WEB_JOBS_EVENT_MS 250 // minimum time between two progress events of a job
+#endif
+
+enum WebJobKind : uint8_t { JOB_INSTALL, JOB_COPY, JOB_DUMP, JOB_MOVE, JOB_DELETE, JOB_EXTRACT };
+enum WebJobState : uint8_t { JOB_QUEUED, JOB_RUNNING, JOB_DONE, JOB_FAILED };
+
+/*
+Long SD and flash operations run one after the other in a background task, so the web server
+keeps answering while they run. Every state change and progressHandler() step of the running
+job is pushed as a "job" Server-Sent Event, any number of browsers can watch the same job.
+
+   POST /jobs  action=install&path=/fw.bin          install from the SD card (restarts when done)
+               action=copy&path=/a.bin&dest=/dir    copy a file or folder into a folder
+               action=move&path=/a.bin&dest=/dir    move a file or folder into a folder
+               action=delete&path=/dir              delete a file or folder
+               action=extract&path=/a.zip[&dest=/dir] extract a .zip or .tar, next to it by default
+               action=dump&label=spiffs[&path=...]  save a partition to the SD card
+               answers {"id":n}
+               action=cancel&id=n                   drop a queued job, stop a running copy,
+                                                    move, delete or extract
+   GET  /jobs                                       the job table as a JSON array
+   GET  /events                                     "jobs" with the table on connect, then "job"
+                                                    {"id","kind","source","target","state",
+                                                     "progress","total","message"} events
+*/
+uint16_t queueWebJob(WebJobKind kind, const String &source, const String &target = "");
+bool cancelWebJob(uint16_t id);
+// A job is queued or running, the device buttons belong to it until it ends
+bool webJobsBusy();
+void configureJobsApi(AsyncWebServer *server);
+// Before the server is reset, once webJobsBusy() is false
+void stopWebJobs();
+
+#endif
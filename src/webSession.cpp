@@ -0,0 +1,180 @@
+#include "webSession.h"
+#include <esp_random.h>
+
+#define TOKEN_BYTES 16
+#define LOGIN_CLIENTS 8 // addresses whose failed logins are remembered
+
+struct WebSession {
+    uint8_t token[TOKEN_BYTES]; // token[0] is the slot index
+    bool used;
+    uint32_t lastSeen;
+#if WEB_SESSION_RATE > 0
+    uint32_t windowStart;
+    uint16_t requests;
+#endif
+};
+
+struct LoginFailures {
+    uint32_t ip;
+    uint8_t count; // 0 for a free slot
+    uint32_t lastFailure;
+};
+
+static WebSession sessions[WEB_SESSIONS];
+static LoginFailures loginFailures[LOGIN_CLIENTS];
+
+static bool expired(const WebSession &s) { return !s.used || millis() - s.lastSeen > WEB_SESSION_IDLE; }
+
+/***************************************************************************************
+** Function name: findSession
+** Description:   Slot of the cookie token, the slot comes from the token itself
+***************************************************************************************/
+static WebSession *findSession(AsyncWebServerRequest *request) {
+    const AsyncWebHeader *header = request->getHeader("Cookie");
+    if (!header) return nullptr;
+    const String &cookies = header->value();
+    int at = cookies.indexOf(WEB_SESSION_COOKIE "=");
+    while (at > 0 && cookies[at - 1] != ' ' && cookies[at - 1] != ';')
+        at = cookies.indexOf(WEB_SESSION_COOKIE "=", at + 1);
+    if (at < 0) return nullptr;
+    at += strlen(WEB_SESSION_COOKIE "=");
+    if (cookies.length() < at + TOKEN_BYTES * 2) return nullptr;
+
+    uint8_t token[TOKEN_BYTES];
+    for (int i = 0; i < TOKEN_BYTES; i++) {
+        char hex[3] = {cookies[at + 2 * i], cookies[at + 2 * i + 1], 0};
+        char *end;
+        token[i] = strtoul(hex, &end, 16);
+        if (*end) return nullptr;
+    }
+    if (token[0] >= WEB_SESSIONS) return nullptr;
+    WebSession &s = sessions[token[0]];
+    uint8_t diff = 0; // same time whichever byte differs
+    for (int i = 0; i < TOKEN_BYTES; i++) diff |= token[i] ^ s.token[i];
+    if (diff || expired(s)) return nullptr;
+    return &s;
+}
+
+// Runs over all of given whatever it holds, only the length of expected shows in the timing
+static bool sameSecret(const String &given, const String &expected) {
+    const char *e = expected.c_str();
+    size_t n = expected.length();
+    uint8_t diff = given.length() != n;
+    for (size_t i = 0; i < given.length(); i++) diff |= given[i] ^ e[n ? i % n : 0];
+    return !diff;
+}
+
+// Failures of ip. With create, a new one takes a free slot or the one that failed the longest ago
+static LoginFailures *findFailures(uint32_t ip, bool create) {
+    LoginFailures *oldest = &loginFailures[0];
+    for (auto &f : loginFailures) {
+        if (f.count && f.ip == ip) return &f;
+        if (oldest->count && (!f.count || millis() - f.lastFailure > millis() - oldest->lastFailure))
+            oldest = &f;
+    }
+    if (!create) return nullptr;
+    oldest->ip = ip;
+    oldest->count = 0;
+    return oldest;
+}
+
+static bool lockedOut(uint32_t ip) {
+    LoginFailures *failures = findFailures(ip, false);
+    return failures && failures->count >= WEB_LOGIN_TRIES &&
+           millis() - failures->lastFailure < WEB_LOGIN_LOCK;
+}
+
+// Counts the outcome of a try from ip and hands it back
+static bool countLogin(uint32_t ip, bool ok) {
+    LoginFailures *failures = findFailures(ip, !ok);
+    if (ok) {
+        if (failures) failures->count = 0;
+        return true;
+    }
+    if (failures->count < WEB_LOGIN_TRIES) failures->count++;
+    failures->lastFailure = millis();
+    return false;
+}
+
+/***************************************************************************************
+** Function name: checkWebLogin
+** Description:   Credentials of a login form, with a lockout per remote address
+***************************************************************************************/
+bool checkWebLogin(AsyncWebServerRequest *request, const String &user, const String &password) {
+    uint32_t ip = request->client()->remoteIP();
+    if (lockedOut(ip)) return false;
+
+    bool ok = request->hasParam("usr", true) && request->hasParam("pwd", true);
+    // both compared, the time doesn't tell which one was wrong
+    if (ok) ok = sameSecret(request->getParam("usr", true)->value(), user) &
+                 sameSecret(request->getParam("pwd", true)->value(), password);
+    return countLogin(ip, ok);
+}
+
+/***************************************************************************************
+** Function name: checkWebBasic
+** Description:   HTTP Basic credentials, counted against the same lockout as the login form
+***************************************************************************************/
+bool checkWebBasic(AsyncWebServerRequest *request, const String &user, const String &password) {
+    // a request without credentials is a client that wasn't asked yet, not a failed try
+    if (!request->hasHeader("Authorization")) return false;
+    uint32_t ip = request->client()->remoteIP();
+    if (lockedOut(ip)) return false;
+    return countLogin(ip, request->authenticate(user.c_str(), password.c_str()));
+}
+
+String openWebSession() {
+    int slot = 0;
+    for (int i = 0; i < WEB_SESSIONS; i++) { // a free slot, or the one unused for the longest
+        if (expired(sessions[i])) {
+            slot = i;
+            break;
+        }
+        if (millis() - sessions[i].lastSeen > millis() - sessions[slot].lastSeen) slot = i;
+    }
+    WebSession &s = sessions[slot];
+    esp_fill_random(s.token, TOKEN_BYTES);
+    s.token[0] = slot;
+    s.used = true;
+    s.lastSeen = millis();
+#if WEB_SESSION_RATE > 0
+    s.windowStart = s.lastSeen;
+    s.requests = 0;
+#endif
+    String token;
+    char hex[3];
+    for (int i = 0; i < TOKEN_BYTES; i++) {
+        sprintf(hex, "%02x", s.token[i]);
+        token += hex;
+    }
+    return token;
+}
+
+bool checkWebSession(AsyncWebServerRequest *request) {
+    WebSession *s = findSession(request);
+    if (s) s->lastSeen = millis();
+    return s;
+}
+
+bool webSessionLimited(AsyncWebServerRequest *request) {
+#if WEB_SESSION_RATE > 0
+    WebSession *s = findSession(request);
+    if (!s) return false;
+    if (millis() - s->windowStart >= 1000) {
+        s->windowStart = millis();
+        s->requests = 0;
+    }
+    return ++s->requests > WEB_SESSION_RATE;
+#else
+    return false;
+#endif
+}
+
+void closeWebSession(AsyncWebServerRequest *request) {
+    WebSession *s = findSession(request);
+    if (s) s->used = false;
+}
+
+void closeWebSessions() {
+    for (auto &s : sessions) s.used = false;
+}
@@ -0,0 +1,48 @@
+#ifndef __WEB_SESSION_H
+#define __WEB_SESSION_H
+
+#include <ESPAsyncWebServer.h>
+
+#ifndef WEB_SESSIONS
+#define WEB_SESSIONS 8 // logged in browsers at once, the least recently used one is dropped for a new one
+#endif
+
+#ifndef WEB_SESSION_IDLE
+#define WEB_SESSION_IDLE (30 * 60 * 1000) // ms without requests before a session expires
+#endif
+
+#ifndef WEB_SESSION_RATE
+#define WEB_SESSION_RATE 0 // requests per second per session, 0 for no limit
+#endif
+
+#ifndef WEB_LOGIN_TRIES
+#define WEB_LOGIN_TRIES 5 // failed logins in a row from one address before it has to wait WEB_LOGIN_LOCK
+#endif
+
+#ifndef WEB_LOGIN_LOCK
+#define WEB_LOGIN_LOCK 30000 // ms
+#endif
+
+#define WEB_SESSION_COOKIE "LSID"
+
+/*
+The WebUI logs in once through POST /login and then sends the session token as a cookie. The
+token names its slot in the session table, so checking it is a table lookup and a 16 byte
+compare, no credential parsing on every request.
+*/
+// usr and pwd of a POST /login against user and password, compared in constant time. Failures
+// are counted per remote address, so a client guessing doesn't lock the others out
+bool checkWebLogin(AsyncWebServerRequest *request, const String &user, const String &password);
+// Authorization header of HTTP Basic against user and password, with the same lockout
+bool checkWebBasic(AsyncWebServerRequest *request, const String &user, const String &password);
+// New session, returns the token to send as the WEB_SESSION_COOKIE cookie
+String openWebSession();
+// The request carries a live session token, refreshing its expiry
+bool checkWebSession(AsyncWebServerRequest *request);
+// Over its WEB_SESSION_RATE budget, always false when no limit is set
+bool webSessionLimited(AsyncWebServerRequest *request);
+void closeWebSession(AsyncWebServerRequest *request);
+// Every browser has to log in again, e.g. after the credentials changed
+void closeWebSessions();
+
+#endif
@@ -0,0 +1,212 @@
+#include "webUpload.h"
+#include "uploadSink.h"
+#include "webInterface.h"
+#include <esp_rom_crc.h>
+#include <vector>
+#include <globals.h>
+
+struct ChunkedUpload {
+    uint32_t id = 0;
+    String path; // final name, data is written to path + ".part"
+    uint32_t size = 0;
+    File file;
+    std::vector<uint8_t> have; // one bit per UPLOAD_CHUNK written and verified
+    uint32_t lastUsed = 0;
+    uint8_t sinks = 0; // PUTs with a sink writing file from another task, the slot stays while any
+};
+
+// Per request state of a PUT, freed by the request
+struct ChunkWrite {
+    uint32_t id;
+    uint32_t offset;
+    uint32_t crc;
+    bool failed;
+    UploadSink *sink;  // set while the body arrives
+    ChunkedUpload *up; // counted in up->sinks while sink is set
+};
+
+static ChunkedUpload uploads[UPLOAD_SLOTS];
+
+static uint32_t chunkCount(const ChunkedUpload &up) { return (up.size + UPLOAD_CHUNK - 1) / UPLOAD_CHUNK; }
+
+static bool hasChunk(const ChunkedUpload &up, uint32_t n) { return up.have[n / 8] & (1 << (n % 8)); }
+
+static String haveString(const ChunkedUpload &up) {
+    String have;
+    have.reserve(chunkCount(up));
+    for (uint32_t n = 0; n < chunkCount(up); n++) have += hasChunk(up, n) ? '1' : '0';
+    return have;
+}
+
+static ChunkedUpload *findUpload(AsyncWebServerRequest *request) {
+    if (!request->hasParam("id")) return nullptr;
+    uint32_t id = strtoul(request->getParam("id")->value().c_str(), nullptr, 10);
+    for (int i = 0; i < UPLOAD_SLOTS; i++) {
+        if (uploads[i].id && uploads[i].id == id) {
+            uploads[i].lastUsed = millis();
+            return &uploads[i];
+        }
+    }
+    return nullptr;
+}
+
+static bool closeChunkSink(ChunkWrite *cw) {
+    if (!cw || !cw->sink) return true;
+    bool ok = cw->sink->close();
+    cw->sink = nullptr;
+    cw->up->sinks--;
+    return ok;
+}
+
+// Frees the slot, the .part file goes too unless it was just renamed by a commit
+static void releaseUpload(ChunkedUpload &up, bool committed = false) {
+    if (up.file) up.file.close();
+    if (!committed && up.id && SDM.exists(up.path + ".part")) SDM.remove(up.path + ".part");
+    up.id = 0;
+    up.path = "";
+    up.have.clear();
+    up.have.shrink_to_fit();
+}
+
+static void sendState(AsyncWebServerRequest *request, int code, const ChunkedUpload &up) {
+    request->send(
+        code,
+        "application/json",
+        "{\"id\":" + String(up.id) + ",\"chunk\":" + String(UPLOAD_CHUNK) + ",\"have\":\"" + haveString(up) +
+            "\"}"
+    );
+}
+
+/***************************************************************************************
+** Function name: uploadInit
+** Description:   Opens, or resumes, the upload of path
+***************************************************************************************/
+static void uploadInit(AsyncWebServerRequest *request) {
+    if (!checkUserWebAuth(request)) return request->requestAuthentication();
+    if (!request->hasParam("path") || !request->hasParam("size"))
+        return request->send(400, "text/plain", "path and size needed");
+    String path = request->getParam("path")->value();
+    uint32_t size = strtoul(request->getParam("size")->value().c_str(), nullptr, 10);
+    if (!path.startsWith("/")) path = "/" + path;
+
+    for (int i = 0; i < UPLOAD_SLOTS; i++) {
+        if (!uploads[i].id || uploads[i].path != path) continue;
+        // same file again after a dropped connection, keep what already arrived
+        if (uploads[i].size == size) {
+            uploads[i].lastUsed = millis();
+            return sendState(request, 200, uploads[i]);
+        }
+        // another size is another file, it starts over in the same .part once nothing writes there
+        if (uploads[i].sinks)
+            return request->send(409, "text/plain", "A chunk of the previous upload is still being written");
+        releaseUpload(uploads[i]);
+    }
+
+    int slot = -1;
+    for (int i = 0; i < UPLOAD_SLOTS; i++) {
+        // a free slot, or else the one left alone the longest, unless a chunk is still being written
+        if (uploads[i].sinks) continue;
+        const ChunkedUpload &best = uploads[slot < 0 ? i : slot];
+        if (slot < 0 || (best.id && (!uploads[i].id || uploads[i].lastUsed < best.lastUsed))) slot = i;
+    }
+    if (slot < 0) return request->send(503, "text/plain", "Every upload slot is busy, try again");
+    ChunkedUpload &up = uploads[slot];
+    releaseUpload(up);
+
+    createDirRecursive(path.substring(0, path.lastIndexOf('/')));
+    up.file = SDM.open(path + ".part", FILE_WRITE);
+    if (!up.file) return request->send(500, "text/plain", "Fail creating " + path);
+
+    up.id = esp_random() | 1;
+    up.path = path;
+    up.size = size;
+    up.have.assign((chunkCount(up) + 7) / 8, 0);
+    up.lastUsed = millis();
+    sendState(request, 200, up);
+}
+
+/***************************************************************************************
+** Function name: uploadChunkBody
+** Description:   Writes the PUT body where it belongs in the .part file, CRC on the way
+***************************************************************************************/
+static void
+uploadChunkBody(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+    ChunkWrite *cw = (ChunkWrite *)request->_tempObject;
+    if (!index) {
+        if (!checkUserWebAuth(request)) return;
+        cw = (ChunkWrite *)malloc(sizeof(ChunkWrite));
+        if (!cw) return;
+        request->_tempObject = cw; // released by the request
+        ChunkedUpload *up = findUpload(request);
+        cw->id = up ? up->id : 0;
+        cw->offset = 0;
+        if (request->hasParam("offset"))
+            cw->offset = strtoul(request->getParam("offset")->value().c_str(), nullptr, 10);
+        cw->crc = 0;
+        // offset checked alone first, the sums below can't wrap then
+        cw->failed = !up || cw->offset >= up->size || cw->offset % UPLOAD_CHUNK != 0 ||
+                     total != std::min((uint32_t)UPLOAD_CHUNK, up->size - cw->offset);
+        cw->sink = cw->failed ? nullptr : UploadSink::open(up->file, cw->offset);
+        cw->up = up;
+        if (cw->sink) up->sinks++;
+        request->onDisconnect([request]() { closeChunkSink((ChunkWrite *)request->_tempObject); });
+    }
+    if (!cw || cw->failed) return;
+
+    ChunkedUpload *up = findUpload(request);
+    if (!up || up->id != cw->id) {
+        closeChunkSink(cw);
+        cw->failed = true;
+        return;
+    }
+    // chunks of several requests interleave on the same handle, writes go through the sink lock
+    if (cw->sink) cw->failed = !cw->sink->write(data, len);
+    else cw->failed = !UploadSink::writeAt(up->file, cw->offset + index, data, len);
+    cw->crc = esp_rom_crc32_le(cw->crc, data, len);
+    // the chunk only counts once it is on the card
+    if ((cw->failed || index + len == total) && !closeChunkSink(cw)) cw->failed = true;
+}
+
+static void uploadChunk(AsyncWebServerRequest *request) {
+    if (!checkUserWebAuth(request)) return request->requestAuthentication();
+    ChunkWrite *cw = (ChunkWrite *)request->_tempObject;
+    ChunkedUpload *up = findUpload(request);
+    if (!up) return request->send(404, "text/plain", "Unknown upload");
+    if (!cw || cw->failed) return request->send(400, "text/plain", "Chunk not written");
+
+    uint32_t crc = 0;
+    if (request->hasParam("crc")) crc = strtoul(request->getParam("crc")->value().c_str(), nullptr, 10);
+    if (crc != cw->crc) return request->send(422, "text/plain", "CRC mismatch, send the chunk again");
+
+    uint32_t n = cw->offset / UPLOAD_CHUNK;
+    up->have[n / 8] |= 1 << (n % 8);
+    request->send(200, "text/plain", "OK");
+}
+
+/***************************************************************************************
+** Function name: uploadCommit
+** Description:   Renames the .part file once every chunk is in
+***************************************************************************************/
+static void uploadCommit(AsyncWebServerRequest *request) {
+    if (!checkUserWebAuth(request)) return request->requestAuthentication();
+    ChunkedUpload *up = findUpload(request);
+    if (!up) return request->send(404, "text/plain", "Unknown upload");
+    for (uint32_t n = 0; n < chunkCount(*up); n++)
+        if (!hasChunk(*up, n)) return sendState(request, 409, *up);
+    if (up->sinks) return request->send(503, "text/plain", "A chunk is still being written, try again");
+
+    up->file.close();
+    if (SDM.exists(up->path)) SDM.remove(up->path);
+    if (!SDM.rename(up->path + ".part", up->path)) {
+        releaseUpload(*up);
+        return request->send(500, "text/plain", "Fail renaming the upload");
+    }
+    releaseUpload(*up, true);
+    request->send(200, "text/plain", "OK");
+}
+
+void configureUploadApi(AsyncWebServer *server) {
+    server->on("/upload/init", HTTP_POST, uploadInit);
+    server->on("/upload/chunk", HTTP_PUT, uploadChunk, nullptr, uploadChunkBody);
+    server->on("/upload/commit", HTTP_POST, uploadCommit);
+}
@@ -0,0 +1,29 @@
+#ifndef __WEB_UPLOAD_H
+#define __WEB_UPLOAD_H
+
+#include <ESPAsyncWebServer.h>
+
+#ifndef UPLOAD_CHUNK
+#define UPLOAD_CHUNK (64 * 1024) // bytes per PUT, the browser slices files by what /upload/init returns
+#endif
+
+#ifndef UPLOAD_SLOTS
+#define UPLOAD_SLOTS 6 // files being received at the same time
+#endif
+
+/*
+Chunked upload API, every call answers JSON
+
+   POST /upload/init?path=/dir/file.bin&size=N   -> {"id":..,"chunk":UPLOAD_CHUNK,"have":"0110.."}
+   PUT  /upload/chunk?id=..&offset=O&crc=C       body: the chunk at offset O, C is its CRC32
+   POST /upload/commit?id=..                     -> 200 once every chunk arrived, 409 + "have" otherwise
+
+Data goes to path + ".part" at its offset, chunks may arrive in any order and over several
+connections. Calling init again for the same path and size resumes: "have" marks the chunks
+already written and verified, the browser only sends the missing ones. Another size drops the
+old upload and starts over, 409 while one of its chunks is still being written. An upload
+dropped from its slot before the commit takes its .part file along.
+*/
+void configureUploadApi(AsyncWebServer *server);
+
+#endif
@@ -0,0 +1,100 @@
+#!/usr/bin/env python3
+"""
+Converts the OTA firmware catalog (third_party.json) into the catalog.bin cache
+the Launcher keeps on the SD card, see src/catalog.h for the layout.
+
+Copy the result to the root of the SD card to skip the first full download.
+
+    python3 catalog_bin.py third_party.json catalog.bin
+    python3 catalog_bin.py https://raw.githubusercontent.com/bmorcelli/M5Stack-json-fw/main/v2/third_party.json catalog.bin
+    python3 catalog_bin.py third_party.json catalog.bin --bench
+"""
+import argparse
+import json
+import struct
+import sys
+import time
+import urllib.request
+
+MAGIC = b"LCAT"
+VERSION = 1
+U32_FIELDS = ("as", "so", "ss", "fo", "fs", "fo2", "fs2")
+
+
+def put_str(out, value):
+    data = (value or "").encode("utf-8")
+    out += struct.pack("<H", len(data)) + data
+
+
+def build(catalog, etag="", last_modified=""):
+    out = bytearray()
+    out += MAGIC + struct.pack("<HHI", VERSION, len(catalog), 0)
+    put_str(out, etag)
+    put_str(out, last_modified)
+
+    offsets = []
+    for item in catalog:
+        offsets.append(len(out))
+        put_str(out, item.get("name"))
+        put_str(out, item.get("author"))
+        versions = item.get("versions", [])
+        out += struct.pack("<H", len(versions))
+        for v in versions:
+            put_str(out, v.get("version"))
+            put_str(out, v.get("published_at"))
+            put_str(out, v.get("file"))
+            flags = bool(v.get("s")) | bool(v.get("nb")) << 1 | bool(v.get("f")) << 2 | bool(v.get("f2")) << 3
+            out += struct.pack("<B", flags)
+            out += struct.pack("<7I", *(int(v.get(k) or 0) for k in U32_FIELDS))
+
+    index_offset = len(out)
+    out += struct.pack("<%dI" % len(offsets), *offsets)
+    struct.pack_into("<I", out, 8, index_offset)
+    return bytes(out)
+
+
+def first_item_from_bin(blob):
+    """What the device does to show the first entry: header, index, one record"""
+    count, index_offset = struct.unpack_from("<HI", blob, 6)
+    (offset,) = struct.unpack_from("<I", blob, index_offset)
+    (name_len,) = struct.unpack_from("<H", blob, offset)
+    return blob[offset + 2 : offset + 2 + name_len].decode("utf-8")
+
+
+def load(source):
+    if source.startswith(("http://", "https://")):
+        with urllib.request.urlopen(source) as resp:
+            return resp.read(), resp.headers.get("ETag", ""), resp.headers.get("Last-Modified", "")
+    with open(source, "rb") as f:
+        return f.read(), "", ""
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Build catalog.bin from the firmware catalog JSON")
+    parser.add_argument("source", help="third_party.json path or URL")
+    parser.add_argument("output", help="catalog.bin to write")
+    parser.add_argument("--bench", action="store_true", help="compare time to the first item, JSON vs binary")
+    args = parser.parse_args()
+
+    raw, etag, last_modified = load(args.source)
+    catalog = json.loads(raw)
+    blob = build(catalog, etag, last_modified)
+    with open(args.output, "wb") as f:
+        f.write(blob)
+    print(f"{len(catalog)} firmwares: {len(raw)} bytes of JSON -> {len(blob)} bytes")
+
+    if args.bench:
+        runs = 20
+        start = time.perf_counter()
+        for _ in range(runs):
+            json.loads(raw)[0]["name"]
+        json_ms = (time.perf_counter() - start) * 1000 / runs
+        start = time.perf_counter()
+        for _ in range(runs):
+            first_item_from_bin(blob)
+        bin_ms = (time.perf_counter() - start) * 1000 / runs
+        print(f"open-to-first-item: JSON {json_ms:.3f} ms, binary {bin_ms:.3f} ms")
+
+
+if __name__ == "__main__":
+    sys.exit(main())
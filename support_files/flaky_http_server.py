@@ -0,0 +1,313 @@
+#!/usr/bin/env python3
+"""
+HTTP server that drops connections part way through, for testing the resumed
+firmware downloads of onlineLauncher.cpp (downloadFirmware) against a link that
+keeps failing.
+
+It serves the files of a folder with ETag, Last-Modified, Range and If-Range,
+and cuts every response after a random number of bytes. --misrange also answers
+some Range requests from an earlier byte than asked, with a Content-Range that
+says so, like a cache that rounds ranges to its blocks. Point the Launcher at
+it (SERVER_PATH) and compare the .bin on the SD card with the served one.
+
+    python3 flaky_http_server.py serve ./firmware --port 8080 --cut 20000 200000
+    python3 flaky_http_server.py serve ./firmware --tls cert.pem key.pem
+    python3 flaky_http_server.py selftest --size 3000000 --runs 20
+
+selftest runs the server on a random file and downloads it with a client doing
+what downloadFirmware does: the data goes to <name>.part, the journal is
+written when a response starts and every 64KB after the file was flushed, the
+file is reopened at the journal offset and written over from there, a 206
+starting anywhere else starts the download over. Only a complete download is
+renamed to its own name. Sessions are also abandoned between a
+flush and the journal write, like a reset would, leaving the file longer than
+the journal says. Every run has to end with the same bytes the server sent,
+and no call may leave a file under the final name before that,
+--append runs the old append mode to show the duplicated bytes.
+"""
+import argparse
+import email.utils
+import hashlib
+import http.client
+import http.server
+import json
+import os
+import random
+import re
+import ssl
+import sys
+import tempfile
+import threading
+
+SYNC_EVERY = 64 * 1024  # DOWNLOAD_SYNC_EVERY
+BUFFER = 4096  # bytes read from the stream at a time
+MAX_RETRIES = 8  # DOWNLOAD_MAX_RETRIES
+
+
+class FlakyHandler(http.server.BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.0"  # the Launcher asks for HTTP/1.0 (useHTTP10)
+    root = "."
+    cut = (20000, 200000)
+    misrange = 0.0
+    rng = random.Random()
+
+    def log_message(self, format, *args):
+        if self.server.verbose:
+            super().log_message(format, *args)
+
+    def do_GET(self):
+        path = os.path.join(self.root, self.path.split("?")[0].lstrip("/"))
+        if not os.path.isfile(path):
+            return self.send_error(404)
+        with open(path, "rb") as f:
+            data = f.read()
+        stat = os.stat(path)
+        etag = '"%s"' % hashlib.md5(data).hexdigest()
+        modified = email.utils.formatdate(stat.st_mtime, usegmt=True)
+
+        start, end = 0, len(data) - 1
+        ranged = False
+        match = re.fullmatch(r"bytes=(\d+)-(\d*)", self.headers.get("Range", ""))
+        if_range = self.headers.get("If-Range")
+        if match and (if_range is None or if_range in (etag, modified)):
+            start = int(match.group(1))
+            if match.group(2):
+                end = min(int(match.group(2)), end)
+            if start > end:
+                self.send_response(416)
+                self.send_header("Content-Range", "bytes */%d" % len(data))
+                self.end_headers()
+                return
+            ranged = True
+            if start and self.rng.random() < self.misrange:
+                start -= min(start, self.rng.randint(1, 4096))
+
+        self.send_response(206 if ranged else 200)
+        self.send_header("Content-Type", "application/octet-stream")
+        self.send_header("Content-Length", str(end - start + 1))
+        self.send_header("Accept-Ranges", "bytes")
+        self.send_header("ETag", etag)
+        self.send_header("Last-Modified", modified)
+        if ranged:
+            self.send_header("Content-Range", "bytes %d-%d/%d" % (start, end, len(data)))
+        self.end_headers()
+
+        body = data[start : end + 1]
+        cut = self.rng.randint(*self.cut) if self.cut[1] else len(body)
+        try:
+            self.wfile.write(body[:cut])
+            self.wfile.flush()
+        except (BrokenPipeError, ConnectionResetError):
+            pass
+        if cut < len(body):
+            self.close_connection = True
+            self.server.cuts += 1
+
+
+def make_server(root, port, cut, tls=None, verbose=False, seed=None, misrange=0.0):
+    attrs = {"root": root, "cut": cut, "misrange": misrange, "rng": random.Random(seed)}
+    handler = type("Handler", (FlakyHandler,), attrs)
+    server = http.server.ThreadingHTTPServer(("", port), handler)
+    server.verbose = verbose
+    server.cuts = 0
+    if tls:
+        context = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+        context.load_cert_chain(*tls)
+        server.socket = context.wrap_socket(server.socket, server_side=True)
+    return server
+
+
+class Abandoned(Exception):
+    pass
+
+
+def read_journal(path):
+    try:
+        with open(path) as f:
+            return json.load(f)
+    except (OSError, ValueError):
+        return None
+
+
+def write_journal(path, journal):
+    with open(path, "w") as f:
+        json.dump(journal, f)
+
+
+def content_range_start(value):
+    match = re.match(r"bytes (\d+)-", value)
+    return int(match.group(1)) if match else -1
+
+
+def finish(bin_path, journal_path):
+    os.replace(bin_path + ".part", bin_path)
+    os.remove(journal_path)
+    return True
+
+
+def download(port, name, bin_path, rng, append=False, abandon=0.0):
+    """One downloadFirmware() call, True once the file is complete"""
+    journal_path = bin_path + ".dl"
+    part_path = bin_path + ".part"
+    url = "/" + name
+    journal = read_journal(journal_path)
+    offset = 0
+    if journal and journal["url"] == url and journal["size"] > 0 and os.path.exists(part_path):
+        offset = min(journal["done"], os.path.getsize(part_path))
+    else:
+        journal = {"url": url, "size": 0, "etag": "", "lastmod": "", "done": 0}
+
+    tries = 0
+    while tries <= MAX_RETRIES:
+        conn = http.client.HTTPConnection("127.0.0.1", port, timeout=10)
+        headers = {}
+        if offset > 0:
+            headers["Range"] = "bytes=%d-" % offset
+            if journal["etag"] or journal["lastmod"]:
+                headers["If-Range"] = journal["etag"] or journal["lastmod"]
+        conn.request("GET", url, headers=headers)
+        response = conn.getresponse()
+        if response.status == 416:
+            conn.close()
+            if journal["size"] > 0 and offset == journal["size"]:
+                return finish(bin_path, journal_path)
+            offset = 0
+            continue
+        if response.status not in (200, 206):
+            conn.close()
+            tries += 1
+            continue
+
+        resumed = response.status == 206 and offset > 0
+        if resumed and not append and content_range_start(response.getheader("Content-Range", "")) != offset:
+            conn.close()
+            offset = 0
+            continue
+        remaining = int(response.getheader("Content-Length", "-1"))
+        if not resumed:
+            offset = 0
+            journal["size"] = max(remaining, 0)
+            journal["etag"] = response.getheader("ETag", "")
+            journal["lastmod"] = response.getheader("Last-Modified", "")
+        if append:
+            f = open(part_path, "ab" if resumed else "wb")
+        else:
+            f = open(part_path, "r+b" if resumed else "wb")
+            f.seek(offset)
+        journal["done"] = offset
+        write_journal(journal_path, journal)
+
+        started = last_sync = offset
+        try:
+            while remaining != 0:
+                try:
+                    chunk = response.read(min(BUFFER, remaining) if remaining > 0 else BUFFER)
+                except (http.client.IncompleteRead, OSError):
+                    chunk = b""
+                if not chunk:
+                    break
+                f.write(chunk)
+                if remaining > 0:
+                    remaining -= len(chunk)
+                offset += len(chunk)
+                if offset - last_sync >= SYNC_EVERY:
+                    f.flush()
+                    if rng.random() < abandon:
+                        raise Abandoned()  # reset after the flush, the journal still has the last sync
+                    journal["done"] = offset
+                    write_journal(journal_path, journal)
+                    last_sync = offset
+        finally:
+            f.close()
+            conn.close()
+
+        journal["done"] = offset
+        if journal["size"] > 0 and offset == journal["size"]:
+            return finish(bin_path, journal_path)
+        write_journal(journal_path, journal)
+        if offset > started:
+            tries = 0
+        tries += 1
+    return False
+
+
+def selftest(args):
+    rng = random.Random(args.seed)
+    failed = 0
+    with tempfile.TemporaryDirectory() as root:
+        server = make_server(root, 0, (args.cut[0], args.cut[1]), seed=args.seed, misrange=args.misrange)
+        port = server.server_address[1]
+        threading.Thread(target=server.serve_forever, daemon=True).start()
+        for run in range(args.runs):
+            served = os.path.join(root, "fw.bin")
+            data = rng.randbytes(rng.randint(args.size // 2, args.size))
+            with open(served, "wb") as f:
+                f.write(data)
+            sd = os.path.join(root, "sd.bin")
+            for leftover in (sd, sd + ".dl", sd + ".part"):
+                if os.path.exists(leftover):
+                    os.remove(leftover)
+
+            calls = 0
+            early = False
+            server.cuts = 0
+            while True:
+                calls += 1
+                try:
+                    if download(port, "fw.bin", sd, rng, args.append, args.abandon):
+                        break
+                except Abandoned:
+                    pass
+                early = early or os.path.exists(sd)  # an unfinished file the SD browser would install
+                if args.change and calls == 2:  # new firmware under the same URL, If-Range starts over
+                    data = rng.randbytes(len(data))
+                    with open(served, "wb") as f:
+                        f.write(data)
+            with open(sd, "rb") as f:
+                got = f.read()
+            ok = got == data and not early
+            failed += not ok
+            result = "byte exact" if ok else f"MISMATCH, got {len(got)} bytes"
+            if early:
+                result = "named .bin before it was complete"
+            print(f"run {run}: {len(data)} bytes, {server.cuts} cuts, {calls} calls, {result}")
+        server.shutdown()
+    print(f"{args.runs - failed} of {args.runs} downloads byte exact")
+    return 1 if failed else 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = parser.add_subparsers(dest="command", required=True)
+    serve = sub.add_parser("serve", help="serve a folder, cutting the connections")
+    serve.add_argument("root")
+    serve.add_argument("--port", type=int, default=8080)
+    serve.add_argument("--tls", nargs=2, metavar=("CERT", "KEY"), help="serve HTTPS, the Launcher skips the check")
+    test = sub.add_parser("selftest", help="download through the server like the Launcher does")
+    test.add_argument("--size", type=int, default=2000000, help="largest file served")
+    test.add_argument("--runs", type=int, default=10)
+    test.add_argument("--abandon", type=float, default=0.1, help="chance to stop between a flush and the journal")
+    test.add_argument("--change", action="store_true", help="replace the served file after the second call")
+    test.add_argument("--append", action="store_true", help="reopen with append like before, shows the bug")
+    test.add_argument("--seed", type=int)
+    test.add_argument("--misrange", type=float, default=0.2, help="chance to answer a Range from an earlier byte")
+    for p in (serve, test):
+        p.add_argument("--cut", type=int, nargs=2, default=[20000, 200000], metavar=("MIN", "MAX"),
+                       help="bytes sent before a connection is cut, 0 0 never cuts")
+    serve.add_argument("--misrange", type=float, default=0.0, help="chance to answer a Range from an earlier byte")
+    serve.add_argument("-v", "--verbose", action="store_true")
+    args = parser.parse_args()
+
+    if args.command == "selftest":
+        return selftest(args)
+    server = make_server(args.root, args.port, tuple(args.cut), args.tls, args.verbose, misrange=args.misrange)
+    print(f"Serving {args.root} on port {args.port}, cutting after {args.cut[0]}-{args.cut[1]} bytes")
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
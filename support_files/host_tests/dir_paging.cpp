@@ -0,0 +1,192 @@
+// Pages through a folder the way /listfiles does (readListingPage in webInterface.cpp, mirrored
+// here without the JSON), at page sizes around DIR_WINDOW and in any order, and checks that the
+// pages put together are the whole folder: sorted ones in the order of sortedNames below, each
+// entry once, "next" pointing at the following page and -1 only on the last one. Unsorted pages
+// go by seekDir and have to hold every entry once as well. Also the onlyBins filter and the
+// indexFolder cache.
+#include "dirIndex.h"
+#include "host.h"
+#include <globals.h>
+#include <random>
+#include <sys/stat.h>
+
+struct Item {
+    String name;
+    uint32_t size;
+    bool folder;
+    bool operator==(const Item &o) const { return name == o.name && size == o.size && folder == o.folder; }
+};
+
+struct Page {
+    std::vector<Item> items;
+    int32_t next;
+};
+
+#define FOLDER "/tree"
+
+// Names a FAT card can hold together, no two differing only in case
+static std::vector<std::pair<String, bool>> treeNames() {
+    std::vector<std::pair<String, bool>> names = {
+        {"Apps", true}, {"apps2", true}, {"_old", true}, {"zeta", true}, {"Backup 2024", true},
+        {"firmware_v1.bin", false}, {"Firmware_v2.bin", false}, {"FIRMWARE_v10.bin", false},
+        {"firmware_v1.bin.gz", false}, {"firmware_v1.txt", false}, {"firmware", false},
+        {"abcdefgh", false}, {"abcdefgh.bin", false}, {"ABCDEFG", false}, {"a", false}, {"A_", false},
+        {"b.bin", false}, {"B2.BIN", false}, {"readme.TXT", false}, {"README2.txt", false},
+        {"x.gz", false}, {"bin", false}, {".bin", false}, {"\xc3\xb1" "and\xc3\xba.bin", false},
+    };
+    for (int i = 0; i < 150; i++) names.push_back({String("img_") + String(i) + ".bin", false});
+    for (int i = 0; i < 60; i++) names.push_back({String("LOG") + String(i) + ".txt", false});
+    for (int i = 0; i < 40; i++) names.push_back({String("dir") + String(i), true});
+    return names;
+}
+
+static bool isBin(const String &name) {
+    String lower = name;
+    lower.toLowerCase();
+    return lower.endsWith(".bin") || lower.endsWith(".bin.gz");
+}
+
+// Folders first, then files, each by their upper-cased bytes, a name before the longer ones it starts
+static std::vector<Item> sortedNames(const std::vector<Item> &items) {
+    std::vector<Item> sorted = items;
+    std::sort(sorted.begin(), sorted.end(), [](const Item &a, const Item &b) {
+        if (a.folder != b.folder) return a.folder;
+        String ua = a.name, ub = b.name;
+        ua.toUpperCase();
+        ub.toUpperCase();
+        return std::lexicographical_compare(ua.begin(), ua.end(), ub.begin(), ub.end(),
+                                            [](char x, char y) { return (uint8_t)x < (uint8_t)y; });
+    });
+    return sorted;
+}
+
+// readListingPage, one DirIndex kept between the pages of a listing like webIndex
+static Page readPage(DirIndex &dir, uint32_t first, uint32_t limit, bool sorted) {
+    Page page;
+    bool exhausted = false;
+    if (sorted) {
+        if (dir.folder() != FOLDER) dir.load(FOLDER, false);
+        for (uint32_t pos = first; pos < dir.size() && page.items.size() < limit; pos++) {
+            Item item = {dir.name(pos), 0, dir.isFolder(pos)};
+            if (!item.folder) {
+                File file = SDM.open(dir.path(pos));
+                if (file) item.size = file.size();
+            }
+            page.items.push_back(item);
+        }
+        exhausted = first + page.items.size() >= dir.size();
+    } else {
+        File root = SDM.open(FOLDER);
+        if (first) root.seekDir(first);
+        while (page.items.size() < limit) {
+            File file = root.openNextFile();
+            if (!file) {
+                exhausted = true;
+                break;
+            }
+            page.items.push_back({String(file.name()), file.isDirectory() ? 0 : (uint32_t)file.size(),
+                                  file.isDirectory()});
+        }
+    }
+    page.next = exhausted ? -1 : (int32_t)(first + page.items.size());
+    return page;
+}
+
+// Follows "next" from offset 0 like the browser does, the index is made on the first page
+static std::vector<Item> listAll(uint32_t limit, bool sorted, int &pages) {
+    DirIndex dir;
+    std::vector<Item> all;
+    pages = 0;
+    for (int32_t offset = 0; offset >= 0 && pages < 10000; pages++) {
+        Page page = readPage(dir, offset, limit, sorted);
+        CHECK(page.items.size() <= limit, "limit %u: %u items", limit, (unsigned)page.items.size());
+        CHECK(page.next == -1 || page.items.size() == limit, "limit %u: short page at %d", limit, offset);
+        all.insert(all.end(), page.items.begin(), page.items.end());
+        offset = page.next;
+    }
+    return all;
+}
+
+static String describe(const std::vector<Item> &got, const std::vector<Item> &want) {
+    size_t i = 0;
+    while (i < got.size() && i < want.size() && got[i] == want[i]) i++;
+    return String("differs at ") + String((unsigned)i) + ": " + (i < got.size() ? got[i].name : "end") +
+           " instead of " + (i < want.size() ? want[i].name : "end");
+}
+
+int main() {
+    setvbuf(stdout, nullptr, _IONBF, 0);
+    hostSdMount(".");
+    mkdir("tree", 0755);
+    std::vector<Item> items;
+    std::mt19937 rng(11);
+    auto names = treeNames();
+    std::shuffle(names.begin(), names.end(), rng); // the card lists them in the order they were made
+    for (auto &n : names) {
+        String path = String(FOLDER "/") + n.first;
+        uint32_t size = 0;
+        if (n.second) SD.mkdir(path);
+        else {
+            size = rng() % 3000;
+            std::vector<uint8_t> data(size, 0xA5);
+            File f = SD.open(path, FILE_WRITE);
+            f.write(data.data(), data.size());
+        }
+        items.push_back({n.first, size, n.second});
+    }
+    const std::vector<Item> sorted = sortedNames(items);
+
+    int checked = 0;
+    for (uint32_t limit : {1u, 2u, 7u, 31u, 32u, 33u, 100u, (uint32_t)items.size(), 1000u}) {
+        int pages = 0;
+        std::vector<Item> got = listAll(limit, true, pages);
+        CHECK(got == sorted, "sorted, limit %u: %s", limit, describe(got, sorted).c_str());
+        CHECK(pages == (int)((items.size() + limit - 1) / limit), "sorted, limit %u: %d pages", limit, pages);
+
+        got = listAll(limit, false, pages);
+        std::vector<Item> unsortedGot = sortedNames(got);
+        CHECK(got.size() == items.size() && unsortedGot == sorted, "unsorted, limit %u: %s", limit,
+              describe(unsortedGot, sorted).c_str());
+        checked += 2;
+    }
+
+    // pages asked in any order, each one from a fresh index like after a reboot or another folder
+    for (uint32_t limit : {5u, 32u, 40u}) {
+        std::vector<uint32_t> offsets;
+        for (uint32_t o = 0; o < sorted.size(); o += limit) offsets.push_back(o);
+        std::shuffle(offsets.begin(), offsets.end(), rng);
+        for (uint32_t offset : offsets) {
+            DirIndex fresh;
+            Page page = readPage(fresh, offset, limit, true);
+            size_t end = std::min(sorted.size(), (size_t)offset + limit);
+            std::vector<Item> want(sorted.begin() + offset, sorted.begin() + end);
+            CHECK(page.items == want, "offset %u limit %u: %s", offset, limit,
+                  describe(page.items, want).c_str());
+            int32_t next = end == sorted.size() ? -1 : (int32_t)end;
+            CHECK(page.next == next, "offset %u: next %d, want %d", offset, page.next, next);
+        }
+        checked++;
+    }
+    DirIndex dir;
+    Page past = readPage(dir, sorted.size() + 3, 10, true);
+    CHECK(past.items.empty() && past.next == -1, "past the end: %u items", (unsigned)past.items.size());
+
+    // onlyBins keeps the folders and the .bin and .bin.gz files, in the same order
+    std::vector<Item> bins;
+    for (const Item &item : sorted)
+        if (item.folder || isBin(item.name)) bins.push_back(item);
+    DirIndex *index = indexFolder(FOLDER, true);
+    CHECK(index && index->size() == bins.size(), "onlyBins: %u entries, want %u",
+          index ? (unsigned)index->size() : 0, (unsigned)bins.size());
+    for (size_t i = 0; index && i < index->size() && i < bins.size(); i++) {
+        bool same = index->name(i) == bins[i].name && index->isFolder(i) == bins[i].folder;
+        CHECK(same, "onlyBins %u: %s for %s", (unsigned)i, index->name(i).c_str(), bins[i].name.c_str());
+    }
+    CHECK(indexFolder(FOLDER, true) == index, "onlyBins listing not cached");
+    CHECK(indexFolder(FOLDER, false) != index, "onlyBins listing handed out for every file");
+    invalidateDirIndex();
+    CHECK(index->size() == 0, "invalidateDirIndex kept %u entries", (unsigned)index->size());
+
+    printf("%u entries, %d pagings, %d failed checks\n", (unsigned)items.size(), checked, hostFailures);
+    return hostFailures != 0;
+}
@@ -0,0 +1,175 @@
+// Installs the images run.py made, plain and gzipped in every way it knows, through ImageInstaller
+// (SD card and WebUI) and UpdateClass (performUpdate), fed in chunks shaped like the network's,
+// then compares the flash with the plain image. Broken streams have to fail.
+#include "host.h"
+#include "imageInstaller.h"
+#include <esp_ota_ops.h>
+#include <globals.h>
+#include <fstream>
+#include <random>
+#include <sstream>
+
+struct Schedule {
+    const char *name;
+    std::vector<size_t> first; // sizes of the first writes, then `size` until the end
+    size_t size;
+    bool random;
+};
+
+static const Schedule schedules[] = {
+    {"tcp", {1}, 1436, false}, // one byte, then TCP segments
+    {"2+3", {2, 3}, 4096, false},
+    {"random", {}, 9000, true},
+    {"64K", {}, 65536, false},
+};
+
+static std::vector<std::vector<std::string>> device;
+static String dataDir;
+
+static std::vector<uint8_t> load(const std::string &name) {
+    return hostReadFile((dataDir + "/" + name.c_str()).c_str());
+}
+
+// The device of device.txt, its partitions filled with a pattern the install has to erase
+static void resetDevice() {
+    hostFlashReset(0x1000000);
+    for (auto &p : device) {
+        const esp_partition_t *part = hostAddPartition(
+            p[0].c_str(), (esp_partition_type_t)std::stoul(p[1]), (esp_partition_subtype_t)std::stoul(p[2]),
+            std::stoul(p[3]), std::stoul(p[4])
+        );
+        std::vector<uint8_t> pattern(part->size, 0x5A);
+        esp_partition_write(part, 0, pattern.data(), pattern.size());
+        if (part->type == ESP_PARTITION_TYPE_APP && part->subtype == ESP_PARTITION_SUBTYPE_APP_OTA_0)
+            MAX_APP = part->size;
+        if (part->subtype == ESP_PARTITION_SUBTYPE_DATA_SPIFFS) MAX_SPIFFS = part->size;
+        if (!strcmp(part->label, "sys")) MAX_FAT_sys = part->size;
+        if (!strcmp(part->label, "vfs")) MAX_FAT_vfs = part->size;
+    }
+}
+
+// Size of what a stream holds, the gzip trailer tells for a .gz like updateFromGzip reads it
+static uint32_t imageSize(const std::vector<uint8_t> &stream) {
+    if (!GzipInflater::isGzip(stream.data(), stream.size())) return stream.size();
+    const uint8_t *t = stream.data() + stream.size() - 4;
+    return t[0] | t[1] << 8 | t[2] << 16 | (uint32_t)t[3] << 24;
+}
+
+template <typename Write>
+static bool feed(const std::vector<uint8_t> &stream, const Schedule &s, Write write) {
+    std::mt19937 rng(stream.size());
+    size_t at = 0;
+    for (size_t i = 0; at < stream.size(); i++) {
+        size_t n = i < s.first.size() ? s.first[i] : s.random ? rng() % s.size + 1 : s.size;
+        n = std::min(n, stream.size() - at);
+        if (!write(stream.data() + at, n)) return false;
+        at += n;
+    }
+    return true;
+}
+
+static bool same(const esp_partition_t *p, const std::vector<uint8_t> &raw, uint32_t from, uint32_t size) {
+    std::vector<uint8_t> flash = hostFlashRead(p->address, size);
+    return !memcmp(flash.data(), raw.data() + from, size);
+}
+
+// What the layout of raw puts where, checked partition by partition
+static void checkFlash(const char *what, const std::vector<uint8_t> &raw, bool withSpiffs) {
+    ImageLayout layout;
+    uint8_t table[IMAGE_TABLE_SIZE];
+    memset(table, 0xFF, sizeof(table));
+    if (raw.size() > IMAGE_TABLE_OFFSET) {
+        size_t n = std::min(raw.size() - IMAGE_TABLE_OFFSET, sizeof(table));
+        memcpy(table, raw.data() + IMAGE_TABLE_OFFSET, n);
+    }
+    parseImageLayout(table, raw.size(), layout);
+
+    const esp_partition_t *app = esp_ota_get_next_update_partition(nullptr);
+    if (!layout.merged) {
+        CHECK(same(app, raw, 0, raw.size()), "%s: app", what);
+        return;
+    }
+    CHECK(layout.app_size && same(app, raw, 0x10000, layout.app_size), "%s: app", what);
+    const esp_partition_t *spiffs =
+        esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_SPIFFS, nullptr);
+    if (layout.spiffs && layout.spiffs_size) {
+        std::vector<uint8_t> pattern(layout.spiffs_size, 0x5A);
+        bool written = same(spiffs, raw, layout.spiffs_offset, layout.spiffs_size);
+        bool untouched = hostFlashRead(spiffs->address, layout.spiffs_size) == pattern;
+        CHECK(withSpiffs ? written : untouched, "%s: spiffs", what);
+    }
+    for (const char *label : {"sys", "vfs"}) {
+        bool sys = !strcmp(label, "sys");
+        uint32_t offset = sys ? layout.fat_offset_sys : layout.fat_offset_vfs;
+        uint32_t size = sys ? layout.fat_size_sys : layout.fat_size_vfs;
+        if (!size) continue;
+        const esp_partition_t *p =
+            esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_FAT, label);
+        CHECK(same(p, raw, offset, size), "%s: FAT %s", what, label);
+    }
+}
+
+static bool
+installImage(const std::vector<uint8_t> &stream, bool withSpiffs, const Schedule &s, String &error) {
+    ImageInstaller installer;
+    bool ok = installer.begin(imageSize(stream), withSpiffs) &&
+              feed(stream, s, [&](const uint8_t *data, size_t len) { return installer.write(data, len); }) &&
+              installer.end();
+    error = installer.error();
+    installer.abort();
+    return ok;
+}
+
+static bool updateApp(const std::vector<uint8_t> &stream, const Schedule &s) {
+    Update.setPipeline(true);
+    auto write = [](const uint8_t *data, size_t len) { return Update.write((uint8_t *)data, len) == len; };
+    bool ok = Update.begin(imageSize(stream), U_FLASH) && feed(stream, s, write);
+    ok = Update.end() && ok;
+    if (!ok) Update.abort();
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    setvbuf(stdout, nullptr, _IONBF, 0);
+    dataDir = argc > 1 ? argv[1] : ".";
+    std::ifstream devices((dataDir + "/device.txt").c_str());
+    for (std::string line; std::getline(devices, line);) {
+        std::istringstream fields(line);
+        std::vector<std::string> p(5);
+        for (auto &f : p) fields >> f;
+        device.push_back(p);
+    }
+
+    int runs = 0;
+    std::ifstream manifest((dataDir + "/manifest.txt").c_str());
+    for (std::string line; std::getline(manifest, line);) {
+        std::istringstream fields(line);
+        std::string kind, streamName, rawName;
+        int withSpiffs = 1;
+        fields >> kind >> streamName >> rawName >> withSpiffs;
+        std::vector<uint8_t> stream = load(streamName);
+        std::vector<uint8_t> raw = load(rawName);
+
+        for (size_t i = 0; i < sizeof(schedules) / sizeof(schedules[0]); i++) {
+            const Schedule &s = schedules[i];
+            deltaFlash = i % 2; // delta flash reads back every sector, the plain path erases ahead
+            String what = String(streamName.c_str()) + " " + s.name + (withSpiffs ? "" : " no spiffs");
+            resetDevice();
+            String error;
+            runs++;
+            if (kind == "good") {
+                bool ok = installImage(stream, withSpiffs, s, error);
+                CHECK(ok, "%s: %s", what.c_str(), error.c_str());
+                if (ok) checkFlash(what.c_str(), raw, withSpiffs);
+            } else if (kind == "bad") {
+                CHECK(!installImage(stream, true, s, error), "%s installed", what.c_str());
+            } else if (kind == "update") {
+                bool ok = updateApp(stream, s);
+                CHECK(ok, "%s: Update error %s", what.c_str(), Update.errorString());
+                if (ok) checkFlash(what.c_str(), raw, false);
+            }
+        }
+    }
+    printf("%d installs, %d failed checks\n", runs, hostFailures);
+    return hostFailures != 0;
+}
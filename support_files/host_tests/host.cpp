@@ -0,0 +1,501 @@
+// Host stand-ins of the Arduino core, FreeRTOS, the flash chip and the SD card, enough to
+// run the Launcher's update and upload code on a PC, see run.py
+#include "host.h"
+#include <FS.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <dirent.h>
+#include <display.h>
+#include <esp_flash.h>
+#include <esp_ota_ops.h>
+#include <fstream>
+#include <iterator>
+#include <list>
+#include <mutex>
+#include <random>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+const String emptyString;
+HardwareSerial Serial;
+EspClass ESP;
+FS SD;
+int hostFailures = 0;
+
+// globals.h and display.h
+volatile uint16_t tftHeight = 135;
+volatile uint16_t tftWidth = 240;
+uint16_t BGCOLOR = 0;
+uint32_t MAX_APP = 0;
+uint32_t MAX_SPIFFS = 0;
+uint32_t MAX_FAT_vfs = 0;
+uint32_t MAX_FAT_sys = 0;
+int prog_handler = 0;
+bool onlyBins = false;
+bool deltaFlash = false;
+static HostTft hostTft;
+HostTft *tft = &hostTft;
+void displayRedStripe(String, uint16_t, uint16_t) {}
+void progressHandler(int, size_t, size_t) {}
+
+static const auto started = std::chrono::steady_clock::now();
+
+unsigned long millis() { return micros() / 1000; }
+
+unsigned long micros() {
+    auto elapsed = std::chrono::steady_clock::now() - started;
+    return std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+}
+
+static void sleepUs(uint64_t us) {
+    if (us) std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+void delay(unsigned long ms) { sleepUs(ms * 1000ull); }
+void yield() { std::this_thread::yield(); }
+void *ps_malloc(size_t size) { return malloc(size); }
+
+static std::mt19937 rng(1);
+uint32_t esp_random() { return rng(); }
+void esp_fill_random(void *buf, size_t len) {
+    for (size_t i = 0; i < len; i++) ((uint8_t *)buf)[i] = rng();
+}
+
+std::vector<uint8_t> hostReadFile(const char *path) {
+    std::ifstream f(path, std::ios::binary);
+    return {std::istreambuf_iterator<char>(f), {}};
+}
+
+/***************************************************************************************
+** FreeRTOS
+** Description:   Tasks are threads, queues and mutexes share one lock. A task deleted by
+**                another one while it waits in here is unwound, like it never ran again
+***************************************************************************************/
+struct HostTask {
+    std::thread thread;
+    bool deleted = false;
+};
+struct HostQueue {
+    size_t itemSize;
+    size_t length;
+    std::deque<std::vector<uint8_t>> items;
+};
+struct HostMutex {
+    bool taken = false;
+};
+struct TaskDeleted {};
+
+// never destroyed, tasks may still be waiting when the test exits
+static std::mutex &rtosLock = *new std::mutex;
+static std::condition_variable &rtosChanged = *new std::condition_variable;
+static thread_local HostTask *currentTask = nullptr;
+
+template <typename Ready>
+static bool rtosWait(std::unique_lock<std::mutex> &lock, TickType_t ticks, Ready ready) {
+    auto until = std::chrono::steady_clock::now() + std::chrono::milliseconds(ticks);
+    for (;;) {
+        if (currentTask && currentTask->deleted) throw TaskDeleted();
+        if (ready()) return true;
+        if (ticks == portMAX_DELAY) rtosChanged.wait(lock);
+        else if (rtosChanged.wait_until(lock, until) == std::cv_status::timeout) return ready();
+    }
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+    return new HostQueue{itemSize, length, {}};
+}
+
+BaseType_t xQueueSend(QueueHandle_t handle, const void *item, TickType_t wait) {
+    HostQueue *q = (HostQueue *)handle;
+    std::unique_lock<std::mutex> lock(rtosLock);
+    if (!rtosWait(lock, wait, [q] { return q->items.size() < q->length; })) return pdFALSE;
+    q->items.emplace_back((const uint8_t *)item, (const uint8_t *)item + q->itemSize);
+    rtosChanged.notify_all();
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t handle, void *item, TickType_t wait) {
+    HostQueue *q = (HostQueue *)handle;
+    std::unique_lock<std::mutex> lock(rtosLock);
+    if (!rtosWait(lock, wait, [q] { return !q->items.empty(); })) return pdFALSE;
+    memcpy(item, q->items.front().data(), q->itemSize);
+    q->items.pop_front();
+    rtosChanged.notify_all();
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t handle) {
+    std::lock_guard<std::mutex> lock(rtosLock);
+    return ((HostQueue *)handle)->items.size();
+}
+
+void vQueueDelete(QueueHandle_t handle) { delete (HostQueue *)handle; }
+
+BaseType_t xTaskCreate(
+    void (*task)(void *), const char *name, uint32_t stack, void *arg, UBaseType_t priority,
+    TaskHandle_t *handle
+) {
+    HostTask *t = new HostTask;
+    t->thread = std::thread([t, task, arg] {
+        currentTask = t;
+        try {
+            task(arg);
+        } catch (TaskDeleted &) {}
+    });
+    if (handle) *handle = t;
+    return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(
+    void (*task)(void *), const char *name, uint32_t stack, void *arg, UBaseType_t priority,
+    TaskHandle_t *handle, BaseType_t core
+) {
+    return xTaskCreate(task, name, stack, arg, priority, handle);
+}
+
+void vTaskDelete(TaskHandle_t handle) {
+    HostTask *t = handle ? (HostTask *)handle : currentTask;
+    if (!t) return;
+    {
+        std::lock_guard<std::mutex> lock(rtosLock);
+        t->deleted = true;
+        rtosChanged.notify_all();
+    }
+    if (t == currentTask) {
+        t->thread.detach();
+        throw TaskDeleted();
+    }
+    t->thread.join();
+}
+
+void vTaskDelay(TickType_t ticks) { sleepUs(ticks * 1000ull); }
+UBaseType_t uxTaskPriorityGet(TaskHandle_t) { return 1; }
+
+SemaphoreHandle_t xSemaphoreCreateMutex() { return new HostMutex; }
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t handle, TickType_t wait) {
+    HostMutex *m = (HostMutex *)handle;
+    std::unique_lock<std::mutex> lock(rtosLock);
+    if (!rtosWait(lock, wait, [m] { return !m->taken; })) return pdFALSE;
+    m->taken = true;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t handle) {
+    std::lock_guard<std::mutex> lock(rtosLock);
+    ((HostMutex *)handle)->taken = false;
+    rtosChanged.notify_all();
+    return pdTRUE;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t handle) { delete (HostMutex *)handle; }
+
+/***************************************************************************************
+** Flash
+** Description:   One NOR chip, erase sets bytes to 0xFF and a write ANDs them in
+***************************************************************************************/
+static std::vector<uint8_t> flash;
+static std::list<esp_partition_t> partitions; // stable addresses for the pointers handed out
+static HostFlashTiming flashTiming = {0, 0, 0};
+static HostFlashStats flashStats = {0, 0, 0};
+static std::mutex flashLock;
+
+void hostFlashReset(uint32_t size) {
+    std::lock_guard<std::mutex> lock(flashLock);
+    flash.assign(size, 0xFF);
+    partitions.clear();
+    flashStats = {0, 0, 0};
+}
+
+const esp_partition_t *hostAddPartition(
+    const char *label, esp_partition_type_t type, esp_partition_subtype_t subtype, uint32_t address,
+    uint32_t size
+) {
+    esp_partition_t p = {};
+    p.type = type;
+    p.subtype = subtype;
+    p.address = address;
+    p.size = size;
+    p.erase_size = SPI_FLASH_SEC_SIZE;
+    snprintf(p.label, sizeof(p.label), "%s", label);
+    partitions.push_back(p);
+    return &partitions.back();
+}
+
+std::vector<uint8_t> hostFlashRead(uint32_t address, uint32_t size) {
+    std::lock_guard<std::mutex> lock(flashLock);
+    return std::vector<uint8_t>(flash.begin() + address, flash.begin() + address + size);
+}
+
+void hostFlashTiming(const HostFlashTiming &timing) { flashTiming = timing; }
+HostFlashStats hostFlashStats() { return flashStats; }
+
+static bool flashErase(uint32_t address, uint32_t size) {
+    if (address % SPI_FLASH_SEC_SIZE || size % SPI_FLASH_SEC_SIZE) return false;
+    if (address + size > flash.size()) return false;
+    uint64_t us = 0;
+    {
+        std::lock_guard<std::mutex> lock(flashLock);
+        memset(&flash[address], 0xFF, size);
+        while (size) { // whole blocks where aligned, like the IDF driver
+            bool block = address % SPI_FLASH_BLOCK_SIZE == 0 && size >= SPI_FLASH_BLOCK_SIZE;
+            uint32_t n = block ? SPI_FLASH_BLOCK_SIZE : SPI_FLASH_SEC_SIZE;
+            us += block ? flashTiming.blockEraseUs : flashTiming.sectorEraseUs;
+            (block ? flashStats.blocksErased : flashStats.sectorsErased)++;
+            address += n;
+            size -= n;
+        }
+    }
+    sleepUs(us);
+    return true;
+}
+
+static bool flashWrite(uint32_t address, const void *data, uint32_t size) {
+    if (address + size > flash.size()) return false;
+    {
+        std::lock_guard<std::mutex> lock(flashLock);
+        for (uint32_t i = 0; i < size; i++) flash[address + i] &= ((const uint8_t *)data)[i];
+        flashStats.bytesWritten += size;
+    }
+    sleepUs((uint64_t)(address % 256 + size + 255) / 256 * flashTiming.pageProgramUs);
+    return true;
+}
+
+static bool flashRead(uint32_t address, void *data, uint32_t size) {
+    if (address + size > flash.size()) return false;
+    std::lock_guard<std::mutex> lock(flashLock);
+    memcpy(data, &flash[address], size);
+    return true;
+}
+
+static bool inside(const esp_partition_t *p, uint32_t offset, size_t size) {
+    return p && offset <= p->size && size <= p->size - offset;
+}
+
+bool EspClass::partitionEraseRange(const esp_partition_t *p, uint32_t offset, size_t size) {
+    return inside(p, offset, size) && flashErase(p->address + offset, size);
+}
+
+bool EspClass::partitionWrite(const esp_partition_t *p, uint32_t offset, uint32_t *data, size_t size) {
+    return inside(p, offset, size) && flashWrite(p->address + offset, data, size);
+}
+
+bool EspClass::partitionRead(const esp_partition_t *p, uint32_t offset, uint32_t *data, size_t size) {
+    return inside(p, offset, size) && flashRead(p->address + offset, data, size);
+}
+
+uint32_t EspClass::getFlashChipSize() { return flash.size(); }
+
+const esp_partition_t *esp_partition_find_first(
+    esp_partition_type_t type, esp_partition_subtype_t subtype, const char *label
+) {
+    for (auto &p : partitions) {
+        if (type != ESP_PARTITION_TYPE_ANY && p.type != type) continue;
+        if (subtype != ESP_PARTITION_SUBTYPE_ANY && p.subtype != subtype) continue;
+        if (label && strcmp(p.label, label)) continue;
+        return &p;
+    }
+    return nullptr;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *p, size_t offset, void *dst, size_t size) {
+    if (!inside(p, offset, size)) return ESP_ERR_INVALID_SIZE;
+    return flashRead(p->address + offset, dst, size) ? ESP_OK : ESP_ERR_INVALID_SIZE;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *p, size_t offset, const void *src, size_t size) {
+    if (!inside(p, offset, size)) return ESP_ERR_INVALID_SIZE;
+    return flashWrite(p->address + offset, src, size) ? ESP_OK : ESP_ERR_INVALID_SIZE;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *p, size_t offset, size_t size) {
+    if (!inside(p, offset, size)) return ESP_ERR_INVALID_SIZE;
+    return flashErase(p->address + offset, size) ? ESP_OK : ESP_ERR_INVALID_SIZE;
+}
+
+// The update goes to the first OTA app slot, the Launcher itself being the test one
+const esp_partition_t *esp_ota_get_next_update_partition(const esp_partition_t *) {
+    for (auto &p : partitions)
+        if (p.type == ESP_PARTITION_TYPE_APP && p.subtype >= ESP_PARTITION_SUBTYPE_APP_OTA_0 &&
+            p.subtype < ESP_PARTITION_SUBTYPE_APP_TEST)
+            return &p;
+    return nullptr;
+}
+
+const esp_partition_t *esp_ota_get_running_partition() {
+    return esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_TEST, nullptr);
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t *p) { return p ? ESP_OK : ESP_ERR_INVALID_ARG; }
+
+esp_err_t esp_flash_erase_region(esp_flash_t *, uint32_t start, uint32_t len) {
+    return flashErase(start, len) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t esp_flash_write(esp_flash_t *, const void *buffer, uint32_t address, uint32_t length) {
+    return flashWrite(address, buffer, length) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t esp_flash_read(esp_flash_t *, void *buffer, uint32_t address, uint32_t length) {
+    return flashRead(address, buffer, length) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t esp_flash_set_chip_write_protect(esp_flash_t *, bool) { return ESP_OK; }
+
+/***************************************************************************************
+** SD card
+** Description:   Paths under the mounted host folder, directories listed once when
+**                opened, in the order the host gives them
+***************************************************************************************/
+struct HostFile {
+    String path;
+    String name;
+    FILE *file = nullptr;
+    bool directory = false;
+    std::vector<std::pair<String, bool>> entries; // name, is a folder
+    size_t next = 0;
+    ~HostFile() { // the last File referring to it closes it, like the core's VFSFileImpl
+        if (file) fclose(file);
+    }
+};
+
+static String sdRoot = ".";
+static HostSdTiming sdTiming = {0, 0, 0};
+static HostSdStats sdStats = {0, 0, 0};
+static std::mutex sdStatsLock;
+
+void hostSdMount(const String &root) { sdRoot = root; }
+void hostSdTiming(const HostSdTiming &timing) { sdTiming = timing; }
+void hostSdResetStats() { sdStats = {0, 0, 0}; }
+HostSdStats hostSdStats() { return sdStats; }
+
+static String hostPath(const String &path) { return sdRoot + (path.startsWith("/") ? "" : "/") + path; }
+
+File::operator bool() const { return _impl && (_impl->file || _impl->directory); }
+
+size_t File::write(const uint8_t *data, size_t len) {
+    if (!_impl || !_impl->file) return 0;
+    long at = ftell(_impl->file);
+    size_t n = fwrite(data, 1, len, _impl->file);
+    bool unaligned = at % 512 || (at + len) % 512;
+    {
+        std::lock_guard<std::mutex> lock(sdStatsLock);
+        sdStats.writes++;
+        sdStats.unaligned += unaligned;
+        sdStats.bytes += n;
+    }
+    uint64_t us = sdTiming.callUs + (uint64_t)sdTiming.byteNs * len / 1000;
+    sleepUs(us + (unaligned ? sdTiming.unalignedUs : 0));
+    return n;
+}
+
+int File::available() {
+    if (!_impl || !_impl->file) return 0;
+    return size() - position();
+}
+
+int File::read() {
+    uint8_t c;
+    return read(&c, 1) ? c : -1;
+}
+
+int File::peek() {
+    if (!_impl || !_impl->file) return -1;
+    int c = fgetc(_impl->file);
+    if (c >= 0) ungetc(c, _impl->file);
+    return c;
+}
+
+size_t File::read(uint8_t *data, size_t len) {
+    return _impl && _impl->file ? fread(data, 1, len, _impl->file) : 0;
+}
+
+void File::flush() {
+    if (_impl && _impl->file) fflush(_impl->file);
+}
+
+bool File::seek(uint32_t pos) { return _impl && _impl->file && !fseek(_impl->file, pos, SEEK_SET); }
+
+size_t File::position() const { return _impl && _impl->file ? ftell(_impl->file) : 0; }
+
+size_t File::size() const {
+    if (!_impl || !_impl->file) return 0;
+    fflush(_impl->file);
+    struct stat st;
+    return fstat(fileno(_impl->file), &st) ? 0 : st.st_size;
+}
+
+void File::close() {
+    if (_impl && _impl->file) fclose(_impl->file);
+    if (_impl) _impl->file = nullptr;
+    _impl.reset();
+}
+
+const char *File::name() const { return _impl ? _impl->name.c_str() : ""; }
+const char *File::path() const { return _impl ? _impl->path.c_str() : ""; }
+bool File::isDirectory() const { return _impl && _impl->directory; }
+
+String File::getNextFileName(bool *isDir) {
+    if (!isDirectory() || _impl->next >= _impl->entries.size()) return "";
+    auto &entry = _impl->entries[_impl->next++];
+    if (isDir) *isDir = entry.second;
+    String path = _impl->path;
+    if (!path.endsWith("/")) path += "/";
+    return path + entry.first;
+}
+
+String File::getNextFileName() { return getNextFileName(nullptr); }
+
+File File::openNextFile(const char *mode) {
+    String path = getNextFileName();
+    return path.isEmpty() ? File() : SD.open(path, mode);
+}
+
+bool File::seekDir(long position) {
+    if (!isDirectory() || position < 0 || (size_t)position > _impl->entries.size()) return false;
+    _impl->next = position;
+    return true;
+}
+
+void File::rewindDirectory() {
+    if (isDirectory()) _impl->next = 0;
+}
+
+File FS::open(const String &path, const char *mode, bool create) {
+    auto impl = std::make_shared<HostFile>();
+    impl->path = path.isEmpty() ? String("/") : path;
+    impl->name = impl->path.substring(impl->path.lastIndexOf('/') + 1);
+    String host = hostPath(path);
+    struct stat st;
+    if (!stat(host.c_str(), &st) && S_ISDIR(st.st_mode)) {
+        DIR *dir = opendir(host.c_str());
+        if (!dir) return File();
+        for (dirent *e; (e = readdir(dir));) {
+            if (!strcmp(e->d_name, ".") || !strcmp(e->d_name, "..")) continue;
+            struct stat es;
+            bool folder = !stat((host + "/" + e->d_name).c_str(), &es) && S_ISDIR(es.st_mode);
+            impl->entries.push_back({e->d_name, folder});
+        }
+        closedir(dir);
+        impl->directory = true;
+        return File(impl);
+    }
+    String m = mode;
+    if (m == "r" || m == "r+") impl->file = fopen(host.c_str(), (m + "b").c_str());
+    else impl->file = fopen(host.c_str(), m == "a" ? "ab" : "w+b");
+    return impl->file ? File(impl) : File();
+}
+
+bool FS::exists(const String &path) {
+    struct stat st;
+    return !stat(hostPath(path).c_str(), &st);
+}
+
+bool FS::remove(const String &path) { return !unlink(hostPath(path).c_str()); }
+bool FS::rename(const String &from, const String &to) {
+    return !::rename(hostPath(from).c_str(), hostPath(to).c_str());
+}
+bool FS::mkdir(const String &path) { return !::mkdir(hostPath(path).c_str(), 0755); }
+bool FS::rmdir(const String &path) { return !::rmdir(hostPath(path).c_str()); }
@@ -0,0 +1,47 @@
+// What the host tests set up and look at, the stand-ins themselves are in host.cpp
+#ifndef __HOST_H
+#define __HOST_H
+
+#include <Arduino.h>
+#include <esp_partition.h>
+#include <vector>
+
+// NOR flash of size bytes, erased. Writes can only clear bits, like the chip
+void hostFlashReset(uint32_t size);
+const esp_partition_t *hostAddPartition(
+    const char *label, esp_partition_type_t type, esp_partition_subtype_t subtype, uint32_t address,
+    uint32_t size
+);
+std::vector<uint8_t> hostFlashRead(uint32_t address, uint32_t size);
+
+// Time the chip takes, slept by the calling thread: per 4KB sector and 64KB block erased
+// and per 256 byte page programmed
+struct HostFlashTiming {
+    uint32_t sectorEraseUs;
+    uint32_t blockEraseUs;
+    uint32_t pageProgramUs;
+};
+void hostFlashTiming(const HostFlashTiming &timing);
+
+struct HostFlashStats {
+    uint32_t sectorsErased;
+    uint32_t blocksErased;
+    uint64_t bytesWritten;
+};
+HostFlashStats hostFlashStats();
+
+// Counts of failed checks, each one printed where it failed
+extern int hostFailures;
+#define CHECK(cond, ...)                                                                                    \
+    do {                                                                                                    \
+        if (!(cond)) {                                                                                      \
+            hostFailures++;                                                                                 \
+            printf("FAIL %s:%d %s: ", __FILE__, __LINE__, #cond);                                           \
+            printf(__VA_ARGS__);                                                                            \
+            printf("\n");                                                                                   \
+        }                                                                                                   \
+    } while (0)
+
+std::vector<uint8_t> hostReadFile(const char *path);
+
+#endif
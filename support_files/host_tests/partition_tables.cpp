@@ -0,0 +1,72 @@
+// Builds every scheme partitioner.cpp and partitioner.h offer (specs.h, made by run.py) with
+// PartitionTable and compares the bytes with the arrays they replaced (partition_baseline.h).
+// Each has to validate on the flash size of its boards and not on half of it, and parsing the
+// old bytes has to give back the same entries.
+#include "host.h"
+#include "partition_baseline.h"
+#include "specs.h"
+
+static const SpecTable *findSpecs(const char *name) {
+    for (const SpecTable &t : specTables)
+        if (!strcmp(t.name, name)) return &t;
+    return nullptr;
+}
+
+static void checkTable(const BaselineTable &old, const SpecTable &scheme) {
+    PartitionTable table;
+    CHECK(table.add(scheme.specs, scheme.count), "%s: add", old.name);
+
+    String error;
+    CHECK(table.validate(old.flashSize, &error), "%s: %s", old.name, error.c_str());
+    CHECK(!table.validate(old.flashSize / 2), "%s: validates on 0x%X", old.name, old.flashSize / 2);
+
+    uint8_t built[PART_TABLE_MAX_SIZE];
+    size_t len = table.build(built, sizeof(built));
+    CHECK(len && len <= old.size, "%s: %u bytes built, %u before", old.name, (unsigned)len,
+          (unsigned)old.size);
+    if (!len || len > old.size) return;
+    for (size_t i = 0; i < old.size; i++) {
+        uint8_t want = i < len ? built[i] : 0; // the old arrays were padded with zeroes past the MD5 row
+        if (old.data[i] != want) {
+            CHECK(false, "%s: byte 0x%X is %02X, was %02X", old.name, (unsigned)i, want, old.data[i]);
+            break;
+        }
+    }
+
+    PartitionTable parsed;
+    CHECK(parsed.parse(old.data, old.size), "%s: parse", old.name);
+    CHECK(parsed.entries().size() == scheme.count, "%s: %u entries parsed", old.name,
+          (unsigned)parsed.entries().size());
+    for (size_t i = 0; i < parsed.entries().size() && i < scheme.count; i++) {
+        const PartitionTable::Entry &e = parsed.entries()[i];
+        const PartitionSpec &s = scheme.specs[i];
+        bool same = !strcmp(e.label, s.label) && e.type == s.type && e.subtype == s.subtype &&
+                    e.offset == s.offset && e.size == s.size;
+        CHECK(same, "%s: entry %u is %s", old.name, (unsigned)i, e.label);
+    }
+}
+
+int main() {
+    setvbuf(stdout, nullptr, _IONBF, 0);
+    int compared = 0;
+    for (const BaselineTable &old : baselineTables) {
+        const SpecTable *scheme = findSpecs(old.name);
+        CHECK(scheme, "%s: scheme gone from partitioner.cpp/.h", old.name);
+        if (!scheme) continue;
+        checkTable(old, *scheme);
+        compared++;
+    }
+    // a scheme added later has no old bytes, it still has to build into a table that parses back
+    for (const SpecTable &t : specTables) {
+        bool known = false;
+        for (const BaselineTable &old : baselineTables) known = known || !strcmp(old.name, t.name);
+        if (known) continue;
+        PartitionTable table, parsed;
+        uint8_t built[PART_TABLE_MAX_SIZE];
+        size_t len = table.add(t.specs, t.count) ? table.build(built, sizeof(built)) : 0;
+        bool ok = len && parsed.parse(built, len) && parsed.entries().size() == t.count;
+        CHECK(ok, "%s: new scheme", t.name);
+    }
+    printf("%d tables compared, %d failed checks\n", compared, hostFailures);
+    return hostFailures != 0;
+}
@@ -0,0 +1,318 @@
+#!/usr/bin/env python3
+"""
+Builds the Launcher's update, partition and upload code for the PC and runs it
+against stand-ins of the flash chip, the SD card and FreeRTOS (host.cpp and
+stubs/), so it can be checked without a board.
+
+Each test compiles the real sources it names. Those sources and their own
+headers are copied to a build folder, so what they include from the rest of
+the firmware (display.h, globals.h, ...) resolves to the stubs. Functions that
+live in files too tied to the hardware to build here are cut out of them.
+
+    python3 run.py                     every test
+    python3 run.py gzip_roundtrip      only the ones named
+    python3 run.py --list
+    python3 run.py --keep              leaves the build folder, printed at the end
+
+Needs g++ (or $CXX) with zlib and OpenSSL headers, gzip(1) is used when found.
+"""
+import argparse
+import gzip
+import hashlib
+import os
+import random
+import re
+import shutil
+import struct
+import subprocess
+import sys
+import tempfile
+import zlib
+from pathlib import Path
+
+HERE = Path(__file__).resolve().parent
+REPO = HERE.parents[1]
+SRC = REPO / "src"
+LIB = REPO / "lib" / "Custom_Update" / "src"
+LIB_SOURCES = ["CustomUpdater.cpp", "GzipInflater.cpp", "FlashVerifier.cpp"]
+
+
+def extract(source, signature):
+    """The function of source starting with signature, up to its closing brace at column 0"""
+    text = (SRC / source).read_text().replace("\r\n", "\n")
+    match = re.search(r"^" + re.escape(signature) + r".*?^\}\n", text, re.M | re.S)
+    if not match:
+        raise SystemExit(f"{signature} not found in {source}")
+    return match.group(0)
+
+
+def build(name, test, work):
+    for f in test.get("sources", []) + test.get("headers", []):
+        shutil.copy(SRC / f, work / f)
+    sources = [str(work / f) for f in test.get("sources", [])]
+    if test.get("lib"):
+        sources += [str(LIB / f) for f in LIB_SOURCES]
+    if test.get("functions"):
+        cut = work / "extracted.cpp"
+        text = "".join(f'#include "{h}"\n' for h in test.get("headers", []))
+        text += "#include <globals.h>\n\n"
+        text += "\n".join(extract(*f) for f in test["functions"])
+        cut.write_text(text)
+        sources.append(str(cut))
+    exe = work / name
+    cmd = [os.environ.get("CXX", "g++"), "-std=gnu++17", "-O2", "-pthread", "-Wno-deprecated-declarations"]
+    cmd += test.get("defines", [])
+    cmd += ["-I", str(work), "-I", str(HERE / "stubs"), "-I", str(LIB), "-I", str(HERE)]
+    cmd += [str(HERE / f"{name}.cpp"), str(HERE / "host.cpp")] + sources
+    cmd += ["-o", str(exe), "-lz", "-lcrypto"]
+    subprocess.run(cmd, check=True)
+    return exe
+
+
+def device_partitions(csv):
+    """label type subtype offset size lines of the first scheme of a support_files .csv"""
+    types = {"app": 0x00, "data": 0x01}
+    subtypes = {"test": 0x20, "ota_0": 0x10, "ota_1": 0x11, "factory": 0x00, "nvs": 0x02, "phy": 0x01,
+                "coredump": 0x03, "fat": 0x81, "spiffs": 0x82}
+    lines = []
+    for row in (REPO / "support_files" / csv).read_text().splitlines():
+        if not row.strip() or row.startswith("#"):
+            continue
+        label, type_, subtype, offset, size = [c.strip() for c in row.split(",")[:5]]
+        size = int(size[:-1]) * 1024 if size.upper().endswith("K") else int(size, 0)
+        lines.append(f"{label} {types[type_]} {subtypes[subtype.lower()]} {int(offset, 0)} {size}")
+    return "\n".join(lines) + "\n"
+
+
+# ---------------------------------------------------------------------------- gzip_roundtrip
+
+
+def partition_table(rows):
+    """Binary table as gen_esp32part.py writes it, MD5 row included"""
+    out = b""
+    for label, type_, subtype, offset, size in rows:
+        out += struct.pack("<2sBBII16sI", b"\xaa\x50", type_, subtype, offset, size, label.encode(), 0)
+    out += b"\xeb\xeb" + b"\xff" * 14 + hashlib.md5(out).digest()
+    return out + b"\xff" * (0xC00 - len(out))
+
+
+def blob(rng, size, magic=None, erased=0.0):
+    """Firmware-like bytes, repeated words and some noise, that share of 4KB sectors erased"""
+    words = [rng.randbytes(rng.randint(2, 12)) for _ in range(96)]
+    out = bytearray()
+    while len(out) < size:
+        if rng.random() < erased:
+            out += b"\xff" * 4096
+            continue
+        sector = bytearray()
+        while len(sector) < 4096:
+            sector += rng.choice(words) if rng.random() < 0.85 else rng.randbytes(24)
+        out += sector[:4096]
+    out = out[:size]
+    if magic is not None:
+        out[0] = magic
+    return bytes(out)
+
+
+def merged(rng, rows, contents):
+    """esptool merge_bin style image: bootloader, table, then each partition's data"""
+    image = bytearray(b"\xff" * max(offset + len(data) for offset, data in contents.items()))
+    image[0x1000 : 0x1000 + 0x5000] = blob(rng, 0x5000, 0xE9)
+    image[0x8000 : 0x8000 + 0xC00] = partition_table(rows)
+    for offset, data in contents.items():
+        image[offset : offset + len(data)] = data
+    return bytes(image)
+
+
+def gzip_headers(raw, name):
+    """One member with FEXTRA, FNAME, FCOMMENT and FHCRC, the fields gzip(1) never writes together"""
+    header = struct.pack("<BBBBIBB", 0x1F, 0x8B, 8, 0x02 | 0x04 | 0x08 | 0x10, 0, 0, 3)
+    header += struct.pack("<H", 6) + b"LN\x02\x00hi"
+    header += name.encode() + b"\x00" + b"made by run.py\x00"
+    header += struct.pack("<H", zlib.crc32(header) & 0xFFFF)
+    c = zlib.compressobj(6, zlib.DEFLATED, -15)
+    return header + c.compress(raw) + c.flush() + struct.pack("<II", zlib.crc32(raw), len(raw) & 0xFFFFFFFF)
+
+
+def prepare_gzip(work):
+    rng = random.Random(23)
+    nvs = (REPO / "support_files" / "UiFlow2_nvs.bin").read_bytes()
+    images = {
+        # factory app with sys and vfs FAT, vfs larger than the device's and cut short by the image end
+        "uiflow.bin": merged(
+            rng,
+            [("nvs", 1, 2, 0x9000, 0x6000), ("factory", 0, 0, 0x10000, 0x200000),
+             ("sys", 1, 0x81, 0x210000, 0x100000), ("vfs", 1, 0x81, 0x310000, 0x300000)],
+            {0x9000: nvs, 0x10000: blob(rng, 0x15A5A3, 0xE9),
+             0x210000: blob(rng, 0x100000, erased=0.3), 0x310000: blob(rng, 0x91234, erased=0.2)},
+        ),
+        # two OTA slots and a SPIFFS larger than the device's
+        "arduino.bin": merged(
+            rng,
+            [("nvs", 1, 2, 0x9000, 0x5000), ("otadata", 1, 0, 0xE000, 0x2000), ("app0", 0, 0x10, 0x10000, 0x140000),
+             ("app1", 0, 0x11, 0x150000, 0x140000), ("spiffs", 1, 0x82, 0x290000, 0x2E0000)],
+            {0x10000: blob(rng, 0x12F001, 0xE9), 0x290000: blob(rng, 0x2E0000, erased=0.5)},
+        ),
+        "app.bin": blob(rng, 0x123457, 0xE9),
+    }
+    manifest = []
+    for name, raw in images.items():
+        (work / name).write_bytes(raw)
+        streams = {
+            f"{name}.py.gz": gzip.compress(raw, 6, mtime=0),
+            f"{name}.fields.gz": gzip_headers(raw, name),
+        }
+        for level in (1, 9) if shutil.which("gzip") else ():
+            streams[f"{name}.{level}.gz"] = subprocess.run(
+                ["gzip", f"-{level}", "-c", str(work / name)], check=True, capture_output=True
+            ).stdout
+        for stream, data in streams.items():
+            (work / stream).write_bytes(data)
+            manifest.append(f"good {stream} {name} 1")
+        manifest.append(f"good {name} {name} 1")
+        if name == "arduino.bin":
+            manifest.append(f"good {name}.py.gz {name} 0")
+        if name == "app.bin":
+            for stream in streams:
+                manifest.append(f"update {stream} {name}")
+
+    # broken streams have to fail, never install quietly
+    good = (work / "uiflow.bin.py.gz").read_bytes()
+    bad = {
+        "crc.gz": good[:-8] + bytes([good[-8] ^ 1]) + good[-7:],
+        "size.gz": good[:-1] + bytes([good[-1] ^ 0x80]),
+        "truncated.gz": good[:-100],
+        "deflate.gz": good[: len(good) // 2] + bytes([good[len(good) // 2] ^ 0x10]) + good[len(good) // 2 + 1 :],
+    }
+    for stream, data in bad.items():
+        (work / stream).write_bytes(data)
+        manifest.append(f"bad {stream} uiflow.bin")
+    (work / "manifest.txt").write_text("\n".join(manifest) + "\n")
+    (work / "device.txt").write_text(device_partitions("custom_16Mb.csv"))
+    return [str(work)]
+
+
+# ---------------------------------------------------------------------------- partition_tables
+
+SCHEME_PREFIXES = {"PART_08MB": "m8_", "PART_16MB": "m16_", "HEADLESS": "h_"}
+
+
+def prepare_partitions(work):
+    """specs.h, the PartitionSpec schemes of partitioner.cpp/.h renamed like partition_baseline.h"""
+    lines, tables = ['#include "partitionTable.h"', ""], []
+    for source in ("partitioner.cpp", "partitioner.h"):
+        text = (SRC / source).read_text().replace("\r\n", "\n")
+        for block in re.finditer(r"^#(?:el)?if defined\((\w+)\)\n(.*?)(?=^#elif|^#endif)", text, re.M | re.S):
+            prefix = SCHEME_PREFIXES.get(block.group(1))
+            if prefix is None:
+                continue
+            for scheme in re.finditer(r"^const PartitionSpec (\w+)\[\] = \{.*?^\};", block.group(2), re.M | re.S):
+                name = prefix + scheme.group(1)
+                lines.append(scheme.group(0).replace(scheme.group(1), name, 1))
+                tables.append(name)
+    if not tables:
+        raise SystemExit("no PartitionSpec schemes found in partitioner.cpp/.h")
+    lines += ["", "struct SpecTable {", "    const char *name;", "    const PartitionSpec *specs;",
+              "    size_t count;", "};", "", "static const SpecTable specTables[] = {"]
+    lines += [f'    {{"{t}", {t}, sizeof({t}) / sizeof({t}[0])}},' for t in tables]
+    (work / "specs.h").write_text("\n".join(lines + ["};", ""]))
+    return []
+
+
+# ---------------------------------------------------------------------------- update_pipeline
+
+
+def prepare_pipeline(work):
+    (work / "app.bin").write_bytes(blob(random.Random(1), 0x80000, 0xE9))
+    return ["app.bin"]
+
+
+# ---------------------------------------------------------------------------- upload_sink
+
+
+def prepare_upload(work):
+    """Fragment sizes of a 2MB multipart upload: the part headers, then TCP segments, a few short or merged"""
+    rng = random.Random(13)
+    trace, total = [1436 - 187], 1436 - 187
+    while total < 0x200000:
+        size = rng.choice([536, 1072, 2872]) if rng.random() < 0.1 else 1436
+        trace.append(size)
+        total += size
+    (work / "trace.txt").write_text("\n".join(map(str, trace)) + "\n")
+    return ["trace.txt"]
+
+
+TESTS = {
+    "gzip_roundtrip": {
+        "doc": "merged, app only and broken .bin.gz streams through ImageInstaller and UpdateClass",
+        "sources": ["imageInstaller.cpp"],
+        "headers": ["imageInstaller.h", "sd_functions.h"],
+        "lib": True,
+        "functions": [("sd_functions.cpp", "void parseImageLayout(")],
+        "prepare": prepare_gzip,
+    },
+    "partition_tables": {
+        "doc": "tables built from the partitioner schemes, byte for byte against the old arrays",
+        "sources": ["partitionTable.cpp"],
+        "headers": ["partitionTable.h"],
+        "prepare": prepare_partitions,
+    },
+    "update_pipeline": {
+        "doc": "benchmark, an image through UpdateClass from a slow source to a slow flash, pipeline off and on",
+        "lib": True,
+        "prepare": prepare_pipeline,
+    },
+    "upload_sink": {
+        "doc": "benchmark, WebUI upload fragments onto a slow SD card, File.write against UploadSink",
+        "sources": ["uploadSink.cpp"],
+        "headers": ["uploadSink.h"],
+        "prepare": prepare_upload,
+    },
+    "dir_paging": {
+        "doc": "/listfiles pages at any offset and limit, sorted and not, against the whole folder",
+        "sources": ["dirIndex.cpp"],
+        "headers": ["dirIndex.h", "sd_functions.h"],
+        "lib": True,
+    },
+}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("tests", nargs="*", help="tests to run, all by default")
+    parser.add_argument("--list", action="store_true")
+    parser.add_argument("--keep", action="store_true", help="keep the build folder")
+    args = parser.parse_args()
+    if args.list:
+        for name, test in TESTS.items():
+            print(f"{name:20} {test['doc']}")
+        return 0
+    unknown = [t for t in args.tests if t not in TESTS]
+    if unknown:
+        parser.error(f"unknown test {', '.join(unknown)}, see --list")
+
+    root = Path(tempfile.mkdtemp(prefix="launcher_host_"))
+    failed = []
+    for name in args.tests or TESTS:
+        test = TESTS[name]
+        work = root / name
+        work.mkdir()
+        print(f"== {name}", flush=True)
+        argv = test["prepare"](work) if "prepare" in test else []
+        try:
+            exe = build(name, test, work)
+        except subprocess.CalledProcessError:
+            failed.append(name)
+            continue
+        if subprocess.run([str(exe)] + argv, cwd=work).returncode:
+            failed.append(name)
+    if args.keep:
+        print(f"build folder: {root}")
+    else:
+        shutil.rmtree(root)
+    print("failed: " + ", ".join(failed) if failed else "all passed")
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,208 @@
+// Host stand-in of the Arduino core, only what the sources under test use
+#ifndef __HOST_ARDUINO_H
+#define __HOST_ARDUINO_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <strings.h>
+
+#define PROGMEM
+#define LOW 0
+#define HIGH 1
+#define INPUT 0
+#define OUTPUT 3
+#define HEX 16
+#define DEC 10
+
+#define log_e(...) ((void)0)
+#define log_w(...) ((void)0)
+#define log_i(...) ((void)0)
+#define log_d(...) ((void)0)
+#define log_v(...) ((void)0)
+
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_INVALID_ARG 0x102
+#define ESP_ERR_INVALID_SIZE 0x104
+
+class String : public std::string {
+public:
+    String() {}
+    String(const char *s) : std::string(s ? s : "") {}
+    String(const std::string &s) : std::string(s) {}
+    String(char c) : std::string(1, c) {}
+    String(int v, int base = DEC) { setNumber(v, base); }
+    String(unsigned v, int base = DEC) { setNumber(v, base); }
+    String(long v, int base = DEC) { setNumber(v, base); }
+    String(unsigned long v, int base = DEC) { setNumber(v, base); }
+    String(long long v, int base = DEC) { setNumber(v, base); }
+    String(unsigned long long v, int base = DEC) { setNumber(v, base); }
+    String(double v, unsigned decimals = 2) {
+        char b[64];
+        snprintf(b, sizeof(b), "%.*f", decimals, v);
+        assign(b);
+    }
+
+    String &operator+=(const String &s) { append(s); return *this; }
+    String &operator+=(const char *s) { append(s); return *this; }
+    String &operator+=(char c) { push_back(c); return *this; }
+    String &operator+=(int v) { return *this += String(v); }
+    String &operator+=(unsigned v) { return *this += String(v); }
+    String &operator+=(long v) { return *this += String(v); }
+    String &operator+=(unsigned long v) { return *this += String(v); }
+    bool concat(const char *s, size_t n) { append(s, n); return true; }
+    bool concat(const String &s) { append(s); return true; }
+    bool concat(char c) { push_back(c); return true; }
+
+    bool isEmpty() const { return empty(); }
+    bool reserve(size_t n) { std::string::reserve(n); return true; }
+    int indexOf(char c, int from = 0) const { return position(find(c, from)); }
+    int indexOf(const char *s, int from = 0) const { return position(find(s, from)); }
+    int indexOf(const String &s, int from = 0) const { return position(find(s, from)); }
+    int lastIndexOf(char c) const { return position(rfind(c)); }
+    int lastIndexOf(const char *s) const { return position(rfind(s)); }
+    String substring(int from) const { return from >= (int)size() ? String() : String(substr(from)); }
+    String substring(int from, int to) const {
+        return from >= (int)size() || to <= from ? String() : String(substr(from, to - from));
+    }
+    long toInt() const { return atol(c_str()); }
+    void toUpperCase() { for (auto &c : *this) c = toupper((uint8_t)c); }
+    void toLowerCase() { for (auto &c : *this) c = tolower((uint8_t)c); }
+    bool equals(const String &s) const { return *this == s; }
+    bool equalsIgnoreCase(const String &s) const { return !strcasecmp(c_str(), s.c_str()); }
+    bool startsWith(const String &s) const { return !compare(0, s.size(), s); }
+    bool endsWith(const String &s) const {
+        return size() >= s.size() && !compare(size() - s.size(), s.size(), s);
+    }
+    int compareTo(const String &s) const { return compare(s); }
+    char charAt(size_t i) const { return i < size() ? (*this)[i] : 0; }
+    void remove(size_t i) { if (i < size()) erase(i); }
+    void remove(size_t i, size_t n) { if (i < size()) erase(i, n); }
+    void replace(const String &from, const String &to) {
+        for (size_t p = 0; !from.empty() && (p = find(from, p)) != npos; p += to.size())
+            std::string::replace(p, from.size(), to);
+    }
+    void trim() {
+        size_t a = find_first_not_of(" \t\r\n");
+        size_t b = find_last_not_of(" \t\r\n");
+        *this = a == npos ? String() : String(substr(a, b - a + 1));
+    }
+
+private:
+    static int position(size_t p) { return p == npos ? -1 : (int)p; }
+    template <typename T> void setNumber(T v, int base) {
+        char b[72];
+        if (base == HEX) snprintf(b, sizeof(b), "%llx", (unsigned long long)v);
+        else if (v < 0) snprintf(b, sizeof(b), "%lld", (long long)v);
+        else snprintf(b, sizeof(b), "%llu", (unsigned long long)v);
+        assign(b);
+    }
+};
+
+inline String operator+(const String &a, const String &b) { return String(std::string(a) + std::string(b)); }
+inline String operator+(const String &a, const char *b) { return String(std::string(a) + b); }
+inline String operator+(const char *a, const String &b) { return String(a + std::string(b)); }
+inline String operator+(const String &a, char b) { return String(std::string(a) + b); }
+inline String operator+(const String &a, int b) { return a + String(b); }
+inline String operator+(const String &a, unsigned b) { return a + String(b); }
+inline String operator+(const String &a, long b) { return a + String(b); }
+inline String operator+(const String &a, unsigned long b) { return a + String(b); }
+
+extern const String emptyString;
+
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) { return write(&c, 1); }
+    virtual size_t write(const uint8_t *data, size_t len) { return len; }
+    size_t print(const String &s) { return write((const uint8_t *)s.c_str(), s.length()); }
+    size_t println(const String &s = String()) { return print(s + "\n"); }
+    size_t printf(const char *format, ...) { return 0; }
+};
+
+class Stream : public Print {
+public:
+    virtual int available() { return 0; }
+    virtual int read() { return -1; }
+    virtual int peek() { return -1; }
+    virtual size_t readBytes(uint8_t *data, size_t len) {
+        size_t n = 0;
+        for (int c; n < len && (c = read()) >= 0;) data[n++] = c;
+        return n;
+    }
+    size_t readBytes(char *data, size_t len) { return readBytes((uint8_t *)data, len); }
+    virtual void flush() {}
+    void setTimeout(unsigned long) {}
+};
+
+struct HardwareSerial : public Stream {
+    void begin(unsigned long) {}
+};
+extern HardwareSerial Serial;
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void yield();
+inline void pinMode(uint8_t, uint8_t) {}
+inline void digitalWrite(uint8_t, uint8_t) {}
+
+void *ps_malloc(size_t size);
+uint32_t esp_random();
+void esp_fill_random(void *buf, size_t len);
+
+// FreeRTOS, tasks are threads, see host.cpp
+typedef void *QueueHandle_t;
+typedef void *TaskHandle_t;
+typedef void *SemaphoreHandle_t;
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+typedef uint32_t TickType_t;
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define pdFAIL 0
+#define portMAX_DELAY 0xffffffffu
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize);
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t wait);
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t wait);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+void vQueueDelete(QueueHandle_t queue);
+BaseType_t xTaskCreate(
+    void (*task)(void *), const char *name, uint32_t stack, void *arg, UBaseType_t priority,
+    TaskHandle_t *handle
+);
+BaseType_t xTaskCreatePinnedToCore(
+    void (*task)(void *), const char *name, uint32_t stack, void *arg, UBaseType_t priority,
+    TaskHandle_t *handle, BaseType_t core
+);
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task);
+SemaphoreHandle_t xSemaphoreCreateMutex();
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t wait);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
+void vSemaphoreDelete(SemaphoreHandle_t semaphore);
+
+#include "esp_partition.h"
+
+class EspClass {
+public:
+    bool partitionEraseRange(const esp_partition_t *partition, uint32_t offset, size_t size);
+    bool partitionWrite(const esp_partition_t *partition, uint32_t offset, uint32_t *data, size_t size);
+    bool partitionRead(const esp_partition_t *partition, uint32_t offset, uint32_t *data, size_t size);
+    uint32_t getFlashChipSize();
+    void restart() {}
+};
+extern EspClass ESP;
+
+#endif
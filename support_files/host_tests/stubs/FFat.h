@@ -0,0 +1,6 @@
+#ifndef __HOST_FFAT_H
+#define __HOST_FFAT_H
+
+#include "FS.h"
+
+#endif
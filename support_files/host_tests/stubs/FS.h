@@ -0,0 +1,81 @@
+// Host stand-in of the Arduino FS, files and folders of a host directory, see hostSdMount()
+#ifndef __HOST_FS_H
+#define __HOST_FS_H
+
+#include <Arduino.h>
+#include <memory>
+#include <vector>
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+struct HostFile;
+
+class File : public Stream {
+public:
+    File() {}
+    explicit File(std::shared_ptr<HostFile> impl) : _impl(impl) {}
+
+    explicit operator bool() const;
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t *data, size_t len) override;
+    int available() override;
+    int read() override;
+    int peek() override;
+    size_t readBytes(uint8_t *data, size_t len) override { return read(data, len); }
+    size_t read(uint8_t *data, size_t len);
+    void flush() override;
+    bool seek(uint32_t pos);
+    size_t position() const;
+    size_t size() const;
+    void close();
+    const char *name() const;
+    const char *path() const;
+    bool isDirectory() const;
+
+    // Directory entries in the order the host lists them, like a FAT directory
+    File openNextFile(const char *mode = FILE_READ);
+    String getNextFileName();
+    String getNextFileName(bool *isDir);
+    bool seekDir(long position);
+    void rewindDirectory();
+
+private:
+    std::shared_ptr<HostFile> _impl;
+};
+
+class FS {
+public:
+    File open(const String &path, const char *mode = FILE_READ, bool create = false);
+    bool exists(const String &path);
+    bool remove(const String &path);
+    bool rename(const String &from, const String &to);
+    bool mkdir(const String &path);
+    bool rmdir(const String &path);
+};
+
+extern FS SD;
+
+// Where SD's root is on the host
+void hostSdMount(const String &root);
+
+// Time a card write takes, slept by the writing thread so concurrent writers behave like
+// on the device: callUs per write() call, plus byteNs per byte, plus unalignedUs when the
+// write doesn't start and end on a 512 byte sector, which the card reads, merges and rewrites
+struct HostSdTiming {
+    uint32_t callUs;
+    uint32_t byteNs;
+    uint32_t unalignedUs;
+};
+void hostSdTiming(const HostSdTiming &timing);
+
+struct HostSdStats {
+    uint32_t writes;
+    uint32_t unaligned;
+    uint64_t bytes;
+};
+HostSdStats hostSdStats();
+void hostSdResetStats();
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef __HOST_MD5_BUILDER_H
+#define __HOST_MD5_BUILDER_H
+
+#include <Arduino.h>
+#include <memory>
+#include <openssl/evp.h>
+
+class MD5Builder {
+public:
+    MD5Builder() = default;
+    MD5Builder(const MD5Builder &o) { *this = o; }
+    MD5Builder &operator=(const MD5Builder &o) {
+        if (this == &o) return *this;
+        _ctx.reset(o._ctx ? EVP_MD_CTX_new() : nullptr);
+        if (_ctx) EVP_MD_CTX_copy_ex(_ctx.get(), o._ctx.get());
+        memcpy(_digest, o._digest, sizeof(_digest));
+        return *this;
+    }
+
+    void begin() {
+        _ctx.reset(EVP_MD_CTX_new());
+        EVP_DigestInit_ex(_ctx.get(), EVP_md5(), nullptr);
+    }
+    void add(const uint8_t *data, size_t len) { EVP_DigestUpdate(_ctx.get(), data, len); }
+    void add(const String &s) { add((const uint8_t *)s.c_str(), s.length()); }
+    void calculate() { EVP_DigestFinal_ex(_ctx.get(), _digest, nullptr); }
+    void getBytes(uint8_t *out) const { memcpy(out, _digest, sizeof(_digest)); }
+    String toString() const {
+        char hex[33];
+        for (int i = 0; i < 16; i++) sprintf(hex + 2 * i, "%02x", _digest[i]);
+        return hex;
+    }
+
+private:
+    struct Free {
+        void operator()(EVP_MD_CTX *ctx) const { EVP_MD_CTX_free(ctx); }
+    };
+    std::unique_ptr<EVP_MD_CTX, Free> _ctx;
+    uint8_t _digest[16] = {0};
+};
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef __HOST_SD_H
+#define __HOST_SD_H
+
+#include "FS.h"
+
+#endif
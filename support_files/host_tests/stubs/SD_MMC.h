@@ -0,0 +1,6 @@
+#ifndef __HOST_SD_MMC_H
+#define __HOST_SD_MMC_H
+
+#include "FS.h"
+
+#endif
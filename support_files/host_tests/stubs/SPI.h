@@ -0,0 +1,6 @@
+#ifndef __HOST_SPI_H
+#define __HOST_SPI_H
+
+class SPIClass {};
+
+#endif
@@ -0,0 +1,17 @@
+// Host stand-in of src/display.h, nothing is drawn
+#ifndef __DISPLAY_H
+#define __DISPLAY_H
+
+#include <Arduino.h>
+
+struct HostTft {
+    void fillRect(int, int, int, int, uint16_t) {}
+    void fillRoundRect(int, int, int, int, int, uint16_t) {}
+    void drawRoundRect(int, int, int, int, int, uint16_t) {}
+};
+extern HostTft *tft;
+
+void displayRedStripe(String text, uint16_t fgcolor = 0, uint16_t bgcolor = 0);
+void progressHandler(int progress, size_t total, size_t skipped = 0);
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef __HOST_ESP_FLASH_H
+#define __HOST_ESP_FLASH_H
+
+#include <Arduino.h>
+#include "esp_spi_flash.h"
+
+// chip is always NULL in the Launcher, the one flash of host.cpp
+typedef struct esp_flash_t esp_flash_t;
+esp_err_t esp_flash_erase_region(esp_flash_t *chip, uint32_t start, uint32_t len);
+esp_err_t esp_flash_write(esp_flash_t *chip, const void *buffer, uint32_t address, uint32_t length);
+esp_err_t esp_flash_read(esp_flash_t *chip, void *buffer, uint32_t address, uint32_t length);
+esp_err_t esp_flash_set_chip_write_protect(esp_flash_t *chip, bool protect);
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef __HOST_ESP_IMAGE_FORMAT_H
+#define __HOST_ESP_IMAGE_FORMAT_H
+
+#define ESP_IMAGE_HEADER_MAGIC 0xE9
+
+#endif
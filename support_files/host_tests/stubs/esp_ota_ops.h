@@ -0,0 +1,10 @@
+#ifndef __HOST_ESP_OTA_OPS_H
+#define __HOST_ESP_OTA_OPS_H
+
+#include "esp_partition.h"
+
+const esp_partition_t *esp_ota_get_next_update_partition(const esp_partition_t *start);
+const esp_partition_t *esp_ota_get_running_partition();
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t *partition);
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef __HOST_ESP_ROM_CRC_H
+#define __HOST_ESP_ROM_CRC_H
+
+#include <cstdint>
+#include <zlib.h>
+
+// The ROM CRC32 is zlib's, same polynomial, initial value and final xor
+inline uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len) {
+    return crc32(crc, buf, len);
+}
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef __HOST_ESP_SPI_FLASH_H
+#define __HOST_ESP_SPI_FLASH_H
+
+#define SPI_FLASH_SEC_SIZE 4096
+#ifndef SPI_FLASH_BLOCK_SIZE
+#define SPI_FLASH_BLOCK_SIZE 65536
+#endif
+
+#endif
@@ -0,0 +1,22 @@
+// Host stand-in of include/globals.h, the settings the sources under test read
+#ifndef GLOBALS_H
+#define GLOBALS_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include <vector>
+
+#define SDM SD
+
+extern volatile uint16_t tftHeight;
+extern volatile uint16_t tftWidth;
+extern uint16_t BGCOLOR;
+extern uint32_t MAX_APP;
+extern uint32_t MAX_SPIFFS;
+extern uint32_t MAX_FAT_vfs;
+extern uint32_t MAX_FAT_sys;
+extern int prog_handler;
+extern bool onlyBins;
+extern bool deltaFlash;
+
+#endif
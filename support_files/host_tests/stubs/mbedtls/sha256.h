@@ -0,0 +1,25 @@
+#ifndef __HOST_MBEDTLS_SHA256_H
+#define __HOST_MBEDTLS_SHA256_H
+
+#include <openssl/evp.h>
+
+struct mbedtls_sha256_context {
+    EVP_MD_CTX *ctx;
+};
+
+inline void mbedtls_sha256_init(mbedtls_sha256_context *c) { c->ctx = EVP_MD_CTX_new(); }
+inline void mbedtls_sha256_free(mbedtls_sha256_context *c) {
+    EVP_MD_CTX_free(c->ctx);
+    c->ctx = nullptr;
+}
+inline int mbedtls_sha256_starts(mbedtls_sha256_context *c, int is224) {
+    return EVP_DigestInit_ex(c->ctx, is224 ? EVP_sha224() : EVP_sha256(), nullptr) ? 0 : -1;
+}
+inline int mbedtls_sha256_update(mbedtls_sha256_context *c, const unsigned char *data, size_t len) {
+    return EVP_DigestUpdate(c->ctx, data, len) ? 0 : -1;
+}
+inline int mbedtls_sha256_finish(mbedtls_sha256_context *c, unsigned char *out) {
+    return EVP_DigestFinal_ex(c->ctx, out, nullptr) ? 0 : -1;
+}
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef __HOST_ROM_MINIZ_H
+#define __HOST_ROM_MINIZ_H
+
+// The ROM tinfl API on top of zlib's raw inflate. Output goes to the same dictionary ring,
+// only what GzipInflater.cpp uses; zlib never reads past the end of the deflate stream, so
+// m_num_bits is always 0 and the trailer handling of the real read-ahead isn't exercised
+#include <cstdint>
+#include <cstring>
+#include <zlib.h>
+
+#define TINFL_LZ_DICT_SIZE 32768
+#define TINFL_FLAG_HAS_MORE_INPUT 2
+
+typedef enum {
+    TINFL_STATUS_FAILED = -1,
+    TINFL_STATUS_DONE = 0,
+    TINFL_STATUS_NEEDS_MORE_INPUT = 1,
+    TINFL_STATUS_HAS_MORE_OUTPUT = 2,
+} tinfl_status;
+
+struct tinfl_decompressor_tag {
+    z_stream z;
+    uint32_t m_num_bits;
+};
+typedef tinfl_decompressor_tag tinfl_decompressor;
+
+inline void tinfl_init(tinfl_decompressor *d) {
+    memset(d, 0, sizeof(*d));
+    inflateInit2(&d->z, -15);
+}
+
+inline tinfl_status tinfl_decompress(
+    tinfl_decompressor *d, const uint8_t *in, size_t *inSize, uint8_t *start, uint8_t *next, size_t *outSize,
+    int flags
+) {
+    d->z.next_in = (Bytef *)in;
+    d->z.avail_in = *inSize;
+    d->z.next_out = next;
+    d->z.avail_out = *outSize;
+    int ret = inflate(&d->z, Z_NO_FLUSH);
+    *inSize -= d->z.avail_in;
+    *outSize -= d->z.avail_out;
+    if (ret == Z_STREAM_END) {
+        inflateEnd(&d->z);
+        return TINFL_STATUS_DONE;
+    }
+    if (ret != Z_OK && ret != Z_BUF_ERROR) return TINFL_STATUS_FAILED;
+    if (!d->z.avail_out) return TINFL_STATUS_HAS_MORE_OUTPUT;
+    return flags & TINFL_FLAG_HAS_MORE_INPUT ? TINFL_STATUS_NEEDS_MORE_INPUT : TINFL_STATUS_FAILED;
+}
+
+#endif
@@ -0,0 +1,144 @@
+// Replays an image through UpdateClass the way performUpdate feeds it, 1KB reads from a source
+// that takes its time, onto a flash chip that takes its time, with the writer task off and on.
+// Serial the install takes read + flash, pipelined it should come close to max(read, flash).
+// Every checkpoint reported on the way has to be on flash already.
+//
+//     update_pipeline [image.bin [timing scale]]
+//
+// The chip times are a typical 4MB-16MB NOR datasheet's (45ms sector and 150ms block erase,
+// 0.7ms page program) divided by scale, 4 by default, so the whole run stays short. An image
+// captured from a real install can be replayed instead of the one run.py makes.
+#include "host.h"
+#include <CustomUpdate.h>
+#include <chrono>
+#include <esp_spi_flash.h>
+#include <thread>
+
+typedef std::chrono::steady_clock Clock;
+
+// Hands out the image in the caller's reads, each one taking readUsPerKB. Time the caller
+// spends elsewhere is not made up for, a read only starts once it is called, like the SD card's
+class SlowSource : public Stream {
+public:
+    SlowSource(const std::vector<uint8_t> &data, uint32_t readUsPerKB)
+        : _data(data), _usPerKB(readUsPerKB) {}
+
+    size_t readBytes(uint8_t *buf, size_t len) override {
+        len = std::min(len, _data.size() - _at);
+        if (_usPerKB) {
+            // owed time is carried over, so sleeping late once doesn't add up over thousands of reads
+            Clock::time_point now = Clock::now();
+            if (_due < now) _due = now;
+            _due += std::chrono::nanoseconds((uint64_t)_usPerKB * 1000 * len / 1024);
+            std::this_thread::sleep_until(_due);
+        }
+        memcpy(buf, _data.data() + _at, len);
+        _at += len;
+        return len;
+    }
+
+private:
+    const std::vector<uint8_t> &_data;
+    uint32_t _usPerKB;
+    size_t _at = 0;
+    Clock::time_point _due;
+};
+
+static double msSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// performUpdate's loop, without the display
+static bool install(const std::vector<uint8_t> &image, uint32_t readUsPerKB, bool pipeline, double &ms) {
+    hostFlashReset(0x400000);
+    const esp_partition_t *app =
+        hostAddPartition("app0", ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_0, 0x10000, 0x3F0000);
+    std::vector<uint8_t> pattern(app->size, 0x5A); // what the previous firmware left
+    esp_partition_write(app, 0, pattern.data(), pattern.size());
+
+    // a checkpoint may only name bytes already on flash, past the 16 end() writes, with their MD5
+    size_t checkpoints = 0;
+    Update.onCheckpoint([app, &image, &checkpoints](size_t done, const String &md5, const uint8_t *head) {
+        std::vector<uint8_t> flashed =
+            hostFlashRead(app->address + ENCRYPTED_BLOCK_SIZE, done - ENCRYPTED_BLOCK_SIZE);
+        CHECK(std::equal(flashed.begin(), flashed.end(), image.begin() + ENCRYPTED_BLOCK_SIZE),
+              "checkpoint at %u before the data was flashed", (unsigned)done);
+        MD5Builder prefix;
+        prefix.begin();
+        prefix.add(image.data(), done);
+        prefix.calculate();
+        CHECK(prefix.toString() == md5 && head && !memcmp(head, image.data(), ENCRYPTED_BLOCK_SIZE),
+              "checkpoint at %u: MD5 or header differ", (unsigned)done);
+        checkpoints++;
+    });
+
+    SlowSource source(image, readUsPerKB);
+    Clock::time_point start = Clock::now();
+    Update.setPipeline(pipeline);
+    Update.setDeltaFlash(false);
+    if (!Update.begin(image.size(), U_FLASH)) return false;
+    size_t written = 0;
+    uint8_t buf[1024];
+    while (written < image.size()) {
+        size_t bytesRead = source.readBytes(buf, sizeof(buf));
+        if (bytesRead == 0) break;
+        written += Update.write(buf, bytesRead);
+    }
+    bool ok = Update.end();
+    ms = msSince(start);
+    if (!ok) Update.abort();
+    Update.onCheckpoint(NULL);
+    // the writer task may still hold the last one when the image ends
+    size_t boundaries = (image.size() - 1) / UPDATE_CHECKPOINT_INTERVAL;
+    CHECK(checkpoints + 1 >= boundaries, "%u checkpoints for %u boundaries", (unsigned)checkpoints,
+          (unsigned)boundaries);
+    return ok && hostFlashRead(app->address, image.size()) == image;
+}
+
+int main(int argc, char **argv) {
+    setvbuf(stdout, nullptr, _IONBF, 0);
+    std::vector<uint8_t> image = hostReadFile(argc > 1 ? argv[1] : "app.bin");
+    uint32_t scale = argc > 2 ? atoi(argv[2]) : 4;
+    if (image.empty() || image[0] != 0xE9 || !scale) {
+        printf("usage: update_pipeline [image.bin [timing scale]], the image starting with 0xE9\n");
+        return 2;
+    }
+    hostFlashTiming({45000 / scale, 150000 / scale, 700 / scale});
+
+    // what the chip alone takes, the source answering at once
+    double flashMs = 0;
+    CHECK(install(image, 0, false, flashMs), "flash only: Update error %s", Update.errorString());
+    uint32_t flashUsPerKB = flashMs * 1000 * 1024 / image.size();
+    printf("%u KB image, flash alone %.0f ms (%.2f MB/s)\n\n", (unsigned)(image.size() / 1024), flashMs,
+           image.size() / flashMs / 1000);
+    printf("%-10s %9s %9s %11s %11s %11s\n", "read", "read ms", "serial", "pipelined", "read+flash",
+           "max");
+
+    // an SD card faster than the chip, a network as fast as it and one twice slower
+    const struct {
+        const char *name;
+        double ratio;
+    } sources[] = {{"SD", 0.25}, {"WiFi", 1}, {"slow WiFi", 2}};
+    for (const auto &s : sources) {
+        uint32_t usPerKB = flashUsPerKB * s.ratio;
+        SlowSource source(image, usPerKB);
+        uint8_t buf[1024];
+        Clock::time_point start = Clock::now();
+        while (source.readBytes(buf, sizeof(buf))) {}
+        double readMs = msSince(start);
+        double serialMs = 0, pipelinedMs = 0;
+        CHECK(install(image, usPerKB, false, serialMs), "%s serial: Update error %s", s.name,
+              Update.errorString());
+        CHECK(install(image, usPerKB, true, pipelinedMs), "%s pipelined: Update error %s", s.name,
+              Update.errorString());
+        double sum = readMs + flashMs, longest = std::max(readMs, flashMs);
+        printf("%-10s %9.0f %9.0f %11.0f %11.0f %11.0f\n", s.name, readMs, serialMs, pipelinedMs, sum,
+               longest);
+        // the overlap has to win back most of the shorter side, not just a little
+        double shorter = std::min(readMs, flashMs);
+        CHECK(pipelinedMs < longest + shorter / 2, "%s: pipelined %.0f ms, max(read, flash) %.0f ms",
+              s.name, pipelinedMs, longest);
+    }
+    printf("\n%d failed checks\n", hostFailures);
+    return hostFailures != 0;
+}
@@ -0,0 +1,104 @@
+// Replays the fragments of a WebUI upload, the way the async TCP task hands them to handleUpload,
+// onto an SD stand-in backed by a file that takes the card's time per write call, per byte and
+// for each write not on 512 byte sectors. Before: every fragment written to the File as it
+// comes. After: through UploadSink. Prints MB/s until the file is on the card and the share of
+// that time the TCP task spent in the handler.
+//
+//     upload_sink [trace.txt]
+//
+// trace.txt holds one fragment size per line, as logged from handleUpload's len on a board,
+// run.py makes one shaped like a TCP stream when none is given.
+#include "host.h"
+#include "uploadSink.h"
+#include <FS.h>
+#include <chrono>
+#include <fstream>
+#include <thread>
+
+typedef std::chrono::steady_clock Clock;
+
+#define LINK_BYTES_PER_S 1200000 // what an ESP32 receives over WiFi, at best
+#define LINK_WINDOW 5744          // TCP window of the Arduino core, what arrives while the handler runs
+
+static double msSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+static std::chrono::microseconds linkTime(size_t bytes) {
+    return std::chrono::microseconds((uint64_t)bytes * 1000000 / LINK_BYTES_PER_S);
+}
+
+struct Result {
+    double ms;        // first fragment until the file is closed
+    double handlerMs; // of it spent in the handler, the TCP task receives nothing meanwhile
+    HostSdStats stats;
+};
+
+static bool
+replay(const std::vector<size_t> &trace, const std::vector<uint8_t> &payload, bool sink, Result &r) {
+    SD.remove("/upload.bin");
+    hostSdResetStats();
+    File file = SD.open("/upload.bin", FILE_WRITE);
+    if (!file) return false;
+    UploadSink *s = sink ? UploadSink::open(file) : nullptr;
+    if (sink && !s) return false;
+
+    bool ok = true;
+    size_t at = 0;
+    r.handlerMs = 0;
+    Clock::time_point start = Clock::now(), due = start;
+    for (size_t len : trace) {
+        // the next fragment comes once the link carried it, the sender stops when the window is full
+        Clock::time_point windowFull = Clock::now() - linkTime(LINK_WINDOW);
+        due = std::max(due, windowFull) + linkTime(len);
+        std::this_thread::sleep_until(due);
+        Clock::time_point called = Clock::now();
+        const uint8_t *data = payload.data() + at;
+        ok = (s ? s->write(data, len) : file.write(data, len) == len) && ok;
+        r.handlerMs += msSince(called);
+        at += len;
+    }
+    Clock::time_point called = Clock::now();
+    if (s) ok = s->close() && ok;
+    file.close();
+    r.handlerMs += msSince(called);
+    r.ms = msSince(start);
+    r.stats = hostSdStats();
+    return ok && hostReadFile("upload.bin") == payload;
+}
+
+int main(int argc, char **argv) {
+    setvbuf(stdout, nullptr, _IONBF, 0);
+    std::vector<size_t> trace;
+    std::ifstream lines(argc > 1 ? argv[1] : "trace.txt");
+    for (size_t len; lines >> len;)
+        if (len) trace.push_back(len);
+    size_t total = 0;
+    for (size_t len : trace) total += len;
+    if (!total) {
+        printf("usage: upload_sink [trace.txt], one fragment size per line\n");
+        return 2;
+    }
+    std::vector<uint8_t> payload(total);
+    esp_fill_random(payload.data(), payload.size());
+
+    // SPI card through FATFS: 0.4ms per call, 2.5MB/s, 1.5ms to read back a sector written in part
+    hostSdMount(".");
+    hostSdTiming({400, 400, 1500});
+    printf("%u fragments, %u KB, %u KB buffers\n\n", (unsigned)trace.size(), (unsigned)(total / 1024),
+           UPLOAD_SINK_BUFFER / 1024);
+    printf("%-8s %7s %10s %8s %8s %11s\n", "", "MB/s", "in handler", "writes", "partial", "to the card");
+
+    Result before, after;
+    CHECK(replay(trace, payload, false, before), "File.write: file differs");
+    CHECK(replay(trace, payload, true, after), "UploadSink: file differs");
+    UploadSink::release();
+    for (const auto &row : {std::make_pair("before", &before), std::make_pair("after", &after)}) {
+        const Result &r = *row.second;
+        printf("%-8s %7.2f %9.0f%% %8u %8u %9.0f ms\n", row.first, total / r.ms / 1000,
+               100 * r.handlerMs / r.ms, r.stats.writes, r.stats.unaligned, r.ms);
+    }
+    CHECK(after.ms * 2 < before.ms, "UploadSink %.0f ms, File.write %.0f ms", after.ms, before.ms);
+    printf("\n%d failed checks\n", hostFailures);
+    return hostFailures != 0;
+}
@@ -1,6 +1,6 @@
 import hashlib
+import re
 from typing import TYPE_CHECKING, Any
-import requests
 
 if TYPE_CHECKING:
     Import: Any = None
@@ -8,7 +8,7 @@ if TYPE_CHECKING:
 
 import glob
 import gzip
-from os import makedirs, remove, rename
+from os import makedirs
 from os.path import basename, dirname, exists, isfile, join
 
 Import("env")  # type: ignore
@@ -47,22 +47,46 @@ def load_checksum_file(input_file):
         return f.readline().strip()
 
 
-def minify_css(c):
-    minify_req = requests.post("https://www.toptal.com/developers/cssminifier/api/raw", {"input": c.read().decode('utf-8')})
-    return c if minify_req is False else minify_req.text.encode('utf-8')
+# Offline, conservative minification: only whitespace and comments are dropped, statements and
+# line breaks stay as they are so JS semicolon insertion is never affected
+def minify_css(text):
+    text = re.sub(r"/\*.*?\*/", "", text, flags=re.S)
+    text = re.sub(r"\s+", " ", text)
+    text = re.sub(r"\s*([{};,>])\s*", r"\1", text)
+    text = re.sub(r":\s+", ":", text)
+    return text.replace(";}", "}").strip()
 
-def minify_js(js):
-    minify_req = requests.post('https://www.toptal.com/developers/javascript-minifier/api/raw', {'input': js.read().decode('utf-8')})
-    return js if minify_req is False else minify_req.text.encode('utf-8')
 
-def minify_html(html):
-    minify_req = requests.post('https://www.toptal.com/developers/html-minifier/api/raw', {'input': html.read().decode('utf-8')})
-    return html if minify_req is False else minify_req.text.encode('utf-8')
+def minify_js(text):
+    lines = (line.strip() for line in text.splitlines())
+    return "\n".join(line for line in lines if line and not line.startswith("//"))
 
-# gzip web files
+
+def minify_html(text):
+    text = re.sub(r"<!--.*?-->", "", text, flags=re.S)
+    return re.sub(r"\s*\n\s*", "\n", text).strip()
+
+
+def version_urls(html, version):
+    """Points the page at ?v=<version> asset URLs, the server caches those for a year"""
+    return re.sub(r'((?:href|src)=")([\w.-]+\.(?:css|js))"', rf'\1\2?v={version}"', html)
+
+
+def write_array(header, name, data):
+    header.write(f"const uint8_t {name}[] PROGMEM = {{\n")
+    # Write hex values, inserting a newline every 15 bytes
+    for i in range(0, len(data), 15):
+        hex_chunk = ", ".join(f"0x{byte:02X}" for byte in data[i : i + 15])
+        header.write(f"  {hex_chunk},\n")
+    header.write("};\n\n")
+    header.write(f"const uint32_t {name}_size = {len(data)};\n\n")
+
+
+# minify, gzip and embed web files
 def prepare_www_files():
     HEADER_FILE = join(env.get("PROJECT_DIR"), "include", "webFiles.h")
     filetypes_to_gzip = ["html", "css", "js"]
+    minifiers = {"html": minify_html, "css": minify_css, "js": minify_js}
     data_src_dir = join(env.get("PROJECT_DIR"), "webUi")
     checksum_file = join(data_src_dir, "checksum.sha256")
     checksum = ""
@@ -76,15 +100,30 @@ def prepare_www_files():
 
     files_to_gzip = []
     for extension in filetypes_to_gzip:
-        files_to_gzip.extend(glob.glob(join(data_src_dir, "*." + extension)))
+        files_to_gzip.extend(sorted(glob.glob(join(data_src_dir, "*." + extension))))
 
-    files_checksum = hash_files(files_to_gzip)
+    # this script is part of the checksum, a new header layout is generated when it changes
+    this_script = join(env.get("PROJECT_DIR"), "support_files", "prep_web_files.py")
+    files_checksum = hash_files(files_to_gzip + [this_script])
     if files_checksum == checksum and exists(HEADER_FILE):
         print("[GZIP & EMBED INTO HEADER] - Nothing to process.")
         return
 
     print(f"[GZIP & EMBED INTO HEADER] - Processing {len(files_to_gzip)} files.")
 
+    minified = {}
+    for file in files_to_gzip:
+        ext = basename(file).rsplit(".", 1)[-1].lower()
+        with open(file, "r", encoding="utf-8") as src:
+            minified[file] = minifiers[ext](src.read())
+
+    # one version for every asset, any change anywhere moves all the ?v= URLs
+    version = hashlib.sha256()
+    for file in files_to_gzip:
+        if not file.endswith(".html"):
+            version.update(minified[file].encode("utf-8"))
+    version = version.hexdigest()[:16]
+
     makedirs(dirname(HEADER_FILE), exist_ok=True)
 
     with open(HEADER_FILE, "w") as header:
@@ -92,43 +131,20 @@ def prepare_www_files():
             "#ifndef WEB_FILES_H\n#define WEB_FILES_H\n\n#include <Arduino.h>\n\n"
         )
         header.write(
-            "// THIS FILE IS AUTOGENERATED DO NOT MODIFY IT. MODIFY FILES IN /embedded_resources/web_interface\n\n"
+            "// THIS FILE IS AUTOGENERATED DO NOT MODIFY IT. MODIFY FILES IN /webUi\n\n"
         )
+        header.write(f'const char web_files_version[] = "{version}";\n\n')
 
         for file in files_to_gzip:
-            gz_file = file + ".gz"
-            with open(file, "rb") as src, gzip.open(gz_file, "wb") as dst:
-                ext = basename(file).rsplit(".", 1)[-1].lower()
-                if ext == 'html':
-                    minified = minify_html(src)
-                elif ext == 'css':
-                    minified = minify_css(src)
-                elif ext == 'js':
-                    minified = minify_js(src)
-                else:
-                    raise ValueError(f"Unsupported file type: {ext}")
-
-                dst.write(minified)
-
-            with open(gz_file, "rb") as gz:
-                compressed_data = gz.read()
-                var_name = basename(file).replace(".", "_")
-
-                header.write(f"const uint8_t {var_name}[] PROGMEM = {{\n")
-
-                # Write hex values, inserting a newline every 15 bytes
-                for i in range(0, len(compressed_data), 15):
-                    hex_chunk = ", ".join(
-                        f"0x{byte:02X}" for byte in compressed_data[i : i + 15]
-                    )
-                    header.write(f"  {hex_chunk},\n")
-
-                header.write("};\n\n")
-                header.write(
-                    f"const uint32_t {var_name}_size = {len(compressed_data)};\n\n"
-                )
-
-            remove(gz_file)  # Clean up temporary gzip file
+            text = minified[file]
+            if file.endswith(".html"):
+                text = version_urls(text, version)
+            # mtime=0 keeps the output, and so the ETag, identical between builds
+            compressed_data = gzip.compress(text.encode("utf-8"), compresslevel=9, mtime=0)
+            var_name = basename(file).replace(".", "_")
+            write_array(header, var_name, compressed_data)
+            etag = hashlib.sha256(compressed_data).hexdigest()[:16]
+            header.write(f'const char {var_name}_etag[] = "\\"{etag}\\"";\n\n')
 
         header.write("#endif // WEB_FILES_H\n")
 
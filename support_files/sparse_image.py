@@ -0,0 +1,132 @@
+#!/usr/bin/env python3
+"""
+Packs and unpacks the sparse partition images the Launcher writes to /bkp,
+see src/sparseImage.h for the layout.
+
+Erased (0xFF) sectors are only counted, so a backup of a mostly empty SPIFFS
+or FAT partition is small. --deflate also compresses the sectors holding data,
+the Launcher restores both kinds.
+
+    python3 sparse_image.py info FAT_vfs.bin
+    python3 sparse_image.py unpack FAT_vfs.bin vfs_raw.bin
+    python3 sparse_image.py pack vfs_raw.bin FAT_vfs.bin --label vfs --deflate
+"""
+import argparse
+import hashlib
+import struct
+import sys
+import zlib
+
+MAGIC = b"LSPI"
+VERSION = 1
+SECTOR = 4096
+HEADER = struct.Struct("<4sHHI16sI")
+RECORD = struct.Struct("<cII")
+ERASED = b"\xff" * SECTOR
+
+
+def deflate(data):
+    c = zlib.compressobj(9, zlib.DEFLATED, -15)
+    return c.compress(data) + c.flush()
+
+
+def pack(raw, label="", compress=False):
+    if len(raw) % SECTOR:
+        raw += b"\xff" * (SECTOR - len(raw) % SECTOR)
+    out = bytearray(HEADER.pack(MAGIC, VERSION, SECTOR, len(raw), label.encode()[:16], 0))
+    sectors = [raw[i : i + SECTOR] for i in range(0, len(raw), SECTOR)]
+    i = 0
+    while i < len(sectors):
+        j = i
+        erased = sectors[i] == ERASED
+        while j < len(sectors) and (sectors[j] == ERASED) == erased:
+            j += 1
+        if erased:
+            out += RECORD.pack(b"H", j - i, 0)
+        else:
+            data = b"".join(sectors[i:j])
+            packed = deflate(data) if compress else data
+            if len(packed) < len(data):
+                out += RECORD.pack(b"Z", j - i, len(packed)) + packed
+            else:
+                out += RECORD.pack(b"D", j - i, len(data)) + data
+        i = j
+    out += RECORD.pack(b"E", 0, 32) + hashlib.sha256(raw).digest()
+    return bytes(out)
+
+
+def unpack(image):
+    """Returns (label, raw bytes, record counts), raises ValueError on a bad image"""
+    magic, version, sector, size, label, _ = HEADER.unpack_from(image, 0)
+    if magic != MAGIC or version != VERSION or sector != SECTOR:
+        raise ValueError("not a sparse image")
+    raw = bytearray()
+    counts = {}
+    pos = HEADER.size
+    while True:
+        kind, sectors, length = RECORD.unpack_from(image, pos)
+        pos += RECORD.size
+        payload = image[pos : pos + length]
+        pos += length
+        counts[kind] = counts.get(kind, 0) + sectors
+        if kind == b"H":
+            raw += ERASED * sectors
+        elif kind == b"D":
+            raw += payload
+        elif kind == b"Z":
+            raw += zlib.decompress(payload, -15)
+        elif kind == b"E":
+            break
+        else:
+            raise ValueError("unknown record %r" % kind)
+    if len(raw) != size:
+        raise ValueError("image holds %d bytes instead of %d" % (len(raw), size))
+    if hashlib.sha256(raw).digest() != payload:
+        raise ValueError("SHA-256 mismatch")
+    return label.rstrip(b"\0").decode(), bytes(raw), counts
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Launcher sparse partition images")
+    sub = parser.add_subparsers(dest="command", required=True)
+    p = sub.add_parser("pack", help="raw partition dump -> sparse image")
+    p.add_argument("raw")
+    p.add_argument("image")
+    p.add_argument("--label", default="", help="partition label, e.g. spiffs or vfs")
+    p.add_argument("--deflate", action="store_true", help="compress the sectors holding data")
+    p = sub.add_parser("unpack", help="sparse image -> raw partition dump")
+    p.add_argument("image")
+    p.add_argument("raw")
+    p = sub.add_parser("info", help="check an image and show what it holds")
+    p.add_argument("image")
+    args = parser.parse_args()
+
+    if args.command == "pack":
+        with open(args.raw, "rb") as f:
+            raw = f.read()
+        image = pack(raw, args.label, args.deflate)
+        with open(args.image, "wb") as f:
+            f.write(image)
+        print(f"{len(raw)} bytes -> {len(image)} bytes")
+        return 0
+
+    with open(args.image, "rb") as f:
+        image = f.read()
+    try:
+        label, raw, counts = unpack(image)
+    except (ValueError, struct.error, zlib.error) as e:
+        print(f"{args.image}: {e}", file=sys.stderr)
+        return 1
+    if args.command == "unpack":
+        with open(args.raw, "wb") as f:
+            f.write(raw)
+    erased = counts.get(b"H", 0)
+    print(
+        f"{label or '?'}: {len(raw)} bytes in {len(image)}, {erased} of {len(raw) // SECTOR} sectors erased, "
+        f"sha256 {hashlib.sha256(raw).hexdigest()}"
+    )
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -33,12 +33,109 @@ xmlhttp.send();
 _("status").innerHTML = xmlhttp.responseText;
 }
 }
+function startJob(fields) {
+const ajax = new XMLHttpRequest();
+const formdata = new FormData();
+for (const k in fields) formdata.append(k, fields[k]);
+ajax.onload = function () { if (ajax.status !== 200) _("status").innerHTML = ajax.responseText; };
+ajax.open("POST", "/jobs", true);
+ajax.send(formdata);
+watchJobs();
+}
 function startUpdate(fileName) {
-const ajax4 = new XMLHttpRequest();
-const formdata4 = new FormData();
-formdata4.append("fileName", fileName);
-ajax4.open("POST", "/UPDATE", false);
-ajax4.send(formdata4);
+if (confirm("Install " + fileName + "?")) startJob({ action: "install", path: fileName });
+}
+function copyFileTo(filePath, action) {
+let dest = prompt((action === "move" ? "Move" : "Copy") + " to folder: ", _("actualFolder").value);
+if (dest != null && dest != "") startJob({ action: action, path: filePath, dest: dest });
+}
+function extractArchive(filePath) {
+let folder = filePath.substring(0, filePath.lastIndexOf('/')) || "/";
+let dest = prompt("Extract to folder: ", folder);
+if (dest != null && dest != "") startJob({ action: "extract", path: filePath, dest: dest });
+}
+function isArchive(name) {
+return /\.(zip|tar)$/i.test(name);
+}
+// .bin.gz images are inflated by the device while they are installed
+function isFirmware(name) {
+return /\.bin(\.gz)?$/i.test(name);
+}
+function isGzip(name) {
+return /\.gz$/i.test(name);
+}
+// size of the image once inflated, gzip keeps it in its last 4 bytes
+function imageSize(file, done) {
+if (!isGzip(file.name)) return done(file.size);
+const reader = new FileReader();
+reader.onload = function () { done(new DataView(reader.result).getUint32(0, true)); };
+reader.readAsArrayBuffer(file.slice(-4));
+}
+// bytes start..end of the image, a .bin.gz is only inflated that far
+function readImage(file, start, end, done) {
+if (!isGzip(file.name)) {
+const reader = new FileReader();
+reader.onload = function () { done(new Uint8Array(reader.result)); };
+reader.readAsArrayBuffer(file.slice(start, end));
+return;
+}
+if (!window.DecompressionStream) return done(new Uint8Array(0));
+const stream = file.stream().pipeThrough(new DecompressionStream("gzip")).getReader();
+const head = new Uint8Array(end);
+let got = 0;
+const pump = function () {
+stream.read().then(function (r) {
+if (!r.done) {
+const n = Math.min(r.value.length, end - got);
+head.set(r.value.subarray(0, n), got);
+got += n;
+}
+if (r.done || got >= end) {
+stream.cancel();
+return done(head.subarray(start, Math.max(start, got)));
+}
+pump();
+}).catch(function () { done(new Uint8Array(0)); });
+};
+pump();
+}
+function cancelJob(id) {
+startJob({ action: "cancel", id: id });
+}
+// job progress pushed by the device, shared by every browser that has the page open
+var jobsSource = null;
+var jobs = {};
+function showJobs() {
+var html = "";
+Object.keys(jobs).sort(function (a, b) { return a - b; }).forEach(function (id) {
+var job = jobs[id];
+var p = job.total ? Math.round(job.progress * 100 / job.total) : 0;
+html += "<p>" + job.kind + " " + job.source + (job.target ? " -> " + job.target : "") + ": " + job.state;
+if (job.state === "running") html += " <progress value='" + p + "' max='100'></progress> " + p + "%";
+if (job.message) html += " (" + job.message + ")";
+if (job.state === "queued" || (job.state === "running" && job.kind !== "install" && job.kind !== "dump")) html += " <a onclick=\"cancelJob(" + job.id + ")\" href='javascript:void(0);'>[cancel]</a>";
+html += "</p>";
+});
+_("jobs").innerHTML = html;
+}
+function watchJobs() {
+if (jobsSource || !window.EventSource) return;
+jobsSource = new EventSource("/events");
+jobsSource.addEventListener("jobs", function (e) {
+jobs = {};
+JSON.parse(e.data).forEach(function (job) { jobs[job.id] = job; });
+showJobs();
+});
+jobsSource.addEventListener("job", function (e) {
+var job = JSON.parse(e.data);
+var was = jobs[job.id];
+jobs[job.id] = job;
+showJobs();
+if (job.kind !== "install" && job.state !== "queued" && job.state !== "running" && (!was || was.state !== job.state)) listFilesButton(_("actualFolder").value);
+});
+jobsSource.onerror = function () {
+for (const id in jobs) if (jobs[id].state === "running" && jobs[id].kind === "install") { jobs[id].message = "device restarting"; showJobs(); }
+};
 }
 function callOTA() {
 const ajax3 = new XMLHttpRequest();
@@ -63,105 +160,51 @@ const uploadSpiffsBtn = _('uploadSpiffs');
 outputDiv.style.display = 'none';
 uploadAppBtn.style.display = 'none';
 uploadSpiffsBtn.style.display = 'none';
-let pass = true;
 if (fileInput.files.length === 0) {
 window.alert('Please, select a file.');
 return;
 }
-if (fileInput.files[0].name.split('.').pop() !== "bin") {
-window.alert('File is not a .bin');
+if (!isFirmware(fileInput.files[0].name)) {
+window.alert('File is not a .bin or .bin.gz');
 return;
 }
 const file = fileInput.files[0];
-const reader = new FileReader();
-reader.onload = function (e) {
-const data = new Uint8Array(reader.result);
-let start_point = 0;
-let spiffs_offset = 0;
-let spiffs_size = 0;
-let app_size = 0;
+// only the partition table is read here, the device splits the image while it is sent
+imageSize(file, function (size) {
+readImage(file, 0x8000, 0x8000 + 0xA0, function (table) {
 let spiffs = false;
-const MAX_APP = 0x470000;
 const MAX_SPIFFS = 0x100000;
-const first_slice = data.slice(0x8000, 0x8000 + 16);
-const byte0 = first_slice[0];
-const byte1 = first_slice[1];
-const byte2 = first_slice[2];
-if (byte0 === 0xaa && byte1 === 0x50 && byte2 === 0x01 && pass === true) {
-pass = false;
-start_point = 0x10000;
-for (let i = 0; i < 0xA0; i += 0x20) {
-const pos = 0x8000 + i;
-if (pos + 16 > data.length) break;
-const slice = data.slice(pos, pos + 16);
-const byte3 = slice[3];
-const byte6 = slice[6];
-if ([0x00, 0x10, 0x20].includes(byte3) && byte6 === 0x01) {
-app_size = (slice[10] << 16) | (slice[11] << 8) | 0x00;
-if (data.length < (app_size + 0x10000)) app_size = data.length - 0x10000;
-if (app_size > MAX_APP) app_size = MAX_APP;
-}
-if (byte3 === 0x82) {
-spiffs_offset = (slice[6] << 16) | (slice[7] << 8) | slice[8];
-spiffs_size = (slice[10] << 16) | (slice[11] << 8);
-if (data.length < spiffs_offset) spiffs = false;
-else if (spiffs_size > MAX_SPIFFS) {
-spiffs_size = MAX_SPIFFS;
-spiffs = true;
-}
-if (spiffs && data.length < (spiffs_offset + spiffs_size)) spiffs_size = data.length - spiffs_offset;
+if (table.length >= 3 && table[0] === 0xaa && table[1] === 0x50 && table[2] === 0x01) {
+for (let i = 0; i + 16 <= table.length; i += 0x20) {
+const slice = table.subarray(i, i + 16);
+if (slice[3] === 0x82) {
+const spiffs_offset = (slice[6] << 16) | (slice[7] << 8) | slice[8];
+const spiffs_size = (slice[10] << 16) | (slice[11] << 8);
+if (size >= spiffs_offset && spiffs_size > MAX_SPIFFS) spiffs = true;
 }}}
-else if (pass === true) {
-pass = false;
-start_point = 0x0;
-app_size = data.length;
-spiffs = false;
-}
-const appBlob = new Blob([data.slice(start_point, start_point + app_size)], { type: 'application/octet-stream' });
-const spiffsBlob = spiffs ? new Blob([data.slice(spiffs_offset, spiffs_offset + spiffs_size)], { type: 'application/octet-stream' }) : null;
-if (app_size > 0) {
 uploadAppBtn.style.display = 'inline';
-uploadAppBtn.onclick = () => uploadSlice(appBlob, app_size, file.name + '-app.bin', 0);
-}
+uploadAppBtn.onclick = () => installImage(file, false, size);
 if (spiffs) {
 uploadSpiffsBtn.style.display = 'inline';
 _("spiffsInfo").style.display = 'block';
-uploadSpiffsBtn.onclick = () => uploadSlice(spiffsBlob, spiffs_size, file.name + '-spiffs.bin', 100);
-}};
-reader.readAsArrayBuffer(file);
+uploadSpiffsBtn.onclick = () => installImage(file, true, size);
+}});
+});
 }
-function uploadSlice(blobData, c_size, fileName, comm) {
-var uploadForm = "Preparing...";
-currentFileIndex = 0;
-totalFiles = 1;
-_("updetails").innerHTML = uploadForm;
+function installImage(file, spiffs, size) {
+_("updetails").innerHTML = `<p>Updating...</p><p><progress id="otaprb" value="0" max="100" style="width:100%;"></progress></p>`;
 const ajax = new XMLHttpRequest();
-ajax.onload = function () {
-if (ajax.status === 200 && ajax.responseText === "OK") {
-var fileProgressDiv = document.createElement("div");
-fileProgressDiv.innerHTML = `<p>Updating...</p><p><progress id="otaprb" value="0" max="100" style="width:100%;"></progress></p>`;
-_("updetails").appendChild(fileProgressDiv); 
-const formdata2 = new FormData();
-formdata2.append("file1", blobData, fileName);
-const ajax2 = new XMLHttpRequest();
-ajax2.open("POST", "/OTAFILE");
-ajax2.upload.addEventListener("progress", function (event) { 
-var p = (event.loaded / event.total) * 100;
-_("otaprb").value = Math.round(p);
+ajax.open("POST", "/install?spiffs=" + (spiffs ? 1 : 0) + "&size=" + size);
+ajax.setRequestHeader("Content-Type", "application/octet-stream");
+ajax.upload.addEventListener("progress", function (event) {
+_("otaprb").value = Math.round((event.loaded / event.total) * 100);
 }, false);
-ajax2.addEventListener("load", function () { _("status").innerHTML = "Instalation Complete, Restart your device!"; }, false);
-ajax2.addEventListener("error", function () { _("status").innerHTML = "Upload Failed"; }, false);
-ajax2.addEventListener("abort", function () { _("status").innerHTML = "Upload Aborted"; }, false);
-ajax2.send(formdata2);
-}};
-ajax.onerror = function () {
-console.error("Erro na requisição inicial GET.");
-};
-const formdata = new FormData();
-formdata.append("command", comm);
-formdata.append("size", c_size);
-ajax.open("POST", "/OTA", true);
-ajax.send(formdata);
+ajax.addEventListener("load", function () {
+_("status").innerHTML = ajax.status === 200 ? "Instalation Complete, Restart your device!" : "Update Failed: " + ajax.responseText;
+}, false);
+ajax.addEventListener("error", function () { _("status").innerHTML = "Upload Failed"; }, false);
+ajax.addEventListener("abort", function () { _("status").innerHTML = "Upload Aborted"; }, false);
+ajax.send(file);
 }
 function logoutButton() {
 var xhr = new XMLHttpRequest();
@@ -197,73 +240,38 @@ console.error("Network error or request failure.");
 xmlhttp.open("GET", "/systeminfo", true);
 xmlhttp.send();
 }
+var listing = { folder: "", next: -1, loading: false };
+var listingObserver = window.IntersectionObserver ? new IntersectionObserver(function (e) { if (e[0].isIntersecting) loadFilesPage(); }) : null;
+function humanSize(bytes) {
+if (bytes < 1024) return bytes + " B";
+if (bytes < 1024 * 1024) return (bytes / 1024).toFixed(2) + " kB";
+if (bytes < 1024 * 1024 * 1024) return (bytes / 1024 / 1024).toFixed(2) + " MB";
+return (bytes / 1024 / 1024 / 1024).toFixed(2) + " GB";
+}
 function listFilesButton(folders) {
-var xmlhttp = new XMLHttpRequest();
 _("drop-area").style.display = 'block';
 _("actualFolder").value = folders;
 var PreFolder = folders.substring(0, folders.lastIndexOf('/'));
 if (PreFolder == "") { PreFolder = "/"; }
-xmlhttp.onload = function () {
-if (xmlhttp.status === 200) {
-var responseText = xmlhttp.responseText;
-var lines = responseText.split('\n');
-var tableContent = "<table><tr><th align='left'>Name</th><th style=\"text-align=center;\">Size</th><th></th></tr>\n";
+var tableContent = "<table id='fileTable'><tr><th align='left'>Name</th><th style=\"text-align=center;\">Size</th><th></th></tr>\n";
 tableContent += "<tr><th align='left'><a onclick=\"listFilesButton('" + PreFolder + "')\" href='javascript:void(0);'>... </a></th><th align='left'></th><th></th></tr>\n";
-var folder = "";
-var foldersArray = [];
-var filesArray = [];
-lines.forEach(function (line) {
-if (line) {
-var type = line.substring(0, 2);
-var path = line.substring(3, line.lastIndexOf(':'));
-var filename = line.substring(3, line.lastIndexOf(':'));
-var size = line.substring(line.lastIndexOf(':') + 1);
-if (type === "pa") {
-if (path !== "") folder = path + "/";
-} else if (type === "Fo") {
-foldersArray.push({ path: folder + path, name: filename });
-} else if (type === "Fi") {
-filesArray.push({ path: folder + path, name: filename, size: size });
-}}});
-foldersArray.sort((a, b) => a.name.localeCompare(b.name));
-filesArray.sort((a, b) => a.name.localeCompare(b.name));
-foldersArray.forEach(function (item) {
-tableContent += "<tr align='left'><td><a onclick=\"listFilesButton('" + item.path + "')\" href='javascript:void(0);'>" + item.name + "</a></td>";
-tableContent += "<td></td>\n";
-tableContent += "<td><i style=\"color: #e0d204;\" class=\"gg-folder\" onclick=\"listFilesButton('" + item.path + "')\"></i>&nbsp&nbsp";
-tableContent += "<i style=\"color: #e0d204;\" class=\"gg-rename\" onclick=\"renameFile('" + item.path + "', '" + item.name + "')\"></i>&nbsp&nbsp";
-tableContent += "<i style=\"color: #e0d204;\" class=\"gg-trash\" onclick=\"downloadDeleteButton('" + item.path + "', 'delete')\"></i></td></tr>\n\n";
-});
-filesArray.forEach(function (item) {
-tableContent += "<tr align='left'><td>" + item.name;
-if (item.name.substring(item.name.lastIndexOf('.') + 1).toLowerCase() === "bin") {
-tableContent += "&nbsp<i class=\"rocket\" onclick=\"startUpdate('" + item.path + "')\"></i>";
-}
-tableContent += "</td>\n";
-tableContent += "<td style=\"font-size: 10px; text-align=center;\">" + item.size + "</td>\n";
-tableContent += "<td><i class=\"gg-arrow-down-r\" onclick=\"downloadDeleteButton('" + item.path + "', 'download')\"></i>&nbsp&nbsp\n";
-tableContent += "<i class=\"gg-rename\" onclick=\"renameFile('" + item.path + "', '" + item.name + "')\"></i>&nbsp&nbsp\n";
-tableContent += "<i class=\"gg-trash\" onclick=\"downloadDeleteButton('" + item.path + "', 'delete')\"></i></td></tr>\n\n";
-});
-tableContent += "</table>";
+tableContent += "</table><div id='moreFiles'></div>";
 _("details").innerHTML = tableContent;
-} else {
-console.error('Erro na requisição: ' + xmlhttp.status);
-}};
-xmlhttp.onerror = function () {
-console.error('Erro na rede ou falha na requisição.');
-};
-xmlhttp.open("GET", "/listfiles?folder=" + folders, true);
-xmlhttp.send();
+listing = { folder: folders, next: 0, loading: false };
+if (listingObserver) listingObserver.disconnect();
+loadFilesPage();
 _("detailsheader").innerHTML = "<h3>Files</h3>";
 _("updetailsheader").innerHTML = "<h3>Folder Actions: " + 
 "<input type='file' id='fa' multiple style='display:none'>" + 
 "<input type='file' id='fol' webkitdirectory directory multiple style='display:none'>" +
+"<input type='file' id='arc' accept='.zip,.tar' style='display:none'>" +
 "<button onclick=\"_('fa').click()\">Send Files</button>" +
 "<button onclick=\"_('fol').click()\">Send Folders</button>" +
+"<button onclick=\"_('arc').click()\">Send Archive</button>" +
 "<button onclick=\"CreateFolder('" + folders + "')\">Create Folder</button></h3>";
 _("fa").onchange = e => handleFileForm(e.target.files, folders);
 _("fol").onchange = e => handleFileForm(e.target.files, folders);
+_("arc").onchange = e => sendArchive(e.target.files[0], folders);
 _("updetails").innerHTML = "";
 _("OTAdetails").style.display = 'none';
 _("analysisOutput").style.display = 'none';
@@ -271,6 +279,58 @@ _("spiffsInfo").style.display = 'none';
 _("uploadApp").style.display = 'none';
 _("uploadSpiffs").style.display = 'none';
 }
+function loadFilesPage() {
+if (listing.next < 0 || listing.loading) return;
+listing.loading = true;
+var folders = listing.folder;
+var xmlhttp = new XMLHttpRequest();
+xmlhttp.onload = function () {
+if (folders !== listing.folder) return;
+listing.loading = false;
+if (xmlhttp.status !== 200) {
+console.error('Erro na requisição: ' + xmlhttp.status);
+return;
+}
+var page = JSON.parse(xmlhttp.responseText);
+var folder = page.folder.endsWith("/") ? page.folder : page.folder + "/";
+var rows = "";
+page.entries.forEach(function (entry) {
+var item = { path: folder + entry.n, name: entry.n };
+if (entry.d) {
+rows += "<tr align='left'><td><a onclick=\"listFilesButton('" + item.path + "')\" href='javascript:void(0);'>" + item.name + "</a></td>";
+rows += "<td></td>\n";
+rows += "<td><i style=\"color: #e0d204;\" class=\"gg-folder\" onclick=\"listFilesButton('" + item.path + "')\"></i>&nbsp&nbsp";
+rows += "<i style=\"color: #e0d204;\" class=\"gg-rename\" onclick=\"renameFile('" + item.path + "', '" + item.name + "')\"></i>&nbsp&nbsp";
+rows += "<i style=\"color: #e0d204;\" class=\"gg-copy\" onclick=\"copyFileTo('" + item.path + "', 'copy')\"></i>&nbsp&nbsp";
+rows += "<i style=\"color: #e0d204;\" class=\"gg-move\" onclick=\"copyFileTo('" + item.path + "', 'move')\"></i>&nbsp&nbsp";
+rows += "<i style=\"color: #e0d204;\" class=\"gg-trash\" onclick=\"downloadDeleteButton('" + item.path + "', 'delete')\"></i></td></tr>\n\n";
+} else {
+rows += "<tr align='left'><td>" + item.name;
+if (isFirmware(item.name)) {
+rows += "&nbsp<i class=\"rocket\" onclick=\"startUpdate('" + item.path + "')\"></i>";
+}
+rows += "</td>\n";
+rows += "<td style=\"font-size: 10px; text-align=center;\">" + humanSize(entry.s) + "</td>\n";
+rows += "<td><i class=\"gg-arrow-down-r\" onclick=\"downloadDeleteButton('" + item.path + "', 'download')\"></i>&nbsp&nbsp\n";
+if (isArchive(item.name)) rows += "<i class=\"gg-extract\" onclick=\"extractArchive('" + item.path + "')\"></i>&nbsp&nbsp\n";
+rows += "<i class=\"gg-rename\" onclick=\"renameFile('" + item.path + "', '" + item.name + "')\"></i>&nbsp&nbsp\n";
+rows += "<i class=\"gg-copy\" onclick=\"copyFileTo('" + item.path + "', 'copy')\"></i>&nbsp&nbsp\n";
+rows += "<i class=\"gg-move\" onclick=\"copyFileTo('" + item.path + "', 'move')\"></i>&nbsp&nbsp\n";
+rows += "<i class=\"gg-trash\" onclick=\"downloadDeleteButton('" + item.path + "', 'delete')\"></i></td></tr>\n\n";
+}});
+_("fileTable").tBodies[0].insertAdjacentHTML('beforeend', rows);
+listing.next = page.next;
+// the observer loads the next page as soon as this link scrolls into view
+_("moreFiles").innerHTML = page.next < 0 ? "" : "<a onclick=\"loadFilesPage()\" href='javascript:void(0);'>Load more...</a>";
+if (listingObserver && page.next >= 0) { listingObserver.disconnect(); listingObserver.observe(_("moreFiles")); }
+};
+xmlhttp.onerror = function () {
+if (folders === listing.folder) listing.loading = false;
+console.error('Erro na rede ou falha na requisição.');
+};
+xmlhttp.open("GET", "/listfiles?sort=name&folder=" + encodeURIComponent(folders) + "&offset=" + listing.next, true);
+xmlhttp.send();
+}
 function renameFile(filePath, oldName) {
 var actualFolder = _("actualFolder").value;
 let fileName = prompt("Enter the new name: ", oldName);
@@ -311,6 +371,7 @@ window.alert("Invalid Folder Name");} else {
 downloadDeleteButton(_("actualFolder").value + "/" + ff, 'create');
 }}
 window.addEventListener("load", function () {
+watchJobs();
 var dropArea = _("drop-area");
 dropArea.addEventListener("dragenter", dragEnter, false);
 dropArea.addEventListener("dragover", dragOver, false);
@@ -403,28 +464,89 @@ _("status").innerHTML = "Upload Failed";
 processNextUpload(folder);
 });
 }
-function uploadFile(folder, file) {
+// the archive is uploaded as is, then the Launcher extracts it on the SD card as a job
+function sendArchive(file, folder) {
+if (!file || !isArchive(file.name)) return;
+writeSendForm();
+const path = (folder == "/" ? "" : folder) + "/" + file.name;
+uploadFile(folder, file)
+.then(() => {
+_("status").innerHTML = "Upload Complete, extracting " + file.name;
+startJob({ action: "extract", path: path, dest: folder });
+})
+.catch(() => { _("status").innerHTML = "Upload Failed"; });
+}
+const chunkParallel = 2;
+const crcTable = (() => {
+let t = new Uint32Array(256);
+for (let n = 0; n < 256; n++) {
+let c = n;
+for (let k = 0; k < 8; k++) c = c & 1 ? 0xEDB88320 ^ (c >>> 1) : c >>> 1;
+t[n] = c >>> 0;
+}
+return t;
+})();
+function crc32(bytes) {
+let c = 0xFFFFFFFF;
+for (let i = 0; i < bytes.length; i++) c = crcTable[(c ^ bytes[i]) & 0xFF] ^ (c >>> 8);
+return (c ^ 0xFFFFFFFF) >>> 0;
+}
+function uploadRequest(method, url, body, onProgress) {
 return new Promise((resolve, reject) => {
+var ajax = new XMLHttpRequest();
+if (onProgress) ajax.upload.addEventListener("progress", onProgress, false);
+ajax.addEventListener("load", () => resolve(ajax), false);
+ajax.addEventListener("error", () => reject(), false);
+ajax.addEventListener("abort", () => reject(), false);
+ajax.open(method, url);
+ajax.send(body);
+});
+}
+// init -> chunks in parallel, each with its CRC32 -> commit; after a dropped connection
+// init tells which chunks the Launcher already has, so only the missing ones are sent again
+async function uploadFile(folder, file) {
 const progressBarId = `${file.name}-progressBar`;
 if (!_(progressBarId)) {
 var fileProgressDiv = document.createElement("div");
 fileProgressDiv.innerHTML = `<p>${file.name}: <progress id="${progressBarId}" value="0" max="100" style="width:100%;"></progress></p>`;
 _("file-progress-container").appendChild(fileProgressDiv);
 }
-var formdata = new FormData();
-formdata.append("file", file, file.webkitRelativePath || file.name);
-formdata.append("folder", folder);
-var ajax = new XMLHttpRequest();
-ajax.upload.addEventListener("progress", function (event) {
-if (event.lengthComputable) {
-var percent = (event.loaded / event.total) * 100;
-_(progressBarId).value = Math.round(percent);
+const path = (folder == "/" ? "" : folder) + "/" + (file.webkitRelativePath || file.name);
+const retries = {};
+for (let attempt = 0; attempt < 5; attempt++) {
+try {
+const init = await uploadRequest("POST", "/upload/init?path=" + encodeURIComponent(path) + "&size=" + file.size, null);
+if (init.status !== 200) throw new Error(init.responseText);
+const state = JSON.parse(init.responseText);
+const pending = [];
+for (let n = 0; n < state.have.length; n++) if (state.have[n] !== "1") pending.push(n);
+let sent = Math.min(file.size, (state.have.length - pending.length) * state.chunk);
+const loading = {};
+const progress = () => {
+let total = sent;
+for (const n in loading) total += loading[n];
+_(progressBarId).value = file.size ? Math.round(Math.min(100, total * 100 / file.size)) : 100;
+};
+const worker = async () => {
+while (pending.length) {
+const n = pending.shift();
+const data = new Uint8Array(await file.slice(n * state.chunk, (n + 1) * state.chunk).arrayBuffer());
+const put = await uploadRequest("PUT", "/upload/chunk?id=" + state.id + "&offset=" + n * state.chunk + "&crc=" + crc32(data), data, e => { loading[n] = e.loaded; progress(); });
+delete loading[n];
+if (put.status === 200) {
+sent += data.length;
+progress();
+} else if (put.status === 422 && (retries[n] = (retries[n] || 0) + 1) < 3) {
+pending.push(n);
+} else throw new Error(put.responseText);
+}};
+await Promise.all(Array.from({ length: chunkParallel }, worker));
+const commit = await uploadRequest("POST", "/upload/commit?id=" + state.id, null);
+if (commit.status === 200) return;
+} catch (e) {
+console.error("Upload of " + path + " interrupted, resuming", e);
 }
-}, false);
-ajax.addEventListener("load", () => resolve(), false);
-ajax.addEventListener("error", () => reject(), false);
-ajax.addEventListener("abort", () => reject(), false);
-ajax.open("POST", "/");
-ajax.send(formdata);
-});
+await new Promise(r => setTimeout(r, 1000));
+}
+throw new Error("Upload of " + path + " failed");
 }